@@ -0,0 +1,287 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizHaloCatalogue.cxx,v $
+=========================================================================*/
+#include "AstroVizHaloCatalogue.h"
+#include "AstroVizHelpers.h"
+#include "vtkCommunicator.h"
+#include "vtkDoubleArray.h"
+#include "vtkIdTypeArray.h"
+#include "vtkMath.h"
+#include "vtkMultiProcessController.h"
+#include "vtkPoints.h"
+#include "vtkSmartPointer.h"
+#include "vtkTable.h"
+#include <vtkstd/algorithm>
+#include <vtkstd/utility>
+
+namespace
+{
+// Columns of the catalogue, of numRows rows
+vtkSmartPointer<vtkDoubleArray> NewCatalogueColumn(const char* name,
+	int numComponents, vtkIdType numRows)
+{
+	vtkSmartPointer<vtkDoubleArray> column=vtkSmartPointer<vtkDoubleArray>::New();
+	column->SetName(name);
+	column->SetNumberOfComponents(numComponents);
+	column->SetNumberOfTuples(numRows);
+	return column;
+}
+
+vtkSmartPointer<vtkIdTypeArray> NewCatalogueIdColumn(const char* name,
+	vtkIdType numRows)
+{
+	vtkSmartPointer<vtkIdTypeArray> column=vtkSmartPointer<vtkIdTypeArray>::New();
+	column->SetName(name);
+	column->SetNumberOfComponents(1);
+	column->SetNumberOfTuples(numRows);
+	return column;
+}
+}
+
+//----------------------------------------------------------------------------
+vtkIdType HaloCatalogue::AddHalo(vtkIdType haloId,vtkIdType hostId)
+{
+	this->HaloIds.push_back(haloId);
+	this->HostIds.push_back(hostId);
+	this->Sums.resize(this->Sums.size()+WIDTH,0.0);
+	this->Sums[this->Sums.size()-WIDTH+MIN_POTENTIAL]=VTK_DOUBLE_MAX;
+	this->Sums[this->Sums.size()-WIDTH+MOST_BOUND]=-1;
+	return this->HaloIds.size()-1;
+}
+
+//----------------------------------------------------------------------------
+void HaloCatalogue::Merge(double* sums,const double* other)
+{
+	for(int i = 0; i < MIN_POTENTIAL; ++i)
+		{
+		sums[i]+=other[i];
+		}
+	if(other[MIN_POTENTIAL] < sums[MIN_POTENTIAL])
+		{
+		sums[MIN_POTENTIAL]=other[MIN_POTENTIAL];
+		sums[MOST_BOUND]=other[MOST_BOUND];
+		}
+}
+
+//----------------------------------------------------------------------------
+void HaloCatalogue::Fill(vtkMultiProcessController* controller,
+	vtkPoints* points,const vtkstd::vector<vtkIdType>& particleRow,
+	vtkTable* catalogue) const
+{
+	// Outline:
+	// 1. Process 0 gathers the sums of every process and adds up the rows
+	//    of each halo
+	// 2. It sends the centers of mass back, and each process finds the
+	//    distance of the farthest of its particles of each halo from its
+	//    center, the largest of which process 0 keeps
+	// 3. Process 0 computes the rows of the catalogue; the others leave
+	//    theirs empty, so that each halo is listed once
+	const bool parallel=RunInParallel(controller);
+	const int procId=parallel ? controller->GetLocalProcessId() : 0;
+	const int numProc=parallel ? controller->GetNumberOfProcesses() : 1;
+	// 1. the rows of every process on process 0, in one collective call per
+	//    column rather than a message from each process in turn
+	vtkstd::vector<vtkIdType> allIds=this->HaloIds;
+	vtkstd::vector<vtkIdType> allHosts=this->HostIds;
+	vtkstd::vector<double> allSums=this->Sums;
+	if(parallel)
+		{
+		vtkIdType numRows=this->HaloIds.size();
+		vtkstd::vector<vtkIdType> procRows(numProc,0);
+		controller->Gather(&numRows,&procRows[0],1,0);
+		// where the rows of each process go, and their sums
+		vtkstd::vector<vtkIdType> offsets(numProc,0);
+		vtkstd::vector<vtkIdType> sumLengths(numProc,0);
+		vtkstd::vector<vtkIdType> sumOffsets(numProc,0);
+		vtkIdType totalRows=0;
+		for(int proc = 0; proc < numProc; ++proc)
+			{
+			offsets[proc]=totalRows;
+			sumLengths[proc]=WIDTH*procRows[proc];
+			sumOffsets[proc]=WIDTH*totalRows;
+			totalRows+=procRows[proc];
+			}
+		// only process 0 receives; one element at least, so that each buffer
+		// has an address
+		const vtkIdType receivedRows=(procId==0) ? 
+			vtkstd::max<vtkIdType>(totalRows,1) : 1;
+		allIds.resize(receivedRows);
+		allHosts.resize(receivedRows);
+		allSums.resize(WIDTH*receivedRows);
+		controller->GatherV(numRows ? &this->HaloIds[0] : NULL,&allIds[0],
+			numRows,&procRows[0],&offsets[0],0);
+		controller->GatherV(numRows ? &this->HostIds[0] : NULL,&allHosts[0],
+			numRows,&procRows[0],&offsets[0],0);
+		controller->GatherV(numRows ? &this->Sums[0] : NULL,&allSums[0],
+			WIDTH*numRows,&sumLengths[0],&sumOffsets[0],0);
+		allIds.resize(procId==0 ? totalRows : 0);
+		}
+	// the sums of each halo, by halo id, on process 0
+	vtkstd::vector<vtkIdType> haloIds;
+	vtkstd::vector<vtkIdType> hostIds;
+	vtkstd::vector<double> haloSums;
+	if(procId==0)
+		{
+		vtkstd::vector<vtkstd::pair<vtkIdType,vtkIdType> > byId;
+		for(vtkstd::vector<vtkIdType>::size_type row = 0; row < allIds.size(); 
+			++row)
+			{
+			byId.push_back(vtkstd::make_pair(allIds[row],vtkIdType(row)));
+			}
+		vtkstd::sort(byId.begin(),byId.end());
+		for(vtkstd::vector<vtkstd::pair<vtkIdType,vtkIdType> >::size_type i = 0; 
+			i < byId.size(); ++i)
+			{
+			const double* rowSums=&allSums[WIDTH*byId[i].second];
+			if(haloIds.empty() || haloIds.back()!=byId[i].first)
+				{
+				haloIds.push_back(byId[i].first);
+				hostIds.push_back(allHosts[byId[i].second]);
+				haloSums.insert(haloSums.end(),rowSums,rowSums+WIDTH);
+				}
+			else
+				{
+				Merge(&haloSums[haloSums.size()-WIDTH],rowSums);
+				}
+			}
+		}
+	// 2. the centers of mass, and the farthest particle from each
+	vtkIdType numHaloes=haloIds.size();
+	vtkstd::vector<double> centers(3*numHaloes);
+	for(vtkIdType h = 0; h < numHaloes; ++h)
+		{
+		const double* haloSum=&haloSums[WIDTH*h];
+		for(int d = 0; d < 3; ++d)
+			{
+			centers[3*h+d]=(haloSum[MASS]!=0) ?
+				haloSum[MASS_POSITION+d]/haloSum[MASS] : 0.0;
+			}
+		}
+	if(parallel)
+		{
+		controller->Broadcast(&numHaloes,1,0);
+		haloIds.resize(numHaloes);
+		centers.resize(3*numHaloes);
+		if(numHaloes > 0)
+			{
+			controller->Broadcast(&haloIds[0],numHaloes,0);
+			controller->Broadcast(&centers[0],3*numHaloes,0);
+			}
+		}
+	// the halo of each local row
+	vtkstd::vector<vtkIdType> haloOfRow(this->HaloIds.size());
+	for(vtkstd::vector<vtkIdType>::size_type row = 0; row < haloOfRow.size(); 
+		++row)
+		{
+		haloOfRow[row]=vtkstd::lower_bound(haloIds.begin(),haloIds.end(),
+			this->HaloIds[row])-haloIds.begin();
+		}
+	vtkstd::vector<double> localMaxR2(numHaloes,0.0);
+	for(vtkstd::vector<vtkIdType>::size_type id = 0; id < particleRow.size(); 
+		++id)
+		{
+		if(particleRow[id] < 0)
+			{
+			continue;
+			}
+		const vtkIdType h=haloOfRow[particleRow[id]];
+		double x[3];
+		points->GetPoint(id,x);
+		double r2=0.0;
+		for(int d = 0; d < 3; ++d)
+			{
+			r2+=(x[d]-centers[3*h+d])*(x[d]-centers[3*h+d]);
+			}
+		localMaxR2[h]=vtkstd::max(localMaxR2[h],r2);
+		}
+	vtkstd::vector<double> maxR2=localMaxR2;
+	if(parallel && numHaloes > 0)
+		{
+		controller->Reduce(&localMaxR2[0],&maxR2[0],numHaloes,
+			vtkCommunicator::MAX_OP,0);
+		}
+	// 3. the rows of the catalogue, on process 0
+	const vtkIdType numRows=(procId==0) ? numHaloes : 0;
+	vtkSmartPointer<vtkIdTypeArray> idColumn=
+		NewCatalogueIdColumn(this->HasHosts ? "subhalo ID" : "halo ID",numRows);
+	vtkSmartPointer<vtkIdTypeArray> hostColumn=
+		NewCatalogueIdColumn("host halo ID",numRows);
+	vtkSmartPointer<vtkIdTypeArray> countColumn=
+		NewCatalogueIdColumn("number of particles",numRows);
+	vtkSmartPointer<vtkDoubleArray> massColumn=
+		NewCatalogueColumn("mass",1,numRows);
+	vtkSmartPointer<vtkDoubleArray> centerColumn=
+		NewCatalogueColumn("center of mass",3,numRows);
+	vtkSmartPointer<vtkDoubleArray> velocityColumn=
+		NewCatalogueColumn("mean velocity",3,numRows);
+	vtkSmartPointer<vtkDoubleArray> dispersionColumn=
+		NewCatalogueColumn("velocity dispersion",1,numRows);
+	vtkSmartPointer<vtkDoubleArray> spinColumn=
+		NewCatalogueColumn("spin parameter",1,numRows);
+	vtkSmartPointer<vtkDoubleArray> radiusColumn=
+		NewCatalogueColumn("max radius",1,numRows);
+	vtkSmartPointer<vtkIdTypeArray> boundColumn=
+		NewCatalogueIdColumn("most bound particle",numRows);
+	for(vtkIdType h = 0; h < numRows; ++h)
+		{
+		const double* haloSum=&haloSums[WIDTH*h];
+		const double mass=haloSum[MASS];
+		const double* center=&centers[3*h];
+		double meanVelocity[3]={0.0,0.0,0.0};
+		double spin=0.0;
+		double dispersion2=0.0;
+		const double radius=sqrt(maxR2[h]);
+		if(mass!=0)
+			{
+			for(int d = 0; d < 3; ++d)
+				{
+				meanVelocity[d]=haloSum[MASS_VELOCITY+d]/mass;
+				}
+			dispersion2=haloSum[MASS_SPEED2]/mass-
+				vtkMath::Dot(meanVelocity,meanVelocity);
+			// the angular momentum about the center of mass, in the frame of
+			// the mean velocity
+			double centerMomentum[3];
+			vtkMath::Cross(center,meanVelocity,centerMomentum);
+			double angularMomentum[3];
+			for(int d = 0; d < 3; ++d)
+				{
+				angularMomentum[d]=haloSum[ANGULAR_MOMENTUM+d]-
+					mass*centerMomentum[d];
+				}
+			// Bullock et al. (2001), lambda'=J/(sqrt(2) M V R) with V the 
+			// circular velocity at R, sqrt(GM/R), in units where G=1
+			if(radius > 0 && mass > 0)
+				{
+				spin=vtkMath::Norm(angularMomentum)/
+					(sqrt(2.0)*mass*sqrt(mass/radius)*radius);
+				}
+			}
+		idColumn->SetValue(h,haloIds[h]);
+		hostColumn->SetValue(h,hostIds[h]);
+		countColumn->SetValue(h,vtkIdType(haloSum[COUNT]));
+		massColumn->SetValue(h,mass);
+		centerColumn->SetTuple(h,center);
+		velocityColumn->SetTuple(h,meanVelocity);
+		dispersionColumn->SetValue(h,sqrt(vtkstd::max(dispersion2,0.0)));
+		spinColumn->SetValue(h,spin);
+		radiusColumn->SetValue(h,radius);
+		boundColumn->SetValue(h,vtkIdType(haloSum[MOST_BOUND]));
+		}
+	catalogue->AddColumn(idColumn);
+	if(this->HasHosts)
+		{
+		catalogue->AddColumn(hostColumn);
+		}
+	catalogue->AddColumn(countColumn);
+	catalogue->AddColumn(massColumn);
+	catalogue->AddColumn(centerColumn);
+	catalogue->AddColumn(velocityColumn);
+	catalogue->AddColumn(dispersionColumn);
+	catalogue->AddColumn(spinColumn);
+	catalogue->AddColumn(radiusColumn);
+	catalogue->AddColumn(boundColumn);
+}
+
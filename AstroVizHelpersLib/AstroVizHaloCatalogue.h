@@ -0,0 +1,96 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizHaloCatalogue.h,v $
+
+  Copyright (c) Christine Corbett Moran
+  All rights reserved.
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME AstroVizHaloCatalogue
+// .SECTION Description
+// Sums over the particles of the haloes (or subhaloes) found in a piece,
+// one row per group, kept while the particles are labelled. Fill adds up,
+// on process 0, the rows of each halo from every group and process, and
+// makes from them a table with a row per halo: its id, that of its host
+// if hosts were given, number of particles, mass, center of mass, mean
+// velocity, velocity dispersion, spin parameter (Bullock et al. 2001, in
+// units where G=1), the distance of its farthest particle from the
+// center and the index of its particle of lowest potential. Process 0
+// alone holds the rows; the table of the others has the columns only.
+#ifndef __AstroVizHaloCatalogue_h
+#define __AstroVizHaloCatalogue_h
+#include "vtkType.h"
+#include <vtkstd/vector>
+class vtkMultiProcessController;
+class vtkPoints;
+class vtkTable;
+
+class HaloCatalogue
+{
+public:
+	HaloCatalogue() : HasHosts(false) {}
+	// Description:
+	// whether the table gets a "host halo ID" column
+	bool HasHosts;
+	enum SumIndex
+		{
+		COUNT,
+		MASS,
+		MASS_POSITION,
+		MASS_VELOCITY=MASS_POSITION+3,
+		ANGULAR_MOMENTUM=MASS_VELOCITY+3,
+		MASS_SPEED2=ANGULAR_MOMENTUM+3,
+		// the lowest potential, and the index of the particle with it
+		MIN_POTENTIAL,
+		MOST_BOUND,
+		WIDTH
+		};
+	// Description:
+	// adds a row for a group of halo haloId, returning the row. hostId is
+	// kept, and becomes the "host halo ID" column, if HasHosts.
+	vtkIdType AddHalo(vtkIdType haloId,vtkIdType hostId=0);
+	// Description:
+	// adds a particle at x, of mass and velocity v, to a row. index is the
+	// particle's to give if it has the lowest potential of its halo.
+	void AddParticle(vtkIdType row,const double x[3],double mass,
+		const double v[3],double potential,vtkIdType index)
+		{
+		double* sums=&this->Sums[WIDTH*row];
+		sums[COUNT]+=1;
+		sums[MASS]+=mass;
+		for(int d = 0; d < 3; ++d)
+			{
+			sums[MASS_POSITION+d]+=mass*x[d];
+			sums[MASS_VELOCITY+d]+=mass*v[d];
+			}
+		sums[ANGULAR_MOMENTUM]+=mass*(x[1]*v[2]-x[2]*v[1]);
+		sums[ANGULAR_MOMENTUM+1]+=mass*(x[2]*v[0]-x[0]*v[2]);
+		sums[ANGULAR_MOMENTUM+2]+=mass*(x[0]*v[1]-x[1]*v[0]);
+		sums[MASS_SPEED2]+=mass*(v[0]*v[0]+v[1]*v[1]+v[2]*v[2]);
+		if(potential < sums[MIN_POTENTIAL])
+			{
+			sums[MIN_POTENTIAL]=potential;
+			sums[MOST_BOUND]=index;
+			}
+		}
+	vtkIdType GetNumberOfRows() const { return this->HaloIds.size(); }
+	// Description:
+	// fills catalogue with the rows of every process, added up by halo id.
+	// particleRow gives the row of each of points, -1 for those in no
+	// halo. Collective: every process of controller, if it is run in
+	// parallel, must call it.
+	void Fill(vtkMultiProcessController* controller,
+		vtkPoints* points,const vtkstd::vector<vtkIdType>& particleRow,
+		vtkTable* catalogue) const;
+private:
+	// adds the sums of another row of the same halo to those of a row
+	static void Merge(double* sums,const double* other);
+	vtkstd::vector<vtkIdType> HaloIds;
+	vtkstd::vector<vtkIdType> HostIds;
+	vtkstd::vector<double> Sums;
+};
+#endif
@@ -4,6 +4,7 @@
   Module:    $RCSfile: AstroVizHelpers.cxx,v $
 =========================================================================*/
 #include "AstroVizHelpers.h"
+#include "AstroVizRadialMassProfile.h"
 #include "vtkCell.h"
 #include "vtkCellArray.h"
 #include "vtkFloatArray.h"
@@ -19,10 +20,10 @@
 #include "vtkPointData.h"
 #include "vtkPointSet.h"
 #include "vtkTable.h"
-#include "vtkPointLocator.h"
 #include "vtkSphereSource.h"
 #include "vtkSmartPointer.h"
 #include "vtkMultiProcessController.h"
+#include "vtkCommunicator.h"
 #include "vtkMath.h"
 #define _USE_MATH_DEFINES
 #include <cmath>
@@ -213,6 +214,70 @@ bool RunInParallel(vtkMultiProcessController* controller)
 	return (controller != NULL && controller->GetNumberOfProcesses() > 1);
 }
 
+//----------------------------------------------------------------------------
+template <class T>
+void ExchangeWithPeerTemplate(vtkMultiProcessController* controller,
+	int peer,const vtkstd::vector<T>& send,vtkstd::vector<T>& recv,
+	int countTag,int dataTag)
+{
+	vtkIdType sendSize=send.size();
+	vtkIdType recvSize=0;
+	const bool sendFirst=controller->GetLocalProcessId() < peer;
+	for(int step = 0; step < 2; ++step)
+		{
+		if((step==0)==sendFirst)
+			{
+			controller->Send(&sendSize,1,peer,countTag);
+			if(sendSize > 0)
+				{
+				controller->Send(&send[0],sendSize,peer,dataTag);
+				}
+			}
+		else
+			{
+			controller->Receive(&recvSize,1,peer,countTag);
+			recv.resize(recvSize);
+			if(recvSize > 0)
+				{
+				controller->Receive(&recv[0],recvSize,peer,dataTag);
+				}
+			}
+		}
+}
+
+//----------------------------------------------------------------------------
+void ExchangeWithPeer(vtkMultiProcessController* controller,int peer,
+	const vtkstd::vector<double>& send,vtkstd::vector<double>& recv,
+	int countTag,int dataTag)
+{
+	ExchangeWithPeerTemplate(controller,peer,send,recv,countTag,dataTag);
+}
+
+//----------------------------------------------------------------------------
+void ExchangeWithPeer(vtkMultiProcessController* controller,int peer,
+	const vtkstd::vector<vtkIdType>& send,vtkstd::vector<vtkIdType>& recv,
+	int countTag,int dataTag)
+{
+	ExchangeWithPeerTemplate(controller,peer,send,recv,countTag,dataTag);
+}
+
+//----------------------------------------------------------------------------
+double Distance2ToBounds(const double x[3],const double bounds[6])
+{
+	if(bounds[0] > bounds[1])
+		{
+		return VTK_DOUBLE_MAX;
+		}
+	double distance2=0.0;
+	for(int d = 0; d < 3; ++d)
+		{
+		const double gap=vtkstd::max(bounds[2*d]-x[d],
+			vtkstd::max(x[d]-bounds[2*d+1],0.0));
+		distance2+=gap*gap;
+		}
+	return distance2;
+}
+
 //----------------------------------------------------------------------------
 double IllinoisRootFinder(double (*func)(double,void *),void *ctx,\
 											double r,double s,double xacc,double yacc,\
@@ -285,28 +350,9 @@ double ComputeMaxRadiusInParallel(
 	double maxR=ComputeMaxR(input,point);
 	if(RunInParallel(controller))
 		{
-		int procId=controller->GetLocalProcessId();
-		int numProc=controller->GetNumberOfProcesses();
-		if(procId==0)
-			{
-			// collecting and updating maxR from other processors			
-			for(int proc= 1; proc < numProc; ++proc)
-				{
-				double recMaxR=0;
-				controller->Receive(&recMaxR,1,proc,MAX_R);
-				maxR=vtkstd::max(maxR,recMaxR);
-				}
-			// Syncronizing global maxR results
-			controller->Broadcast(&maxR,1,0);
-			}
-		else
-			{
-			// sending to process 0, which will compare all results and compute
-			// global maximum
-			controller->Send(&maxR,1,0,MAX_R);
-			// syncronizing global maxR results
-			controller->Broadcast(&maxR,1,0);
-			}
+		// the global maximum, on every process at once
+		double localMaxR=maxR;
+		controller->AllReduce(&localMaxR,&maxR,1,vtkCommunicator::MAX_OP);
 		}
 	return maxR;
 }
@@ -338,204 +384,105 @@ double ComputeMaxR(vtkPointSet* input,double point[])
 }
 
 //----------------------------------------------------------------------------
-double OverDensityInSphere(double r,void* inputVirialRadiusInfo)
+double* CalculateCenter(vtkDataSet* source)
 {
-	VirialRadiusInfo* virialRadiusInfo = \
-		static_cast<VirialRadiusInfo*>(inputVirialRadiusInfo);
-	vtkIdList* pointsInRadius = \
-		FindPointsWithinRadius(r,virialRadiusInfo->center,
-		virialRadiusInfo->locator);
-	// calculating the average mass, dividing this by the volume of the sphere
-	// to get the density
-	double totalMass=0;
-	vtkPointSet* dataSet=\
-		vtkPointSet::SafeDownCast(
-		virialRadiusInfo->locator->GetDataSet());
-	for(unsigned long pointLocalId = 0; 
-			pointLocalId < pointsInRadius->GetNumberOfIds(); 
-			++pointLocalId)
+	double* center = new double[3];
+	center = source->GetCenter();
+	return center;
+}
+
+//----------------------------------------------------------------------------
+VirialRadiusInfo ComputeVirialRadius(
+	vtkMultiProcessController* controller, vtkPointSet* dataSet,
+	vtkstd::string massArrayName, double softening,double overdensity,
+	double maxR,double center[])
+{
+	VirialRadiusInfo virialRadiusInfo;
+	virialRadiusInfo.dataSet=dataSet;
+	virialRadiusInfo.controller=controller;
+	for(int i = 0; i < 3; ++i)
 		{
-		vtkIdType pointGlobalId = pointsInRadius->GetId(pointLocalId);
-		double* nextPoint=GetPoint(dataSet,pointGlobalId);
-		// extracting the mass
-		// has to be double as this version of VTK doesn't have float method
-		double* mass=GetDataValue(dataSet,virialRadiusInfo->massArrayName.c_str(),
-			pointGlobalId);
-		totalMass+=mass[0];
-		// Finally, some memory management
-		delete [] mass;
-		delete [] nextPoint;
+		virialRadiusInfo.center[i]=center[i];
 		}
-	// If we are running in parallel, update result based on that of other 
-	// processors
-	if(RunInParallel(virialRadiusInfo->controller))
+	virialRadiusInfo.softening=softening;
+	virialRadiusInfo.virialRadius = -1; // if stays -1 means not found
+	virialRadiusInfo.massArrayName = massArrayName;
+	virialRadiusInfo.criticalValue=overdensity;
+	// Sorting the points of this process by radius once, so the mass within
+	// any radius is a binary search. Every process must take part in the
+	// search, even one lacking the array.
+	RadialMassProfile profile;
+	profile.Build(dataSet,massArrayName.c_str(),center);
+	virialRadiusInfo.virialRadius=profile.FindOverdensityRadius(controller,
+		overdensity,softening,maxR);
+	if(virialRadiusInfo.virialRadius>0)
 		{
-		int procId=virialRadiusInfo->controller->GetLocalProcessId();
-		int numProc=virialRadiusInfo->controller->GetNumberOfProcesses();
-		if(procId!=0)
-			{
-			// Sending to root
-			virialRadiusInfo->controller->Send(&totalMass,1,0,TOTAL_MASS_IN_SPHERE);
-			// Receiving back the final totalMass from root
-			virialRadiusInfo->controller->Broadcast(&totalMass,1,0);
-			}
-		else
-			{
-			// Now gather results from each process other than this one
-			for(int proc = 1; proc < numProc; ++proc)
-				{
-				double recTotalMass[1];
-				// Receiving
-				virialRadiusInfo->controller->Receive(recTotalMass,
-					1,proc,TOTAL_MASS_IN_SPHERE);
-				// Updating
-				totalMass+=recTotalMass[0];
-				}
-			virialRadiusInfo->controller->Broadcast(&totalMass,1,0);
-			}
+		profile.GetPointsWithinRadius(virialRadiusInfo.virialRadius,
+			virialRadiusInfo.pointsInRadius);
 		}
-	// Returning the density minus the critical density. Density is defined
-	// as zero if the number points within the radius is zero
-	double density = totalMass/(4./3*M_PI*pow(r,3));
-	double overdensity = density - 	virialRadiusInfo->criticalValue;
-	// managing memory as instructed
-	pointsInRadius->Delete();
-	return overdensity;
+	return virialRadiusInfo;
 }
 
 //----------------------------------------------------------------------------
-double OverNumberInSphere(double r,void* inputVirialRadiusInfo)
+bool ComputeOverdensityRadii(vtkMultiProcessController* controller,
+	vtkPointSet* dataSet, const char* massArrayName, double softening,
+	double maxR, const double center[3],
+	const vtkstd::vector<double>& overdensities,
+	vtkstd::vector<double>& radii, vtkstd::vector<double>& masses,
+	vtkstd::vector<vtkIdType>& numbers,
+	vtkstd::vector<vtkstd::vector<vtkIdType> >* pointsInRadii)
 {
-	VirialRadiusInfo* virialRadiusInfo = \
-		static_cast<VirialRadiusInfo*>(inputVirialRadiusInfo);
-	vtkIdList* pointsInRadius = \
-		FindPointsWithinRadius(r,virialRadiusInfo->center,
-		virialRadiusInfo->locator);
-	// If we are running in parallel, update result based on that of other 
-	// processors
-	unsigned long totalNumberInSphere = pointsInRadius->GetNumberOfIds();
-	if(RunInParallel(virialRadiusInfo->controller))
+	const size_t numOverdensities=overdensities.size();
+	RadialMassProfile profile;
+	int hasMass=profile.Build(dataSet,massArrayName,center);
+	if(RunInParallel(controller))
 		{
-		int procId=virialRadiusInfo->controller->GetLocalProcessId();
-		int numProc=virialRadiusInfo->controller->GetNumberOfProcesses();
-		if(procId!=0)
-			{
-			// Sending to root
-			virialRadiusInfo->controller->Send(&totalNumberInSphere,1,0,
-				TOTAL_NUMBER_IN_SPHERE);
-			// Making sure we are done, so that the function must finish
-			// on all processes before it is attempted to be called again
-			virialRadiusInfo->controller->Broadcast(&totalNumberInSphere,1,0);
-			}
-		else
+		int localHasMass=hasMass;
+		controller->AllReduce(&localHasMass,&hasMass,1,vtkCommunicator::MIN_OP);
+		}
+	if(!hasMass)
+		{
+		return false;
+		}
+	profile.FindOverdensityRadii(controller,overdensities,softening,maxR,
+		radii);
+	// the mass, then the number, within each radius, summed over the
+	// processes at once
+	vtkstd::vector<double> sums(2*numOverdensities,0.0);
+	for(size_t i = 0; i < numOverdensities; ++i)
+		{
+		if(radii[i]>0)
 			{
-			// Now gather results from each process other than this one
-			for(int proc = 1; proc < numProc; ++proc)
-				{
-				unsigned long recTotalNumber[1];
-				// Receiving
-				virialRadiusInfo->controller->Receive(recTotalNumber,
-					1,proc,TOTAL_NUMBER_IN_SPHERE);
-				// Updating
-				totalNumberInSphere+=recTotalNumber[0];
-				}
-			virialRadiusInfo->controller->Broadcast(&totalNumberInSphere,1,0);
+			sums[2*i]=profile.GetMassWithinRadius(radii[i]);
+			sums[2*i+1]=profile.GetNumberWithinRadius(radii[i]);
 			}
 		}
-	// Returning the number minus the critical number
-	double overNumberInSphere = totalNumberInSphere - \
-	 	virialRadiusInfo->criticalValue;
-	// Managing memory first, as instructed by FindPoints..
-	pointsInRadius->Delete();
-	return overNumberInSphere;
-}
-
-//----------------------------------------------------------------------------
-vtkIdList* FindPointsWithinRadius(double r, 
-	double* center, vtkPointLocator* locatorOfThisProcess)
-{
-	// find points within r, all will need this
-	// THIS MEMORY MUST BE MANAGED BY ROOT/CALLER
-	vtkIdList* pointsInRadius = vtkIdList::New();
-	pointsInRadius->Initialize();
-	locatorOfThisProcess->FindPointsWithinRadius(r,
-		center,
-		pointsInRadius);
-	// serial, simply return result
-	return pointsInRadius;
-}
-
-//----------------------------------------------------------------------------
-double* CalculateCenter(vtkDataSet* source)
-{
-	double* center = new double[3];
-	center = source->GetCenter();
-	return center;
-}
-
-//----------------------------------------------------------------------------
-VirialRadiusInfo ComputeVirialRadius(
-	vtkMultiProcessController* controller, vtkPointLocator* locator,
-	vtkstd::string massArrayName, double softening,double overdensity,
-	double maxR,double center[])
-{
-		// Building the struct to use as argument to root finder and density
-		// functions. Contains locator, center, softening info and stores virial
-		// radius info for output
-		VirialRadiusInfo virialRadiusInfo;
-		virialRadiusInfo.locator=locator;
-		virialRadiusInfo.controller=controller;
-		for(int i = 0; i < 3; ++i)
+	if(RunInParallel(controller) && numOverdensities > 0)
+		{
+		vtkstd::vector<double> localSums(sums);
+		controller->AllReduce(&localSums[0],&sums[0],sums.size(),
+			vtkCommunicator::SUM_OP);
+		}
+	masses.resize(numOverdensities);
+	numbers.resize(numOverdensities);
+	for(size_t i = 0; i < numOverdensities; ++i)
 		{
-			virialRadiusInfo.center[i]=center[i];
+		masses[i]=sums[2*i];
+		numbers[i]=vtkIdType(sums[2*i+1]);
 		}
-		virialRadiusInfo.softening=softening;
-		virialRadiusInfo.virialRadius = -1; // if stays -1 means not found
-		virialRadiusInfo.massArrayName = massArrayName;
-		virialRadiusInfo.criticalValue=maxR;
-		// but IllinoisRootFinder takes in a void pointer
-		void* pntrVirialRadiusInfo = &virialRadiusInfo;
-		// 3. Define necessary variables to find virial radius, then search for 
-		// it
-		int numIter=0; // don't ever use this info, but root finder needs it
-	 // keeps track of our guesses and their associated overdensities
-	 /// initial guess is the softening
-		double guessR[3]={softening,softening,softening};
-		double denGuessR[3]={0,0,0}; // keeps track of the density within each R
-		int fib[2]={1,1};
-		while(guessR[2]<maxR)
+	if(pointsInRadii)
+		{
+		pointsInRadii->resize(numOverdensities);
+		for(size_t i = 0; i < numOverdensities; ++i)
 			{
-			// if our last three guesses have been monotonically decreasing
-			// in density, then try to calculate the root
-			if(denGuessR[0]>denGuessR[1]>denGuessR[2])
+			(*pointsInRadii)[i].clear();
+			if(radii[i]>0)
 				{
-				virialRadiusInfo.criticalValue=overdensity;
-				virialRadiusInfo.virialRadius = \
-					IllinoisRootFinder(OverDensityInSphere,
-					pntrVirialRadiusInfo,
-					guessR[0],guessR[2],
-					softening,softening,
-					&numIter);
-				// we are done trying to find the root if the virial radius found is 
-				// greater than zero, as rootfinder returns -1 if there were problems 
-				if(virialRadiusInfo.virialRadius>0)
-					{
-					break;
-					}
+				profile.GetPointsWithinRadius(radii[i],(*pointsInRadii)[i]);
 				}
-			int nextFib=fib[0]+fib[1];
-			// updating the fibonacci sequence
-			shiftLeftUpdate(fib,2,nextFib);
-			// Updating guessR
-			double nextR=nextFib*virialRadiusInfo.softening;
-			shiftLeftUpdate(guessR,3,nextR);
-			// Updating density estimates
-			// Means that OverDensityInSphere will just return DensityInSphere
-			virialRadiusInfo.criticalValue=0; 
-			shiftLeftUpdate(denGuessR,3,OverDensityInSphere(nextR,
-				pntrVirialRadiusInfo));
+			}
 		}
-		return virialRadiusInfo;
+	return true;
 }
 
 //----------------------------------------------------------------------------
@@ -600,109 +547,25 @@ vtkPolyData* CopyPointsAndData(vtkPointSet* dataSet, vtkIdList*
 
 
 //----------------------------------------------------------------------------
-vtkPolyData* GetDatasetWithinVirialRadius(VirialRadiusInfo virialRadiusInfo)
+vtkPolyData* GetDatasetWithinVirialRadius(
+	const VirialRadiusInfo& virialRadiusInfo)
 {
-
-	vtkIdList* pointsInRadius = \
-		FindPointsWithinRadius(virialRadiusInfo.virialRadius,
-		virialRadiusInfo.center, virialRadiusInfo.locator);
-  vtkPointSet* dataSet = \
-		vtkPointSet::SafeDownCast(virialRadiusInfo.locator->GetDataSet());	
+	vtkIdList* pointsInRadius = vtkIdList::New();
+	pointsInRadius->SetNumberOfIds(virialRadiusInfo.pointsInRadius.size());
+	for(vtkIdType i = 0; i < pointsInRadius->GetNumberOfIds(); ++i)
+		{
+		pointsInRadius->SetId(i,virialRadiusInfo.pointsInRadius[i]);
+		}
 	// Creating a new dataset
 	// first allocating
 	vtkPolyData* newDataSet = \
-		CopyPointsAndData(dataSet,pointsInRadius);
+		CopyPointsAndData(virialRadiusInfo.dataSet,pointsInRadius);
 	// Managing memory
 	pointsInRadius->Delete();
 	return newDataSet;
 }
 
 
-//----------------------------------------------------------------------------
-double* ComputeRadialVelocity(double v[],double r[])
-{
-	return ComputeProjection(v,r);
-}
-
-//----------------------------------------------------------------------------
-double* ComputeTangentialVelocity(double v[],double r[])
-{
-	double* vRad=ComputeRadialVelocity(v,r);
-  double* vTan=PointVectorDifference(v,vRad);
-	delete [] vRad;
-	return vTan;	
-}
-//----------------------------------------------------------------------------
-double* ComputeAngularMomentum(double v[], double r[])
-{
-	double* angularMomentum = new double[3];
-	vtkMath::Cross(v,r,angularMomentum);
-	return angularMomentum;
-}
-
-//----------------------------------------------------------------------------
-double* ComputeVelocitySquared(double v[],double r[])
-{
-	double* velocitySquared = new double[1];
-	velocitySquared[0]=vtkMath::Dot(v,v);
-	return velocitySquared;
-}
-
-//----------------------------------------------------------------------------
-double* ComputeRadialVelocitySquared(double v[],double r[])
-{
-	double* vRad=ComputeRadialVelocity(v,r);
-	double* vRadSquared=new double[1];
-	vRadSquared[0]=vtkMath::Dot(vRad,vRad);
-	delete [] vRad;
-	return vRadSquared;
-}
-
-//----------------------------------------------------------------------------
-double* ComputeTangentialVelocitySquared(double v[],double r[])
-{
-	double* vRad=ComputeRadialVelocity(v,r);
-	double* vTan=ComputeTangentialVelocity(v,r);
-	double* vTanSquared=new double[1];
-	vTanSquared[0]=vtkMath::Dot(vTan,vTan);
-	delete [] vRad;
-	delete [] vTan;
-	return vTanSquared;	
-}
-
-//----------------------------------------------------------------------------
-double* ComputeVelocityDispersion(vtkVariant vSquaredAve, vtkVariant vAve)
-{
-	// vSquared ave required to be a variant which holds a double,
-	// vAve required to be a variant which holds a double array with 3 
-	// components
-	double* velocityDispersion = new double[3];
-	for(int comp = 0; comp < 3; ++comp)
-		{
-		velocityDispersion[comp] = sqrt(fabs(vSquaredAve.ToDouble() -
-			pow(vAve.ToArray()->GetVariantValue(comp).ToDouble(),2)));
-		}
-	return velocityDispersion;
-}
-//----------------------------------------------------------------------------
-double* ComputeCircularVelocity(vtkVariant cumulativeMass, 
-	vtkVariant binRadius)
-{
-	double* circularVelocity = new double[1];
-	circularVelocity[0]=cumulativeMass.ToDouble()/binRadius.ToDouble();
-	return circularVelocity;
-}
-
-//----------------------------------------------------------------------------
-double* ComputeDensity(vtkVariant cumulativeMass, 
-	vtkVariant binRadius)
-{
-	double* density = new double[1];
-	density[0] = cumulativeMass.ToDouble()/(4./3*vtkMath::Pi()*pow(
-		binRadius.ToDouble(),3));
-	return density;
-}
-
 //----------------------------------------------------------------------------
 double* ComputeProjection(double  vectorOne[],double vectorTwo[])
 {
@@ -16,6 +16,7 @@
 #include "vtkIdTypeArray.h" // TODO: needed to include this, but should figure out how to remove
 #include <iostream>
 #include <sstream>
+#include <vtkstd/vector>
 class vtkPolyData;
 class vtkPointSet;
 class vtkDataSet;
@@ -25,13 +26,11 @@ class vtkPointData;
 class vtkDataSetAttributes;
 class vtkIdTypeArray;
 class vtkIdList;
-class vtkPointLocator;
 class vtkCell;
 class vtkCellArray;
 class vtkFloatArray;
 class vtkInformationVector;
 class vtkMultiProcessController;
-class vtkVariant;
 
 /*
 * The following methods take and modify vtkPolyData
@@ -153,6 +152,22 @@ inline vtkstd::string ToString(double x)
 // returns true if this process should be run in parallel
 // (i.e. we have  non-null controller and more than one process to work with)
 bool RunInParallel(vtkMultiProcessController* controller);
+// Description:
+// sends a buffer to peer and receives one back from it, first its size
+// with countTag and then its values with dataTag. The lower process of the
+// pair sends first, so if each process exchanges with its peers in
+// increasing order, every pair is served in the same order everywhere and
+// no two processes wait on each other.
+void ExchangeWithPeer(vtkMultiProcessController* controller,int peer,
+	const vtkstd::vector<double>& send,vtkstd::vector<double>& recv,
+	int countTag,int dataTag);
+void ExchangeWithPeer(vtkMultiProcessController* controller,int peer,
+	const vtkstd::vector<vtkIdType>& send,vtkstd::vector<vtkIdType>& recv,
+	int countTag,int dataTag);
+// Description:
+// returns the squared distance from x to the nearest point of bounds,
+// VTK_DOUBLE_MAX if the bounds are empty (min > max)
+double Distance2ToBounds(const double x[3],const double bounds[6]);
 enum PointsInRadiusMPIData
 {
 	TOTAL_MASS_IN_SPHERE,
@@ -211,59 +226,55 @@ double ComputeMaxR(vtkPointSet* input,double point[]);
 double ComputeMaxRadiusInParallel(
 	vtkMultiProcessController* controller,vtkPointSet* input,double point[]);
 	
-// Description:
-// This assumes locatorStruct is a VirialRadiusInfo struct, which contains
-// a locator for a given vtkdataset, a center from which to calculate
-// the volume 
-// Given a radius, a center, calculates the density of within the sphere
-// of radius r around the center and subtracts the critical density of 
-// the user's choice.
-// 
-double OverDensityInSphere(double r, void* locatorStruct);
-
-// Description:
-// This assumes locatorStruct is a VirialRadiusInfo struct, which contains
-// a locator for a given vtkdataset, a center from which to calculate
-// the volume 
-// Given a radius, a center, calculates the number density of within the
-// sphere of radius r around the center and subtracts the critical density of 
-// the user's choice.
-double OverNumberInSphere(double r, void* locatorStruct);
-
-// Descriptions:
-// If this is called by each process in the domain of the controller, finds
-// all points within a given radius on this process
-vtkIdList* FindPointsWithinRadius(double r, double* center,
-	vtkPointLocator* locatorOfThisProcess);
-
 // Description:
 // The VirialRadiusInfo struct is an containing:
-// .locator which is a vtkPointLocator
+// .dataSet which is the vtkPointSet searched
 // .center  which is a double[3]
 // .criticalDensity which is a double
 // .virialRadius
+// .pointsInRadius, the ids of the points of dataSet within virialRadius
 struct VirialRadiusInfo 
 {
-	vtkPointLocator* locator;
+	vtkPointSet* dataSet;
 	vtkMultiProcessController* controller;
 	double center[3];
 	double criticalValue;
 	double virialRadius;
 	double softening;
 	vtkstd::string massArrayName;
+	vtkstd::vector<vtkIdType> pointsInRadius;
 };
 
 
 // Description:
 // Computes the virial radius >=0 base upon the user defined 
-// overdensity and center. Returns -1 if there is a problem. 
+// overdensity and center: the first radius beyond the softening at which
+// the mean density within falls to overdensity. The virial radius is -1
+// if there is a problem. The points are sorted by radius once, after
+// which each evaluation of the mass within a radius is a binary search;
+// see RadialMassProfile.
 // Works in parallel if a controller is specified not equal to null and if 
 // the number of processors is > 1
 VirialRadiusInfo ComputeVirialRadius(
-	vtkMultiProcessController* controller, vtkPointLocator* locator,
+	vtkMultiProcessController* controller, vtkPointSet* dataSet,
 	vtkstd::string massArrayName, double softening,double overdensity,
 	double maxR,double center[]);
 
+// Description:
+// As ComputeVirialRadius for each of overdensities at once, from one sort
+// of the points: radii[i] is the radius of overdensities[i], -1 if it is
+// not found, masses[i] and numbers[i] the mass and number of points within
+// it over every process. If pointsInRadii is given, (*pointsInRadii)[i]
+// gets the ids of the points of dataSet within radii[i]. Returns false if
+// dataSet lacks the mass array on any process.
+bool ComputeOverdensityRadii(vtkMultiProcessController* controller,
+	vtkPointSet* dataSet, const char* massArrayName, double softening,
+	double maxR, const double center[3],
+	const vtkstd::vector<double>& overdensities,
+	vtkstd::vector<double>& radii, vtkstd::vector<double>& masses,
+	vtkstd::vector<vtkIdType>& numbers,
+	vtkstd::vector<vtkstd::vector<vtkIdType> >* pointsInRadii=NULL);
+
 // Description:
 // shifts every item in array one to left (the first element is thrown away)
 // then sets inserts updateValue in the last, free slot
@@ -281,7 +292,8 @@ vtkPolyData* CopyPointsAndData(vtkPointSet* dataSet, vtkIdList*
 // Given a populated virialradiusinfo struct, returns a dataset corresponding
 // to only those points within the virial radius.
 // This method only works if input was vtkPolyData...
-vtkPolyData* GetDatasetWithinVirialRadius(VirialRadiusInfo virialRadiusInfo);
+vtkPolyData* GetDatasetWithinVirialRadius(
+	const VirialRadiusInfo& virialRadiusInfo);
 
 // Description:
 // helper function to calculate the center based upon the source.
@@ -322,54 +334,10 @@ double* ComputeProjection(double  vectorOne[],double vectorTwo[]);
 // tangentialVelocity = PointVectorDifference(v,radialVelocity);
 double* PointVectorDifference(double vectorOne[], double vectorTwo[]);
 
-// Description
-// Give a 3 vector v and a three vector r computes the specific angular 
-// momentum = r x v
-double* ComputeAngularMomentum(double v[], double r[]);
-
 // Description:
 // Multiplies in place a 3-vector by a constant
 void VecMultConstant(double vector[],double constant);
 
-// Description
-// Given a vSquaredAve and a vAve calculates the velocity dispersion
-// placing it in the output vector velocityDispersion
-double* ComputeVelocityDispersion(vtkVariant vSquaredAve, vtkVariant vAve);
-	
-// Description:
-// helper function to compute radial velocity
-double* ComputeRadialVelocity(double v[],double r[]);
-
-// Description:
-// helper function to compute tangential velocity
-double* ComputeTangentialVelocity(double v[],double r[]);
-
-// Description:
-// helper function to compute angular momentum
-double* ComputeAngularMomentum(double v[], double r[]);
-
-// Description:
-// helper function to compute velocity squared
-double* ComputeVelocitySquared(double v[],double r[]);
-
-// Description:
-// helper function to compute radial velocity squared
-double* ComputeRadialVelocitySquared(double v[],double r[]);
-
-// Description:
-// helper function to compute tangential velocity squared
-double* ComputeTangentialVelocitySquared(double v[],double r[]);
-
-// Description:
-// helper function to compute circular velocity
-double* ComputeCircularVelocity(vtkVariant cumulativeMass, 
-	vtkVariant binRadius);
-
-// Description:
-// helper function to compute density
-double* ComputeDensity(vtkVariant cumulativeMass, 
-	vtkVariant binRadius);
-	
 // Description:
 // Helper function to compute the midpoint between two points
 double* ComputeMidpoint(double pointOne[], double pointTwo[]);
@@ -0,0 +1,309 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizKdTree.cxx,v $
+=========================================================================*/
+#include "AstroVizKdTree.h"
+#include "vtkPoints.h"
+#include <vtkstd/algorithm>
+#include <vtkstd/functional>
+
+namespace
+{
+// orders point ids by one coordinate
+class CoordinateLess
+{
+public:
+	CoordinateLess(const double* points,int dim) : Points(points), Dim(dim) {}
+	bool operator()(vtkIdType a,vtkIdType b) const
+		{
+		return this->Points[3*a+this->Dim] < this->Points[3*b+this->Dim];
+		}
+private:
+	const double* Points;
+	int Dim;
+};
+}
+
+//----------------------------------------------------------------------------
+void NeighborHeap::Reset(int k)
+{
+	this->K=k;
+	this->Heap.clear();
+	this->Heap.reserve(k);
+}
+
+//----------------------------------------------------------------------------
+void NeighborHeap::Push(double distance2,vtkIdType id)
+{
+	const Neighbor next(distance2,id);
+	if(int(this->Heap.size()) < this->K)
+		{
+		this->Heap.push_back(next);
+		vtkstd::push_heap(this->Heap.begin(),this->Heap.end());
+		}
+	else if(this->K > 0 && next < this->Heap.front())
+		{
+		vtkstd::pop_heap(this->Heap.begin(),this->Heap.end());
+		this->Heap.back()=next;
+		vtkstd::push_heap(this->Heap.begin(),this->Heap.end());
+		}
+}
+
+//----------------------------------------------------------------------------
+void NeighborHeap::Sort()
+{
+	vtkstd::sort_heap(this->Heap.begin(),this->Heap.end());
+}
+
+//----------------------------------------------------------------------------
+KdTree::KdTree()
+{
+	this->Buckets.push_back(0);
+}
+
+//----------------------------------------------------------------------------
+void KdTree::Build(vtkPoints* points,int bucketSize)
+{
+	const vtkIdType numPoints=points->GetNumberOfPoints();
+	this->Points.resize(3*numPoints);
+	for(vtkIdType i=0; i < numPoints; ++i)
+		{
+		points->GetPoint(i,&this->Points[3*i]);
+		}
+	this->BuildNodes(bucketSize);
+}
+
+//----------------------------------------------------------------------------
+void KdTree::Build(const double* points,vtkIdType numPoints,int bucketSize)
+{
+	this->Points.assign(points,points+3*numPoints);
+	this->BuildNodes(bucketSize);
+}
+
+//----------------------------------------------------------------------------
+void KdTree::BuildNodes(int bucketSize)
+{
+	const vtkIdType numPoints=this->Points.size()/3;
+	this->Order.resize(numPoints);
+	for(vtkIdType i=0; i < numPoints; ++i)
+		{
+		this->Order[i]=i;
+		}
+	this->Nodes.clear();
+	this->Buckets.clear();
+	if(numPoints > 0)
+		{
+		this->BuildNode(0,numPoints,vtkstd::max(bucketSize,1));
+		}
+	this->Buckets.push_back(numPoints);
+}
+
+//----------------------------------------------------------------------------
+int KdTree::BuildNode(vtkIdType begin,vtkIdType end,int bucketSize)
+{
+	const int index=this->Nodes.size();
+	this->Nodes.push_back(Node());
+	Node node;
+	node.Begin=begin;
+	node.End=end;
+	node.Lower=node.Upper=-1;
+	// the bounds are those of the points, not of the split, so searches
+	// skip the empty space around them
+	for(int d=0; d < 3; ++d)
+		{
+		node.Bounds[2*d]=node.Bounds[2*d+1]=this->Points[3*this->Order[begin]+d];
+		}
+	for(vtkIdType i=begin+1; i < end; ++i)
+		{
+		const double* x=&this->Points[3*this->Order[i]];
+		for(int d=0; d < 3; ++d)
+			{
+			node.Bounds[2*d]=vtkstd::min(node.Bounds[2*d],x[d]);
+			node.Bounds[2*d+1]=vtkstd::max(node.Bounds[2*d+1],x[d]);
+			}
+		}
+	if(end-begin <= bucketSize)
+		{
+		this->Buckets.push_back(begin);
+		this->Nodes[index]=node;
+		return index;
+		}
+	// split at the median of the widest dimension
+	int dim=0;
+	for(int d=1; d < 3; ++d)
+		{
+		if(node.Bounds[2*d+1]-node.Bounds[2*d] >
+			node.Bounds[2*dim+1]-node.Bounds[2*dim])
+			{
+			dim=d;
+			}
+		}
+	const vtkIdType middle=begin+(end-begin)/2;
+	vtkstd::nth_element(this->Order.begin()+begin,this->Order.begin()+middle,
+		this->Order.begin()+end,CoordinateLess(&this->Points[0],dim));
+	node.Lower=this->BuildNode(begin,middle,bucketSize);
+	node.Upper=this->BuildNode(middle,end,bucketSize);
+	this->Nodes[index]=node;
+	return index;
+}
+
+//----------------------------------------------------------------------------
+void KdTree::GetBounds(double bounds[6]) const
+{
+	for(int i=0; i < 6; ++i)
+		{
+		bounds[i]=this->Nodes.empty() ? ((i%2) ? -VTK_DOUBLE_MAX : VTK_DOUBLE_MAX) :
+			this->Nodes[0].Bounds[i];
+		}
+}
+
+//----------------------------------------------------------------------------
+double KdTree::Distance2ToNode(const Node& node,const double x[3]) const
+{
+	double distance2=0.0;
+	for(int d=0; d < 3; ++d)
+		{
+		if(x[d] < node.Bounds[2*d])
+			{
+			const double gap=node.Bounds[2*d]-x[d];
+			distance2+=gap*gap;
+			}
+		else if(x[d] > node.Bounds[2*d+1])
+			{
+			const double gap=x[d]-node.Bounds[2*d+1];
+			distance2+=gap*gap;
+			}
+		}
+	return distance2;
+}
+
+//----------------------------------------------------------------------------
+void KdTree::FindClosestNPoints(const double x[3],int k,
+	NeighborHeap& heap) const
+{
+	heap.Reset(k);
+	if(!this->Nodes.empty() && k > 0)
+		{
+		this->Search(0,x,heap);
+		}
+	heap.Sort();
+}
+
+//----------------------------------------------------------------------------
+void KdTree::Search(int index,const double x[3],NeighborHeap& heap) const
+{
+	const Node& node=this->Nodes[index];
+	if(node.Lower < 0)
+		{
+		for(vtkIdType i=node.Begin; i < node.End; ++i)
+			{
+			const vtkIdType id=this->Order[i];
+			const double* y=&this->Points[3*id];
+			const double dx=y[0]-x[0], dy=y[1]-x[1], dz=y[2]-x[2];
+			heap.Push(dx*dx+dy*dy+dz*dz,id);
+			}
+		return;
+		}
+	// the nearer child first, so the bound is tight for the other
+	int first=node.Lower, second=node.Upper;
+	double firstDistance2=this->Distance2ToNode(this->Nodes[first],x);
+	double secondDistance2=this->Distance2ToNode(this->Nodes[second],x);
+	if(secondDistance2 < firstDistance2)
+		{
+		vtkstd::swap(first,second);
+		vtkstd::swap(firstDistance2,secondDistance2);
+		}
+	if(firstDistance2 <= heap.GetBound())
+		{
+		this->Search(first,x,heap);
+		}
+	if(secondDistance2 <= heap.GetBound())
+		{
+		this->Search(second,x,heap);
+		}
+}
+
+//----------------------------------------------------------------------------
+double KdTree::FarthestDistance2ToNode(const Node& node,const double x[3]) const
+{
+	double distance2=0.0;
+	for(int d=0; d < 3; ++d)
+		{
+		const double gap=vtkstd::max(x[d]-node.Bounds[2*d],
+			node.Bounds[2*d+1]-x[d]);
+		distance2+=gap*gap;
+		}
+	return distance2;
+}
+
+//----------------------------------------------------------------------------
+void KdTree::FindPointsWithinRadius(const double x[3],double radius,
+	vtkstd::vector<vtkIdType>& ids) const
+{
+	ids.clear();
+	if(!this->Nodes.empty() && radius >= 0)
+		{
+		this->SearchRadius(0,x,radius*radius,ids);
+		}
+}
+
+//----------------------------------------------------------------------------
+void KdTree::SearchRadius(int index,const double x[3],double radius2,
+	vtkstd::vector<vtkIdType>& ids) const
+{
+	const Node& node=this->Nodes[index];
+	if(this->Distance2ToNode(node,x) > radius2)
+		{
+		return;
+		}
+	// a node wholly inside the sphere is taken without looking at its points,
+	// which saves most of the work in dense regions
+	const bool inside=this->FarthestDistance2ToNode(node,x) <= radius2;
+	if(node.Lower < 0 || inside)
+		{
+		for(vtkIdType i=node.Begin; i < node.End; ++i)
+			{
+			const vtkIdType id=this->Order[i];
+			const double* y=&this->Points[3*id];
+			const double dx=y[0]-x[0], dy=y[1]-x[1], dz=y[2]-x[2];
+			if(inside || dx*dx+dy*dy+dz*dz <= radius2)
+				{
+				ids.push_back(id);
+				}
+			}
+		return;
+		}
+	this->SearchRadius(node.Lower,x,radius2,ids);
+	this->SearchRadius(node.Upper,x,radius2,ids);
+}
+
+//----------------------------------------------------------------------------
+void NeighborLists::Allocate(vtkIdType numPoints,int k)
+{
+	// freed first, so the old lists and the new are never held at once
+	this->Initialize();
+	this->K=vtkstd::min<vtkIdType>(k,numPoints);
+	this->NumberOfPoints=numPoints;
+	this->Ids.resize(numPoints*this->K);
+}
+
+//----------------------------------------------------------------------------
+void NeighborLists::Initialize()
+{
+	this->K=0;
+	this->NumberOfPoints=0;
+	vtkstd::vector<vtkIdType>().swap(this->Ids);
+}
+
+//----------------------------------------------------------------------------
+void NeighborLists::Set(vtkIdType id,const NeighborHeap& heap)
+{
+	const int count=vtkstd::min(heap.GetNumberOfNeighbors(),this->K);
+	const NeighborHeap::Neighbor* neighbors=heap.GetNeighbors();
+	vtkIdType* ids=&this->Ids[id*this->K];
+	for(int j = 0; j < count; ++j)
+		{
+		ids[j]=neighbors[j].second;
+		}
+}
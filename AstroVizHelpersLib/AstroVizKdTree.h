@@ -0,0 +1,164 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizKdTree.h,v $
+
+  Copyright (c) Christine Corbett Moran
+  All rights reserved.
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME AstroVizKdTree
+// .SECTION Description
+// A bucket kd-tree over the points of a data set, for k nearest neighbor
+// searches by many threads at once. Nodes are split at the median of
+// their widest dimension until they hold at most BucketSize points, so the
+// buckets, taken in tree order, are small spatially compact blocks; points
+// next to each other in that order have mostly the same neighbors, which
+// makes the order a good one to process points in. The tree is not changed
+// by a search, and each thread searches with its own NeighborHeap.
+#ifndef __AstroVizKdTree_h
+#define __AstroVizKdTree_h
+#include "vtkType.h"
+#include <vtkstd/vector>
+#include <vtkstd/utility>
+class vtkPoints;
+
+// Description:
+// The k nearest points found so far during a search: a max-heap on the
+// squared distance, with the point id breaking ties, so the farthest is
+// on top and is the one replaced by a closer point.
+class NeighborHeap
+{
+public:
+	typedef vtkstd::pair<double,vtkIdType> Neighbor;
+	NeighborHeap() : K(0) {}
+	// Description:
+	// empties the heap, to collect up to k points
+	void Reset(int k);
+	// Description:
+	// returns the squared distance a point must be within to be added
+	double GetBound() const
+		{
+		return (int(this->Heap.size()) < this->K) ?
+			VTK_DOUBLE_MAX : this->Heap.front().first;
+		}
+	// Description:
+	// adds a point, if it is closer than the farthest kept
+	void Push(double distance2,vtkIdType id);
+	// Description:
+	// sorts the kept points by increasing distance, after which they are
+	// Neighbors[0..GetNumberOfNeighbors()). The heap must be Reset to be
+	// used again.
+	void Sort();
+	int GetNumberOfNeighbors() const { return this->Heap.size(); }
+	const Neighbor* GetNeighbors() const
+		{ return this->Heap.empty() ? NULL : &this->Heap[0]; }
+private:
+	int K;
+	vtkstd::vector<Neighbor> Heap;
+};
+
+class KdTree
+{
+public:
+	KdTree();
+	// Description:
+	// builds the tree over the points. BucketSize is the largest number of
+	// points in a leaf.
+	void Build(vtkPoints* points,int bucketSize=16);
+	// Description:
+	// builds the tree over numPoints points given as x,y,z triples, such as
+	// positions scaled or shifted from those of a data set
+	void Build(const double* points,vtkIdType numPoints,int bucketSize=16);
+	vtkIdType GetNumberOfPoints() const { return this->Order.size(); }
+	// Description:
+	// the ids of the points in tree order; the points of each bucket are
+	// a contiguous run, [GetBucketBegin(b),GetBucketBegin(b+1))
+	const vtkIdType* GetOrder() const
+		{ return this->Order.empty() ? NULL : &this->Order[0]; }
+	int GetNumberOfBuckets() const { return this->Buckets.size()-1; }
+	vtkIdType GetBucketBegin(int bucket) const
+		{ return this->Buckets[bucket]; }
+	// Description:
+	// the position of a point, as used by the tree
+	const double* GetPoint(vtkIdType id) const { return &this->Points[3*id]; }
+	// Description:
+	// the bounds of the points, empty (min > max) if there are none
+	void GetBounds(double bounds[6]) const;
+	// Description:
+	// finds the k points nearest to x, including any at x itself, and
+	// leaves them in heap sorted by increasing distance
+	void FindClosestNPoints(const double x[3],int k,NeighborHeap& heap) const;
+	// Description:
+	// finds the points within radius of x, including x itself, and leaves
+	// their ids in ids, in no particular order
+	void FindPointsWithinRadius(const double x[3],double radius,
+		vtkstd::vector<vtkIdType>& ids) const;
+private:
+	struct Node
+	{
+		double Bounds[6];
+		// children, or -1 for a bucket
+		int Lower;
+		int Upper;
+		// the points of the node, a run of Order
+		vtkIdType Begin;
+		vtkIdType End;
+	};
+	// builds the nodes over Points
+	void BuildNodes(int bucketSize);
+	int BuildNode(vtkIdType begin,vtkIdType end,int bucketSize);
+	void Search(int node,const double x[3],NeighborHeap& heap) const;
+	void SearchRadius(int node,const double x[3],double radius2,
+		vtkstd::vector<vtkIdType>& ids) const;
+	// squared distance from x to the nearest point of a node
+	double Distance2ToNode(const Node& node,const double x[3]) const;
+	// squared distance from x to the farthest point of a node
+	double FarthestDistance2ToNode(const Node& node,const double x[3]) const;
+	vtkstd::vector<double> Points;
+	vtkstd::vector<vtkIdType> Order;
+	vtkstd::vector<Node> Nodes;
+	vtkstd::vector<vtkIdType> Buckets;
+};
+
+// Description:
+// The ids of the nearest neighbors of every point of a tree, kept so that
+// smoothing over as many or fewer neighbors need not search again. Each
+// point keeps the same number, K, so those of point i are Ids[i*K,i*K+K),
+// nearest first; their distances are computed again from the points of
+// the tree when they are used. Rows are filled by Set, each by one
+// thread, after Allocate has laid them out.
+class NeighborLists
+{
+public:
+	NeighborLists() : K(0), NumberOfPoints(0) {}
+	// Description:
+	// lays out room for k neighbors of each of numPoints points, or all the
+	// points if there are fewer, freeing any lists kept before
+	void Allocate(vtkIdType numPoints,int k);
+	// Description:
+	// empties the lists, freeing their memory
+	void Initialize();
+	// Description:
+	// the number of neighbors kept per point
+	int GetK() const { return this->K; }
+	vtkIdType GetNumberOfPoints() const { return this->NumberOfPoints; }
+	// Description:
+	// the bytes taken by the lists of k neighbors of numPoints points
+	static double GetMemorySize(vtkIdType numPoints,int k)
+		{ return double(numPoints)*k*sizeof(vtkIdType); }
+	// Description:
+	// stores the ids of the neighbors of a point, sorted as left by
+	// FindClosestNPoints
+	void Set(vtkIdType id,const NeighborHeap& heap);
+	const vtkIdType* GetNeighbors(vtkIdType id) const
+		{ return &this->Ids[id*this->K]; }
+private:
+	int K;
+	vtkIdType NumberOfPoints;
+	vtkstd::vector<vtkIdType> Ids;
+};
+#endif
@@ -0,0 +1,66 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizKernel.cxx,v $
+=========================================================================*/
+#define _USE_MATH_DEFINES
+#include "AstroVizKernel.h"
+#include <math.h>
+
+//----------------------------------------------------------------------------
+SmoothingKernel::SmoothingKernel(int type,double h)
+{
+	this->Type=type;
+	this->H=h;
+	this->InverseH2=(h > 0) ? 1.0/(h*h) : 0.0;
+	const double inverseH3=this->InverseH2*sqrt(this->InverseH2);
+	// W(r)=Norm*w(r/h), where w integrates to 1/c over space
+	const double c=(type==WENDLAND_C2) ? 21./(16*M_PI) : 1./M_PI;
+	this->Norm=c*inverseH3;
+	this->GradientNorm=c*inverseH3*this->InverseH2;
+}
+
+//----------------------------------------------------------------------------
+double SmoothingKernel::Evaluate(double r2) const
+{
+	const double q2=r2*this->InverseH2;
+	if(q2 >= 4.0)
+		{
+		return 0.0;
+		}
+	const double q=sqrt(q2);
+	if(this->Type==WENDLAND_C2)
+		{
+		const double t=1.0-0.5*q;
+		return this->Norm*t*t*t*t*(1.0+2.0*q);
+		}
+	if(q2 < 1.0)
+		{
+		return this->Norm*(1.0-1.5*q2+0.75*q2*q);
+		}
+	const double t=2.0-q;
+	return this->Norm*0.25*t*t*t;
+}
+
+//----------------------------------------------------------------------------
+double SmoothingKernel::EvaluateGradient(double r2) const
+{
+	const double q2=r2*this->InverseH2;
+	if(q2 >= 4.0)
+		{
+		return 0.0;
+		}
+	const double q=sqrt(q2);
+	// w'(q)/q, which stays finite as q goes to zero
+	if(this->Type==WENDLAND_C2)
+		{
+		const double t=1.0-0.5*q;
+		return -5.0*this->GradientNorm*t*t*t;
+		}
+	if(q2 < 1.0)
+		{
+		return this->GradientNorm*(-3.0+2.25*q);
+		}
+	const double t=2.0-q;
+	return -0.75*this->GradientNorm*t*t/q;
+}
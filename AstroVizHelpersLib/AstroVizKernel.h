@@ -0,0 +1,51 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizKernel.h,v $
+
+  Copyright (c) Christine Corbett Moran
+  All rights reserved.
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME AstroVizKernel
+// .SECTION Description
+// The SPH smoothing kernels, normalized to one over 3D space. Both reach
+// zero at 2h, the convention of the Tipsy smooth tool, which sets h to half
+// the distance of the farthest of the nSmooth neighbors; with the cubic
+// spline the densities are those of smooth. The Wendland C2 kernel does
+// not let particles pair up, but needs more neighbors, of order 100, to be
+// as accurate.
+#ifndef __AstroVizKernel_h
+#define __AstroVizKernel_h
+
+class SmoothingKernel
+{
+public:
+	enum KernelType
+		{
+		CUBIC_SPLINE=0,
+		WENDLAND_C2=1
+		};
+	// Description:
+	// a kernel of smoothing length h
+	SmoothingKernel(int type,double h);
+	double GetSmoothingLength() const { return this->H; }
+	// Description:
+	// returns W at squared distance r2
+	double Evaluate(double r2) const;
+	// Description:
+	// returns dW/dr divided by r at squared distance r2, so the gradient
+	// at x_i of the kernel centered on x_j is the result times x_i-x_j
+	double EvaluateGradient(double r2) const;
+private:
+	int Type;
+	double H;
+	// 1/h^2, and the normalizations of W and its gradient
+	double InverseH2;
+	double Norm;
+	double GradientNorm;
+};
+#endif
@@ -0,0 +1,119 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizPrefetch.cxx,v $
+=========================================================================*/
+#include "AstroVizPrefetch.h"
+#include "vtkMutexLock.h"
+#include <vtkstd/algorithm>
+#include <fstream>
+
+//----------------------------------------------------------------------------
+int FindTimeStep(const vtkstd::vector<double>& times,double time)
+{
+	// first step after time, the one before it is shown
+	const int after=vtkstd::upper_bound(times.begin(),times.end(),time)
+		-times.begin();
+	return (after > 0) ? after-1 : 0;
+}
+
+//----------------------------------------------------------------------------
+int NextTimeStep(int numberOfSteps,int step,int previousStep)
+{
+	const int next=(step < previousStep) ? step-1 : step+1;
+	return (next >= 0 && next < numberOfSteps) ? next : -1;
+}
+
+//----------------------------------------------------------------------------
+void WarmFiles(const vtkstd::vector<vtkstd::string>& fileNames)
+{
+	vtkstd::vector<char> buffer(1 << 20);
+	for(vtkstd::vector<vtkstd::string>::size_type i=0;
+		i < fileNames.size(); ++i)
+		{
+		std::ifstream file(fileNames[i].c_str(),std::ios::in | std::ios::binary);
+		while(file.read(&buffer[0],buffer.size()))
+			{
+			}
+		}
+}
+
+//----------------------------------------------------------------------------
+BackgroundTask::BackgroundTask()
+{
+	this->Threader=vtkMultiThreader::New();
+	this->Lock=vtkMutexLock::New();
+	this->ThreadId=-1;
+	this->Finished=1;
+	this->Function=NULL;
+	this->Data=NULL;
+}
+
+//----------------------------------------------------------------------------
+BackgroundTask::~BackgroundTask()
+{
+	this->Wait();
+	this->Lock->Delete();
+	this->Threader->Delete();
+}
+
+//----------------------------------------------------------------------------
+int BackgroundTask::Start(TaskFunction function,void* data)
+{
+	if(this->IsRunning())
+		{
+		return 0;
+		}
+	// join the finished thread before reusing its slot
+	this->Wait();
+	this->Function=function;
+	this->Data=data;
+	this->Finished=0;
+	this->ThreadId=this->Threader->SpawnThread(BackgroundTask::Run,this);
+	if(this->ThreadId < 0)
+		{
+		// no thread to spare, so there is no background
+		this->ThreadId=-1;
+		this->Finished=1;
+		return 0;
+		}
+	return 1;
+}
+
+//----------------------------------------------------------------------------
+int BackgroundTask::IsStarted()
+{
+	return this->ThreadId >= 0;
+}
+
+//----------------------------------------------------------------------------
+int BackgroundTask::IsRunning()
+{
+	this->Lock->Lock();
+	const int running=!this->Finished;
+	this->Lock->Unlock();
+	return running;
+}
+
+//----------------------------------------------------------------------------
+void BackgroundTask::Wait()
+{
+	if(this->ThreadId >= 0)
+		{
+		// joins the thread
+		this->Threader->TerminateThread(this->ThreadId);
+		this->ThreadId=-1;
+		}
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE BackgroundTask::Run(void* arg)
+{
+	BackgroundTask* self=static_cast<BackgroundTask*>(
+		static_cast<vtkMultiThreader::ThreadInfo*>(arg)->UserData);
+	self->Function(self->Data);
+	self->Lock->Lock();
+	self->Finished=1;
+	self->Lock->Unlock();
+	return VTK_THREAD_RETURN_VALUE;
+}
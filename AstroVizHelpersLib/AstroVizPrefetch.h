@@ -0,0 +1,77 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizPrefetch.h,v $
+
+  Copyright (c) Christine Corbett Moran
+  All rights reserved.
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME AstroVizPrefetch
+// .SECTION Description
+// Helpers for readers of snapshot series: choosing the snapshot for a
+// requested time, and running one task, such as reading the next
+// snapshot, on a background thread while the current one is being looked
+// at. The task must not use the pipeline, a vtkMultiProcessController, or
+// anything else which the main thread may be using at the same time.
+#ifndef __AstroVizPrefetch_h
+#define __AstroVizPrefetch_h
+#include "vtkMultiThreader.h"
+#include <vtkstd/string>
+#include <vtkstd/vector>
+class vtkMutexLock;
+
+// Description:
+// returns the index of the time step to show for the requested time,
+// the last one not after it, or 0 if the time is before the first.
+// times must be increasing.
+int FindTimeStep(const vtkstd::vector<double>& times,double time);
+
+// Description:
+// returns the time step after step when stepping forward, or the one
+// before when stepping back from previousStep, or -1 if there is none.
+int NextTimeStep(int numberOfSteps,int step,int previousStep);
+
+// Description:
+// reads the files through so that they are in the page cache when they
+// are next opened
+void WarmFiles(const vtkstd::vector<vtkstd::string>& fileNames);
+
+// Description:
+// Runs one function at a time on a thread of its own.
+class BackgroundTask
+{
+public:
+	typedef void (*TaskFunction)(void* data);
+	BackgroundTask();
+	// Description:
+	// waits for the running task, if any
+	~BackgroundTask();
+	// Description:
+	// starts function(data) in the background and returns 1, or returns 0
+	// if the previous task is still running.
+	int Start(TaskFunction function,void* data);
+	// Description:
+	// returns 1 if a task was started and has not been waited for
+	int IsStarted();
+	// Description:
+	// returns 1 if a task was started and has not finished
+	int IsRunning();
+	// Description:
+	// blocks until the task started last has finished
+	void Wait();
+private:
+	static VTK_THREAD_RETURN_TYPE Run(void* arg);
+	vtkMultiThreader* Threader;
+	vtkMutexLock* Lock;
+	int ThreadId;
+	int Finished;
+	TaskFunction Function;
+	void* Data;
+	BackgroundTask(const BackgroundTask&); // Not implemented
+	void operator=(const BackgroundTask&); // Not implemented
+};
+#endif
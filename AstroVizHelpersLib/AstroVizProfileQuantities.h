@@ -0,0 +1,192 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizProfileQuantities.h,v $
+
+  Copyright (c) Christine Corbett Moran
+  All rights reserved.
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME AstroVizProfileQuantities
+// .SECTION Description
+// The quantities profiled by vtkProfileFilter beyond the input arrays.
+// Each is a class with the number of components of the quantity and an
+// inline static Compute writing them to out.
+//
+// Those computed per particle, which also give their name, take its
+// velocity v and its radius r from the center; AccumulateProfileQuantity<Quantity> adds them up over a
+// batch of particles, so the filter calls through a pointer once per
+// batch and Compute is inlined into the loop over the particles.
+//
+// Those postprocessed take the values in a row of two columns of the
+// profile, argOne and argTwo, once the averages and cumulative values
+// are known, and are named as they are added, as one may be computed
+// from several pairs of columns.
+//
+// A new quantity needs only such a class, added to the filter with
+// vtkProfileFilter::AddProfileQuantity or AddPostprocessedProfileQuantity.
+#ifndef __AstroVizProfileQuantities_h
+#define __AstroVizProfileQuantities_h
+#include "vtkType.h"
+#include <cmath>
+
+//----------------------------------------------------------------------------
+// Description:
+// adds Quantity of particle i, of velocity v[3*i] and radius r[3*i], to
+// the components at accumulators[rowOffsets[i]], for each of numPoints
+template<class Quantity>
+void AccumulateProfileQuantity(const double* v,const double* r,
+	const vtkIdType* rowOffsets,vtkIdType numPoints,double* accumulators)
+{
+	for(vtkIdType i = 0; i < numPoints; ++i)
+		{
+		double quantity[Quantity::NumberOfComponents];
+		Quantity::Compute(v+3*i,r+3*i,quantity);
+		double* row=accumulators+rowOffsets[i];
+		for(int comp = 0; comp < Quantity::NumberOfComponents; ++comp)
+			{
+			row[comp]+=quantity[comp];
+			}
+		}
+}
+
+//----------------------------------------------------------------------------
+// Description:
+// the projection of v onto r; 0 for a particle at the center, where r
+// has no direction
+class RadialVelocityQuantity
+{
+public:
+	enum { NumberOfComponents=3 };
+	static const char* GetName() { return "radial velocity"; }
+	static void Compute(const double v[3],const double r[3],double* out)
+		{
+		const double r2=r[0]*r[0]+r[1]*r[1]+r[2]*r[2];
+		const double scale=(r2 > 0) ? (v[0]*r[0]+v[1]*r[1]+v[2]*r[2])/r2 : 0;
+		out[0]=scale*r[0];
+		out[1]=scale*r[1];
+		out[2]=scale*r[2];
+		}
+};
+
+//----------------------------------------------------------------------------
+// Description:
+// v less its radial velocity
+class TangentialVelocityQuantity
+{
+public:
+	enum { NumberOfComponents=3 };
+	static const char* GetName() { return "tangential velocity"; }
+	static void Compute(const double v[3],const double r[3],double* out)
+		{
+		RadialVelocityQuantity::Compute(v,r,out);
+		out[0]=v[0]-out[0];
+		out[1]=v[1]-out[1];
+		out[2]=v[2]-out[2];
+		}
+};
+
+//----------------------------------------------------------------------------
+// Description:
+// the specific angular momentum, as v x r
+class AngularMomentumQuantity
+{
+public:
+	enum { NumberOfComponents=3 };
+	static const char* GetName() { return "angular momentum"; }
+	static void Compute(const double v[3],const double r[3],double* out)
+		{
+		out[0]=v[1]*r[2]-v[2]*r[1];
+		out[1]=v[2]*r[0]-v[0]*r[2];
+		out[2]=v[0]*r[1]-v[1]*r[0];
+		}
+};
+
+//----------------------------------------------------------------------------
+class VelocitySquaredQuantity
+{
+public:
+	enum { NumberOfComponents=1 };
+	static const char* GetName() { return "velocity squared"; }
+	static void Compute(const double v[3],const double*,double* out)
+		{
+		out[0]=v[0]*v[0]+v[1]*v[1]+v[2]*v[2];
+		}
+};
+
+//----------------------------------------------------------------------------
+class RadialVelocitySquaredQuantity
+{
+public:
+	enum { NumberOfComponents=1 };
+	static const char* GetName() { return "radial velocity squared"; }
+	static void Compute(const double v[3],const double r[3],double* out)
+		{
+		double vRad[3];
+		RadialVelocityQuantity::Compute(v,r,vRad);
+		out[0]=vRad[0]*vRad[0]+vRad[1]*vRad[1]+vRad[2]*vRad[2];
+		}
+};
+
+//----------------------------------------------------------------------------
+class TangentialVelocitySquaredQuantity
+{
+public:
+	enum { NumberOfComponents=1 };
+	static const char* GetName() { return "tangential velocity squared"; }
+	static void Compute(const double v[3],const double r[3],double* out)
+		{
+		double vTan[3];
+		TangentialVelocityQuantity::Compute(v,r,vTan);
+		out[0]=vTan[0]*vTan[0]+vTan[1]*vTan[1]+vTan[2]*vTan[2];
+		}
+};
+
+//----------------------------------------------------------------------------
+// Description:
+// from the average of a velocity squared, argOne, and the average of
+// that velocity, argTwo, the dispersion in each component
+class VelocityDispersionQuantity
+{
+public:
+	enum { NumberOfComponents=3 };
+	static void Compute(const double* argOne,const double* argTwo,double* out)
+		{
+		for(int comp = 0; comp < 3; ++comp)
+			{
+			out[comp]=sqrt(fabs(argOne[0]-argTwo[comp]*argTwo[comp]));
+			}
+		}
+};
+
+//----------------------------------------------------------------------------
+// Description:
+// from the cumulative mass, argOne, and the bin radius, argTwo
+class CircularVelocityQuantity
+{
+public:
+	enum { NumberOfComponents=1 };
+	static void Compute(const double* argOne,const double* argTwo,double* out)
+		{
+		out[0]=argOne[0]/argTwo[0];
+		}
+};
+
+//----------------------------------------------------------------------------
+// Description:
+// from the cumulative mass, argOne, and the bin radius, argTwo, the mean
+// density within the bin radius
+class DensityQuantity
+{
+public:
+	enum { NumberOfComponents=1 };
+	static void Compute(const double* argOne,const double* argTwo,double* out)
+		{
+		out[0]=argOne[0]/(4./3*3.14159265358979323846*
+			argTwo[0]*argTwo[0]*argTwo[0]);
+		}
+};
+#endif
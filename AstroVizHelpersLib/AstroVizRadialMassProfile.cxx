@@ -0,0 +1,272 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizRadialMassProfile.cxx,v $
+=========================================================================*/
+#include "AstroVizRadialMassProfile.h"
+#include "AstroVizHelpers.h"
+#include "vtkCommunicator.h"
+#include "vtkDataArray.h"
+#include "vtkMath.h"
+#include "vtkMultiProcessController.h"
+#include "vtkPointData.h"
+#include "vtkPointSet.h"
+#include <cmath>
+#include <vtkstd/algorithm>
+#include <vtkstd/utility>
+
+//----------------------------------------------------------------------------
+bool RadialMassProfile::Build(vtkPointSet* dataSet,const char* massArrayName,
+	const double center[3])
+{
+	this->Radii.clear();
+	this->CumulativeMass.clear();
+	this->Ids.clear();
+	vtkDataArray* massArray=dataSet->GetPointData()->GetArray(massArrayName);
+	if(!massArray)
+		{
+		return false;
+		}
+	const vtkIdType numPoints=dataSet->GetNumberOfPoints();
+	vtkstd::vector<vtkstd::pair<double,vtkIdType> > byRadius(numPoints);
+	for(vtkIdType id = 0; id < numPoints; ++id)
+		{
+		double x[3];
+		dataSet->GetPoint(id,x);
+		byRadius[id].first=sqrt(vtkMath::Distance2BetweenPoints(x,center));
+		byRadius[id].second=id;
+		}
+	vtkstd::sort(byRadius.begin(),byRadius.end());
+	this->Radii.resize(numPoints);
+	this->CumulativeMass.resize(numPoints);
+	this->Ids.resize(numPoints);
+	double mass=0;
+	for(vtkIdType i = 0; i < numPoints; ++i)
+		{
+		this->Radii[i]=byRadius[i].first;
+		this->Ids[i]=byRadius[i].second;
+		mass+=massArray->GetComponent(this->Ids[i],0);
+		this->CumulativeMass[i]=mass;
+		}
+	return true;
+}
+
+//----------------------------------------------------------------------------
+vtkIdType RadialMassProfile::GetNumberWithinRadius(double r) const
+{
+	return vtkstd::upper_bound(this->Radii.begin(),this->Radii.end(),r)-
+		this->Radii.begin();
+}
+
+//----------------------------------------------------------------------------
+double RadialMassProfile::GetMassWithinRadius(double r) const
+{
+	const vtkIdType number=this->GetNumberWithinRadius(r);
+	return number > 0 ? this->CumulativeMass[number-1] : 0;
+}
+
+//----------------------------------------------------------------------------
+double RadialMassProfile::FindOverdensityRadius(
+	vtkMultiProcessController* controller,double density,
+	double rMin,double rMax) const
+{
+	vtkstd::vector<double> radii;
+	this->FindOverdensityRadii(controller,vtkstd::vector<double>(1,density),
+		rMin,rMax,radii);
+	return radii[0];
+}
+
+//----------------------------------------------------------------------------
+void RadialMassProfile::FindOverdensityRadii(
+	vtkMultiProcessController* controller,
+	const vtkstd::vector<double>& densities,double rMin,double rMax,
+	vtkstd::vector<double>& radii) const
+{
+	const bool parallel=RunInParallel(controller);
+	const size_t numDensities=densities.size();
+	radii.assign(numDensities,-1);
+	if(rMax <= rMin)
+		{
+		return;
+		}
+	// with no point within rMin, as when the center is off any particle,
+	// there is no mass within it; the density within first rises at the
+	// nearest point, so the search starts there
+	double nearestRadius=this->Radii.empty() ? VTK_DOUBLE_MAX : this->Radii[0];
+	if(parallel)
+		{
+		double localNearestRadius=nearestRadius;
+		controller->AllReduce(&localNearestRadius,&nearestRadius,1,
+			vtkCommunicator::MIN_OP);
+		}
+	if(nearestRadius > rMax)
+		{
+		return;
+		}
+	rMin=vtkstd::max(rMin,nearestRadius);
+	// the bracket of each density, from a where the density within is
+	// above it to b where it has fallen to it, is split into numIntervals a
+	// round, evenly in log r as density profiles are steep
+	const int numIntervals=64;
+	const int numEdges=numIntervals+1;
+	vtkstd::vector<double> a(numDensities,rMin);
+	vtkstd::vector<double> b(numDensities,rMax);
+	vtkstd::vector<double> massA(numDensities,0);
+	vtkstd::vector<double> massB(numDensities,0);
+	vtkstd::vector<double> numberInBracket(numDensities,0);
+	// SEARCHING while the bracket is refined, FOUND once it can be solved,
+	// NOT_FOUND if the density is never crossed between rMin and rMax
+	enum { SEARCHING, FOUND, NOT_FOUND };
+	vtkstd::vector<int> state(numDensities,SEARCHING);
+	for(size_t j = 0; j < numDensities; ++j)
+		{
+		if(densities[j] <= 0)
+			{
+			state[j]=NOT_FOUND;
+			}
+		}
+	vtkstd::vector<size_t> searching;
+	vtkstd::vector<double> edges;
+	// for each edge of each bracket searched, the mass and the number of
+	// points within it
+	vtkstd::vector<double> local;
+	vtkstd::vector<double> sums;
+	for(int round = 0; round < 64; ++round)
+		{
+		searching.clear();
+		for(size_t j = 0; j < numDensities; ++j)
+			{
+			if(state[j]==SEARCHING)
+				{
+				searching.push_back(j);
+				}
+			}
+		if(searching.empty())
+			{
+			break;
+			}
+		edges.resize(searching.size()*numEdges);
+		local.resize(2*edges.size());
+		sums.resize(local.size());
+		for(size_t m = 0; m < searching.size(); ++m)
+			{
+			const size_t j=searching[m];
+			double* bracketEdges=&edges[m*numEdges];
+			for(int k = 0; k < numEdges; ++k)
+				{
+				bracketEdges[k]=(a[j] > 0) ? 
+					a[j]*pow(b[j]/a[j],double(k)/numIntervals) :
+					a[j]+(b[j]-a[j])*k/numIntervals;
+				}
+			bracketEdges[numIntervals]=b[j];
+			for(int k = 0; k < numEdges; ++k)
+				{
+				const double r=bracketEdges[k];
+				local[2*(m*numEdges+k)]=this->GetMassWithinRadius(r);
+				local[2*(m*numEdges+k)+1]=this->GetNumberWithinRadius(r);
+				}
+			}
+		// the brackets of every density searched in one reduction
+		if(parallel)
+			{
+			controller->AllReduce(&local[0],&sums[0],local.size(),
+				vtkCommunicator::SUM_OP);
+			}
+		else
+			{
+			sums=local;
+			}
+		for(size_t m = 0; m < searching.size(); ++m)
+			{
+			const size_t j=searching[m];
+			const double* bracketEdges=&edges[m*numEdges];
+			const double* bracketSums=&sums[2*m*numEdges];
+			// the mean density within r exceeds densities[j] while the mass
+			// within it exceeds massPerVolume*r^3
+			const double massPerVolume=4./3*vtkMath::Pi()*densities[j];
+			int k=1;
+			if(round==0)
+				{
+				// the density within may have to rise above densities[j], where
+				// the nearest points are sparse, before it can fall to it
+				int above=0;
+				while(above < numEdges && bracketSums[2*above] <= 
+					massPerVolume*pow(bracketEdges[above],3))
+					{
+					++above;
+					}
+				if(above==numEdges)
+					{
+					// never above it between rMin and rMax
+					state[j]=NOT_FOUND;
+					continue;
+					}
+				k=above+1;
+				}
+			while(k < numEdges && 
+				bracketSums[2*k] > massPerVolume*pow(bracketEdges[k],3))
+				{
+				++k;
+				}
+			if(k==numEdges)
+				{
+				// still above the density at rMax
+				state[j]=NOT_FOUND;
+				continue;
+				}
+			a[j]=bracketEdges[k-1];
+			b[j]=bracketEdges[k];
+			massA[j]=bracketSums[2*(k-1)];
+			massB[j]=bracketSums[2*k];
+			numberInBracket[j]=bracketSums[2*k+1]-bracketSums[2*k-1];
+			// done once the mass within only changes once in the bracket, or
+			// the bracket can't be split further, as for points at the same
+			// radius
+			if(numberInBracket[j] <= 1 || b[j] <= a[j]*(1+1e-12))
+				{
+				state[j]=FOUND;
+				}
+			}
+		}
+	// the first point beyond a in each bracket
+	vtkstd::vector<double> firstRadius(numDensities,VTK_DOUBLE_MAX);
+	for(size_t j = 0; j < numDensities; ++j)
+		{
+		if(state[j]!=NOT_FOUND)
+			{
+			const vtkIdType next=this->GetNumberWithinRadius(a[j]);
+			firstRadius[j]=(next < vtkIdType(this->Radii.size()) &&
+				this->Radii[next] <= b[j]) ? this->Radii[next] : b[j];
+			}
+		}
+	if(parallel && numDensities > 0)
+		{
+		vtkstd::vector<double> localFirstRadius(firstRadius);
+		controller->AllReduce(&localFirstRadius[0],&firstRadius[0],
+			numDensities,vtkCommunicator::MIN_OP);
+		}
+	for(size_t j = 0; j < numDensities; ++j)
+		{
+		if(state[j]==NOT_FOUND)
+			{
+			continue;
+			}
+		// up to the first point beyond a the mass within is massA, and the
+		// density within falls to densities[j] at
+		const double massPerVolume=4./3*vtkMath::Pi()*densities[j];
+		radii[j]=pow(massA[j]/massPerVolume,1./3);
+		if(numberInBracket[j] > 0 && radii[j] >= firstRadius[j])
+			{
+			// not before that point, beyond which the mass within is massB
+			radii[j]=pow(massB[j]/massPerVolume,1./3);
+			}
+		}
+}
+
+//----------------------------------------------------------------------------
+void RadialMassProfile::GetPointsWithinRadius(double r,
+	vtkstd::vector<vtkIdType>& ids) const
+{
+	ids.assign(this->Ids.begin(),
+		this->Ids.begin()+this->GetNumberWithinRadius(r));
+}
@@ -0,0 +1,74 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizRadialMassProfile.h,v $
+
+  Copyright (c) Christine Corbett Moran
+  All rights reserved.
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME AstroVizRadialMassProfile
+// .SECTION Description
+// The points of a piece sorted once by their distance from a center, with
+// the mass within each, so the mass and number of points within any
+// radius are a binary search away.
+//
+// FindOverdensityRadius finds where the mean density within a sphere
+// about the center falls to a given density, over the pieces of every
+// process. It brackets the crossing on a grid of radii, the masses within
+// which are summed over the processes in one AllReduce, and refines the
+// bracket on a finer grid until it holds at most one point, between
+// which and the ends the mass is constant and the radius is exact.
+// FindOverdensityRadii does so for many densities at once, the brackets
+// of all of them summed in the same reduction each round.
+#ifndef __AstroVizRadialMassProfile_h
+#define __AstroVizRadialMassProfile_h
+#include "vtkType.h"
+#include <vtkstd/vector>
+class vtkMultiProcessController;
+class vtkPointSet;
+
+class RadialMassProfile
+{
+public:
+	// Description:
+	// sorts the points of dataSet by their distance from center, the mass
+	// of each the first component of its massArrayName array. Returns
+	// false if dataSet has no such array.
+	bool Build(vtkPointSet* dataSet,const char* massArrayName,
+		const double center[3]);
+	// Description:
+	// the mass, and the number of points, within r on this process
+	double GetMassWithinRadius(double r) const;
+	vtkIdType GetNumberWithinRadius(double r) const;
+	// Description:
+	// the radius between rMin and rMax at which the mean density within
+	// it first falls to density, having been above it, or -1 if it is never
+	// found to there. With no point within rMin the search starts at the
+	// nearest point, where the density within first rises. The
+	// crossing is the first found at an edge of the grid, so a dip below
+	// density between two edges, from the gap between two points, may be
+	// passed over for the next.
+	// Collective: every process of controller, if it is run in parallel,
+	// must call it.
+	double FindOverdensityRadius(vtkMultiProcessController* controller,
+		double density,double rMin,double rMax) const;
+	// Description:
+	// as FindOverdensityRadius, radii[j] that of densities[j]
+	void FindOverdensityRadii(vtkMultiProcessController* controller,
+		const vtkstd::vector<double>& densities,double rMin,double rMax,
+		vtkstd::vector<double>& radii) const;
+	// Description:
+	// the ids of the points of this process within r
+	void GetPointsWithinRadius(double r,vtkstd::vector<vtkIdType>& ids) const;
+private:
+	// the distance from the center of each point, ascending, with the mass
+	// within it, its own included, and the point's id
+	vtkstd::vector<double> Radii;
+	vtkstd::vector<double> CumulativeMass;
+	vtkstd::vector<vtkIdType> Ids;
+};
+#endif
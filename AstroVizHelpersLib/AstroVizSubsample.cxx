@@ -0,0 +1,131 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizSubsample.cxx,v $
+=========================================================================*/
+#include "AstroVizSubsample.h"
+#include "vtkCellArray.h"
+#include "vtkDataArray.h"
+#include "vtkIdTypeArray.h"
+#include "vtkPointData.h"
+#include "vtkPoints.h"
+#include "vtkPolyData.h"
+
+//----------------------------------------------------------------------------
+double SubsampleKey(vtkTypeUInt64 index,int mode)
+{
+	// 2^64 divided by the golden ratio; multiples of it modulo 2^64 are the
+	// most evenly spread sequence there is
+	vtkTypeUInt64 key=index*0x9E3779B97F4A7C15ULL;
+	if(mode==SUBSAMPLE_RANDOM)
+		{
+		// splitmix64 finalizer
+		key=(key ^ (key >> 30))*0xBF58476D1CE4E5B9ULL;
+		key=(key ^ (key >> 27))*0x94D049BB133111EBULL;
+		key=key ^ (key >> 31);
+		}
+	// the top 53 bits as a double in [0,1)
+	return (key >> 11)*(1.0/9007199254740992.0);
+}
+
+//----------------------------------------------------------------------------
+vtkIdType SubsamplePolyData(vtkPolyData* input,vtkIdTypeArray* inputIds,
+	double fraction,int mode,double massScale,vtkPolyData* output,
+	vtkIdTypeArray* outputIds)
+{
+	const vtkIdType numInput=input->GetNumberOfPoints();
+	vtkSmartPointer<vtkIdTypeArray> kept = \
+		vtkSmartPointer<vtkIdTypeArray>::New();
+	kept->Allocate(vtkIdType(numInput*fraction)+1);
+	for(vtkIdType i=0; i < numInput; ++i)
+		{
+		if(InSubsample(inputIds->GetValue(i),fraction,mode))
+			{
+			kept->InsertNextValue(i);
+			}
+		}
+	const vtkIdType numKept=kept->GetNumberOfTuples();
+	vtkSmartPointer<vtkPoints> points=vtkSmartPointer<vtkPoints>::New();
+	points->SetDataTypeToFloat();
+	points->SetNumberOfPoints(numKept);
+	vtkSmartPointer<vtkCellArray> vertices = \
+		vtkSmartPointer<vtkCellArray>::New();
+	vtkIdType *cells=vertices->WritePointer(numKept,numKept*2);
+	output->GetPointData()->CopyAllocate(input->GetPointData(),numKept);
+	outputIds->SetNumberOfTuples(numKept);
+	for(vtkIdType i=0; i < numKept; ++i)
+		{
+		const vtkIdType from=kept->GetValue(i);
+		points->SetPoint(i,input->GetPoint(from));
+		output->GetPointData()->CopyData(input->GetPointData(),from,i);
+		outputIds->SetValue(i,inputIds->GetValue(from));
+		cells[i*2]   = 1;
+		cells[i*2+1] = i;
+		}
+	output->SetPoints(points);
+	output->SetVerts(vertices);
+	output->SetFieldData(input->GetFieldData());
+	vtkDataArray* mass=output->GetPointData()->GetArray("mass");
+	if(mass && massScale!=1.0)
+		{
+		for(vtkIdType i=0; i < numKept; ++i)
+			{
+			mass->SetTuple1(i,mass->GetTuple1(i)*massScale);
+			}
+		}
+	return numKept;
+}
+
+//----------------------------------------------------------------------------
+SubsampleCache::SubsampleCache()
+{
+	this->Fraction=0.0;
+}
+
+//----------------------------------------------------------------------------
+int SubsampleCache::Extract(const vtkstd::string& key,double fraction,
+	int mode,vtkPolyData* output)
+{
+	if(!this->Data || key!=this->Key || fraction > this->Fraction)
+		{
+		return 0;
+		}
+	if(fraction==this->Fraction)
+		{
+		output->ShallowCopy(this->Data);
+		return 1;
+		}
+	// the cached masses were scaled by 1/Fraction, they need 1/fraction
+	vtkSmartPointer<vtkIdTypeArray> ids=vtkSmartPointer<vtkIdTypeArray>::New();
+	vtkSmartPointer<vtkPolyData> subsample=vtkSmartPointer<vtkPolyData>::New();
+	SubsamplePolyData(this->Data,this->Ids,fraction,mode,
+		this->Fraction/fraction,subsample,ids);
+	output->ShallowCopy(subsample);
+	return 1;
+}
+
+//----------------------------------------------------------------------------
+void SubsampleCache::Store(const vtkstd::string& key,double fraction,
+	vtkPolyData* output,vtkIdTypeArray* ids)
+{
+	this->Clear();
+	if(fraction >= 1.0 || !ids || 
+		ids->GetNumberOfTuples()!=output->GetNumberOfPoints())
+		{
+		return;
+		}
+	this->Key=key;
+	this->Fraction=fraction;
+	this->Data=vtkSmartPointer<vtkPolyData>::New();
+	this->Data->ShallowCopy(output);
+	this->Ids=ids;
+}
+
+//----------------------------------------------------------------------------
+void SubsampleCache::Clear()
+{
+	this->Key.clear();
+	this->Fraction=0.0;
+	this->Data=NULL;
+	this->Ids=NULL;
+}
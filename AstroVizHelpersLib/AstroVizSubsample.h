@@ -0,0 +1,92 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizSubsample.h,v $
+
+  Copyright (c) Christine Corbett Moran
+  All rights reserved.
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME AstroVizSubsample
+// .SECTION Description
+// Level of detail subsampling shared by the particle readers. Whether a
+// particle is loaded depends only on its index and the requested fraction:
+// each index has a key in [0,1) and is kept if the key is below the
+// fraction. The subsample for a smaller fraction is therefore contained in
+// the subsample for any larger one, which lets a reader serve a lowered
+// fraction from what it has already read.
+// Kept in its own header as the readers define array allocation helpers
+// whose names clash with those in AstroVizHelpers.h.
+#ifndef __AstroVizSubsample_h
+#define __AstroVizSubsample_h
+#include "vtkType.h"
+#include "vtkSmartPointer.h"
+#include <vtkstd/string>
+class vtkPolyData;
+class vtkIdTypeArray;
+
+enum SubsampleMode
+{
+	// keys are the golden ratio (Weyl) sequence, so about one particle in
+	// every 1/fraction consecutive indices is kept, at a near fixed spacing
+	SUBSAMPLE_STRIDE,
+	// keys are a hash of the index, so particles are kept independently
+	// and uncorrelated with any ordering of the file
+	SUBSAMPLE_RANDOM
+};
+
+// Description:
+// returns the key in [0,1) of the particle with index index
+double SubsampleKey(vtkTypeUInt64 index,int mode);
+
+// Description:
+// returns true if the particle with index index is in the subsample
+// of the given fraction. Everything is in a subsample of fraction >= 1.
+inline bool InSubsample(vtkTypeUInt64 index,double fraction,int mode)
+{
+	return fraction >= 1.0 || SubsampleKey(index,mode) < fraction;
+}
+
+// Description:
+// Copies into output the points of input, and their point data, whose
+// global index (the matching entry of inputIds) is in the subsample of
+// fraction. The array named "mass" is multiplied by massScale. The global
+// indices of the copied points are placed in outputIds. Returns the number
+// of points copied.
+vtkIdType SubsamplePolyData(vtkPolyData* input,vtkIdTypeArray* inputIds,
+	double fraction,int mode,double massScale,vtkPolyData* output,
+	vtkIdTypeArray* outputIds);
+
+// Description:
+// Remembers the last subsampled output of a reader. When only the
+// fraction has been lowered since, the new output is taken from it
+// instead of being read again. The key identifies everything else the
+// output depends on (file, piece, selected arrays, mode ...).
+class SubsampleCache
+{
+public:
+	SubsampleCache();
+	// Description:
+	// if the cache holds a read with the same key and a fraction at least
+	// as large, fills output from it and returns 1, otherwise returns 0.
+	int Extract(const vtkstd::string& key,double fraction,int mode,
+		vtkPolyData* output);
+	// Description:
+	// remembers output, read with the given key and fraction, where ids are
+	// the global indices of its points. Reads of every particle are not
+	// worth keeping and just empty the cache.
+	void Store(const vtkstd::string& key,double fraction,vtkPolyData* output,
+		vtkIdTypeArray* ids);
+	// Description:
+	// forgets the cached output
+	void Clear();
+private:
+	vtkstd::string Key;
+	double Fraction;
+	vtkSmartPointer<vtkPolyData> Data;
+	vtkSmartPointer<vtkIdTypeArray> Ids;
+};
+#endif
@@ -0,0 +1,88 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizUnionFind.cxx,v $
+=========================================================================*/
+#include "AstroVizUnionFind.h"
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+namespace
+{
+// reads a link as it is now, not as an earlier read left it
+inline vtkIdType LoadLink(const vtkIdType* link)
+{
+	return *static_cast<const volatile vtkIdType*>(link);
+}
+
+// sets *link to next if it is still expected, and says whether it was
+inline bool SwapLink(vtkIdType* link,vtkIdType expected,vtkIdType next)
+{
+#ifdef _WIN32
+	return InterlockedCompareExchange64(reinterpret_cast<LONGLONG*>(link),
+		next,expected)==expected;
+#else
+	return __sync_bool_compare_and_swap(link,expected,next);
+#endif
+}
+}
+
+//----------------------------------------------------------------------------
+void UnionFind::Initialize(vtkIdType numberOfIds)
+{
+	this->Parent.resize(numberOfIds);
+	for(vtkIdType id=0; id < numberOfIds; ++id)
+		{
+		this->Parent[id]=id;
+		}
+}
+
+//----------------------------------------------------------------------------
+vtkIdType UnionFind::Find(vtkIdType id)
+{
+	vtkIdType* parent=&this->Parent[0];
+	for(;;)
+		{
+		const vtkIdType up=LoadLink(parent+id);
+		if(up==id)
+			{
+			return id;
+			}
+		const vtkIdType upUp=LoadLink(parent+up);
+		if(upUp!=up)
+			{
+			// halving the path; if another thread got there first, its link
+			// is at least as short
+			SwapLink(parent+id,up,upUp);
+			}
+		id=upUp;
+		}
+}
+
+//----------------------------------------------------------------------------
+void UnionFind::Union(vtkIdType a,vtkIdType b)
+{
+	vtkIdType* parent=&this->Parent[0];
+	for(;;)
+		{
+		a=this->Find(a);
+		b=this->Find(b);
+		if(a==b)
+			{
+			return;
+			}
+		if(b < a)
+			{
+			const vtkIdType t=a;
+			a=b;
+			b=t;
+			}
+		// linking the higher root under the lower, unless it has stopped
+		// being a root, in which case we try again from the new roots
+		if(SwapLink(parent+b,b,a))
+			{
+			return;
+			}
+		}
+}
@@ -0,0 +1,44 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: AstroVizUnionFind.h,v $
+
+  Copyright (c) Christine Corbett Moran
+  All rights reserved.
+     This software is distributed WITHOUT ANY WARRANTY; without even
+     the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+     PURPOSE.  See the above copyright notice for more information.
+
+=========================================================================*/
+// .NAME AstroVizUnionFind
+// .SECTION Description
+// Disjoint sets of point ids, which many threads may join at once without
+// locks. Each set is a tree of parent links, changed only by compare and
+// swap: a root is linked under the other root of lower id, so the root of
+// a set is always its lowest id, and finds halve the path as they go.
+// Linking by id rather than by rank keeps a root a single word to swap,
+// and as points are joined in roughly spatial order the trees stay
+// shallow all the same.
+#ifndef __AstroVizUnionFind_h
+#define __AstroVizUnionFind_h
+#include "vtkType.h"
+#include <vtkstd/vector>
+
+class UnionFind
+{
+public:
+	// Description:
+	// makes each of numberOfIds ids a set of its own
+	void Initialize(vtkIdType numberOfIds);
+	vtkIdType GetNumberOfIds() const { return this->Parent.size(); }
+	// Description:
+	// returns the lowest id of the set of id. Safe to call while other
+	// threads call Union.
+	vtkIdType Find(vtkIdType id);
+	// Description:
+	// joins the sets of a and b
+	void Union(vtkIdType a,vtkIdType b);
+private:
+	vtkstd::vector<vtkIdType> Parent;
+};
+#endif
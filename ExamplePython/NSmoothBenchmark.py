@@ -0,0 +1,43 @@
+#!/usr/bin/python
+# Times the neighbor smoothing filter on the test snapshot, so builds can be
+# compared. Run with pvpython from the top of the source tree:
+#   pvpython ExamplePython/NSmoothBenchmark.py [plugin] [neighbors] [repeats]
+# and run it again with another build of the plugin; also prints a checksum
+# of the smoothed density so results can be checked to be identical.
+import sys
+import time
+from paraview.simple import *
+from paraview import servermanager
+
+plugin = len(sys.argv) > 1 and sys.argv[1] or 'libAstroVizPlugin.so'
+neighbors = len(sys.argv) > 2 and int(sys.argv[2]) or 32
+repeats = len(sys.argv) > 3 and int(sys.argv[3]) or 5
+
+if not servermanager.ActiveConnection:
+	connection = servermanager.Connect()
+servermanager.LoadPlugin(plugin)
+
+tipsyfile = servermanager.sources.TipsyReader(
+	FileName='Testing/b1.00300.d0-1000.std')
+tipsyfile.UpdatePipeline()
+
+smooth = servermanager.filters.NeighborSmooth(Input=tipsyfile)
+smooth.SelectInputArray = ['POINTS', 'mass']
+smooth.NeighborNumber = neighbors
+
+times = []
+for i in range(repeats):
+	# a new neighbor number forces the filter to execute again
+	smooth.NeighborNumber = neighbors + 1
+	smooth.UpdatePipeline()
+	smooth.NeighborNumber = neighbors
+	start = time.time()
+	smooth.UpdatePipeline()
+	times.append(time.time() - start)
+
+data = servermanager.Fetch(smooth)
+density = data.GetPointData().GetArray('smoothed density')
+checksum = sum([density.GetValue(i) for i in range(density.GetNumberOfTuples())])
+print 'NeighborNumber %d: best %.4f s, mean %.4f s over %d runs' % \
+	(neighbors, min(times), sum(times) / len(times), repeats)
+print 'smoothed density checksum %.17g' % checksum
@@ -13,7 +13,7 @@ VirialRadius1.ProbeType = "High Resolution Line Source"
 VirialRadius1.SelectInputArray = ['POINTS', 'mass']
 VirialRadius1.ProbeType = "Fixed Radius Point Source"
 VirialRadius1.Softening = 0.001
-VirialRadius1.Delta = 0.13
+VirialRadius1.Deltas = [0.13]
 
 my_representation1 = GetDisplayProperties(Glyph1)
 DataRepresentation11 = Show()
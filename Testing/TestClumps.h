@@ -0,0 +1,261 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: TestClumps.h,v $
+=========================================================================*/
+// Particles for the tests of the halo finders, the same on every run and
+// platform: haloes about fixed centers in the unit box, each a diffuse
+// cloud with denser subclumps moving at velocities of their own, over a
+// uniform background. The first halo is several times the size of the
+// blocks the finders hand their threads, so that they share it.
+#ifndef __TestClumps_h
+#define __TestClumps_h
+#include "vtkCellArray.h"
+#include "vtkFloatArray.h"
+#include "vtkIdTypeArray.h"
+#include "vtkPointData.h"
+#include "vtkPoints.h"
+#include "vtkPolyData.h"
+#include "vtkSmartPointer.h"
+#include <vtkstd/vector>
+#include <cmath>
+
+//----------------------------------------------------------------------------
+// A 64-bit linear congruential generator (Knuth's MMIX constants), so that
+// the particles do not depend on the platform's rand().
+class TestRandom
+{
+public:
+	TestRandom() : State(1) {}
+	// uniform in [0,1)
+	double Uniform()
+		{
+		this->State=this->State*6364136223846793005ULL+1442695040888963407ULL;
+		return (this->State >> 11)*(1.0/9007199254740992.0);
+		}
+	// normal with mean 0 and deviation 1, by Box-Muller
+	double Normal()
+		{
+		const double u=1.0-this->Uniform();
+		return sqrt(-2.0*log(u))*cos(6.283185307179586*this->Uniform());
+		}
+private:
+	unsigned long long State;
+};
+
+//----------------------------------------------------------------------------
+// The particles: position and velocity of each, and the index+1 of the
+// halo it was made part of, 0 for the background.
+class TestClumps
+{
+public:
+	vtkstd::vector<double> Positions;
+	vtkstd::vector<double> Velocities;
+	vtkstd::vector<vtkIdType> HaloIds;
+	vtkIdType GetNumberOfPoints() const { return this->HaloIds.size(); }
+	void Make()
+		{
+		TestRandom random;
+		const int numHaloes=40;
+		for(int h = 0; h < numHaloes; ++h)
+			{
+			double center[3];
+			double bulk[3];
+			for(int d = 0; d < 3; ++d)
+				{
+				center[d]=0.1+0.8*random.Uniform();
+				bulk[d]=random.Normal();
+				}
+			// the first halo sits across the middle of the box, where the
+			// pieces of two or four processes meet
+			if(h==0)
+				{
+				center[0]=center[1]=center[2]=0.5;
+				}
+			const int members=(h==0) ? 24000 : 400+(37*h*h)%2000;
+			const double sigma=(h==0) ? 0.03 : 0.004*pow(members/400.0,1./3);
+			const int numSubclumps=(h==0) ? 6 : h%3;
+			const int subclumpMembers=(h==0) ? 1500 : members/8;
+			this->AddClump(random,h+1,center,bulk,sigma,1.0,
+				members-numSubclumps*subclumpMembers);
+			for(int s = 0; s < numSubclumps; ++s)
+				{
+				double subCenter[3];
+				double subBulk[3];
+				for(int d = 0; d < 3; ++d)
+					{
+					subCenter[d]=center[d]+sigma*random.Normal();
+					subBulk[d]=bulk[d]+2.0*random.Normal();
+					}
+				this->AddClump(random,h+1,subCenter,subBulk,0.1*sigma,0.1,
+					subclumpMembers);
+				}
+			}
+		for(int i = 0; i < 20000; ++i)
+			{
+			for(int d = 0; d < 3; ++d)
+				{
+				this->Positions.push_back(random.Uniform());
+				this->Velocities.push_back(random.Normal());
+				}
+			this->HaloIds.push_back(0);
+			}
+		}
+	// Description:
+	// A data set of the particles of ids, with a "velocity" array, a
+	// "halo ID" array and their index among all the particles in a
+	// "global id" array.
+	vtkSmartPointer<vtkPolyData> NewDataSet(
+		const vtkstd::vector<vtkIdType>& ids) const
+		{
+		const vtkIdType numPoints=ids.size();
+		vtkSmartPointer<vtkPoints> points=vtkSmartPointer<vtkPoints>::New();
+		points->SetNumberOfPoints(numPoints);
+		vtkSmartPointer<vtkCellArray> vertices=
+			vtkSmartPointer<vtkCellArray>::New();
+		vtkSmartPointer<vtkFloatArray> velocity=
+			vtkSmartPointer<vtkFloatArray>::New();
+		velocity->SetName("velocity");
+		velocity->SetNumberOfComponents(3);
+		velocity->SetNumberOfTuples(numPoints);
+		vtkSmartPointer<vtkIdTypeArray> haloId=
+			vtkSmartPointer<vtkIdTypeArray>::New();
+		haloId->SetName("halo ID");
+		haloId->SetNumberOfTuples(numPoints);
+		vtkSmartPointer<vtkIdTypeArray> globalId=
+			vtkSmartPointer<vtkIdTypeArray>::New();
+		globalId->SetName("global id");
+		globalId->SetNumberOfTuples(numPoints);
+		for(vtkIdType i = 0; i < numPoints; ++i)
+			{
+			points->SetPoint(i,&this->Positions[3*ids[i]]);
+			vertices->InsertNextCell(1,&i);
+			velocity->SetTuple(i,&this->Velocities[3*ids[i]]);
+			haloId->SetValue(i,this->HaloIds[ids[i]]);
+			globalId->SetValue(i,ids[i]);
+			}
+		vtkSmartPointer<vtkPolyData> dataSet=vtkSmartPointer<vtkPolyData>::New();
+		dataSet->SetPoints(points);
+		dataSet->SetVerts(vertices);
+		dataSet->GetPointData()->AddArray(velocity);
+		dataSet->GetPointData()->AddArray(haloId);
+		dataSet->GetPointData()->AddArray(globalId);
+		return dataSet;
+		}
+private:
+	// adds a clump of members particles normally distributed about center
+	// with deviation sigma, and in velocity about bulk with dispersion
+	void AddClump(TestRandom& random,vtkIdType haloId,const double center[3],
+		const double bulk[3],double sigma,double dispersion,int members)
+		{
+		for(int i = 0; i < members; ++i)
+			{
+			for(int d = 0; d < 3; ++d)
+				{
+				this->Positions.push_back(center[d]+sigma*random.Normal());
+				this->Velocities.push_back(bulk[d]+dispersion*random.Normal());
+				}
+			this->HaloIds.push_back(haloId);
+			}
+		}
+};
+
+//----------------------------------------------------------------------------
+// Friends-of-friends groups of the points of x, by brute force over a grid
+// of cells a linking length wide rather than through a tree, labelled as
+// vtkFriendsOfFriendsHaloFinder labels them: by the index+1 of their first
+// point, 0 for groups of fewer than minimumNumberOfParticles.
+inline void FindGroupsOnGrid(const vtkstd::vector<double>& x,
+	double linkingLength,int minimumNumberOfParticles,
+	vtkstd::vector<vtkIdType>& labels)
+{
+	const vtkIdType numPoints=x.size()/3;
+	double lower[3]={x[0],x[1],x[2]};
+	for(vtkIdType i = 0; i < numPoints; ++i)
+		{
+		for(int d = 0; d < 3; ++d)
+			{
+			lower[d]=(x[3*i+d] < lower[d]) ? x[3*i+d] : lower[d];
+			}
+		}
+	// the points of each cell, listed through the first of each cell
+	const long long numCells=1LL << 21;
+	vtkstd::vector<vtkIdType> firstOfCell(numCells,-1);
+	vtkstd::vector<vtkIdType> nextInCell(numPoints,-1);
+	vtkstd::vector<long long> cell(3*numPoints);
+	for(vtkIdType i = 0; i < numPoints; ++i)
+		{
+		for(int d = 0; d < 3; ++d)
+			{
+			cell[3*i+d]=(long long)((x[3*i+d]-lower[d])/linkingLength);
+			}
+		const long long c=((cell[3*i]*73856093LL)^(cell[3*i+1]*19349663LL)^
+			(cell[3*i+2]*83492791LL))&(numCells-1);
+		nextInCell[i]=firstOfCell[c];
+		firstOfCell[c]=i;
+		}
+	// the root of each set, its lowest point
+	vtkstd::vector<vtkIdType> parent(numPoints);
+	for(vtkIdType i = 0; i < numPoints; ++i)
+		{
+		parent[i]=i;
+		}
+	const double linkingLength2=linkingLength*linkingLength;
+	for(vtkIdType i = 0; i < numPoints; ++i)
+		{
+		for(int n = 0; n < 27; ++n)
+			{
+			const long long c0=cell[3*i]+n%3-1;
+			const long long c1=cell[3*i+1]+(n/3)%3-1;
+			const long long c2=cell[3*i+2]+n/9-1;
+			const long long c=((c0*73856093LL)^(c1*19349663LL)^(c2*83492791LL))&
+				(numCells-1);
+			for(vtkIdType j = firstOfCell[c]; j >= 0; j=nextInCell[j])
+				{
+				double r2=0;
+				for(int d = 0; d < 3; ++d)
+					{
+					r2+=(x[3*i+d]-x[3*j+d])*(x[3*i+d]-x[3*j+d]);
+					}
+				if(j <= i || r2 > linkingLength2)
+					{
+					continue;
+					}
+				vtkIdType a=i;
+				vtkIdType b=j;
+				while(parent[a]!=a)
+					{
+					a=parent[a];
+					}
+				while(parent[b]!=b)
+					{
+					b=parent[b];
+					}
+				if(a < b)
+					{
+					parent[b]=a;
+					}
+				else if(b < a)
+					{
+					parent[a]=b;
+					}
+				}
+			}
+		}
+	vtkstd::vector<vtkIdType> count(numPoints,0);
+	for(vtkIdType i = 0; i < numPoints; ++i)
+		{
+		while(parent[parent[i]]!=parent[i])
+			{
+			parent[i]=parent[parent[i]];
+			}
+		++count[parent[i]];
+		}
+	labels.resize(numPoints);
+	for(vtkIdType i = 0; i < numPoints; ++i)
+		{
+		labels[i]=(count[parent[i]] >= minimumNumberOfParticles) ?
+			parent[i]+1 : 0;
+		}
+}
+#endif
@@ -0,0 +1,91 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: TestFriendsOfFriendsMerge.cxx,v $
+=========================================================================*/
+// Splits the clumps of TestClumps.h into a slab in x per process, with
+// the largest halo across the middle, and finds the friends-of-friends
+// haloes in parallel, merging the groups linked across pieces. Compares
+// the halo ID of every particle with that of a serial search of all the
+// particles over a grid of cells. Exits non-zero on any difference, on
+// every process.
+//
+// Usage: mpirun -np <processes> TestFriendsOfFriendsMerge
+#include "vtkFriendsOfFriendsHaloFinder.h"
+#include "vtkCommunicator.h"
+#include "vtkDataArray.h"
+#include "vtkDataObject.h"
+#include "vtkMPIController.h"
+#include "vtkPointData.h"
+#include "vtkPointSet.h"
+#include "vtkSmartPointer.h"
+#include "TestClumps.h"
+#include <vtkstd/algorithm>
+#include <vtkstd/vector>
+#include <iostream>
+
+//----------------------------------------------------------------------------
+int main(int argc,char* argv[])
+{
+	vtkMPIController* controller=vtkMPIController::New();
+	controller->Initialize(&argc,&argv);
+	vtkMultiProcessController::SetGlobalController(controller);
+	const int procId=controller->GetLocalProcessId();
+	const int numProc=controller->GetNumberOfProcesses();
+	const double linkingLength=0.004;
+	const int minimumNumberOfParticles=50;
+	TestClumps clumps;
+	clumps.Make();
+	// this process's slab, its particles in order of global id
+	vtkstd::vector<vtkIdType> ids;
+	for(vtkIdType i = 0; i < clumps.GetNumberOfPoints(); ++i)
+		{
+		const int slab=vtkstd::max(0,vtkstd::min(numProc-1,
+			int(clumps.Positions[3*i]*numProc)));
+		if(slab==procId)
+			{
+			ids.push_back(i);
+			}
+		}
+	vtkSmartPointer<vtkPolyData> dataSet=clumps.NewDataSet(ids);
+	vtkstd::vector<vtkIdType> expected;
+	FindGroupsOnGrid(clumps.Positions,linkingLength,minimumNumberOfParticles,
+		expected);
+	vtkFriendsOfFriendsHaloFinder* finder=vtkFriendsOfFriendsHaloFinder::New();
+	finder->SetController(controller);
+	finder->SetInput(dataSet);
+	finder->SetInputArrayToProcess(0,0,0,
+		vtkDataObject::FIELD_ASSOCIATION_POINTS,"global id");
+	finder->SetLinkingLength(linkingLength);
+	finder->SetMinimumNumberOfParticles(minimumNumberOfParticles);
+	finder->Update();
+	vtkDataArray* haloIds=
+		finder->GetOutput()->GetPointData()->GetArray("halo ID");
+	int differences=0;
+	for(vtkIdType i = 0; i < vtkIdType(ids.size()); ++i)
+		{
+		if(vtkIdType(haloIds->GetComponent(i,0))!=expected[ids[i]])
+			{
+			if(differences==0)
+				{
+				std::cerr << "process " << procId << ": halo ID of particle " <<
+					ids[i] << " is " << haloIds->GetComponent(i,0) << ", expected " <<
+					expected[ids[i]] << std::endl;
+				}
+			++differences;
+			}
+		}
+	int totalDifferences=0;
+	controller->AllReduce(&differences,&totalDifferences,1,
+		vtkCommunicator::SUM_OP);
+	if(procId==0)
+		{
+		std::cout << expected.size() << " particles, " << numProc <<
+			" processes: " << (totalDifferences ? "FAILED" : "identical") <<
+			std::endl;
+		}
+	finder->Delete();
+	controller->Finalize();
+	controller->Delete();
+	return totalDifferences ? 1 : 0;
+}
@@ -0,0 +1,71 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: TestFriendsOfFriendsThreads.cxx,v $
+=========================================================================*/
+// Finds the friends-of-friends haloes of the clumps of TestClumps.h on one
+// thread and on several, the threads joining groups at once through the
+// lock-free UnionFind, and compares the halo ID of every particle with
+// that of a serial search over a grid of cells. Exits non-zero on any
+// difference.
+//
+// Usage: TestFriendsOfFriendsThreads
+#include "vtkFriendsOfFriendsHaloFinder.h"
+#include "vtkDataArray.h"
+#include "vtkPointData.h"
+#include "vtkPointSet.h"
+#include "vtkSmartPointer.h"
+#include "TestClumps.h"
+#include <vtkstd/vector>
+#include <iostream>
+
+//----------------------------------------------------------------------------
+int main(int,char*[])
+{
+	const double linkingLength=0.004;
+	const int minimumNumberOfParticles=50;
+	TestClumps clumps;
+	clumps.Make();
+	vtkstd::vector<vtkIdType> ids(clumps.GetNumberOfPoints());
+	for(vtkIdType i = 0; i < clumps.GetNumberOfPoints(); ++i)
+		{
+		ids[i]=i;
+		}
+	vtkSmartPointer<vtkPolyData> dataSet=clumps.NewDataSet(ids);
+	vtkstd::vector<vtkIdType> expected;
+	FindGroupsOnGrid(clumps.Positions,linkingLength,minimumNumberOfParticles,
+		expected);
+	int errors=0;
+	const int threadCounts[]={1,2,4,8,16};
+	for(int t = 0; t < 5; ++t)
+		{
+		vtkSmartPointer<vtkFriendsOfFriendsHaloFinder> finder=
+			vtkSmartPointer<vtkFriendsOfFriendsHaloFinder>::New();
+		finder->SetController(NULL);
+		finder->SetInput(dataSet);
+		finder->SetLinkingLength(linkingLength);
+		finder->SetMinimumNumberOfParticles(minimumNumberOfParticles);
+		finder->SetNumberOfThreads(threadCounts[t]);
+		finder->Update();
+		vtkDataArray* haloIds=
+			finder->GetOutput()->GetPointData()->GetArray("halo ID");
+		int differences=0;
+		for(vtkIdType id = 0; id < vtkIdType(expected.size()); ++id)
+			{
+			if(vtkIdType(haloIds->GetComponent(id,0))!=expected[id])
+				{
+				if(differences==0)
+					{
+					std::cerr << "halo ID[" << id << "] is " <<
+						haloIds->GetComponent(id,0) << ", expected " << expected[id] <<
+						std::endl;
+					}
+				++differences;
+				}
+			}
+		std::cout << expected.size() << " particles, " << threadCounts[t] <<
+			" threads: " << (differences ? "FAILED" : "identical") << std::endl;
+		errors+=differences;
+		}
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,189 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: TestRadialMassProfile.cxx,v $
+=========================================================================*/
+// Finds the radii of several overdensities about a center off any
+// particle, the center of mass of the 50 particles nearest the densest,
+// with the search starting at a softening within which there is no mass,
+// and compares them with a scan of every particle outward from the center.
+// Exits non-zero on any difference.
+//
+// Usage: TestRadialMassProfile <standard>, e.g. Testing/b1.00300.d0-1000.std
+#include "AstroVizRadialMassProfile.h"
+#include "vtkFloatArray.h"
+#include "vtkMath.h"
+#include "vtkPointData.h"
+#include "vtkPoints.h"
+#include "vtkPolyData.h"
+#include "vtkSmartPointer.h"
+#include "tipsylib/ftipsy.hpp"
+#include <vtkstd/algorithm>
+#include <vtkstd/utility>
+#include <vtkstd/vector>
+#include <cmath>
+#include <iostream>
+
+//----------------------------------------------------------------------------
+bool ReadPoints(const char* fileName,vtkPolyData* dataSet)
+{
+	ifTipsy in(fileName,"standard");
+	if(!in.is_open())
+		{
+		return false;
+		}
+	TipsyHeader h;
+	in >> h;
+	vtkSmartPointer<vtkPoints> points=vtkSmartPointer<vtkPoints>::New();
+	points->SetNumberOfPoints(h.h_nBodies);
+	vtkSmartPointer<vtkFloatArray> mass=vtkSmartPointer<vtkFloatArray>::New();
+	mass->SetName("mass");
+	mass->SetNumberOfTuples(h.h_nBodies);
+	for(uint64_t i = 0; i < h.h_nBodies; ++i)
+		{
+		TipsyBaseParticle* b;
+		TipsyGasParticle g;
+		TipsyDarkParticle d;
+		TipsyStarParticle s;
+		if(i < h.h_nSph)
+			{
+			in.seekg(tipsypos(tipsypos::gas,i));
+			in >> g;
+			b=&g;
+			}
+		else if(i < h.h_nSph+h.h_nDark)
+			{
+			in.seekg(tipsypos(tipsypos::dark,i-h.h_nSph));
+			in >> d;
+			b=&d;
+			}
+		else
+			{
+			in.seekg(tipsypos(tipsypos::star,i-h.h_nSph-h.h_nDark));
+			in >> s;
+			b=&s;
+			}
+		points->SetPoint(i,b->pos[0],b->pos[1],b->pos[2]);
+		mass->SetValue(i,b->mass);
+		}
+	dataSet->SetPoints(points);
+	dataSet->GetPointData()->AddArray(mass);
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// the distance of every point from x, with its id, nearest first
+void SortByDistance(vtkPolyData* dataSet,const double x[3],
+	vtkstd::vector<vtkstd::pair<double,vtkIdType> >& byDistance)
+{
+	byDistance.resize(dataSet->GetNumberOfPoints());
+	for(vtkIdType id = 0; id < dataSet->GetNumberOfPoints(); ++id)
+		{
+		double y[3];
+		dataSet->GetPoint(id,y);
+		byDistance[id]=vtkstd::make_pair(
+			sqrt(vtkMath::Distance2BetweenPoints(x,y)),id);
+		}
+	vtkstd::sort(byDistance.begin(),byDistance.end());
+}
+
+//----------------------------------------------------------------------------
+int main(int argc,char* argv[])
+{
+	if(argc < 2)
+		{
+		std::cerr << "Usage: " << argv[0] << " <standard>" << std::endl;
+		return 2;
+		}
+	vtkSmartPointer<vtkPolyData> dataSet=vtkSmartPointer<vtkPolyData>::New();
+	if(!ReadPoints(argv[1],dataSet))
+		{
+		std::cerr << "Unable to open Tipsy binary " << argv[1] << std::endl;
+		return 2;
+		}
+	vtkDataArray* mass=dataSet->GetPointData()->GetArray("mass");
+	const vtkIdType numPoints=dataSet->GetNumberOfPoints();
+	// the densest particle, that nearest its 32nd neighbor
+	vtkstd::vector<vtkstd::pair<double,vtkIdType> > byDistance;
+	vtkIdType densest=0;
+	double nearest32=VTK_DOUBLE_MAX;
+	for(vtkIdType id = 0; id < numPoints; ++id)
+		{
+		double x[3];
+		dataSet->GetPoint(id,x);
+		SortByDistance(dataSet,x,byDistance);
+		if(numPoints > 32 && byDistance[32].first < nearest32)
+			{
+			nearest32=byDistance[32].first;
+			densest=id;
+			}
+		}
+	double x[3];
+	dataSet->GetPoint(densest,x);
+	SortByDistance(dataSet,x,byDistance);
+	double center[3]={0.0,0.0,0.0};
+	double totalMass=0.0;
+	for(vtkIdType i = 0; i < 50 && i < numPoints; ++i)
+		{
+		double y[3];
+		dataSet->GetPoint(byDistance[i].second,y);
+		const double m=mass->GetComponent(byDistance[i].second,0);
+		for(int d = 0; d < 3; ++d)
+			{
+			center[d]+=m*y[d];
+			}
+		totalMass+=m;
+		}
+	for(int d = 0; d < 3; ++d)
+		{
+		center[d]/=totalMass;
+		}
+	// the default softening of the virial radius filter
+	const double softening=1e-6;
+	RadialMassProfile profile;
+	profile.Build(dataSet,"mass",center);
+	if(profile.GetMassWithinRadius(softening)!=0)
+		{
+		std::cerr << "the center is meant to be off any particle" << std::endl;
+		return 1;
+		}
+	SortByDistance(dataSet,center,byDistance);
+	const double maxR=byDistance.back().first;
+	vtkstd::vector<double> densities;
+	for(double density = 1; density <= 1e6; density*=10)
+		{
+		densities.push_back(density);
+		}
+	vtkstd::vector<double> radii;
+	profile.FindOverdensityRadii(NULL,densities,softening,maxR,radii);
+	int errors=0;
+	for(vtkstd::vector<double>::size_type j = 0; j < densities.size(); ++j)
+		{
+		// the first radius, once the density within has risen above the
+		// density, at which it falls to it between two particles
+		const double massPerVolume=4./3*vtkMath::Pi()*densities[j];
+		double expected=-1;
+		double massWithin=0;
+		bool above=false;
+		for(vtkIdType i = 0; i < numPoints; ++i)
+			{
+			const double r=byDistance[i].first;
+			massWithin+=mass->GetComponent(byDistance[i].second,0);
+			above=above || massWithin > massPerVolume*r*r*r;
+			const double crossing=pow(massWithin/massPerVolume,1./3);
+			const double next=(i+1 < numPoints) ? byDistance[i+1].first :
+				VTK_DOUBLE_MAX;
+			if(above && crossing >= r && crossing < next)
+				{
+				expected=crossing;
+				break;
+				}
+			}
+		const bool same=(expected < 0) ? radii[j]==expected :
+			fabs(radii[j]-expected) <= 1e-9*expected;
+		std::cout << "overdensity " << densities[j] << ": radius " << radii[j] <<
+			", expected " << expected << (same ? "" : " FAILED") << std::endl;
+		errors+=same ? 0 : 1;
+		}
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: TestSubhaloThreads.cxx,v $
+=========================================================================*/
+// Finds the subhaloes of the haloes of TestClumps.h on one thread and on
+// several; with more than one the largest halo is linked by all the
+// threads at once, the others dealt to their queues. Compares the subhalo
+// ID of every particle with that found on one thread. Exits non-zero on
+// any difference, or if there is no subhalo to compare.
+//
+// Usage: TestSubhaloThreads
+#include "vtkSubhaloFinder.h"
+#include "vtkDataArray.h"
+#include "vtkDataObject.h"
+#include "vtkPointData.h"
+#include "vtkPointSet.h"
+#include "vtkSmartPointer.h"
+#include "TestClumps.h"
+#include <vtkstd/set>
+#include <vtkstd/vector>
+#include <iostream>
+
+//----------------------------------------------------------------------------
+// the subhalo ID of each particle found on numThreads threads
+void FindSubhaloes(vtkPolyData* dataSet,int numThreads,
+	vtkstd::vector<vtkIdType>& subhaloIds)
+{
+	vtkSmartPointer<vtkSubhaloFinder> finder=
+		vtkSmartPointer<vtkSubhaloFinder>::New();
+	finder->SetController(NULL);
+	finder->SetInput(dataSet);
+	finder->SetInputArrayToProcess(0,0,0,
+		vtkDataObject::FIELD_ASSOCIATION_POINTS,"halo ID");
+	finder->SetNumberOfThreads(numThreads);
+	finder->Update();
+	vtkDataArray* array=
+		finder->GetOutput()->GetPointData()->GetArray("subhalo ID");
+	subhaloIds.resize(dataSet->GetNumberOfPoints());
+	for(vtkIdType id = 0; id < vtkIdType(subhaloIds.size()); ++id)
+		{
+		subhaloIds[id]=array ? vtkIdType(array->GetComponent(id,0)) : -1;
+		}
+}
+
+//----------------------------------------------------------------------------
+int main(int,char*[])
+{
+	TestClumps clumps;
+	clumps.Make();
+	vtkstd::vector<vtkIdType> ids(clumps.GetNumberOfPoints());
+	for(vtkIdType i = 0; i < clumps.GetNumberOfPoints(); ++i)
+		{
+		ids[i]=i;
+		}
+	vtkSmartPointer<vtkPolyData> dataSet=clumps.NewDataSet(ids);
+	vtkstd::vector<vtkIdType> expected;
+	FindSubhaloes(dataSet,1,expected);
+	vtkstd::set<vtkIdType> subhaloes(expected.begin(),expected.end());
+	subhaloes.erase(0);
+	std::cout << expected.size() << " particles, " << subhaloes.size() <<
+		" subhaloes on one thread" << std::endl;
+	int errors=subhaloes.empty() ? 1 : 0;
+	const int threadCounts[]={2,4,8,16};
+	for(int t = 0; t < 4; ++t)
+		{
+		vtkstd::vector<vtkIdType> subhaloIds;
+		FindSubhaloes(dataSet,threadCounts[t],subhaloIds);
+		int differences=0;
+		for(vtkIdType id = 0; id < vtkIdType(expected.size()); ++id)
+			{
+			if(subhaloIds[id]!=expected[id])
+				{
+				if(differences==0)
+					{
+					std::cerr << "subhalo ID[" << id << "] is " << subhaloIds[id] <<
+						", expected " << expected[id] << std::endl;
+					}
+				++differences;
+				}
+			}
+		std::cout << expected.size() << " particles, " << threadCounts[t] <<
+			" threads: " << (differences ? "FAILED" : "identical") << std::endl;
+		errors+=differences;
+		}
+	return errors ? 1 : 0;
+}
@@ -0,0 +1,214 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: TestTipsyReader.cxx,v $
+=========================================================================*/
+// Reads a standard Tipsy file with vtkTipsyReader, through both the stream
+// and the memory mapping, and compares every point and array with a read
+// of the file a particle at a time, with a seek before each, as the reader
+// used to. Reports the first difference in each array and exits non-zero
+// if there is any.
+//
+// Usage: TestTipsyReader <standard>, e.g. Testing/b1.00300.d0-1000.std
+#include "vtkTipsyReader.h"
+#include "vtkFloatArray.h"
+#include "vtkPointData.h"
+#include "vtkPoints.h"
+#include "vtkPolyData.h"
+#include "vtkSmartPointer.h"
+#include "tipsylib/ftipsy.hpp"
+#include <vtkstd/vector>
+#include <iostream>
+
+//----------------------------------------------------------------------------
+// The values of one particle as read from the file, the fields its type
+// lacks left at zero as the reader leaves them, and its type 0, 1 or 2 for
+// gas, dark or star, as the reader stores it.
+class TipsyValues
+{
+public:
+	TipsyValues()
+		{
+		for(int i = 0; i < 3; ++i)
+			{
+			this->pos[i]=this->vel[i]=0;
+			}
+		this->mass=this->phi=this->eps=this->rho=this->temp=this->hsmooth=
+			this->metals=this->tform=0;
+		this->type=0;
+		}
+	float pos[3],vel[3];
+	float mass,phi,eps,rho,temp,hsmooth,metals,tform;
+	int type;
+};
+
+//----------------------------------------------------------------------------
+bool ReadSingle(const char* fileName,vtkstd::vector<TipsyValues>& values)
+{
+	ifTipsy in(fileName,"standard");
+	if(!in.is_open())
+		{
+		return false;
+		}
+	TipsyHeader h;
+	in >> h;
+	values.assign(h.h_nBodies,TipsyValues());
+	for(uint64_t i = 0; i < h.h_nBodies; ++i)
+		{
+		TipsyValues& v=values[i];
+		TipsyBaseParticle* b;
+		TipsyGasParticle g;
+		TipsyDarkParticle d;
+		TipsyStarParticle s;
+		if(i < h.h_nSph)
+			{
+			in.seekg(tipsypos(tipsypos::gas,i));
+			in >> g;
+			b=&g;
+			v.rho=g.rho;
+			v.temp=g.temp;
+			v.hsmooth=g.hsmooth;
+			v.metals=g.metals;
+			v.type=0;
+			}
+		else if(i < h.h_nSph+h.h_nDark)
+			{
+			in.seekg(tipsypos(tipsypos::dark,i-h.h_nSph));
+			in >> d;
+			b=&d;
+			v.eps=d.eps;
+			v.type=1;
+			}
+		else
+			{
+			in.seekg(tipsypos(tipsypos::star,i-h.h_nSph-h.h_nDark));
+			in >> s;
+			b=&s;
+			v.eps=s.eps;
+			v.metals=s.metals;
+			v.tform=s.tform;
+			v.type=2;
+			}
+		for(int j = 0; j < 3; ++j)
+			{
+			v.pos[j]=b->pos[j];
+			v.vel[j]=b->vel[j];
+			}
+		v.mass=b->mass;
+		v.phi=b->phi;
+		}
+	in.close();
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// Compares component comp of the array arrayName in output with the field
+// of each particle; returns the number of differences.
+int CompareArray(vtkPolyData* output,const char* arrayName,int comp,
+	const vtkstd::vector<float>& expected)
+{
+	vtkDataArray* array=output->GetPointData()->GetArray(arrayName);
+	if(!array)
+		{
+		std::cerr << "no " << arrayName << " array" << std::endl;
+		return 1;
+		}
+	for(vtkIdType id = 0; id < vtkIdType(expected.size()); ++id)
+		{
+		if(array->GetComponent(id,comp)!=expected[id])
+			{
+			std::cerr << arrayName << "[" << id << "][" << comp << "] is " <<
+				array->GetComponent(id,comp) << ", expected " << expected[id] <<
+				std::endl;
+			return 1;
+			}
+		}
+	return 0;
+}
+
+//----------------------------------------------------------------------------
+int CompareReader(const char* fileName,int useMemoryMap,
+	const vtkstd::vector<TipsyValues>& values)
+{
+	vtkSmartPointer<vtkTipsyReader> reader=
+		vtkSmartPointer<vtkTipsyReader>::New();
+	reader->SetFileName(fileName);
+	reader->SetUseMemoryMap(useMemoryMap);
+	reader->Update();
+	vtkPolyData* output=reader->GetOutput();
+	const vtkIdType numPoints=values.size();
+	if(output->GetNumberOfPoints()!=numPoints)
+		{
+		std::cerr << output->GetNumberOfPoints() << " points, expected " <<
+			numPoints << std::endl;
+		return 1;
+		}
+	int errors=0;
+	for(vtkIdType id = 0; id < numPoints && !errors; ++id)
+		{
+		double x[3];
+		output->GetPoint(id,x);
+		for(int j = 0; j < 3; ++j)
+			{
+			if(float(x[j])!=values[id].pos[j])
+				{
+				std::cerr << "point " << id << " is (" << x[0] << "," << x[1] <<
+					"," << x[2] << ")" << std::endl;
+				++errors;
+				break;
+				}
+			}
+		}
+	vtkstd::vector<float> expected(numPoints);
+	for(int j = 0; j < 3; ++j)
+		{
+		for(vtkIdType id = 0; id < numPoints; ++id)
+			{
+			expected[id]=values[id].vel[j];
+			}
+		errors+=CompareArray(output,"velocity",j,expected);
+		}
+#define COMPARE_FIELD(field,arrayName) \
+	for(vtkIdType id = 0; id < numPoints; ++id) \
+		{ \
+		expected[id]=values[id].field; \
+		} \
+	errors+=CompareArray(output,arrayName,0,expected);
+	COMPARE_FIELD(mass,"mass");
+	COMPARE_FIELD(phi,"potential");
+	COMPARE_FIELD(eps,"eps");
+	COMPARE_FIELD(rho,"rho");
+	COMPARE_FIELD(temp,"temperature");
+	COMPARE_FIELD(hsmooth,"hsmooth");
+	COMPARE_FIELD(metals,"metals");
+	COMPARE_FIELD(tform,"tform");
+	COMPARE_FIELD(type,"type");
+#undef COMPARE_FIELD
+	return errors;
+}
+
+//----------------------------------------------------------------------------
+int main(int argc,char* argv[])
+{
+	if(argc < 2)
+		{
+		std::cerr << "Usage: " << argv[0] << " <standard>" << std::endl;
+		return 2;
+		}
+	vtkstd::vector<TipsyValues> values;
+	if(!ReadSingle(argv[1],values))
+		{
+		std::cerr << "Unable to open Tipsy binary " << argv[1] << std::endl;
+		return 2;
+		}
+	int errors=0;
+	for(int useMemoryMap = 0; useMemoryMap <= 1; ++useMemoryMap)
+		{
+		const int readerErrors=CompareReader(argv[1],useMemoryMap,values);
+		std::cout << values.size() << " particles, " <<
+			(useMemoryMap ? "memory mapped" : "stream") << " read: " <<
+			(readerErrors ? "FAILED" : "identical") << std::endl;
+		errors+=readerErrors;
+		}
+	return errors ? 1 : 0;
+}
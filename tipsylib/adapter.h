@@ -11,6 +11,7 @@
 #include <map>
 #include <vector>
 #include "tipsypos.h"
+#include "tipsycols.h"
 
 /**
  *  @brief  Abstract implementation of a file adapter.
@@ -74,6 +75,19 @@ public:
      */
     virtual void putNext(void) = 0;
 
+    /** @brief Read a block of particles from the current position
+     *
+     *  Reading stops at the end of the current section; the position is
+     *  left at the particle following the last one read.
+     *  @param n    Maximum number of particles to read
+     *  @param cols Destination columns
+     *  @param at   Index in cols of the first particle read
+     *  @return The number of particles read.
+     */
+    virtual tipsypos::offset_type getBlock( tipsypos::offset_type n,
+					    TipsyColumns &cols,
+					    tipsypos::offset_type at ) = 0;
+
     /** @brief Seek to the specified particle
      *  @return The new position (if successful), else the old position.
      */
@@ -341,7 +341,7 @@ int main( int argc, char *argv[] ) {
 
     TipsyHeader       h;
 
-    unsigned int i;
+    uint64_t i;
     AllInfo info;
     Info *ip;
 
@@ -507,7 +507,7 @@ int main( int argc, char *argv[] ) {
     }
     else {
 	std::ifstream mark(nameMark.c_str());
-	uint32_t ng, nd, ns;
+	uint64_t ng, nd, ns;
 
 	if ( !mark.is_open() ) {
 	    std::cerr << "Unable to open file " << nameMark << std::endl;
@@ -0,0 +1,64 @@
+/**
+ *  @file
+ *  @brief Bulk conversion of big-endian (XDR) 32-bit words
+ */
+
+#include <cstring>
+#include "tipsypos.h"
+#include "byteswap.h"
+
+#if defined(__AVX2__)
+ #include <immintrin.h>
+ #define TIPSY_SWAP_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+ #include <emmintrin.h>
+ #define TIPSY_SWAP_SSE2
+#endif
+
+//! Swap a single word; memcpy keeps this free of aliasing problems.
+static inline void swapOne( const char *src, char *dst )
+{
+    uint32_t v;
+    memcpy(&v,src,sizeof(v));
+    v = (v>>24) | ((v>>8)&0x0000ff00u) | ((v<<8)&0x00ff0000u) | (v<<24);
+    memcpy(dst,&v,sizeof(v));
+}
+
+void tipsySwap32( const void *src, void *dst, std::size_t n )
+{
+    const char *s = static_cast<const char *>(src);
+    char *d = static_cast<char *>(dst);
+    std::size_t i = 0;
+
+#if defined(TIPSY_SWAP_AVX2)
+    //! A byte shuffle reverses each group of four bytes, eight words a time.
+    const __m256i mask = _mm256_setr_epi8(
+	3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12,
+	3,2,1,0, 7,6,5,4, 11,10,9,8, 15,14,13,12 );
+    for( ; i+8 <= n; i+=8 ) {
+	__m256i v = _mm256_loadu_si256( (const __m256i *)(s+4*i) );
+	_mm256_storeu_si256( (__m256i *)(d+4*i), _mm256_shuffle_epi8(v,mask) );
+    }
+#elif defined(TIPSY_SWAP_SSE2)
+    //! SSE2 has no byte shuffle: swap the bytes in each 16-bit half, then
+    //! swap the halves of each 32-bit word.
+    for( ; i+4 <= n; i+=4 ) {
+	__m128i v = _mm_loadu_si128( (const __m128i *)(s+4*i) );
+	v = _mm_or_si128( _mm_slli_epi16(v,8), _mm_srli_epi16(v,8) );
+	v = _mm_shufflehi_epi16( _mm_shufflelo_epi16(v,0xb1), 0xb1 );
+	_mm_storeu_si128( (__m128i *)(d+4*i), v );
+    }
+#endif
+    for( ; i<n; i++ ) swapOne( s+4*i, d+4*i );
+}
+
+const char *tipsySwap32Kernel(void)
+{
+#if defined(TIPSY_SWAP_AVX2)
+    return "avx2";
+#elif defined(TIPSY_SWAP_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,26 @@
+/**
+ *  @file
+ *  @brief Bulk conversion of big-endian (XDR) 32-bit words
+ */
+
+#ifndef TIPSY_BYTESWAP_H
+#define TIPSY_BYTESWAP_H
+
+#include <cstddef>
+
+/** @brief Reverse the byte order of n consecutive 32-bit words.
+ *
+ *  Uses AVX2 or SSE2 when the compiler targets them, with a scalar loop
+ *  for the remainder and for other architectures.  Neither pointer needs
+ *  to be aligned; src and dst may be the same but must not otherwise
+ *  overlap.
+ *  @param src Source words (big-endian)
+ *  @param dst Destination words (host order on little-endian hosts)
+ *  @param n   Number of words
+ */
+void tipsySwap32( const void *src, void *dst, std::size_t n );
+
+//! @brief Name of the kernel selected at compile time ("avx2", "sse2", ...).
+const char *tipsySwap32Kernel(void);
+
+#endif
@@ -166,6 +166,15 @@ iTipsy& iTipsy::operator>>(TipsyStarParticle &val)
     return *this;
 }
 
+tipsypos::offset_type iTipsy::readBlock( tipsypos::offset_type n,
+					 TipsyColumns &cols,
+					 tipsypos::offset_type at )
+{
+    // The density file is read one value at a time and cannot follow.
+    assert( m_fDensity == 0 );
+    return adapter->getBlock(n,cols,at);
+}
+
 iTipsy &iTipsy::seekg( tipsypos pos )
 {
     // It is possible to rewind the density file
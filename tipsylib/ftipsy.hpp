@@ -33,19 +33,24 @@
 #include <istream>
 
 #include "tipsypos.h"
+#include "tipsycols.h"
 
 class TipsyAdapter;
 
-//! @brief Description of the contents of a Tipsy file
+/** @brief Description of the contents of a Tipsy file
+ *
+ *  The counts are 64-bit.  Files with more than 2^32 particles store the
+ *  high bits in the pad word of the header (see tipsycount.h).
+ */
 class TipsyHeader
 {
 public:
     double  h_time;     //!< Expansion factor
-    uint32_t h_nBodies; //!< Total number of particles
+    uint64_t h_nBodies; //!< Total number of particles
     uint32_t h_nDims;   //!< Number of dimensions (3)
-    uint32_t h_nSph;    //!< Number of gas particles
-    uint32_t h_nDark;   //!< Number of dark particles
-    uint32_t h_nStar;   //!< Number of star particles
+    uint64_t h_nSph;    //!< Number of gas particles
+    uint64_t h_nDark;   //!< Number of dark particles
+    uint64_t h_nStar;   //!< Number of star particles
 };
 //! @brief Information common to all particle types.
 class TipsyBaseParticle
@@ -178,6 +183,16 @@ public:
     //! @param val A TipsyDarkParticle Structure.
     virtual iTipsy& operator>>(TipsyDarkParticle &val);
 
+    //! @brief Read a block of particles from the current section.
+    //! Reading stops at the end of the section (see tellg).
+    //! @param n    Maximum number of particles to read.
+    //! @param cols Destination columns.
+    //! @param at   Index in cols of the first particle read.
+    //! @return The number of particles read.
+    virtual tipsypos::offset_type readBlock( tipsypos::offset_type n,
+					     TipsyColumns &cols,
+					     tipsypos::offset_type at = 0 );
+
     //! @brief Seek to a specific particle in the stream.
     //! @param pos The new position.
     virtual iTipsy &seekg( tipsypos pos );
@@ -187,6 +202,24 @@ public:
     virtual tipsypos tellg();
 };
 
+//! @brief Present an iTipsy stream as a TipsyBlockSource (seek, then read).
+class TipsyStreamSource : public TipsyBlockSource {
+    iTipsy &m_in; //!< The wrapped stream.
+public:
+    //! @brief Wrap an input stream.
+    //! @param in The stream to read from; it must outlive this object.
+    explicit TipsyStreamSource( iTipsy &in ) : m_in(in) {}
+
+    //! @brief Seek to pos and read up to n particles.
+    virtual tipsypos::offset_type readBlock( tipsypos pos,
+					     tipsypos::offset_type n,
+					     TipsyColumns &cols,
+					     tipsypos::offset_type at ) {
+	m_in.seekg(pos);
+	return m_in.readBlock(n,cols,at);
+    }
+};
+
 //! @brief Read a Tipsy formatted stream.
 class oTipsy : virtual public TipsyIOS {
 protected:
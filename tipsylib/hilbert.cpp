@@ -0,0 +1,73 @@
+/**
+ *  @file
+ *  @brief Peano-Hilbert keys in three dimensions
+ *
+ *  Based on J. Skilling, "Programming the Hilbert curve", AIP Conf. Proc.
+ *  707, 381 (2004): coordinates are transformed in place into the
+ *  "transposed" form of the key, whose bits are then interleaved.
+ */
+
+#include "hilbert.h"
+
+uint64_t hilbertKey( const uint32_t x[3], int bits )
+{
+    uint32_t X[3] = { x[0], x[1], x[2] };
+    uint32_t M = 1u << (bits-1), P, Q, t;
+    int i;
+
+    //! Inverse undo
+    for( Q=M; Q>1; Q>>=1 ) {
+	P = Q - 1;
+	for( i=0; i<3; i++ ) {
+	    if ( X[i] & Q ) X[0] ^= P;
+	    else {
+		t = (X[0]^X[i]) & P;
+		X[0] ^= t; X[i] ^= t;
+	    }
+	}
+    }
+
+    //! Gray encode
+    for( i=1; i<3; i++ ) X[i] ^= X[i-1];
+    t = 0;
+    for( Q=M; Q>1; Q>>=1 )
+	if ( X[2] & Q ) t ^= Q-1;
+    for( i=0; i<3; i++ ) X[i] ^= t;
+
+    //! Interleave the transposed form, most significant bit first.
+    uint64_t key = 0;
+    for( int b=bits-1; b>=0; b-- )
+	for( i=0; i<3; i++ )
+	    key = (key<<1) | ((X[i]>>b) & 1);
+    return key;
+}
+
+void hilbertCell( uint64_t key, int bits, uint32_t x[3] )
+{
+    uint32_t X[3] = { 0, 0, 0 };
+    uint32_t N = 2u << (bits-1), P, Q, t;
+    int i;
+
+    //! Undo the interleave to recover the transposed form.
+    for( int b=bits-1; b>=0; b-- )
+	for( i=0; i<3; i++ )
+	    X[i] |= uint32_t( (key >> (3*b + 2-i)) & 1 ) << b;
+
+    //! Gray decode by H ^ (H/2)
+    t = X[2] >> 1;
+    for( i=2; i>0; i-- ) X[i] ^= X[i-1];
+    X[0] ^= t;
+
+    //! Undo excess work
+    for( Q=2; Q!=N; Q<<=1 ) {
+	P = Q - 1;
+	for( i=2; i>=0; i-- ) {
+	    if ( X[i] & Q ) X[0] ^= P;
+	    else {
+		t = (X[0]^X[i]) & P;
+		X[0] ^= t; X[i] ^= t;
+	    }
+	}
+    }
+    x[0] = X[0]; x[1] = X[1]; x[2] = X[2];
+}
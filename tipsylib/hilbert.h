@@ -0,0 +1,31 @@
+/**
+ *  @file
+ *  @brief Peano-Hilbert keys in three dimensions
+ */
+
+#ifndef TIPSY_HILBERT_H
+#define TIPSY_HILBERT_H
+
+#include "tipsypos.h"
+
+//! Largest number of bits per dimension that fits a 64-bit key.
+static const int hilbertMaxBits = 21;
+
+/** @brief Compute the Peano-Hilbert key of an integer grid cell.
+ *
+ *  Cells of an aligned octree node always map to one contiguous range of
+ *  keys, so the top 3*L bits of a key name its level L ancestor.
+ *  @param x    Integer coordinates in [0,2^bits)
+ *  @param bits Bits per dimension (at most hilbertMaxBits)
+ *  @return The key, in [0,2^(3*bits)).
+ */
+uint64_t hilbertKey( const uint32_t x[3], int bits );
+
+/** @brief Inverse of hilbertKey.
+ *  @param key  A key computed with the same number of bits
+ *  @param bits Bits per dimension
+ *  @param x    Integer coordinates of the cell
+ */
+void hilbertCell( uint64_t key, int bits, uint32_t x[3] );
+
+#endif
@@ -2,16 +2,22 @@
 #include <stdint.h>
 #include <getopt.h>
 #include <math.h>
+#include <vector>
 #include "ftipsy.hpp"
 #include "grid.hpp"
+#include "tipsymark.h"
 
 #define OPT_GRID 'g'
+#define OPT_BINARY 'b'
 
 
-void outIf( Grid &grid, TipsyBaseParticle &b, uint32_t iIndex )
+//! Mark a particle on stdout or, if a bitmap is given, in the bitmap.
+void outIf( Grid &grid, TipsyBaseParticle &b, uint64_t iIndex,
+	    std::vector<unsigned char> *bitmap )
 {
     if ( grid.inGrid( b.pos[0], b.pos[1], b.pos[2] ) ) {
-	std::cout << iIndex << std::endl;
+	if ( bitmap ) (*bitmap)[(iIndex-1)/8] |= 1 << ((iIndex-1)%8);
+	else std::cout << iIndex << std::endl;
     }
 }
 
@@ -20,12 +26,14 @@ int main( int argc, char *argv[] ) {
 
     const char *gridName = 0;
     const char *tipsyName = 0;
+    const char *binaryName = 0;
 
     TipsyHeader       h; // The header structure
     TipsyGasParticle  g; // A gas particle
     TipsyDarkParticle d; // A dark particle
     TipsyStarParticle s; // A star particle
-    uint32_t i, iIndex;
+    uint64_t i, iIndex;
+    std::vector<unsigned char> bitmap, *pBitmap = 0;
 
     Grid grid;
 
@@ -35,16 +43,20 @@ int main( int argc, char *argv[] ) {
 
         static struct option long_options[] = {
             { "grid",        1, 0, OPT_GRID },
+            { "binary",      1, 0, OPT_BINARY },
             { 0,             0, 0, 0 }
         };
 
-        c = getopt_long( argc, argv, "g:",
+        c = getopt_long( argc, argv, "g:b:",
                          long_options, &option_index );
         if ( c == -1 ) break;
         switch(c) {
         case OPT_GRID:
 	    gridName = optarg;
             break;
+        case OPT_BINARY:
+	    binaryName = optarg;
+            break;
 	}
     }
 
@@ -72,15 +84,27 @@ int main( int argc, char *argv[] ) {
     // Read the header from the input and write it to the output.
     in >> h;
 
-    std::cout << h.h_nDark << " " << h.h_nSph << " " << h.h_nStar << std::endl;
+    // With --binary the marks go to a bitmap file instead of stdout.
+    if ( binaryName ) {
+	bitmap.resize( (uint64_t(h.h_nBodies)+7)/8 );
+	pBitmap = &bitmap;
+    }
+    else {
+	std::cout << h.h_nDark << " " << h.h_nSph << " " << h.h_nStar << std::endl;
+    }
 
 
     // Read every particle and write it to the output file.
     iIndex = 1;
-    for( i=0; i<h.h_nSph;  i++,iIndex++ ) { in >> g; outIf(grid,g,iIndex); }
-    for( i=0; i<h.h_nDark; i++,iIndex++ ) { in >> d; outIf(grid,d,iIndex); }
-    for( i=0; i<h.h_nStar; i++,iIndex++ ) { in >> s; outIf(grid,s,iIndex); }
+    for( i=0; i<h.h_nSph;  i++,iIndex++ ) { in >> g; outIf(grid,g,iIndex,pBitmap); }
+    for( i=0; i<h.h_nDark; i++,iIndex++ ) { in >> d; outIf(grid,d,iIndex,pBitmap); }
+    for( i=0; i<h.h_nStar; i++,iIndex++ ) { in >> s; outIf(grid,s,iIndex,pBitmap); }
 
     // Close the file.
     in.close();
+
+    if ( binaryName && !tipsyWriteMarkBitmap( binaryName, h, bitmap ) ) {
+	std::cerr << "Unable to write " << binaryName << std::endl;
+	exit(2);
+    }
 }
@@ -0,0 +1,283 @@
+/**
+ *  @file
+ *  @brief Memory mapped Tipsy file reader
+ */
+
+#include <cstring>
+#include <vector>
+#ifdef _WIN32
+ #include <windows.h>
+ #include <winsock2.h> // ntohl
+#else
+ #include <sys/types.h>
+ #include <sys/stat.h>
+ #include <sys/mman.h>
+ #include <fcntl.h>
+ #include <unistd.h>
+ #include <netinet/in.h>
+#endif
+#include "mtipsy.hpp"
+#include "byteswap.h"
+#include "tipsycount.h"
+
+//! Number of records converted at a time; small enough to stay in cache.
+static const std::size_t mtipsyChunk = 256;
+
+//! Runs shorter than this many bytes are read without madvise.
+static const std::size_t mtipsyAdviseBytes = 65536;
+
+//! Size in 32-bit words of the header and of each particle record.
+enum {
+    words_header = 8,
+    words_gas    = 12,
+    words_dark   = 9,
+    words_star   = 11
+};
+
+//! A field of a record: its first word and where it goes.
+struct mtipsyField {
+    float      *dst;   //!< Destination column (null to skip)
+    std::size_t word;  //!< First word of the field within the record
+    std::size_t width; //!< Number of words (1 or 3)
+};
+
+mTipsy::mTipsy()
+    : m_base(0), m_size(0), m_swap(false)
+{
+#ifdef _WIN32
+    m_file = m_map = 0;
+#endif
+    memset(&m_header,0,sizeof(m_header));
+}
+
+mTipsy::mTipsy( const char *iname, const char *adaptertype )
+    : m_base(0), m_size(0), m_swap(false)
+{
+#ifdef _WIN32
+    m_file = m_map = 0;
+#endif
+    memset(&m_header,0,sizeof(m_header));
+    open(iname,adaptertype);
+}
+
+mTipsy::~mTipsy()
+{
+    close();
+}
+
+bool mTipsy::open( const char *iname, const char *adaptertype )
+{
+    close();
+
+    //! Map the whole file read-only.
+#ifdef _WIN32
+    HANDLE f = CreateFileA( iname, GENERIC_READ, FILE_SHARE_READ, 0,
+			    OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0 );
+    if ( f == INVALID_HANDLE_VALUE ) return false;
+    LARGE_INTEGER size;
+    GetFileSizeEx( f, &size );
+    HANDLE m = CreateFileMapping( f, 0, PAGE_READONLY, 0, 0, 0 );
+    if ( m == 0 ) { CloseHandle(f); return false; }
+    void *base = MapViewOfFile( m, FILE_MAP_READ, 0, 0, 0 );
+    if ( base == 0 ) { CloseHandle(m); CloseHandle(f); return false; }
+    m_file = f;
+    m_map  = m;
+    m_size = size.QuadPart;
+#else
+    int fd = ::open( iname, O_RDONLY );
+    if ( fd < 0 ) return false;
+    struct stat st;
+    if ( fstat(fd,&st) != 0 || st.st_size < 4*words_header ) {
+	::close(fd);
+	return false;
+    }
+    void *base = mmap( 0, st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    ::close(fd); // The mapping keeps its own reference
+    if ( base == MAP_FAILED ) return false;
+    madvise( base, st.st_size, MADV_SEQUENTIAL );
+    m_size = st.st_size;
+#endif
+    m_base = static_cast<const char *>(base);
+
+    //! Standard files are big-endian; native files are in host order.
+    m_swap = strcmp(adaptertype,"standard") == 0 && ntohl(1) != 1;
+
+    //! Decode the header (a double, six 32-bit integers and the pad word).
+    uint32_t hdr[words_header];
+    if ( m_swap ) tipsySwap32( m_base, hdr, words_header );
+    else memcpy( hdr, m_base, sizeof(hdr) );
+    uint32_t t[2];
+    if ( m_swap ) { t[0] = hdr[1]; t[1] = hdr[0]; }
+    else { t[0] = hdr[0]; t[1] = hdr[1]; }
+    memcpy( &m_header.h_time, t, sizeof(double) );
+    uint64_t n[4];
+    tipsyDecodeCounts( hdr[2], hdr[4], hdr[5], hdr[6], hdr[7], n );
+    m_header.h_nBodies = n[0];
+    m_header.h_nDims   = hdr[3];
+    m_header.h_nSph    = n[1];
+    m_header.h_nDark   = n[2];
+    m_header.h_nStar   = n[3];
+
+    //! Refuse truncated files rather than reading past the mapping.
+    if ( offset(tipsypos::eof,0) > m_size ) {
+	close();
+	return false;
+    }
+    return true;
+}
+
+void mTipsy::close()
+{
+    if ( m_base == 0 ) return;
+#ifdef _WIN32
+    UnmapViewOfFile( m_base );
+    CloseHandle( (HANDLE)m_map );
+    CloseHandle( (HANDLE)m_file );
+    m_file = m_map = 0;
+#else
+    munmap( const_cast<char *>(m_base), m_size );
+#endif
+    m_base = 0;
+    m_size = 0;
+}
+
+uint64_t mTipsy::offset( tipsypos::section_type s,
+			 tipsypos::offset_type o ) const
+{
+    uint64_t where = 4*words_header;
+    switch( s ) {
+    case tipsypos::eof:
+	where += 4*words_star * uint64_t(m_header.h_nStar);
+	// fall through
+    case tipsypos::star:
+	where += 4*words_dark * uint64_t(m_header.h_nDark);
+	// fall through
+    case tipsypos::dark:
+	where += 4*words_gas * uint64_t(m_header.h_nSph);
+	// fall through
+    case tipsypos::gas:
+	break;
+    default:
+	return 0;
+    }
+    switch( s ) {
+    case tipsypos::gas:  return where + 4*words_gas  * o;
+    case tipsypos::dark: return where + 4*words_dark * o;
+    case tipsypos::star: return where + 4*words_star * o;
+    default:             return where;
+    }
+}
+
+std::size_t tipsyRecordSize( tipsypos::section_type s )
+{
+    switch( s ) {
+    case tipsypos::gas:  return 4*words_gas;
+    case tipsypos::dark: return 4*words_dark;
+    case tipsypos::star: return 4*words_star;
+    default:             return 0;
+    }
+}
+
+void tipsyDecodeRecords( const char *src, bool swap, tipsypos::section_type s,
+			 tipsypos::offset_type n, TipsyColumns &c,
+			 tipsypos::offset_type at )
+{
+    mtipsyField f[8];
+    std::size_t nf = 0, words;
+
+    //! Describe where each field of this record type goes.
+    f[nf].dst=c.mass; f[nf].word=0; f[nf++].width=1;
+    f[nf].dst=c.pos;  f[nf].word=1; f[nf++].width=3;
+    f[nf].dst=c.vel;  f[nf].word=4; f[nf++].width=3;
+    switch( s ) {
+    case tipsypos::gas:
+	words = words_gas;
+	f[nf].dst=c.rho;     f[nf].word=7;  f[nf++].width=1;
+	f[nf].dst=c.temp;    f[nf].word=8;  f[nf++].width=1;
+	f[nf].dst=c.hsmooth; f[nf].word=9;  f[nf++].width=1;
+	f[nf].dst=c.metals;  f[nf].word=10; f[nf++].width=1;
+	f[nf].dst=c.phi;     f[nf].word=11; f[nf++].width=1;
+	break;
+    case tipsypos::dark:
+	words = words_dark;
+	f[nf].dst=c.eps;     f[nf].word=7;  f[nf++].width=1;
+	f[nf].dst=c.phi;     f[nf].word=8;  f[nf++].width=1;
+	break;
+    case tipsypos::star:
+	words = words_star;
+	f[nf].dst=c.metals;  f[nf].word=7;  f[nf++].width=1;
+	f[nf].dst=c.tform;   f[nf].word=8;  f[nf++].width=1;
+	f[nf].dst=c.eps;     f[nf].word=9;  f[nf++].width=1;
+	f[nf].dst=c.phi;     f[nf].word=10; f[nf++].width=1;
+	break;
+    default:
+	return;
+    }
+
+    //! Convert a chunk of whole records, then scatter it to the columns.
+    std::vector<float> buf( (n < mtipsyChunk ? std::size_t(n) : mtipsyChunk) * words );
+    for( tipsypos::offset_type done=0; done<n; ) {
+	std::size_t m = mtipsyChunk;
+	if ( n - done < m ) m = std::size_t(n - done);
+	if ( swap ) tipsySwap32( src, &buf[0], m*words );
+	else memcpy( &buf[0], src, 4*m*words );
+	for( std::size_t k=0; k<nf; k++ ) {
+	    if ( f[k].dst == 0 ) continue;
+	    const float *in = &buf[f[k].word];
+	    if ( f[k].width == 1 ) {
+		float *out = f[k].dst + (at+done);
+		for( std::size_t i=0; i<m; i++ ) out[i] = in[i*words];
+	    }
+	    else {
+		float *out = f[k].dst + 3*(at+done);
+		for( std::size_t i=0; i<m; i++ ) {
+		    out[3*i+0] = in[i*words+0];
+		    out[3*i+1] = in[i*words+1];
+		    out[3*i+2] = in[i*words+2];
+		}
+	    }
+	}
+	src  += 4*m*words;
+	done += m;
+    }
+}
+
+tipsypos::offset_type mTipsy::readBlock( tipsypos pos,
+					 tipsypos::offset_type n,
+					 TipsyColumns &c,
+					 tipsypos::offset_type at )
+{
+    tipsypos::offset_type count;
+
+    if ( m_base == 0 ) return 0;
+
+    switch( pos.section() ) {
+    case tipsypos::gas:  count = m_header.h_nSph;  break;
+    case tipsypos::dark: count = m_header.h_nDark; break;
+    case tipsypos::star: count = m_header.h_nStar; break;
+    default:
+	return 0;
+    }
+    if ( pos.offset() >= count ) return 0;
+    if ( n > count - pos.offset() ) n = count - pos.offset();
+
+    const char *src = m_base + offset(pos.section(),pos.offset());
+#ifndef _WIN32
+    //! Ask for the whole run up front instead of faulting it in page by page.
+    //! Short runs (sparse or subsampled reads) are not worth a system call.
+    const std::size_t bytes = tipsyRecordSize(pos.section());
+    if ( n*bytes >= mtipsyAdviseBytes ) {
+	const long page = sysconf(_SC_PAGESIZE);
+	const char *first = m_base + ((src - m_base) / page) * page;
+ #ifdef MADV_POPULATE_READ
+	const int advice = MADV_POPULATE_READ;
+ #else
+	const int advice = MADV_WILLNEED;
+ #endif
+	madvise( const_cast<char *>(first), (src - first) + n*bytes, advice );
+    }
+#endif
+
+    tipsyDecodeRecords( src, m_swap, pos.section(), n, c, at );
+    return n;
+}
@@ -0,0 +1,93 @@
+/**
+ *  @file
+ *  @brief Memory mapped Tipsy file reader
+ */
+
+#ifndef MTIPSY_H
+#define MTIPSY_H
+
+#include "ftipsy.hpp"
+
+//! @brief Size in bytes of one record of a section (zero for eof).
+std::size_t tipsyRecordSize( tipsypos::section_type s );
+
+/** @brief Convert records held in memory to columns.
+ *
+ *  The records are byte swapped a chunk at a time with tipsySwap32 if
+ *  required and then scattered to the requested columns.
+ *  @param src  First record, as stored in the file
+ *  @param swap Records must be byte swapped (standard file, little-endian host)
+ *  @param s    Section (and hence type) of the records
+ *  @param n    Number of records
+ *  @param c    Destination columns
+ *  @param at   Index in c of the first record
+ */
+void tipsyDecodeRecords( const char *src, bool swap, tipsypos::section_type s,
+			 tipsypos::offset_type n, TipsyColumns &c,
+			 tipsypos::offset_type at );
+
+/** @brief Read a Tipsy file through a read-only memory mapping.
+ *
+ *  The whole file is mapped and each section's byte range is computed from
+ *  the header.  Blocks of particles are converted from the mapped records
+ *  to columns a chunk at a time: the chunk is byte swapped as one run of
+ *  32-bit words with the vectorized tipsySwap32 kernel and then scattered
+ *  to the requested columns.  No stream buffer or per-particle virtual call
+ *  is involved, so on a warm page cache a read runs at memory speed.
+ */
+class mTipsy : public TipsyBlockSource {
+protected:
+    const char   *m_base;    //!< Start of the mapping (null if closed).
+    uint64_t      m_size;    //!< Size of the mapping in bytes.
+    bool          m_swap;    //!< Records must be byte swapped.
+    TipsyHeader   m_header;  //!< The file header.
+#ifdef _WIN32
+    void         *m_file;    //!< File handle.
+    void         *m_map;     //!< File mapping handle.
+#endif
+
+    //! @brief Byte offset of a particle within the file.
+    uint64_t offset( tipsypos::section_type s, tipsypos::offset_type o ) const;
+
+public:
+    //! @brief Construct a closed reader.
+    mTipsy();
+
+    //! @brief Construct a reader and open the file.
+    //! @param iname Input file name
+    //! @param adaptertype Type of file (standard or native)
+    explicit mTipsy( const char *iname, const char *adaptertype="standard" );
+
+    //! @brief Unmap the file.
+    virtual ~mTipsy();
+
+    //! @brief Map a Tipsy file and read its header.
+    //! @param iname Input file name
+    //! @param adaptertype Type of file (standard or native)
+    //! @return true if the file was mapped and its size matches the header.
+    bool open( const char *iname, const char *adaptertype="standard" );
+
+    //! @brief Check if the file is mapped.
+    bool is_open() const
+	{ return m_base != 0; }
+
+    //! @brief Unmap the file.
+    void close();
+
+    //! @brief The header of the mapped file.
+    const TipsyHeader &header() const
+	{ return m_header; }
+
+    //! @brief Read a run of particles from one section.
+    //! @param pos  Section and offset of the first particle
+    //! @param n    Maximum number of particles (clipped to the section)
+    //! @param cols Destination columns
+    //! @param at   Index in cols of the first particle read
+    //! @return The number of particles read.
+    virtual tipsypos::offset_type readBlock( tipsypos pos,
+					     tipsypos::offset_type n,
+					     TipsyColumns &cols,
+					     tipsypos::offset_type at );
+};
+
+#endif
@@ -80,6 +80,8 @@ typedef float    disk_float;    //!< A float as stored in the file.
 typedef double   disk_double;   //!< A double as stored in the file.
 
 #include "tipsyrec.h"
+#include "tipsycount.h"
+#include "tipsyblock.h"
 
 //! Construct a Tipsy Native Adapter.
 TipsyNativeAdapter::TipsyNativeAdapter( streambuf_type *sb )
@@ -146,6 +148,15 @@ void TipsyNativeAdapter::forward(void)
     }
 }
 
+//! Advance the file position past a block of n particles.
+void TipsyNativeAdapter::forward( tipsypos::offset_type n )
+{
+    //! A block never crosses a section, so only the last step can switch.
+    if ( n == 0 ) return;
+    m_position.offset() += n - 1;
+    forward();
+}
+
 //! Read the next particle (at the current position).
 void TipsyNativeAdapter::getNext(void)
 {
@@ -153,17 +164,20 @@ void TipsyNativeAdapter::getNext(void)
     tipsyrec_gas    gas;
     tipsyrec_dark   dark;
     tipsyrec_star   star;
+    uint64_t        n[4];
 
     //! Depending on the section, read the appropriate particle type.
     switch( m_position.section() ) {
     case tipsypos::header:
 	assert( m_sb->sgetn( (char *)(&hdr), sizeof(hdr) ) == sizeof(hdr));
+	tipsyDecodeCounts( hdr.h_nBodies, hdr.h_nSph, hdr.h_nDark,
+			   hdr.h_nStar, hdr.h_MBZ, n );
 	m_dTime  = hdr.h_dTime;
-	m_nBodies= hdr.h_nBodies;
+	m_nBodies= n[0];
 	m_nDims  = hdr.h_nDims;
-	m_nSph   = hdr.h_nSph;
-	m_nDark  = hdr.h_nDark;
-	m_nStar  = hdr.h_nStar;
+	m_nSph   = n[1];
+	m_nDark  = n[2];
+	m_nStar  = n[3];
 	break;
     case tipsypos::gas:
 	assert( m_sb->sgetn( (char *)(&gas), sizeof(gas) ) == sizeof(gas));
@@ -226,12 +240,13 @@ void TipsyNativeAdapter::putNext(void)
     switch( m_position.section() ) {
     case tipsypos::header:
 	hdr.h_dTime  = m_dTime;
-	hdr.h_nBodies= m_nBodies;
+	//! Counts beyond 32 bits keep their high bits in the pad word.
+	hdr.h_nBodies= uint32_t(m_nBodies);
 	hdr.h_nDims  = m_nDims;
-	hdr.h_nSph   = m_nSph;
-	hdr.h_nDark  = m_nDark;
-	hdr.h_nStar  = m_nStar;
-	hdr.h_MBZ    = 0;
+	hdr.h_nSph   = uint32_t(m_nSph);
+	hdr.h_nDark  = uint32_t(m_nDark);
+	hdr.h_nStar  = uint32_t(m_nStar);
+	hdr.h_MBZ    = tipsyEncodePad( m_nBodies, m_nSph, m_nDark, m_nStar );
 	m_sb->sputn( (char *)(&hdr), sizeof(hdr) );
 	break;
     case tipsypos::gas:
@@ -283,6 +298,35 @@ void TipsyNativeAdapter::putNext(void)
     forward();
 }
 
+//! Read up to n particles from the current section.
+tipsypos::offset_type TipsyNativeAdapter::getBlock( tipsypos::offset_type n,
+						    TipsyColumns &cols,
+						    tipsypos::offset_type at )
+{
+    tipsypos::offset_type done = 0;
+
+    //! Clip the request to the end of the section and read it in chunks.
+    switch( m_position.section() ) {
+    case tipsypos::gas:
+	if ( n > m_nSph - m_position.offset() ) n = m_nSph - m_position.offset();
+	done = tipsyReadBlock<tipsyrec_gas>( m_sb, n, cols, at );
+	break;
+    case tipsypos::dark:
+	if ( n > m_nDark - m_position.offset() ) n = m_nDark - m_position.offset();
+	done = tipsyReadBlock<tipsyrec_dark>( m_sb, n, cols, at );
+	break;
+    case tipsypos::star:
+	if ( n > m_nStar - m_position.offset() ) n = m_nStar - m_position.offset();
+	done = tipsyReadBlock<tipsyrec_star>( m_sb, n, cols, at );
+	break;
+    default:
+	assert( "Invalid block read position" == 0 );
+    }
+
+    forward(done);
+    return done;
+}
+
 //! Move the get pointer (seek) to the specified particle.
 tipsypos TipsyNativeAdapter::seekg( tipsypos & pos )
 {
@@ -60,6 +60,10 @@ protected:
     //! @brief Move forward a single particle.
     void forward(void);
 
+    //! @brief Move forward after a block of particles was read.
+    //! @param n The number of particles read.
+    void forward( tipsypos::offset_type n );
+
     //! @brief Initialize this object.
     //! @param sb The streambuf object to use.
     void init( streambuf_type *sb );
@@ -75,6 +79,15 @@ public:
     //! @brief Write the next record (header or particle).
     virtual void putNext();
 
+    //! @brief Read a block of particles from the current section.
+    //! @param n    Maximum number of particles to read.
+    //! @param cols Destination columns.
+    //! @param at   Index in cols of the first particle read.
+    //! @return The number of particles read.
+    virtual tipsypos::offset_type getBlock( tipsypos::offset_type n,
+					    TipsyColumns &cols,
+					    tipsypos::offset_type at );
+
     //! @brief Seek the get pointer to a specific particle.
     //! @param pos The particle to seek to.
     virtual tipsypos seekg( tipsypos &pos );
@@ -25,7 +25,7 @@ int main( int argc, char *argv[] ) {
     TipsyGasParticle  g; // A gas particle
     TipsyDarkParticle d; // A dark particle
     TipsyStarParticle s; // A star particle
-    uint32_t i;
+    uint64_t i;
     float c[3];
 
 
@@ -22,6 +22,15 @@ public:
 
     //! @brief Write the next particle to the stream.
     virtual void putNext();
+
+    //! @brief Read a block of particles from the current section.
+    //! @param n    Maximum number of particles to read.
+    //! @param cols Destination columns.
+    //! @param at   Index in cols of the first particle read.
+    //! @return The number of particles read.
+    virtual tipsypos::offset_type getBlock( tipsypos::offset_type n,
+					    TipsyColumns &cols,
+					    tipsypos::offset_type at );
 };
 
 #endif
@@ -0,0 +1,208 @@
+/**
+ *  @file
+ *  @brief Time per-particle reads against block reads of a Tipsy file.
+ *
+ *  Usage: tblock [--generate N] <standard>
+ *
+ *  With --generate a synthetic standard file of N dark particles is written
+ *  first.  The file is then read three times: a particle at a time with a
+ *  seek before every particle (as the ParaView reader used to), a section
+ *  at a time with readBlock, and a section at a time from a memory mapping
+ *  (mTipsy).  The results are compared.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <vector>
+#include <getopt.h>
+#include <sys/time.h>
+#include "ftipsy.hpp"
+#include "mtipsy.hpp"
+#include "byteswap.h"
+
+#define OPT_GENERATE 'g'
+
+static double Now(void) {
+    struct timeval tv;
+    gettimeofday(&tv,0);
+    return tv.tv_sec + 1e-6*tv.tv_usec;
+}
+
+//! Storage for every field a particle can have.
+class Fields {
+public:
+    std::vector<float> pos, vel, mass, phi, eps, rho, temp, hsmooth, metals, tform;
+    TipsyColumns cols;
+
+    explicit Fields( uint64_t n )
+	: pos(3*n), vel(3*n), mass(n), phi(n), eps(n), rho(n), temp(n),
+	  hsmooth(n), metals(n), tform(n) {
+	cols.pos = &pos[0];     cols.vel = &vel[0];
+	cols.mass = &mass[0];   cols.phi = &phi[0];
+	cols.eps = &eps[0];     cols.rho = &rho[0];
+	cols.temp = &temp[0];   cols.hsmooth = &hsmooth[0];
+	cols.metals = &metals[0]; cols.tform = &tform[0];
+    }
+    bool operator==( const Fields &o ) const {
+	return pos==o.pos && vel==o.vel && mass==o.mass && phi==o.phi
+	    && eps==o.eps && rho==o.rho && temp==o.temp
+	    && hsmooth==o.hsmooth && metals==o.metals && tform==o.tform;
+    }
+};
+
+static void Generate( const char *name, uint64_t n ) {
+    ofTipsy out(name,"standard");
+    TipsyHeader h;
+    TipsyDarkParticle d;
+    memset(&d,0,sizeof(d));
+    h.h_time = 1.0; h.h_nDims = 3;
+    h.h_nBodies = h.h_nDark = n; h.h_nSph = h.h_nStar = 0;
+    out << h;
+    srand(42);
+    for( uint64_t i=0; i<n; i++ ) {
+	d.mass = 1.0f / n;
+	for( int j=0; j<3; j++ ) {
+	    d.pos[j] = rand() / (RAND_MAX+1.0) - 0.5;
+	    d.vel[j] = rand() / (RAND_MAX+1.0) - 0.5;
+	}
+	d.eps = 1e-3f; d.phi = -d.pos[0];
+	out << d;
+    }
+    out.close();
+}
+
+static void ReadSingle( const char *name, TipsyHeader &h, Fields &f ) {
+    ifTipsy in(name,"standard");
+    TipsyGasParticle  g;
+    TipsyDarkParticle d;
+    TipsyStarParticle s;
+    in >> h;
+    for( uint64_t i=0; i<h.h_nBodies; i++ ) {
+	TipsyBaseParticle *b;
+	if ( i < h.h_nSph ) {
+	    in.seekg(tipsypos(tipsypos::gas,i)); in >> g; b = &g;
+	    f.rho[i]=g.rho; f.temp[i]=g.temp; f.hsmooth[i]=g.hsmooth;
+	    f.metals[i]=g.metals;
+	}
+	else if ( i < h.h_nSph + h.h_nDark ) {
+	    in.seekg(tipsypos(tipsypos::dark,i-h.h_nSph)); in >> d; b = &d;
+	    f.eps[i]=d.eps;
+	}
+	else {
+	    in.seekg(tipsypos(tipsypos::star,i-h.h_nSph-h.h_nDark));
+	    in >> s; b = &s;
+	    f.eps[i]=s.eps; f.metals[i]=s.metals; f.tform[i]=s.tform;
+	}
+	for( int j=0; j<3; j++ ) {
+	    f.pos[3*i+j] = b->pos[j];
+	    f.vel[3*i+j] = b->vel[j];
+	}
+	f.mass[i] = b->mass;
+	f.phi[i]  = b->phi;
+    }
+    in.close();
+}
+
+static void ReadBlock( const char *name, TipsyHeader &h, Fields &f ) {
+    ifTipsy in(name,"standard");
+    uint64_t at = 0;
+    in >> h;
+    if ( h.h_nSph ) {
+	in.seekg(tipsypos(tipsypos::gas,0));
+	at += in.readBlock(h.h_nSph,f.cols,at);
+    }
+    if ( h.h_nDark ) {
+	in.seekg(tipsypos(tipsypos::dark,0));
+	at += in.readBlock(h.h_nDark,f.cols,at);
+    }
+    if ( h.h_nStar ) {
+	in.seekg(tipsypos(tipsypos::star,0));
+	at += in.readBlock(h.h_nStar,f.cols,at);
+    }
+    in.close();
+}
+
+static void ReadMapped( const char *name, TipsyHeader &h, Fields &f ) {
+    mTipsy in(name,"standard");
+    uint64_t at = 0;
+    h = in.header();
+    at += in.readBlock(tipsypos(tipsypos::gas,0),h.h_nSph,f.cols,at);
+    at += in.readBlock(tipsypos(tipsypos::dark,0),h.h_nDark,f.cols,at);
+    at += in.readBlock(tipsypos(tipsypos::star,0),h.h_nStar,f.cols,at);
+    in.close();
+}
+
+int main( int argc, char *argv[] ) {
+    uint64_t nGenerate = 0;
+    const char *tipsyName;
+    TipsyHeader h;
+
+    //! Parse command line
+    for(;;) {
+        int c, option_index=0;
+
+        static struct option long_options[] = {
+            { "generate",    1, 0, OPT_GENERATE },
+            { 0,             0, 0, 0 }
+        };
+
+        c = getopt_long( argc, argv, "g:",
+                         long_options, &option_index );
+        if ( c == -1 ) break;
+        switch(c) {
+        case OPT_GENERATE:
+	    nGenerate = strtoull(optarg,0,10);
+            break;
+	default:
+	    exit(1);
+	}
+    }
+
+    if ( optind < argc ) {
+        tipsyName = argv[optind++];
+    }
+    else {
+        std::cerr << "Usage: " << argv[0]
+		  << " [--generate N] <standard>" << std::endl;
+        exit(2);
+    }
+
+    if ( nGenerate ) Generate(tipsyName,nGenerate);
+
+    {
+	ifTipsy in(tipsyName,"standard");
+	if ( ! in.is_open() ) {
+	    std::cerr << "Unable to open Tipsy binary " << tipsyName << std::endl;
+	    exit(2);
+	}
+	in >> h;
+    }
+
+    Fields single(h.h_nBodies), block(h.h_nBodies), mapped(h.h_nBodies);
+    double t0 = Now();
+    ReadSingle(tipsyName,h,single);
+    double t1 = Now();
+    ReadBlock(tipsyName,h,block);
+    double t2 = Now();
+    ReadMapped(tipsyName,h,mapped);
+    double t3 = Now();
+
+    std::cout << h.h_nBodies << " particles" << std::endl
+	      << "per-particle: " << t1-t0 << " s" << std::endl
+	      << "block:        " << t2-t1 << " s" << std::endl
+	      << "mapped (" << tipsySwap32Kernel() << "): "
+	      << t3-t2 << " s" << std::endl
+	      << "speedup:      " << (t1-t0)/(t2-t1) << " (block), "
+	      << (t1-t0)/(t3-t2) << " (mapped)" << std::endl;
+
+    if ( !(single == block) ) {
+	std::cerr << "MISMATCH between per-particle and block reads" << std::endl;
+	return 1;
+    }
+    if ( !(single == mapped) ) {
+	std::cerr << "MISMATCH between per-particle and mapped reads" << std::endl;
+	return 1;
+    }
+    return 0;
+}
@@ -90,7 +90,7 @@ int main( int argc, char *argv[] ) {
     TipsyDarkParticle d1, d2;
     TipsyStarParticle s1, s2;
 
-    uint32_t i;
+    uint64_t i;
 
     if ( argc < 3 ) {
         fprintf( stderr, "Usage: %s <instd1> <instd2>\n", argv[0] );
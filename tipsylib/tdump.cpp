@@ -143,7 +143,7 @@ int main( int argc, char *argv[] ) {
     TipsyDarkParticle d;
     TipsyStarParticle s;
 
-    unsigned int i;
+    uint64_t i;
 
 
     //! Parse command line
@@ -290,7 +290,7 @@ int main( int argc, char *argv[] ) {
 
     if ( !markname.empty() ) {
 	std::ifstream mf(markname.c_str());
-	uint32_t nd, ng, ns;
+	uint64_t nd, ng, ns;
 	if ( !mf.is_open() ) {
 	    std::cerr << "Unable to open " << markname << std::endl;
 	    exit(2);
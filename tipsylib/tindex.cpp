@@ -0,0 +1,161 @@
+/**
+ *  @file
+ *  @brief Write a Peano-Hilbert sidecar index for a Tipsy file.
+ *
+ *  Usage: tindex [--bits B] [--level L] [--output name] <standard|blocked>
+ *
+ *  The positions are read, a key is computed for every particle inside the
+ *  smallest cube enclosing them all, and the particles are sorted by key.
+ *  The sorted keys, the permutation and a table of level-L octree cell
+ *  offsets are written to <standard>.phidx (or the --output name).  By
+ *  default L is the deepest level up to 6 with no more cells than particles.
+ *  The ParaView reader uses the index to give each piece a compact region,
+ *  and to read only the particles near a box or sphere of interest.
+ */
+
+#include <stdlib.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <getopt.h>
+#include "mtipsy.hpp"
+#include "zblock.hpp"
+#include "tipsyidx.hpp"
+#include "hilbert.h"
+
+#define OPT_BITS   'b'
+#define OPT_LEVEL  'l'
+#define OPT_OUTPUT 'o'
+
+//! Orders the permutation by key, and by file order within a key.
+class KeyLess {
+    const std::vector<uint64_t> &m_keys;
+public:
+    explicit KeyLess( const std::vector<uint64_t> &keys ) : m_keys(keys) {}
+    bool operator()( uint64_t a, uint64_t b ) const {
+	return m_keys[a] < m_keys[b] || (m_keys[a] == m_keys[b] && a < b);
+    }
+};
+
+int main( int argc, char *argv[] ) {
+    int bits = hilbertMaxBits;
+    int level = -1;
+    std::string outName;
+    const char *tipsyName;
+
+    //! Parse command line
+    for(;;) {
+        int c, option_index=0;
+
+        static struct option long_options[] = {
+            { "bits",        1, 0, OPT_BITS },
+            { "level",       1, 0, OPT_LEVEL },
+            { "output",      1, 0, OPT_OUTPUT },
+            { 0,             0, 0, 0 }
+        };
+
+        c = getopt_long( argc, argv, "b:l:o:",
+                         long_options, &option_index );
+        if ( c == -1 ) break;
+        switch(c) {
+        case OPT_BITS:
+	    bits = atoi(optarg);
+            break;
+        case OPT_LEVEL:
+	    level = atoi(optarg);
+            break;
+        case OPT_OUTPUT:
+	    outName = optarg;
+            break;
+	default:
+	    exit(1);
+	}
+    }
+
+    if ( optind < argc ) {
+        tipsyName = argv[optind++];
+    }
+    else {
+        std::cerr << "Usage: " << argv[0]
+		  << " [--bits B] [--level L] [--output name] <standard>"
+		  << std::endl;
+        exit(2);
+    }
+    if ( bits < 1 || bits > hilbertMaxBits || level < -1 || level > bits
+	 || level > 10 ) {
+	std::cerr << "bits must be in [1," << hilbertMaxBits
+		  << "] and level in [0,min(bits,10)]" << std::endl;
+	exit(2);
+    }
+    if ( outName.empty() ) outName = TipsyKeyIndex::sidecarName(tipsyName);
+
+    //! Block compressed files are indexed like the standard file they hold.
+    zbTipsy blocked;
+    mTipsy mapped;
+    TipsyBlockSource *in;
+    TipsyHeader h;
+    if ( blocked.open(tipsyName) ) {
+	in = &blocked;
+	h = blocked.header();
+    }
+    else if ( mapped.open(tipsyName,"standard") ) {
+	in = &mapped;
+	h = mapped.header();
+    }
+    else {
+	std::cerr << "Unable to open Tipsy binary " << tipsyName << std::endl;
+	exit(2);
+    }
+    uint64_t n = h.h_nBodies;
+    if ( level < 0 )
+	for( level=0; level<6 && level<bits
+		 && (uint64_t(8)<<(3*level)) <= n; level++ ) {}
+
+    //! Only the positions are needed.
+    std::vector<float> pos(3*n);
+    TipsyColumns cols;
+    uint64_t at = 0;
+    if ( n ) {
+	cols.pos = &pos[0];
+	at += in->readBlock(tipsypos(tipsypos::gas,0),h.h_nSph,cols,at);
+	at += in->readBlock(tipsypos(tipsypos::dark,0),h.h_nDark,cols,at);
+	at += in->readBlock(tipsypos(tipsypos::star,0),h.h_nStar,cols,at);
+    }
+    blocked.close();
+    mapped.close();
+    if ( at != n ) {
+	std::cerr << "Short read of " << tipsyName << std::endl;
+	exit(2);
+    }
+
+    double bounds[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+    if ( n ) for( int d=0; d<3; d++ ) {
+	bounds[2*d] = bounds[2*d+1] = pos[d];
+    }
+    for( uint64_t i=0; i<n; i++ ) {
+	for( int d=0; d<3; d++ ) {
+	    bounds[2*d]   = std::min( bounds[2*d],   double(pos[3*i+d]) );
+	    bounds[2*d+1] = std::max( bounds[2*d+1], double(pos[3*i+d]) );
+	}
+    }
+    TipsyKeyIndex::cubeBounds(bounds,bounds);
+
+    std::vector<uint64_t> keys(n), order(n);
+    for( uint64_t i=0; i<n; i++ ) {
+	keys[i] = TipsyKeyIndex::keyOf(&pos[3*i],bounds,bits);
+	order[i] = i;
+    }
+    std::vector<float>().swap(pos);
+    std::sort( order.begin(), order.end(), KeyLess(keys) );
+
+    std::vector<uint64_t> sorted(n);
+    for( uint64_t i=0; i<n; i++ ) sorted[i] = keys[order[i]];
+    std::vector<uint64_t>().swap(keys);
+
+    if ( !TipsyKeyIndex::write(outName.c_str(),bits,level,bounds,sorted,order) ) {
+	std::cerr << "Unable to write " << outName << std::endl;
+	exit(2);
+    }
+    std::cout << "Indexed " << n << " particles into " << outName << std::endl;
+    return 0;
+}
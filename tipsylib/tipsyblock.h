@@ -0,0 +1,131 @@
+/**
+ *  @file
+ *  @brief Block decoding of Tipsy particle records
+ *
+ *  You must include tipsyrec.h (and hence define the disk types) before
+ *  including this file.  Each adapter includes it once so that the same
+ *  code is compiled against its own on-disk representation.
+ */
+
+#ifndef TIPSYBLOCK_H
+#define TIPSYBLOCK_H
+
+#include <vector>
+#include <streambuf>
+#include "tipsypos.h"
+#include "tipsycols.h"
+
+//! Number of records read from the stream buffer at a time.
+static const std::size_t tipsyBlockChunk = 4096;
+
+//! @brief Decode gas records into columns.
+//! @param r   First record
+//! @param n   Number of records
+//! @param c   Destination columns
+//! @param at  Destination index of the first record
+static inline void tipsyDecode( const tipsyrec_gas *r, std::size_t n,
+				TipsyColumns &c, std::size_t at )
+{
+    std::size_t i;
+    if ( c.pos ) for( i=0; i<n; i++ ) {
+	c.pos[3*(at+i)+0] = r[i].pos[0];
+	c.pos[3*(at+i)+1] = r[i].pos[1];
+	c.pos[3*(at+i)+2] = r[i].pos[2];
+    }
+    if ( c.vel ) for( i=0; i<n; i++ ) {
+	c.vel[3*(at+i)+0] = r[i].vel[0];
+	c.vel[3*(at+i)+1] = r[i].vel[1];
+	c.vel[3*(at+i)+2] = r[i].vel[2];
+    }
+    if ( c.mass )    for( i=0; i<n; i++ ) c.mass[at+i]    = r[i].mass;
+    if ( c.phi )     for( i=0; i<n; i++ ) c.phi[at+i]     = r[i].phi;
+    if ( c.rho )     for( i=0; i<n; i++ ) c.rho[at+i]     = r[i].rho;
+    if ( c.temp )    for( i=0; i<n; i++ ) c.temp[at+i]    = r[i].temp;
+    if ( c.hsmooth ) for( i=0; i<n; i++ ) c.hsmooth[at+i] = r[i].hsmooth;
+    if ( c.metals )  for( i=0; i<n; i++ ) c.metals[at+i]  = r[i].metals;
+}
+
+//! @brief Decode dark records into columns.
+//! @param r   First record
+//! @param n   Number of records
+//! @param c   Destination columns
+//! @param at  Destination index of the first record
+static inline void tipsyDecode( const tipsyrec_dark *r, std::size_t n,
+				TipsyColumns &c, std::size_t at )
+{
+    std::size_t i;
+    if ( c.pos ) for( i=0; i<n; i++ ) {
+	c.pos[3*(at+i)+0] = r[i].pos[0];
+	c.pos[3*(at+i)+1] = r[i].pos[1];
+	c.pos[3*(at+i)+2] = r[i].pos[2];
+    }
+    if ( c.vel ) for( i=0; i<n; i++ ) {
+	c.vel[3*(at+i)+0] = r[i].vel[0];
+	c.vel[3*(at+i)+1] = r[i].vel[1];
+	c.vel[3*(at+i)+2] = r[i].vel[2];
+    }
+    if ( c.mass ) for( i=0; i<n; i++ ) c.mass[at+i] = r[i].mass;
+    if ( c.phi )  for( i=0; i<n; i++ ) c.phi[at+i]  = r[i].phi;
+    if ( c.eps )  for( i=0; i<n; i++ ) c.eps[at+i]  = r[i].eps;
+}
+
+//! @brief Decode star records into columns.
+//! @param r   First record
+//! @param n   Number of records
+//! @param c   Destination columns
+//! @param at  Destination index of the first record
+static inline void tipsyDecode( const tipsyrec_star *r, std::size_t n,
+				TipsyColumns &c, std::size_t at )
+{
+    std::size_t i;
+    if ( c.pos ) for( i=0; i<n; i++ ) {
+	c.pos[3*(at+i)+0] = r[i].pos[0];
+	c.pos[3*(at+i)+1] = r[i].pos[1];
+	c.pos[3*(at+i)+2] = r[i].pos[2];
+    }
+    if ( c.vel ) for( i=0; i<n; i++ ) {
+	c.vel[3*(at+i)+0] = r[i].vel[0];
+	c.vel[3*(at+i)+1] = r[i].vel[1];
+	c.vel[3*(at+i)+2] = r[i].vel[2];
+    }
+    if ( c.mass )   for( i=0; i<n; i++ ) c.mass[at+i]   = r[i].mass;
+    if ( c.phi )    for( i=0; i<n; i++ ) c.phi[at+i]    = r[i].phi;
+    if ( c.eps )    for( i=0; i<n; i++ ) c.eps[at+i]    = r[i].eps;
+    if ( c.metals ) for( i=0; i<n; i++ ) c.metals[at+i] = r[i].metals;
+    if ( c.tform )  for( i=0; i<n; i++ ) c.tform[at+i]  = r[i].tform;
+}
+
+/** @brief Read and decode a run of records of one type.
+ *
+ *  Records are pulled from the stream buffer tipsyBlockChunk at a time and
+ *  decoded field by field, so there is one sgetn per chunk rather than one
+ *  per particle.
+ *
+ *  @param sb  Stream buffer positioned at the first record
+ *  @param n   Number of records to read
+ *  @param c   Destination columns
+ *  @param at  Destination index of the first record
+ *  @return The number of records actually read.
+ */
+template<class REC>
+static tipsypos::offset_type tipsyReadBlock( std::basic_streambuf<char> *sb,
+					     tipsypos::offset_type n,
+					     TipsyColumns &c,
+					     tipsypos::offset_type at )
+{
+    std::vector<REC> buf( n < tipsyBlockChunk ? std::size_t(n) : tipsyBlockChunk );
+    tipsypos::offset_type done = 0;
+
+    while( done < n ) {
+	std::size_t want = buf.size();
+	if ( n - done < want ) want = std::size_t(n - done);
+	std::streamsize got = sb->sgetn( (char *)(&buf[0]), want*sizeof(REC) );
+	std::size_t nrec = std::size_t(got) / sizeof(REC);
+	tipsyDecode( &buf[0], nrec, c, std::size_t(at+done) );
+	done += nrec;
+	if ( nrec != want ) break;
+    }
+    return done;
+}
+
+#endif
@@ -0,0 +1,69 @@
+/**
+ *  @file
+ *  @brief Column (structure of arrays) destination for block reads
+ */
+
+#ifndef TIPSYCOLS_H
+#define TIPSYCOLS_H
+
+#include <cstddef>
+#include "tipsypos.h"
+
+/** @brief Destination buffers for a block of particles.
+ *
+ *  Each pointer refers to caller owned storage with room for every particle
+ *  that will be read into it.  Vector quantities (pos, vel) are stored
+ *  interleaved, three floats per particle.  Any pointer may be left null,
+ *  in which case that field is skipped.  Fields that a particle type does
+ *  not have (e.g., rho for dark particles) are left untouched.
+ */
+class TipsyColumns {
+public:
+    float *pos;     //!< Positions (x,y,z), three per particle
+    float *vel;     //!< Velocities (Vx,Vy,Vz), three per particle
+    float *mass;    //!< Mass
+    float *phi;     //!< Potential
+    float *eps;     //!< Softening (dark and star)
+    float *rho;     //!< rho (gas)
+    float *temp;    //!< Temperature (gas)
+    float *hsmooth; //!< hsmooth (gas)
+    float *metals;  //!< Metals (gas and star)
+    float *tform;   //!< tform (star)
+
+    //! @brief Construct an empty set of columns (all fields skipped).
+    TipsyColumns()
+	: pos(0), vel(0), mass(0), phi(0), eps(0), rho(0), temp(0),
+	  hsmooth(0), metals(0), tform(0) {}
+
+    //! @brief Return true if at least one field is to be read.
+    bool any() const {
+	return pos || vel || mass || phi || eps || rho || temp
+	    || hsmooth || metals || tform;
+    }
+};
+
+/** @brief Something that can deliver runs of particles into columns.
+ *
+ *  This is implemented by the memory mapped reader (mTipsy) and, through
+ *  TipsyStreamSource, by any iTipsy stream so that callers need not care
+ *  how the file is being accessed.
+ */
+class TipsyBlockSource {
+public:
+    //! @brief Destroy a block source.
+    virtual ~TipsyBlockSource() {}
+
+    /** @brief Read a run of particles from one section.
+     *  @param pos  Section and offset of the first particle
+     *  @param n    Maximum number of particles (clipped to the section)
+     *  @param cols Destination columns
+     *  @param at   Index in cols of the first particle read
+     *  @return The number of particles read.
+     */
+    virtual tipsypos::offset_type readBlock( tipsypos pos,
+					     tipsypos::offset_type n,
+					     TipsyColumns &cols,
+					     tipsypos::offset_type at ) = 0;
+};
+
+#endif
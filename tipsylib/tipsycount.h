@@ -0,0 +1,51 @@
+/**
+ *  @file
+ *  @brief Particle counts of more than 32 bits in a Tipsy header
+ *
+ *  The header has room for 32-bit counts only.  Files with more particles
+ *  keep bits 32 to 39 of each count in one byte of the pad word that
+ *  follows: nBodies in the low byte, then nSph, nDark and nStar.  This is
+ *  what pkdgrav (fio) writes, so such files hold up to 2^40 particles.
+ *  Older files may have junk in the pad word, which is detected because
+ *  the counts then do not add up, and the pad word is ignored.
+ */
+
+#ifndef TIPSYCOUNT_H
+#define TIPSYCOUNT_H
+
+#include "tipsypos.h"
+
+/** @brief Decode the particle counts of a header.
+ *  @param nBodies Low 32 bits of the total number of particles
+ *  @param nSph    Low 32 bits of the number of gas particles
+ *  @param nDark   Low 32 bits of the number of dark particles
+ *  @param nStar   Low 32 bits of the number of star particles
+ *  @param pad     The pad word
+ *  @param n       Receives the full counts: total, gas, dark, star
+ */
+static inline void tipsyDecodeCounts( uint32_t nBodies, uint32_t nSph,
+				      uint32_t nDark, uint32_t nStar,
+				      uint32_t pad, uint64_t n[4] )
+{
+    n[0] = (uint64_t(pad & 0xff)        << 32) + nBodies;
+    n[1] = (uint64_t((pad>>8)  & 0xff)  << 32) + nSph;
+    n[2] = (uint64_t((pad>>16) & 0xff)  << 32) + nDark;
+    n[3] = (uint64_t((pad>>24) & 0xff)  << 32) + nStar;
+    if ( n[0] != n[1] + n[2] + n[3] ) {
+	n[0] = nBodies; n[1] = nSph; n[2] = nDark; n[3] = nStar;
+    }
+}
+
+/** @brief Encode the high bits of the particle counts as a pad word.
+ *  @return The pad word, zero if every count fits in 32 bits.
+ */
+static inline uint32_t tipsyEncodePad( uint64_t nBodies, uint64_t nSph,
+				       uint64_t nDark, uint64_t nStar )
+{
+    return uint32_t( ((nBodies>>32) & 0xff)
+		     | (((nSph>>32)  & 0xff) << 8)
+		     | (((nDark>>32) & 0xff) << 16)
+		     | (((nStar>>32) & 0xff) << 24) );
+}
+
+#endif
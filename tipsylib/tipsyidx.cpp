@@ -0,0 +1,260 @@
+/**
+ *  @file
+ *  @brief Peano-Hilbert sidecar index of a Tipsy file
+ */
+
+#include <cstring>
+#include <algorithm>
+#include "tipsyidx.hpp"
+#include "hilbert.h"
+
+static const char tipsyIdxMagic[8] = { 'T','I','P','S','Y','P','H','I' };
+static const uint32_t tipsyIdxVersion = 1;
+
+TipsyRegion::TipsyRegion( const double b[6] )
+    : shape(box), radius(0.0)
+{
+    for( int i=0; i<6; i++ ) bounds[i] = b[i];
+    center[0] = center[1] = center[2] = 0.0;
+}
+
+TipsyRegion::TipsyRegion( const double c[3], double r )
+    : shape(sphere), radius(r)
+{
+    for( int d=0; d<3; d++ ) {
+	center[d] = c[d];
+	bounds[2*d]   = c[d] - r;
+	bounds[2*d+1] = c[d] + r;
+    }
+}
+
+int TipsyRegion::classify( const double cell[6] ) const
+{
+    if ( shape == box ) {
+	bool inside = true;
+	for( int d=0; d<3; d++ ) {
+	    if ( cell[2*d+1] < bounds[2*d] || cell[2*d] > bounds[2*d+1] )
+		return -1;
+	    if ( cell[2*d] < bounds[2*d] || cell[2*d+1] > bounds[2*d+1] )
+		inside = false;
+	}
+	return inside ? 1 : 0;
+    }
+
+    //! Distances to the nearest and to the farthest point of the cell.
+    double near2 = 0.0, far2 = 0.0;
+    for( int d=0; d<3; d++ ) {
+	double lo = cell[2*d] - center[d], hi = cell[2*d+1] - center[d];
+	if ( lo > 0.0 ) near2 += lo*lo;
+	else if ( hi < 0.0 ) near2 += hi*hi;
+	far2 += std::max( lo*lo, hi*hi );
+    }
+    if ( near2 > radius*radius ) return -1;
+    return far2 <= radius*radius ? 1 : 0;
+}
+
+TipsyKeyIndex::TipsyKeyIndex()
+{
+    memset(&m_hdr,0,sizeof(m_hdr));
+}
+
+std::string TipsyKeyIndex::sidecarName( const char *tipsyName )
+{
+    return std::string(tipsyName) + ".phidx";
+}
+
+bool TipsyKeyIndex::open( const char *name )
+{
+    close();
+    m_in.open( name, std::ios_base::in|std::ios_base::binary );
+    if ( !m_in.is_open() ) return false;
+
+    //! Check the header before trusting any of the sizes in it.
+    if ( !m_in.read( (char *)(&m_hdr), sizeof(m_hdr) )
+	 || memcmp( m_hdr.magic, tipsyIdxMagic, sizeof(tipsyIdxMagic) ) != 0
+	 || m_hdr.version != tipsyIdxVersion
+	 || m_hdr.bits < 1 || m_hdr.bits > uint32_t(hilbertMaxBits)
+	 || m_hdr.level > m_hdr.bits || m_hdr.level > 10 ) {
+	close();
+	return false;
+    }
+
+    //! The offsets table is small (8^level+1 entries) and kept in memory.
+    m_offsets.resize( (uint64_t(1) << (3*m_hdr.level)) + 1 );
+    m_in.seekg( std::streamoff(orderAt() + 8*m_hdr.nBodies) );
+    if ( !m_in.read( (char *)(&m_offsets[0]), 8*m_offsets.size() )
+	 || m_offsets.back() != m_hdr.nBodies ) {
+	close();
+	return false;
+    }
+    return true;
+}
+
+void TipsyKeyIndex::close()
+{
+    if ( m_in.is_open() ) m_in.close();
+    m_in.clear();
+    m_offsets.clear();
+    memset(&m_hdr,0,sizeof(m_hdr));
+}
+
+void TipsyKeyIndex::cellCoordinates( uint64_t cell, uint32_t x[3] ) const
+{
+    hilbertCell( cell, m_hdr.level, x );
+}
+
+uint64_t TipsyKeyIndex::cellAt( const uint32_t x[3] ) const
+{
+    return hilbertKey( x, m_hdr.level );
+}
+
+uint64_t TipsyKeyIndex::keyOf( const float pos[3] ) const
+{
+    return keyOf( pos, m_hdr.bounds, m_hdr.bits );
+}
+
+bool TipsyKeyIndex::readKeys( uint64_t first, uint64_t n, uint64_t *keys )
+{
+    if ( first + n > m_hdr.nBodies ) return false;
+    m_in.seekg( std::streamoff(keysAt() + 8*first) );
+    return bool( m_in.read( (char *)keys, 8*n ) );
+}
+
+bool TipsyKeyIndex::readOrder( uint64_t first, uint64_t n, uint64_t *order )
+{
+    if ( first + n > m_hdr.nBodies ) return false;
+    m_in.seekg( std::streamoff(orderAt() + 8*first) );
+    return bool( m_in.read( (char *)order, 8*n ) );
+}
+
+void TipsyKeyIndex::nodeBounds( uint64_t node, uint32_t level,
+				double b[6] ) const
+{
+    uint32_t x[3] = { 0, 0, 0 };
+    if ( level > 0 ) hilbertCell( node, level, x );
+    const double side = (m_hdr.bounds[1] - m_hdr.bounds[0])
+	/ double(uint64_t(1) << level);
+    for( int d=0; d<3; d++ ) {
+	b[2*d]   = m_hdr.bounds[2*d] + side * x[d];
+	b[2*d+1] = b[2*d] + side;
+    }
+}
+
+bool TipsyKeyIndex::selectRegion( const TipsyRegion &region,
+				  std::vector<range_type> &ranges,
+				  uint64_t leaf )
+{
+    ranges.clear();
+    if ( !is_open() || m_hdr.nBodies == 0 ) return true;
+    std::vector<uint64_t> keys;
+    selectNode( region, 0, 0, 0, m_hdr.nBodies, leaf, keys, 0, ranges );
+    return bool(m_in);
+}
+
+void TipsyKeyIndex::selectNode( const TipsyRegion &region, uint64_t node,
+				uint32_t level, uint64_t first, uint64_t last,
+				uint64_t leaf, std::vector<uint64_t> &keys,
+				uint64_t base, std::vector<range_type> &ranges )
+{
+    if ( first == last ) return;
+    double b[6];
+    nodeBounds( node, level, b );
+    int where = region.classify( b );
+    if ( where < 0 ) return;
+    if ( where > 0 || last - first <= leaf || level == m_hdr.bits ) {
+	if ( !ranges.empty() && ranges.back().second == first )
+	    ranges.back().second = last;
+	else
+	    ranges.push_back( range_type(first,last) );
+	return;
+    }
+
+    //! Read the keys of a table cell before descending below the table.
+    if ( level == m_hdr.level ) {
+	keys.resize( std::size_t(last-first) );
+	if ( !readKeys( first, last-first, &keys[0] ) ) return;
+	base = first;
+    }
+
+    //! The children are consecutive in key order, as are their runs.
+    for( uint64_t c=0; c<8; c++ ) {
+	uint64_t child = 8*node + c, cf, cl;
+	if ( level < m_hdr.level ) {
+	    const int shift = 3*(m_hdr.level-level-1);
+	    cf = m_offsets[child << shift];
+	    cl = m_offsets[(child+1) << shift];
+	}
+	else {
+	    const int shift = 3*(m_hdr.bits-level-1);
+	    const uint64_t lo = child << shift, hi = (child+1) << shift;
+	    cf = base + (std::lower_bound(keys.begin(),keys.end(),lo)
+			 - keys.begin());
+	    cl = base + (std::lower_bound(keys.begin(),keys.end(),hi)
+			 - keys.begin());
+	}
+	selectNode( region, child, level+1, cf, cl, leaf, keys, base, ranges );
+    }
+}
+
+bool TipsyKeyIndex::write( const char *name, int bits, int level,
+			   const double bounds[6],
+			   const std::vector<uint64_t> &keys,
+			   const std::vector<uint64_t> &order )
+{
+    header_type hdr;
+    memset(&hdr,0,sizeof(hdr));
+    memcpy( hdr.magic, tipsyIdxMagic, sizeof(tipsyIdxMagic) );
+    hdr.version = tipsyIdxVersion;
+    hdr.bits    = bits;
+    hdr.nBodies = keys.size();
+    hdr.level   = level;
+    for( int i=0; i<6; i++ ) hdr.bounds[i] = bounds[i];
+
+    //! Build the offsets table from the sorted keys.
+    std::vector<uint64_t> offsets( (uint64_t(1) << (3*level)) + 1 );
+    const int shift = 3*(bits-level);
+    uint64_t i = 0;
+    for( uint64_t c=0; c+1<offsets.size(); c++ ) {
+	offsets[c] = i;
+	while( i < keys.size() && (keys[i]>>shift) == c ) i++;
+    }
+    offsets.back() = keys.size();
+
+    std::ofstream out( name, std::ios_base::out|std::ios_base::binary );
+    if ( !out.is_open() ) return false;
+    out.write( (const char *)(&hdr), sizeof(hdr) );
+    if ( !keys.empty() ) {
+	out.write( (const char *)(&keys[0]), 8*keys.size() );
+	out.write( (const char *)(&order[0]), 8*order.size() );
+    }
+    out.write( (const char *)(&offsets[0]), 8*offsets.size() );
+    return bool(out);
+}
+
+void TipsyKeyIndex::cubeBounds( const double in[6], double out[6] )
+{
+    double side = 0.0;
+    for( int d=0; d<3; d++ ) side = std::max( side, in[2*d+1]-in[2*d] );
+    //! Pad slightly so the maximum coordinate falls inside the grid.
+    side = side > 0.0 ? side * (1.0 + 1e-6) : 1.0;
+    for( int d=0; d<3; d++ ) {
+	double mid = 0.5*(in[2*d]+in[2*d+1]);
+	out[2*d]   = mid - 0.5*side;
+	out[2*d+1] = mid + 0.5*side;
+    }
+}
+
+uint64_t TipsyKeyIndex::keyOf( const float pos[3], const double bounds[6],
+			       int bits )
+{
+    const double cells = double(uint64_t(1) << bits);
+    uint32_t x[3];
+    for( int d=0; d<3; d++ ) {
+	double f = (pos[d] - bounds[2*d]) / (bounds[2*d+1] - bounds[2*d]);
+	double c = f * cells;
+	if ( c < 0.0 ) c = 0.0;
+	if ( c > cells-1.0 ) c = cells-1.0;
+	x[d] = uint32_t(c);
+    }
+    return hilbertKey( x, bits );
+}
@@ -0,0 +1,184 @@
+/**
+ *  @file
+ *  @brief Peano-Hilbert sidecar index of a Tipsy file
+ *
+ *  The index is a separate file (by default the Tipsy file name with
+ *  ".phidx" appended) written once by tindex.  It holds, in host byte order:
+ *
+\verbatim
+  header    magic "TIPSYPHI", version, bits, particle count, bounds, level
+  keys      the Peano-Hilbert key of every particle, sorted ascending
+  order     the particle index (in file order) for each sorted key
+  offsets   for each level-L octree cell, its first position in keys/order,
+            followed by the particle count
+\endverbatim
+ *
+ *  Any contiguous slice of order is a spatially compact set of particles,
+ *  and an octree cell at any level L' <= bits is one contiguous slice, so
+ *  readers can split a file into compact pieces without looking at the
+ *  particle data.
+ */
+
+#ifndef TIPSYIDX_H
+#define TIPSYIDX_H
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <fstream>
+#include "tipsypos.h"
+
+/** @brief A box or a sphere, to select the particles inside it.
+ */
+class TipsyRegion {
+public:
+    //! Shape of the region.
+    enum shape_type { box, sphere };
+
+    shape_type shape;     //!< box or sphere
+    double     bounds[6]; //!< The box (xmin,xmax,ymin,...)
+    double     center[3]; //!< Center of the sphere
+    double     radius;    //!< Radius of the sphere
+
+    //! @brief A box region.
+    explicit TipsyRegion( const double b[6] );
+
+    //! @brief A sphere region.
+    TipsyRegion( const double c[3], double r );
+
+    //! @brief Where a box (xmin,xmax,ymin,...) lies with respect to the region.
+    //! @return -1 if entirely outside, 1 if entirely inside, 0 otherwise.
+    int classify( const double cell[6] ) const;
+};
+
+/** @brief Reader and writer of the Peano-Hilbert sidecar index.
+ */
+class TipsyKeyIndex {
+public:
+    //! On-disk header of the index.
+    struct header_type {
+	char     magic[8];  //!< "TIPSYPHI"
+	uint32_t version;   //!< Format version
+	uint32_t bits;      //!< Bits per dimension of each key
+	uint64_t nBodies;   //!< Number of particles (must match the Tipsy file)
+	double   bounds[6]; //!< Cube covered by the keys (xmin,xmax,ymin,...)
+	uint32_t level;     //!< Octree level of the offsets table
+	uint32_t pad;       //!< Zero
+    };
+
+public:
+    //! A run [first,second) of sorted positions in keys/order.
+    typedef std::pair<uint64_t,uint64_t> range_type;
+
+protected:
+    std::ifstream         m_in;      //!< The open index file.
+    header_type           m_hdr;     //!< Its header.
+    std::vector<uint64_t> m_offsets; //!< The cell offsets table.
+
+    //! @brief Byte offset of the sorted keys.
+    uint64_t keysAt() const
+	{ return sizeof(header_type); }
+    //! @brief Byte offset of the permutation.
+    uint64_t orderAt() const
+	{ return keysAt() + 8*m_hdr.nBodies; }
+
+    //! @brief Bounds of the octree node named by a key prefix of a level.
+    void nodeBounds( uint64_t node, uint32_t level, double b[6] ) const;
+
+    //! @brief Add the runs of a node and of its children meeting a region.
+    //! @param keys  Keys of the table cell holding the node, once read
+    //! @param base  Sorted position of keys[0]
+    void selectNode( const TipsyRegion &region, uint64_t node, uint32_t level,
+		     uint64_t first, uint64_t last, uint64_t leaf,
+		     std::vector<uint64_t> &keys, uint64_t base,
+		     std::vector<range_type> &ranges );
+
+public:
+    //! @brief Construct a closed index.
+    TipsyKeyIndex();
+
+    //! @brief The conventional index name for a Tipsy file.
+    //! @param tipsyName Name of the Tipsy file.
+    static std::string sidecarName( const char *tipsyName );
+
+    //! @brief Open an index and load its header and offsets table.
+    //! @return false if the file is missing or not an index.
+    bool open( const char *name );
+
+    //! @brief Check if an index is open.
+    bool is_open() const
+	{ return m_in.is_open(); }
+
+    //! @brief Close the index.
+    void close();
+
+    //! @brief The index header.
+    const header_type &header() const
+	{ return m_hdr; }
+
+    //! @brief Number of cells in the offsets table (8^level).
+    uint64_t cellCount() const
+	{ return m_offsets.empty() ? 0 : m_offsets.size()-1; }
+
+    //! @brief First sorted position of a table cell (cellCount() gives the end).
+    uint64_t cellBegin( uint64_t cell ) const
+	{ return m_offsets[cell]; }
+
+    //! @brief The table cell containing a key.
+    uint64_t cellOf( uint64_t key ) const
+	{ return key >> (3*(m_hdr.bits-m_hdr.level)); }
+
+    //! @brief Integer coordinates of a table cell, in [0,2^level).
+    void cellCoordinates( uint64_t cell, uint32_t x[3] ) const;
+
+    //! @brief The table cell at the given integer coordinates.
+    uint64_t cellAt( const uint32_t x[3] ) const;
+
+    //! @brief Key of a position (clamped to the bounds).
+    uint64_t keyOf( const float pos[3] ) const;
+
+    //! @brief Read n sorted keys starting at sorted position first.
+    bool readKeys( uint64_t first, uint64_t n, uint64_t *keys );
+
+    //! @brief Read n particle indices starting at sorted position first.
+    bool readOrder( uint64_t first, uint64_t n, uint64_t *order );
+
+    /** @brief Find the particles in the octree nodes meeting a region.
+     *
+     *  The octree is descended from the root.  Nodes outside the region
+     *  are skipped, and nodes inside it, nodes with at most leaf particles
+     *  and nodes of the finest level are taken whole, so the result holds
+     *  every particle in the region and a few around it.  Down to the level
+     *  of the offsets table a node's run comes from the table; below it,
+     *  the keys of the table cell are read once and searched.
+     *  @param region The box or sphere
+     *  @param ranges Receives the runs of sorted positions, in order
+     *  @param leaf   Partly covered nodes this small are not split further
+     *  @return false if the keys could not be read.
+     */
+    bool selectRegion( const TipsyRegion &region,
+		       std::vector<range_type> &ranges, uint64_t leaf=64 );
+
+    /** @brief Write an index.
+     *  @param name   Name of the index file
+     *  @param bits   Bits per dimension used for the keys
+     *  @param level  Octree level of the offsets table
+     *  @param bounds Cube covered by the keys
+     *  @param keys   Sorted keys
+     *  @param order  Particle index for each key
+     *  @return true on success.
+     */
+    static bool write( const char *name, int bits, int level,
+		       const double bounds[6],
+		       const std::vector<uint64_t> &keys,
+		       const std::vector<uint64_t> &order );
+
+    //! @brief Cube (xmin,xmax,ymin,...) enclosing a set of bounds.
+    static void cubeBounds( const double in[6], double out[6] );
+
+    //! @brief Key of a position within the given cube.
+    static uint64_t keyOf( const float pos[3], const double bounds[6],
+			   int bits );
+};
+
+#endif
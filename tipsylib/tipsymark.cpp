@@ -0,0 +1,69 @@
+/**
+ *  @file
+ *  @brief Binary (bitmap) mark files
+ */
+
+#include <cstring>
+#include <fstream>
+#include "tipsymark.h"
+
+static const char tipsyMarkMagic[8] = { 'T','I','P','S','Y','M','R','K' };
+
+//! Bitmap bytes converted to indices at a time.
+static const std::size_t tipsyMarkChunk = 65536;
+
+bool tipsyIsMarkBitmap( const char *name )
+{
+    char magic[sizeof(tipsyMarkMagic)];
+    std::ifstream in( name, std::ios_base::in|std::ios_base::binary );
+    return in.read( magic, sizeof(magic) )
+	&& memcmp( magic, tipsyMarkMagic, sizeof(magic) ) == 0;
+}
+
+bool tipsyReadMarkBitmap( const char *name, const TipsyHeader &h,
+			  std::vector<uint64_t> &marked )
+{
+    char magic[sizeof(tipsyMarkMagic)];
+    uint64_t counts[3];
+    std::ifstream in( name, std::ios_base::in|std::ios_base::binary );
+
+    marked.clear();
+    if ( !in.read( magic, sizeof(magic) )
+	 || memcmp( magic, tipsyMarkMagic, sizeof(magic) ) != 0
+	 || !in.read( (char *)counts, sizeof(counts) )
+	 || counts[0] != h.h_nSph || counts[1] != h.h_nDark
+	 || counts[2] != h.h_nStar ) return false;
+
+    const uint64_t n = counts[0] + counts[1] + counts[2];
+    const uint64_t nBytes = (n+7) / 8;
+    std::vector<unsigned char> buf( tipsyMarkChunk );
+    for( uint64_t at=0; at<nBytes; at+=buf.size() ) {
+	std::size_t want = nBytes-at < buf.size() ? std::size_t(nBytes-at) : buf.size();
+	if ( !in.read( (char *)(&buf[0]), want ) ) {
+	    marked.clear();
+	    return false;
+	}
+	for( std::size_t i=0; i<want; i++ ) {
+	    unsigned char b = buf[i];
+	    //! Most bytes are zero when few particles are marked.
+	    for( int j=0; b; j++, b>>=1 )
+		if ( b&1 ) marked.push_back( 8*(at+i) + j );
+	}
+    }
+    //! Ignore any stray bits past the last particle.
+    while( !marked.empty() && marked.back() >= n ) marked.pop_back();
+    return true;
+}
+
+bool tipsyWriteMarkBitmap( const char *name, const TipsyHeader &h,
+			   const std::vector<unsigned char> &bitmap )
+{
+    uint64_t counts[3] = { h.h_nSph, h.h_nDark, h.h_nStar };
+    std::ofstream out( name, std::ios_base::out|std::ios_base::binary );
+    if ( !out.is_open() ) return false;
+    out.write( tipsyMarkMagic, sizeof(tipsyMarkMagic) );
+    out.write( (const char *)counts, sizeof(counts) );
+    if ( !bitmap.empty() )
+	out.write( (const char *)(&bitmap[0]), bitmap.size() );
+    return bool(out);
+}
@@ -0,0 +1,44 @@
+/**
+ *  @file
+ *  @brief Binary (bitmap) mark files
+ *
+ *  A mark file selects a subset of the particles of a Tipsy file.  The
+ *  original ASCII format has a line with the particle counts followed by
+ *  one 1-based index per line; at 10^7 marks of 10^9 particles it is slow to
+ *  parse and large.  The bitmap format is, in host byte order:
+ *
+\verbatim
+  magic     "TIPSYMRK"
+  counts    nSph, nDark, nStar as three uint64_t
+  bitmap    (nSph+nDark+nStar+7)/8 bytes; particle i is bit i%8 of byte i/8
+\endverbatim
+ */
+
+#ifndef TIPSYMARK_H
+#define TIPSYMARK_H
+
+#include <vector>
+#include "ftipsy.hpp"
+
+//! @brief Check if a file is a bitmap mark file.
+bool tipsyIsMarkBitmap( const char *name );
+
+/** @brief Read the marked (0-based) indices from a bitmap mark file.
+ *  @param name   Mark file
+ *  @param h      Header of the Tipsy file the marks must match
+ *  @param marked Receives the marked indices in increasing order
+ *  @return false if the file cannot be read or does not match h.
+ */
+bool tipsyReadMarkBitmap( const char *name, const TipsyHeader &h,
+			  std::vector<uint64_t> &marked );
+
+/** @brief Write a bitmap mark file.
+ *  @param name   Mark file
+ *  @param h      Header of the Tipsy file the marks refer to
+ *  @param bitmap One bit per particle as described above
+ *  @return true on success.
+ */
+bool tipsyWriteMarkBitmap( const char *name, const TipsyHeader &h,
+			   const std::vector<unsigned char> &bitmap );
+
+#endif
@@ -12,7 +12,7 @@ int main( int argc, char *argv[] ) {
     TipsyGasParticle  g; // A gas particle
     TipsyDarkParticle d; // A dark particle
     TipsyStarParticle s; // A star particle
-    uint32_t i;
+    uint64_t i;
 
     // Make sure we have two parameters, a native and a standard file.
     if ( argc != 3 ) {
@@ -0,0 +1,194 @@
+/**
+ *  @file
+ *  @brief Convert a standard Tipsy file to the block compressed format.
+ *
+ *  Usage: tzblock [--records R] [--level L] [--threads T] <standard> <blocked>
+ *
+ *  Each run of R records (65536 by default) of one section is deflated at
+ *  zlib level L on its own, on T threads (one per core by default), and
+ *  the block index is written after the blocks.  See zblock.hpp for the
+ *  layout.  The ParaView reader reads these files directly; a native file
+ *  must be converted with tostd first.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <getopt.h>
+#include <zlib.h>
+#include "mtipsy.hpp"
+#include "zblock.hpp"
+
+#define OPT_RECORDS 'r'
+#define OPT_LEVEL   'l'
+#define OPT_THREADS 't'
+
+//! @brief A batch of blocks to deflate.
+struct Batch {
+    const char                       *raw;     //!< First record of the batch
+    std::size_t                       bytes;   //!< Size of a full block
+    std::size_t                       total;   //!< Size of the whole batch
+    int                               level;   //!< zlib level
+    std::vector< std::vector<char> >  packed;  //!< Deflated blocks
+    std::vector<int>                  status;  //!< zlib result per block
+};
+
+static void deflateBlock( void *ctx, std::size_t i, std::size_t )
+{
+    Batch &b = *static_cast<Batch *>(ctx);
+    std::size_t begin = i*b.bytes;
+    std::size_t size = std::min( b.bytes, b.total - begin );
+    uLongf len = compressBound(size);
+    b.packed[i].resize(len);
+    b.status[i] = compress2( reinterpret_cast<Bytef *>(&b.packed[i][0]), &len,
+			     reinterpret_cast<const Bytef *>(b.raw + begin),
+			     size, b.level );
+    b.packed[i].resize(len);
+}
+
+static void put32( std::vector<char> &out, uint32_t v )
+{
+    for( int s=24; s>=0; s-=8 ) out.push_back( char((v>>s) & 0xff) );
+}
+
+static void put64( std::vector<char> &out, uint64_t v )
+{
+    put32( out, uint32_t(v>>32) );
+    put32( out, uint32_t(v) );
+}
+
+int main( int argc, char *argv[] ) {
+    long records = zblockRecords;
+    int level = Z_DEFAULT_COMPRESSION;
+    int threads = 0;
+    const char *inName, *outName;
+
+    //! Parse command line
+    for(;;) {
+        int c, option_index=0;
+
+        static struct option long_options[] = {
+            { "records",     1, 0, OPT_RECORDS },
+            { "level",       1, 0, OPT_LEVEL },
+            { "threads",     1, 0, OPT_THREADS },
+            { 0,             0, 0, 0 }
+        };
+
+        c = getopt_long( argc, argv, "r:l:t:",
+                         long_options, &option_index );
+        if ( c == -1 ) break;
+        switch(c) {
+        case OPT_RECORDS:
+	    records = atol(optarg);
+            break;
+        case OPT_LEVEL:
+	    level = atoi(optarg);
+            break;
+        case OPT_THREADS:
+	    threads = atoi(optarg);
+            break;
+	default:
+	    exit(1);
+	}
+    }
+
+    if ( optind + 2 == argc ) {
+        inName = argv[optind++];
+        outName = argv[optind++];
+    }
+    else {
+        std::cerr << "Usage: " << argv[0]
+		  << " [--records R] [--level L] [--threads T]"
+		  << " <standard> <blocked>" << std::endl;
+        exit(2);
+    }
+    //! A block of star records must inflate to less than 4GB.
+    if ( records < 1 || records > 0x4000000 || level < -1 || level > 9
+	 || threads < 0 ) {
+	std::cerr << "records must be in [1,2^26], level in [-1,9]"
+		  << " and threads not negative" << std::endl;
+	exit(2);
+    }
+
+    //! Mapping checks that the file is as long as its header says.
+    mTipsy check(inName,"standard");
+    if ( ! check.is_open() ) {
+	std::cerr << "Unable to open Tipsy binary " << inName << std::endl;
+	exit(2);
+    }
+    const TipsyHeader h = check.header();
+    check.close();
+
+    std::ifstream in( inName, std::ios_base::in|std::ios_base::binary );
+    std::ofstream out( outName, std::ios_base::out|std::ios_base::binary
+		       |std::ios_base::trunc );
+    if ( ! out.is_open() ) {
+	std::cerr << "Unable to create " << outName << std::endl;
+	exit(2);
+    }
+
+    //! The standard header is copied as is.
+    std::vector<char> head;
+    static const char magic[8] = { 'T','I','P','S','Y','Z','B','1' };
+    head.insert( head.end(), magic, magic+8 );
+    put32( head, uint32_t(records) );
+    put32( head, 0 );
+    head.resize( head.size() + 32 );
+    in.read( &head[16], 32 );
+    out.write( &head[0], head.size() );
+
+    TipsyThreadPool pool(threads);
+    std::vector<char> index;
+    uint64_t where = head.size(), nBlocks = 0;
+    const tipsypos::section_type sections[3]
+	= { tipsypos::gas, tipsypos::dark, tipsypos::star };
+    const uint64_t counts[3] = { h.h_nSph, h.h_nDark, h.h_nStar };
+
+    Batch b;
+    b.level = level;
+    std::vector<char> raw;
+    for( int s=0; s<3; s++ ) {
+	const std::size_t bytes = tipsyRecordSize(sections[s]);
+	b.bytes = records * bytes;
+	//! Read a few blocks per thread, deflate them together, write in order.
+	const uint64_t batch = uint64_t(records) * 4 * pool.size();
+	for( uint64_t r=0; r<counts[s]; r+=batch ) {
+	    const uint64_t m = std::min( batch, counts[s]-r );
+	    b.total = std::size_t(m*bytes);
+	    raw.resize( b.total );
+	    if ( !in.read(&raw[0],b.total) ) {
+		std::cerr << "Short read of " << inName << std::endl;
+		exit(2);
+	    }
+	    const std::size_t blocks = std::size_t((m + records - 1) / records);
+	    b.raw = &raw[0];
+	    b.packed.resize(blocks);
+	    b.status.assign(blocks,Z_OK);
+	    pool.run( deflateBlock, &b, blocks );
+	    for( std::size_t i=0; i<blocks; i++ ) {
+		if ( b.status[i] != Z_OK ) {
+		    std::cerr << "Unable to compress " << inName << std::endl;
+		    exit(2);
+		}
+		out.write( &b.packed[i][0], b.packed[i].size() );
+		put64( index, where );
+		put32( index, uint32_t(b.packed[i].size()) );
+		where += b.packed[i].size();
+	    }
+	    nBlocks += blocks;
+	}
+    }
+
+    put64( index, where );
+    put64( index, nBlocks );
+    index.insert( index.end(), magic, magic+8 );
+    out.write( &index[0], index.size() );
+    out.close();
+    if ( ! out ) {
+	std::cerr << "Error writing " << outName << std::endl;
+	exit(2);
+    }
+    return 0;
+}
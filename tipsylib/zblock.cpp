@@ -0,0 +1,404 @@
+/**
+ *  @file
+ *  @brief Seekable block compressed Tipsy files
+ */
+
+#include <cstring>
+#include <algorithm>
+#ifdef _WIN32
+ #include <winsock2.h> // ntohl
+#else
+ #include <pthread.h>
+ #include <unistd.h>
+ #include <netinet/in.h>
+#endif
+#ifdef USE_ZLIB
+ #include <zlib.h>
+#endif
+#include "zblock.hpp"
+#include "mtipsy.hpp"
+#include "tipsycount.h"
+
+static const char zblockMagic[8] = { 'T','I','P','S','Y','Z','B','1' };
+
+//! Sizes in bytes of the fixed parts of the file and of an index entry.
+enum {
+    zblockHead  = 48,
+    zblockTail  = 24,
+    zblockEntry = 12
+};
+
+//! Number of blocks read and inflated together, per worker.
+static const std::size_t zblockBatch = 4;
+
+static uint32_t zblockGet32( const unsigned char *p )
+{
+    return (uint32_t(p[0])<<24) | (uint32_t(p[1])<<16)
+	| (uint32_t(p[2])<<8) | uint32_t(p[3]);
+}
+
+static uint64_t zblockGet64( const unsigned char *p )
+{
+    return (uint64_t(zblockGet32(p))<<32) | zblockGet32(p+4);
+}
+
+/* ********** TipsyThreadPool ********** */
+
+#ifndef _WIN32
+class TipsyThreadPool::Impl {
+public:
+    //! @brief What a thread needs to know to start.
+    struct start {
+	Impl       *impl;
+	std::size_t worker;
+    };
+
+    pthread_mutex_t        lock;
+    pthread_cond_t         work;       //!< A loop was started, or stop
+    pthread_cond_t         idle;       //!< The last iteration finished
+    std::vector<pthread_t> threads;
+    std::vector<start>     starts;
+    task_type              f;
+    void                  *ctx;
+    std::size_t            n;          //!< Iterations of the current loop
+    std::size_t            next;       //!< Next iteration to hand out
+    std::size_t            done;       //!< Iterations finished
+    unsigned long          generation; //!< Number of loops started
+    bool                   stop;
+
+    //! @brief Run iterations of the current loop until none are left.
+    void loop( std::size_t worker ) {
+	for(;;) {
+	    pthread_mutex_lock(&lock);
+	    if ( next >= n ) {
+		pthread_mutex_unlock(&lock);
+		return;
+	    }
+	    std::size_t i = next++;
+	    task_type fi = f;
+	    void *ci = ctx;
+	    pthread_mutex_unlock(&lock);
+
+	    fi( ci, i, worker );
+
+	    pthread_mutex_lock(&lock);
+	    if ( ++done == n ) pthread_cond_signal(&idle);
+	    pthread_mutex_unlock(&lock);
+	}
+    }
+
+    //! @brief Wait for loops, and help with each of them.
+    static void *main( void *arg ) {
+	start *s = static_cast<start *>(arg);
+	Impl *self = s->impl;
+	unsigned long seen = 0;
+	pthread_mutex_lock(&self->lock);
+	for(;;) {
+	    while( !self->stop && self->generation == seen )
+		pthread_cond_wait(&self->work,&self->lock);
+	    if ( self->stop ) break;
+	    seen = self->generation;
+	    pthread_mutex_unlock(&self->lock);
+	    self->loop(s->worker);
+	    pthread_mutex_lock(&self->lock);
+	}
+	pthread_mutex_unlock(&self->lock);
+	return 0;
+    }
+};
+#endif
+
+TipsyThreadPool::TipsyThreadPool( std::size_t n )
+    : m_impl(0), m_size(1)
+{
+#ifndef _WIN32
+    if ( n == 0 ) {
+	long cores = sysconf(_SC_NPROCESSORS_ONLN);
+	n = cores > 0 ? std::size_t(cores) : 1;
+    }
+    if ( n <= 1 ) return;
+
+    m_impl = new Impl;
+    pthread_mutex_init(&m_impl->lock,0);
+    pthread_cond_init(&m_impl->work,0);
+    pthread_cond_init(&m_impl->idle,0);
+    m_impl->f = 0;
+    m_impl->ctx = 0;
+    m_impl->n = m_impl->next = m_impl->done = 0;
+    m_impl->generation = 0;
+    m_impl->stop = false;
+    m_impl->starts.resize(n-1);
+    for( std::size_t i=0; i<n-1; i++ ) {
+	pthread_t t;
+	m_impl->starts[i].impl = m_impl;
+	m_impl->starts[i].worker = i+1;
+	if ( pthread_create(&t,0,Impl::main,&m_impl->starts[i]) != 0 ) break;
+	m_impl->threads.push_back(t);
+    }
+    //! Fewer threads than asked for is not an error, only slower.
+    m_size = m_impl->threads.size() + 1;
+#endif
+}
+
+TipsyThreadPool::~TipsyThreadPool()
+{
+#ifndef _WIN32
+    if ( m_impl == 0 ) return;
+    pthread_mutex_lock(&m_impl->lock);
+    m_impl->stop = true;
+    pthread_cond_broadcast(&m_impl->work);
+    pthread_mutex_unlock(&m_impl->lock);
+    for( std::size_t i=0; i<m_impl->threads.size(); i++ )
+	pthread_join(m_impl->threads[i],0);
+    pthread_cond_destroy(&m_impl->idle);
+    pthread_cond_destroy(&m_impl->work);
+    pthread_mutex_destroy(&m_impl->lock);
+    delete m_impl;
+#endif
+}
+
+void TipsyThreadPool::run( task_type f, void *ctx, std::size_t n )
+{
+#ifndef _WIN32
+    if ( m_impl != 0 && n > 1 ) {
+	pthread_mutex_lock(&m_impl->lock);
+	m_impl->f = f;
+	m_impl->ctx = ctx;
+	m_impl->n = n;
+	m_impl->next = m_impl->done = 0;
+	m_impl->generation++;
+	pthread_cond_broadcast(&m_impl->work);
+	pthread_mutex_unlock(&m_impl->lock);
+
+	m_impl->loop(0);
+
+	pthread_mutex_lock(&m_impl->lock);
+	while( m_impl->done < m_impl->n )
+	    pthread_cond_wait(&m_impl->idle,&m_impl->lock);
+	pthread_mutex_unlock(&m_impl->lock);
+	return;
+    }
+#endif
+    for( std::size_t i=0; i<n; i++ ) f( ctx, i, 0 );
+}
+
+/* ********** zbTipsy ********** */
+
+//! @brief A batch of blocks of one section to inflate into columns.
+struct zblockTask {
+    const zbTipsy::entry *index;    //!< Index entry of the first block
+    const char           *packed;   //!< The packed blocks, as read
+    uint64_t              base;     //!< File offset of packed
+    uint64_t              block;    //!< First block, counted in the section
+    uint64_t              records;  //!< Records per block
+    uint64_t              count;    //!< Records in the section
+    uint64_t              begin;    //!< First record wanted
+    uint64_t              end;      //!< One past the last record wanted
+    uint64_t              at;       //!< Index in cols of record begin
+    tipsypos::section_type section;
+    std::size_t           bytes;    //!< Size of a record
+    bool                  swap;     //!< Records must be byte swapped
+    TipsyColumns         *cols;
+    std::vector< std::vector<char> > *scratch; //!< One buffer per worker
+    std::vector<char>    *ok;       //!< Set for each block decoded
+};
+
+//! @brief Inflate block i of a batch and decode the wanted part of it.
+static void zblockInflate( void *ctx, std::size_t i, std::size_t worker )
+{
+#ifdef USE_ZLIB
+    zblockTask &t = *static_cast<zblockTask *>(ctx);
+    const zbTipsy::entry &e = t.index[i];
+    uint64_t first = (t.block+i) * t.records;
+    uint64_t last = std::min( first + t.records, t.count );
+    std::size_t raw = std::size_t(last-first) * t.bytes;
+
+    std::vector<char> &out = (*t.scratch)[worker];
+    if ( out.size() < raw ) out.resize(raw);
+    uLongf len = raw;
+    if ( uncompress( reinterpret_cast<Bytef *>(&out[0]), &len,
+		     reinterpret_cast<const Bytef *>(t.packed + (e.offset-t.base)),
+		     e.size ) != Z_OK || len != raw ) {
+	(*t.ok)[i] = 0;
+	return;
+    }
+
+    uint64_t lo = std::max( first, t.begin );
+    uint64_t hi = std::min( last, t.end );
+    tipsyDecodeRecords( &out[std::size_t(lo-first)*t.bytes], t.swap, t.section,
+			hi-lo, *t.cols, t.at + (lo-t.begin) );
+    (*t.ok)[i] = 1;
+#else
+    (void)ctx; (void)i; (void)worker;
+#endif
+}
+
+zbTipsy::zbTipsy( std::size_t threads )
+    : m_records(0), m_threads(threads), m_pool(0)
+{
+    memset(&m_header,0,sizeof(m_header));
+    memset(m_first,0,sizeof(m_first));
+}
+
+zbTipsy::~zbTipsy()
+{
+    close();
+    delete m_pool;
+}
+
+bool zbTipsy::is_blocked( const char *iname )
+{
+    char magic[sizeof(zblockMagic)];
+    std::ifstream in( iname, std::ios_base::in|std::ios_base::binary );
+    return in.read(magic,sizeof(magic))
+	&& memcmp(magic,zblockMagic,sizeof(magic)) == 0;
+}
+
+bool zbTipsy::open( const char *iname )
+{
+    close();
+#ifdef USE_ZLIB
+    m_file.open( iname, std::ios_base::in|std::ios_base::binary );
+    if ( !m_file.is_open() ) return false;
+    if ( !readIndex() ) {
+	close();
+	return false;
+    }
+    return true;
+#else
+    (void)iname;
+    return false;
+#endif
+}
+
+bool zbTipsy::readIndex()
+{
+    unsigned char head[zblockHead], tail[zblockTail];
+
+    if ( !m_file.read(reinterpret_cast<char *>(head),sizeof(head))
+	 || memcmp(head,zblockMagic,sizeof(zblockMagic)) != 0 )
+	return false;
+    m_records = zblockGet32(head+8);
+    if ( m_records == 0 ) return false;
+
+    //! The embedded header is that of a standard file.
+    const unsigned char *h = head + 16;
+    uint64_t t = zblockGet64(h), n[4];
+    memcpy( &m_header.h_time, &t, sizeof(double) );
+    tipsyDecodeCounts( zblockGet32(h+8), zblockGet32(h+16), zblockGet32(h+20),
+		       zblockGet32(h+24), zblockGet32(h+28), n );
+    m_header.h_nBodies = n[0];
+    m_header.h_nDims   = zblockGet32(h+12);
+    m_header.h_nSph    = n[1];
+    m_header.h_nDark   = n[2];
+    m_header.h_nStar   = n[3];
+
+    //! Blocks follow from the counts; the trailer must agree with them.
+    m_first[0] = 0;
+    for( int k=0; k<3; k++ )
+	m_first[k+1] = m_first[k] + (n[k+1] + m_records - 1) / m_records;
+
+    if ( !m_file.seekg(0,std::ios_base::end) ) return false;
+    uint64_t size = uint64_t(std::streamoff(m_file.tellg()));
+    if ( size < zblockHead + zblockTail ) return false;
+    m_file.seekg( std::streamoff(size - zblockTail) );
+    if ( !m_file.read(reinterpret_cast<char *>(tail),sizeof(tail))
+	 || memcmp(tail+16,zblockMagic,sizeof(zblockMagic)) != 0 )
+	return false;
+    uint64_t where = zblockGet64(tail), nBlocks = zblockGet64(tail+8);
+    if ( nBlocks != m_first[3]
+	 || where + zblockEntry*nBlocks + zblockTail != size )
+	return false;
+
+    std::vector<unsigned char> raw( std::size_t(zblockEntry*nBlocks) + 1 );
+    m_file.seekg( std::streamoff(where) );
+    if ( !m_file.read(reinterpret_cast<char *>(&raw[0]),zblockEntry*nBlocks) )
+	return false;
+    m_index.resize( std::size_t(nBlocks) );
+    for( std::size_t i=0; i<m_index.size(); i++ ) {
+	m_index[i].offset = zblockGet64(&raw[zblockEntry*i]);
+	m_index[i].size   = zblockGet32(&raw[zblockEntry*i+8]);
+	if ( m_index[i].offset < zblockHead
+	     || m_index[i].offset + m_index[i].size > where )
+	    return false;
+    }
+    return true;
+}
+
+void zbTipsy::close()
+{
+    if ( m_file.is_open() ) m_file.close();
+    m_file.clear();
+    m_index.clear();
+    m_records = 0;
+    memset(&m_header,0,sizeof(m_header));
+    memset(m_first,0,sizeof(m_first));
+}
+
+tipsypos::offset_type zbTipsy::readBlock( tipsypos pos,
+					  tipsypos::offset_type n,
+					  TipsyColumns &c,
+					  tipsypos::offset_type at )
+{
+    int k;
+    tipsypos::offset_type count;
+
+    if ( !is_open() ) return 0;
+    switch( pos.section() ) {
+    case tipsypos::gas:  k = 0; count = m_header.h_nSph;  break;
+    case tipsypos::dark: k = 1; count = m_header.h_nDark; break;
+    case tipsypos::star: k = 2; count = m_header.h_nStar; break;
+    default:
+	return 0;
+    }
+    if ( pos.offset() >= count || n == 0 ) return 0;
+    if ( n > count - pos.offset() ) n = count - pos.offset();
+
+    if ( m_pool == 0 ) {
+	m_pool = new TipsyThreadPool(m_threads);
+	m_scratch.resize( m_pool->size() );
+    }
+
+    zblockTask t;
+    t.records = m_records;
+    t.count   = count;
+    t.begin   = pos.offset();
+    t.end     = pos.offset() + n;
+    t.at      = at;
+    t.section = pos.section();
+    t.bytes   = tipsyRecordSize(pos.section());
+    t.swap    = ntohl(1) != 1;
+    t.cols    = &c;
+    t.scratch = &m_scratch;
+
+    //! Each batch is one read of consecutive packed blocks, then inflated
+    //! in parallel; batches bound the memory held by packed data.
+    const uint64_t b0 = t.begin / m_records, b1 = (t.end - 1) / m_records;
+    const uint64_t batch = zblockBatch * m_pool->size();
+    std::vector<char> packed, ok;
+    for( uint64_t b=b0; b<=b1; b+=batch ) {
+	const uint64_t e = std::min( b + batch, b1 + 1 );
+	const entry &first = m_index[m_first[k]+b];
+	const entry &last  = m_index[m_first[k]+e-1];
+	const uint64_t bytes = last.offset + last.size - first.offset;
+
+	packed.resize( std::size_t(bytes) + 1 );
+	m_file.seekg( std::streamoff(first.offset) );
+	if ( !m_file.read(&packed[0],bytes) ) {
+	    m_file.clear();
+	    return std::max(b*m_records,t.begin) - t.begin;
+	}
+	ok.assign( std::size_t(e-b), 0 );
+	t.index  = &first;
+	t.packed = &packed[0];
+	t.base   = first.offset;
+	t.block  = b;
+	t.ok     = &ok;
+	m_pool->run( zblockInflate, &t, std::size_t(e-b) );
+
+	//! Report the particles before the first damaged block.
+	for( std::size_t i=0; i<ok.size(); i++ )
+	    if ( !ok[i] ) return std::max((b+i)*m_records,t.begin) - t.begin;
+    }
+    return n;
+}
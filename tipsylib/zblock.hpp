@@ -0,0 +1,147 @@
+/**
+ *  @file
+ *  @brief Seekable block compressed Tipsy files
+ *
+ *  A zstreambuf compresses the whole file as one deflate stream, so it can
+ *  only be read from the start, one core at a time.  This container
+ *  compresses runs of records independently instead:
+ *
+ *  @verbatim
+    offset  size        contents
+    0       8           magic "TIPSYZB1"
+    8       4           records per block
+    12      4           zero
+    16      32          the header of the standard file, as is
+    48      ...         the blocks, each standard records deflated with zlib
+    index   12*nBlocks  per block: 64-bit file offset, 32-bit packed size
+    end-24  8           offset of the index
+    end-16  8           number of blocks
+    end-8   8           magic "TIPSYZB1"
+    @endverbatim
+ *
+ *  All integers are big-endian.  Blocks never span sections: gas blocks
+ *  come first, then dark, then star, and only the last block of each
+ *  section may be short.  The block holding any particle is found from the
+ *  counts in the header, so reading a range inflates just the blocks that
+ *  cover it, on several threads at once.  Files are written by tzblock.
+ */
+
+#ifndef ZBLOCK_H
+#define ZBLOCK_H
+
+#include <fstream>
+#include <string>
+#include <vector>
+#include "ftipsy.hpp"
+
+//! Default number of records per block.
+static const uint32_t zblockRecords = 65536;
+
+/** @brief A fixed set of threads that run the iterations of a loop.
+ *
+ *  The calling thread takes part as worker zero, so a pool of size one has
+ *  no threads of its own and simply runs the loop.  Only one loop may run
+ *  at a time.
+ */
+class TipsyThreadPool {
+public:
+    //! @brief Body of a loop: ctx, iteration, and the worker running it.
+    typedef void (*task_type)( void *ctx, std::size_t i, std::size_t worker );
+
+    //! @brief Start the threads.
+    //! @param n Number of workers including the caller, 0 for one per core
+    explicit TipsyThreadPool( std::size_t n=0 );
+
+    //! @brief Stop and join the threads.
+    ~TipsyThreadPool();
+
+    //! @brief Number of workers, including the caller.
+    std::size_t size() const
+	{ return m_size; }
+
+    //! @brief Run f(ctx,i,worker) for each i in [0,n) and wait for them all.
+    void run( task_type f, void *ctx, std::size_t n );
+
+private:
+    class Impl;
+    Impl       *m_impl; //!< Threads and their synchronization (or null)
+    std::size_t m_size; //!< Number of workers including the caller
+
+    TipsyThreadPool( const TipsyThreadPool & );
+    TipsyThreadPool &operator=( const TipsyThreadPool & );
+};
+
+/** @brief Read a block compressed Tipsy file.
+ *
+ *  Only the index is read on open.  Each readBlock reads the packed blocks
+ *  covering the run with one read, then inflates and decodes them on a
+ *  thread pool, each block straight into its part of the columns.
+ */
+class zbTipsy : public TipsyBlockSource {
+public:
+    //! @brief One entry of the block index.
+    struct entry {
+	uint64_t offset; //!< Offset of the packed block in the file
+	uint32_t size;   //!< Size of the packed block
+    };
+
+    //! @brief Construct a closed reader.
+    //! @param threads Number of threads to inflate with, 0 for one per core
+    explicit zbTipsy( std::size_t threads=0 );
+
+    //! @brief Close the file.
+    virtual ~zbTipsy();
+
+    //! @brief Check whether a file is block compressed (by its magic).
+    static bool is_blocked( const char *iname );
+
+    //! @brief Open a block compressed file and read its header and index.
+    //! @param iname Input file name
+    //! @return false if the file is missing, not blocked or inconsistent,
+    //!         or if tipsylib was built without zlib.
+    bool open( const char *iname );
+
+    //! @brief Check if a file is open.
+    bool is_open() const
+	{ return m_file.is_open(); }
+
+    //! @brief Close the file.
+    void close();
+
+    //! @brief The header of the open file.
+    const TipsyHeader &header() const
+	{ return m_header; }
+
+    //! @brief Number of records per block.
+    uint32_t records() const
+	{ return m_records; }
+
+    //! @brief Read a run of particles from one section.
+    //! @param pos  Section and offset of the first particle
+    //! @param n    Maximum number of particles (clipped to the section)
+    //! @param cols Destination columns
+    //! @param at   Index in cols of the first particle read
+    //! @return The number of particles read; short if a block is damaged.
+    virtual tipsypos::offset_type readBlock( tipsypos pos,
+					     tipsypos::offset_type n,
+					     TipsyColumns &cols,
+					     tipsypos::offset_type at );
+
+private:
+    std::ifstream      m_file;     //!< The file
+    TipsyHeader        m_header;   //!< The standard header
+    uint32_t           m_records;  //!< Records per block
+    std::vector<entry> m_index;    //!< The block index
+    uint64_t           m_first[4]; //!< First block of gas, dark, star, eof
+    std::size_t        m_threads;  //!< Requested number of threads
+    TipsyThreadPool   *m_pool;     //!< Created on the first read
+    std::vector< std::vector<char> > m_scratch; //!< Inflated block per worker
+
+    //! @brief Read the header and the index of the open file.
+    bool readIndex();
+
+    zbTipsy( const zbTipsy & );
+    zbTipsy &operator=( const zbTipsy & );
+};
+
+#endif
@@ -2,6 +2,7 @@
 /* Doug Potter - 06/06/06 */
 #include <math.h>
 #include "ztipsy.hpp"
+#include "tipsycount.h"
 
 /* ********** ozTipsy ********** */
 
@@ -57,7 +58,10 @@ izTipsy::~izTipsy()
 ozTipsy& ozTipsy::operator<<(TipsyHeader &val)
 {
     oxdrstream *s = this;
-    int pad = 0;
+    uint32_t n[4] = { uint32_t(val.h_nBodies), uint32_t(val.h_nSph),
+                      uint32_t(val.h_nDark), uint32_t(val.h_nStar) };
+    uint32_t pad = tipsyEncodePad( val.h_nBodies, val.h_nSph,
+                                   val.h_nDark, val.h_nStar );
     header = val;
 
     if ( sputn( "tzip", 4 ) != 4 ) {
@@ -66,8 +70,8 @@ ozTipsy& ozTipsy::operator<<(TipsyHeader &val)
     }
     *s << m_flags;
 
-    *s << val.h_time << val.h_nBodies << val.h_nDims
-       << val.h_nSph << val.h_nDark << val.h_nStar << pad;
+    *s << val.h_time << n[0] << val.h_nDims
+       << n[1] << n[2] << n[3] << pad;
     return *this;
 }
 
@@ -297,7 +301,7 @@ void izTipsy::ReadParticle(TipsyBaseParticle &val)
 izTipsy& izTipsy::operator>>(TipsyHeader &val)
 {
     ixdrstream *s = this;
-    int pad = 0;
+    uint32_t pad = 0;
     char tzip[4];
 
     if ( sgetn(tzip,sizeof(tzip)) != sizeof(tzip)
@@ -307,8 +311,15 @@ izTipsy& izTipsy::operator>>(TipsyHeader &val)
     }
     *s >> m_flags;
 
-    *s >> val.h_time >> val.h_nBodies >> val.h_nDims
-       >> val.h_nSph >> val.h_nDark >> val.h_nStar >> pad;
+    uint32_t n[4];
+    uint64_t counts[4];
+    *s >> val.h_time >> n[0] >> val.h_nDims
+       >> n[1] >> n[2] >> n[3] >> pad;
+    tipsyDecodeCounts( n[0], n[1], n[2], n[3], pad, counts );
+    val.h_nBodies = counts[0];
+    val.h_nSph    = counts[1];
+    val.h_nDark   = counts[2];
+    val.h_nStar   = counts[3];
     header = val;
     return *this;
 }
@@ -5,6 +5,9 @@
 =========================================================================*/
 #include "vtkFriendsOfFriendsHaloFinder.h"
 #include "AstroVizHelpersLib/AstroVizHelpers.h"
+#include "AstroVizHelpersLib/AstroVizHaloCatalogue.h"
+#include "AstroVizHelpersLib/AstroVizKdTree.h"
+#include "AstroVizHelpersLib/AstroVizUnionFind.h"
 #include "vtkIdList.h"
 #include "vtkIdTypeArray.h"
 #include "vtkInformation.h"
@@ -12,7 +15,6 @@
 #include "vtkObjectFactory.h"
 #include "vtkPointData.h"
 #include "vtkSmartPointer.h"
-#include "vtkKdTree.h"
 #include "vtkPointSet.h"
 #include "vtkPoints.h"
 #include "vtkGenericPointIterator.h"
@@ -22,8 +24,13 @@
 #include "vtkCallbackCommand.h"
 #include "vtkPolyData.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
+#include "vtkMultiThreader.h"
+#include "vtkMutexLock.h"
+#include "vtkCommunicator.h"
+#include "vtkTable.h"
 #include <vtkstd/vector>
-#include <vtkstd/map>
+#include <vtkstd/algorithm>
+#include <vtkstd/utility>
 
 
 vtkCxxRevisionMacro(vtkFriendsOfFriendsHaloFinder, "$Revision: 1.72 $");
@@ -42,6 +49,9 @@ vtkFriendsOfFriendsHaloFinder::vtkFriendsOfFriendsHaloFinder()
     vtkDataSetAttributes::SCALARS);
   this->LinkingLength = 1e-6; //default
 	this->MinimumNumberOfParticles = 50; // default
+	this->NumberOfThreads = 0; // one per core
+	// the particles, and the catalogue of haloes
+	this->SetNumberOfOutputPorts(2);
 	this->Controller = NULL;
 	this->SetController(vtkMultiProcessController::GetGlobalController());
 }
@@ -59,6 +69,7 @@ void vtkFriendsOfFriendsHaloFinder::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "Linking Length: " << this->LinkingLength 
 		<<	indent << "Minimum Number Of Particles: " 
 		<<  this->MinimumNumberOfParticles << "\n";
+  os << indent << "Number Of Threads: " << this->NumberOfThreads << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -69,6 +80,52 @@ int vtkFriendsOfFriendsHaloFinder::FillInputPortInformation(int,
   return 1;
 }
 
+//----------------------------------------------------------------------------
+int vtkFriendsOfFriendsHaloFinder::FillOutputPortInformation(int port,
+	vtkInformation* info)
+{
+	if(port==1)
+		{
+		info->Set(vtkDataObject::DATA_TYPE_NAME(), "vtkTable");
+		return 1;
+		}
+	return this->Superclass::FillOutputPortInformation(port,info);
+}
+
+//----------------------------------------------------------------------------
+int vtkFriendsOfFriendsHaloFinder::RequestDataObject(vtkInformation*,
+	vtkInformationVector** inputVector, vtkInformationVector* outputVector)
+{
+	// the particles are of the type of the input, as the superclass would
+	// make them, but the superclass would make the catalogue one too
+	vtkPointSet* input = vtkPointSet::GetData(inputVector[0]);
+	if(!input)
+		{
+		return 0;
+		}
+	vtkInformation* info = outputVector->GetInformationObject(0);
+	vtkPointSet* output = vtkPointSet::SafeDownCast(
+		info->Get(vtkDataObject::DATA_OBJECT()));
+	if(!output || !output->IsA(input->GetClassName()))
+		{
+		vtkDataObject* newOutput = input->NewInstance();
+		newOutput->SetPipelineInformation(info);
+		newOutput->Delete();
+		this->GetOutputPortInformation(0)->Set(
+			vtkDataObject::DATA_EXTENT_TYPE(), newOutput->GetExtentType());
+		}
+	info = outputVector->GetInformationObject(1);
+	if(!vtkTable::SafeDownCast(info->Get(vtkDataObject::DATA_OBJECT())))
+		{
+		vtkTable* catalogue = vtkTable::New();
+		catalogue->SetPipelineInformation(info);
+		catalogue->Delete();
+		this->GetOutputPortInformation(1)->Set(
+			vtkDataObject::DATA_EXTENT_TYPE(), catalogue->GetExtentType());
+		}
+	return 1;
+}
+
 //----------------------------------------------------------------------------
 vtkIdType vtkFriendsOfFriendsHaloFinder::GetUniqueId(
 	unsigned long index, vtkIdTypeArray* globalIdArray)
@@ -83,61 +140,351 @@ vtkIdType vtkFriendsOfFriendsHaloFinder::GetUniqueId(
 		}
 }		
 
+//----------------------------------------------------------------------------
+// What the threads linking particles share: the tree, the sets, and the
+// next block of points, in tree order, to hand out
+struct vtkFriendsOfFriendsTask
+{
+	const KdTree* Tree;
+	UnionFind* Groups;
+	double LinkingLength;
+	vtkIdType NumberOfPoints;
+	vtkIdType PointsPerBlock;
+	vtkIdType NextPoint;
+	vtkMutexLock* Lock;
+};
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkFriendsOfFriendsHaloFinder::LinkThread(void* arg)
+{
+	vtkFriendsOfFriendsTask* task=static_cast<vtkFriendsOfFriendsTask*>(
+		static_cast<vtkMultiThreader::ThreadInfo*>(arg)->UserData);
+	const KdTree* tree=task->Tree;
+	const vtkIdType* order=tree->GetOrder();
+	// the friends of the current point, reused for every point
+	vtkstd::vector<vtkIdType> friends;
+	for(;;)
+		{
+		task->Lock->Lock();
+		const vtkIdType first=task->NextPoint;
+		task->NextPoint=vtkstd::min(task->NumberOfPoints,
+			first+task->PointsPerBlock);
+		const vtkIdType last=task->NextPoint;
+		task->Lock->Unlock();
+		if(first >= last)
+			{
+			break;
+			}
+		for(vtkIdType n = first; n < last; ++n)
+			{
+			const vtkIdType id=order[n];
+			tree->FindPointsWithinRadius(tree->GetPoint(id),task->LinkingLength,
+				friends);
+			for(vtkstd::vector<vtkIdType>::size_type j = 0; j < friends.size(); ++j)
+				{
+				// each pair is found from both ends, so is linked from one
+				if(friends[j] > id)
+					{
+					task->Groups->Union(id,friends[j]);
+					}
+				}
+			}
+		}
+	return VTK_THREAD_RETURN_VALUE;
+}
+
 //----------------------------------------------------------------------------
 vtkIdTypeArray* vtkFriendsOfFriendsHaloFinder::FindHaloes(
-	vtkKdTree* pointTree, vtkIdTypeArray* globalIdArray, vtkPointSet* input)
+	vtkIdTypeArray* globalIdArray, vtkPointSet* input, vtkTable* catalogue)
 {
 	if(this->MinimumNumberOfParticles < 2)
 		{
 		vtkWarningMacro("setting minimum number of particles to 2, a minimum number of particles below this makes no sense.");
 		this->MinimumNumberOfParticles=2;
 		}
-	// Initializing maps and sets to keep track of haloes, unique ids, and
-	// if running in parallel ghost cells, whether a halo is split accross 
-	// processors, and a map from the local halo id to the global
-	vtkstd::map<vtkIdType,unsigned long> haloCount;
-	vtkstd::map<vtkIdType,unsigned long> haloUniqueId;	
-	// 1.  Calculating the initial haloes
-	vtkIdTypeArray* haloIdArray = \
-		pointTree->BuildMapForDuplicatePoints(this->LinkingLength);
+	const vtkIdType numPoints=input->GetPoints()->GetNumberOfPoints();
+	// 1.  Linking every pair of particles within a linking length, on many
+	// threads, each taking blocks of the points in tree order. Friends of
+	// friends end up in one set, whose root is its lowest point id.
+	KdTree tree;
+	tree.Build(input->GetPoints());
+	UnionFind groups;
+	groups.Initialize(numPoints);
+	vtkFriendsOfFriendsTask task;
+	task.Tree=&tree;
+	task.Groups=&groups;
+	task.LinkingLength=this->LinkingLength;
+	task.NumberOfPoints=numPoints;
+	task.PointsPerBlock=4096;
+	task.NextPoint=0;
+	task.Lock=vtkMutexLock::New();
+	int numThreads=this->NumberOfThreads > 0 ? this->NumberOfThreads :
+		vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+	vtkMultiThreader* threader=vtkMultiThreader::New();
+	threader->SetNumberOfThreads(vtkstd::max(1,int(vtkstd::min<vtkIdType>(
+		numThreads,numPoints/task.PointsPerBlock+1))));
+	threader->SetSingleMethod(vtkFriendsOfFriendsHaloFinder::LinkThread,&task);
+	threader->SingleMethodExecute();
+	threader->Delete();
+	task.Lock->Delete();
+	// 2. Counting the particles of each group, by its root, in a flat array,
+	// and labelling each group by the unique id of its root, its first
+	// particle
+	vtkstd::vector<vtkIdType> label(numPoints);
+	vtkstd::vector<vtkIdType> haloCount(numPoints,0);
+	for(vtkIdType id = 0; id < numPoints; ++id)
+		{
+		const vtkIdType root=groups.Find(id);
+		haloCount[root]+=1;
+		label[id]=(root==id) ? this->GetUniqueId(id,globalIdArray) : label[root];
+		}
+	// 3. In parallel, merging groups linked across pieces; the labels of
+	// groups so merged, sorted, with the label of the halo each is part of,
+	// the lowest of them, and the halo's count over all processes
+	vtkstd::vector<vtkIdType> mergedLabels;
+	vtkstd::vector<vtkIdType> mergedHaloes;
+	vtkstd::vector<vtkIdType> mergedCounts;
+	if(RunInParallel(this->Controller))
+		{
+		this->MergeHaloes(tree,label,haloCount,groups,mergedLabels,
+			mergedHaloes,mergedCounts);
+		}
+	// 4. Cutting off haloes with count < this->MinimumNumberOfParticles, 
+	// whose particles get 0, and giving the particles of the others the 
+	// label of their halo, while summing over the particles of each group
+	// for the catalogue; a group's root comes before its other particles
+	vtkIdTypeArray* haloIdArray = vtkIdTypeArray::New();
 	haloIdArray->SetNumberOfComponents(1);
-	haloIdArray->SetNumberOfTuples(input->GetPoints()->GetNumberOfPoints());
+	haloIdArray->SetNumberOfTuples(numPoints);
 	haloIdArray->SetName("halo ID");
-	for(unsigned long nextHaloIdIndex = 0;
-		nextHaloIdIndex < haloIdArray->GetNumberOfTuples();
-	 	++nextHaloIdIndex)
+	vtkDataArray* massArray=input->GetPointData()->GetArray("mass");
+	vtkDataArray* velocityArray=input->GetPointData()->GetArray("velocity");
+	vtkDataArray* potentialArray=input->GetPointData()->GetArray("potential");
+	if(velocityArray && velocityArray->GetNumberOfComponents()!=3)
 		{
-		vtkIdType haloId = haloIdArray->GetValue(nextHaloIdIndex);
-		haloCount[haloId]+=1;
+		velocityArray=NULL;
 		}
-	// Setting proto-halos which have 
-	// count < this->MinimumNumberOfParticles, O(N), and
-	// assigning those we have seen more the requisite number
-	// of times to their unique id, meaning we have truly found a halo.
-	for(unsigned long nextHaloIdIndex = 0;
-		nextHaloIdIndex < haloIdArray->GetNumberOfTuples();
-	 	++nextHaloIdIndex)
+	HaloCatalogue sums;
+	vtkstd::vector<vtkIdType> particleRow(catalogue ? numPoints : 0,-1);
+	for(vtkIdType id = 0; id < numPoints; ++id)
 		{
-		vtkIdType haloId = haloIdArray->GetValue(nextHaloIdIndex);
-		if(haloCount[haloId]<this->GetMinimumNumberOfParticles())
+		const vtkIdType root=groups.Find(id);
+		vtkIdType haloId=label[id];
+		vtkIdType count=haloCount[root];
+		vtkstd::vector<vtkIdType>::iterator merged=vtkstd::lower_bound(
+			mergedLabels.begin(),mergedLabels.end(),haloId);
+		if(merged!=mergedLabels.end() && *merged==haloId)
 			{
-			// we only saw it less than requisite number of times
-			haloIdArray->SetValue(nextHaloIdIndex,0);
+			haloId=mergedHaloes[merged-mergedLabels.begin()];
+			count=mergedCounts[merged-mergedLabels.begin()];
 			}
-		else
+		if(count < this->GetMinimumNumberOfParticles())
+			{
+			haloId=0;
+			}
+		haloIdArray->SetValue(id,haloId);
+		if(!catalogue || haloId==0)
+			{
+			continue;
+			}
+		particleRow[id]=(root==id) ? sums.AddHalo(haloId) : particleRow[root];
+		double velocity[3]={0.0,0.0,0.0};
+		if(velocityArray)
 			{
-			// we saw it requisite number of times, getting unique id if it 
-			// has already been assigned, otherwise assigning it.
-			unsigned long uniqueId = haloUniqueId[haloId];
-			if(!uniqueId)
+			velocityArray->GetTuple(id,velocity);
+			}
+		sums.AddParticle(particleRow[id],tree.GetPoint(id),
+			massArray ? massArray->GetComponent(id,0) : 1.0,velocity,
+			potentialArray ? potentialArray->GetComponent(id,0) : VTK_DOUBLE_MAX,
+			this->GetUniqueId(id,globalIdArray)-1);
+		}
+	if(catalogue)
+		{
+		if(!massArray)
+			{
+			vtkWarningMacro("No mass array, so every particle has mass 1 in the "
+				"halo catalogue");
+			}
+		sums.Fill(this->Controller,input->GetPoints(),
+			particleRow,catalogue);
+		}
+	return haloIdArray;
+}
+
+//----------------------------------------------------------------------------
+void vtkFriendsOfFriendsHaloFinder::MergeHaloes(const KdTree& tree,
+	const vtkstd::vector<vtkIdType>& label,
+	const vtkstd::vector<vtkIdType>& haloCount, UnionFind& groups,
+	vtkstd::vector<vtkIdType>& mergedLabels,
+	vtkstd::vector<vtkIdType>& mergedHaloes,
+	vtkstd::vector<vtkIdType>& mergedCounts)
+{
+	// Outline:
+	// 1. Share the bounds of every piece
+	// 2. Send each other process the particles within a linking length of
+	//    its piece, with the labels of their groups, and receive those of
+	//    the other processes within a linking length of this piece
+	// 3. A particle received linked to one of the piece links the two
+	//    groups; process 0 gathers these links from all and joins the
+	//    groups they link, the lowest label naming the halo
+	// 4. Process 0 sends back the labels merged and their haloes, every
+	//    process counts its particles in each, and process 0 adds the
+	//    counts up and sends them back
+	const vtkIdType numPoints=tree.GetNumberOfPoints();
+	const int procId=this->Controller->GetLocalProcessId();
+	const int numProc=this->Controller->GetNumberOfProcesses();
+	const double linkingLength2=this->LinkingLength*this->LinkingLength;
+	// 1. the bounds of every piece
+	double localBounds[6];
+	tree.GetBounds(localBounds);
+	vtkstd::vector<double> bounds(6*numProc);
+	this->Controller->AllGather(localBounds,&bounds[0],6);
+	// 2. and 3. swapping particles near each other's pieces, and finding the
+	// links between groups
+	vtkstd::vector<vtkIdType> links;
+	vtkstd::vector<double> sendPoints, recvPoints;
+	vtkstd::vector<vtkIdType> sendLabels, recvLabels;
+	vtkstd::vector<vtkIdType> friends;
+	for(int proc = 0; proc < numProc; ++proc)
+		{
+		if(proc==procId)
+			{
+			continue;
+			}
+		sendPoints.clear();
+		sendLabels.clear();
+		for(vtkIdType id = 0; id < numPoints; ++id)
+			{
+			const double* x=tree.GetPoint(id);
+			if(Distance2ToBounds(x,&bounds[6*proc]) <= linkingLength2)
+				{
+				sendPoints.insert(sendPoints.end(),x,x+3);
+				sendLabels.push_back(label[id]);
+				}
+			}
+		ExchangeWithPeer(this->Controller,proc,sendPoints,recvPoints,
+			GHOST_POINTS_COUNT,GHOST_POINTS_AND_LOCAL_HALO_IDS);
+		ExchangeWithPeer(this->Controller,proc,sendLabels,recvLabels,
+			GHOST_POINTS_COUNT,GHOST_POINTS_AND_LOCAL_HALO_IDS);
+		for(vtkstd::vector<vtkIdType>::size_type g = 0; g < recvLabels.size(); 
+			++g)
+			{
+			tree.FindPointsWithinRadius(&recvPoints[3*g],this->LinkingLength,
+				friends);
+			vtkIdType lastLabel=-1;
+			for(vtkstd::vector<vtkIdType>::size_type j = 0; j < friends.size(); 
+				++j)
 				{
-				haloUniqueId[haloId] = \
-				 	this->GetUniqueId(nextHaloIdIndex,globalIdArray);
+				const vtkIdType friendLabel=label[groups.Find(friends[j])];
+				if(friendLabel!=lastLabel)
+					{
+					links.push_back(vtkstd::min(friendLabel,recvLabels[g]));
+					links.push_back(vtkstd::max(friendLabel,recvLabels[g]));
+					lastLabel=friendLabel;
+					}
 				}
-			haloIdArray->SetValue(nextHaloIdIndex,uniqueId);
 			}
 		}
-	return haloIdArray;
+	// each link once
+	vtkstd::vector<vtkstd::pair<vtkIdType,vtkIdType> > pairs;
+	for(vtkstd::vector<vtkIdType>::size_type i = 0; i < links.size(); i+=2)
+		{
+		pairs.push_back(vtkstd::make_pair(links[i],links[i+1]));
+		}
+	vtkstd::sort(pairs.begin(),pairs.end());
+	pairs.erase(vtkstd::unique(pairs.begin(),pairs.end()),pairs.end());
+	links.clear();
+	for(vtkstd::vector<vtkstd::pair<vtkIdType,vtkIdType> >::size_type i = 0; 
+		i < pairs.size(); ++i)
+		{
+		links.push_back(pairs[i].first);
+		links.push_back(pairs[i].second);
+		}
+	// 3. joining the linked groups on process 0
+	vtkIdType numMerged=0;
+	if(procId==0)
+		{
+		vtkstd::vector<vtkIdType> recvLinks;
+		for(int proc = 1; proc < numProc; ++proc)
+			{
+			vtkIdType numLinks=0;
+			this->Controller->Receive(&numLinks,1,proc,HALO_LINKS);
+			recvLinks.resize(numLinks);
+			if(numLinks > 0)
+				{
+				this->Controller->Receive(&recvLinks[0],numLinks,proc,HALO_LINKS);
+				}
+			links.insert(links.end(),recvLinks.begin(),recvLinks.end());
+			}
+		mergedLabels=links;
+		vtkstd::sort(mergedLabels.begin(),mergedLabels.end());
+		mergedLabels.erase(vtkstd::unique(mergedLabels.begin(),
+			mergedLabels.end()),mergedLabels.end());
+		// the labels are sorted, so the lowest index of a set is its lowest
+		// label
+		UnionFind haloes;
+		haloes.Initialize(mergedLabels.size());
+		for(vtkstd::vector<vtkIdType>::size_type i = 0; i < links.size(); i+=2)
+			{
+			haloes.Union(
+				vtkstd::lower_bound(mergedLabels.begin(),mergedLabels.end(),
+					links[i])-mergedLabels.begin(),
+				vtkstd::lower_bound(mergedLabels.begin(),mergedLabels.end(),
+					links[i+1])-mergedLabels.begin());
+			}
+		numMerged=mergedLabels.size();
+		mergedHaloes.resize(numMerged);
+		for(vtkIdType i = 0; i < numMerged; ++i)
+			{
+			mergedHaloes[i]=mergedLabels[haloes.Find(i)];
+			}
+		}
+	else
+		{
+		vtkIdType numLinks=links.size();
+		this->Controller->Send(&numLinks,1,0,HALO_LINKS);
+		if(numLinks > 0)
+			{
+			this->Controller->Send(&links[0],numLinks,0,HALO_LINKS);
+			}
+		}
+	// 4. sharing the merged haloes and adding up their counts
+	this->Controller->Broadcast(&numMerged,1,0);
+	if(numMerged==0)
+		{
+		return;
+		}
+	mergedLabels.resize(numMerged);
+	mergedHaloes.resize(numMerged);
+	this->Controller->Broadcast(&mergedLabels[0],numMerged,0);
+	this->Controller->Broadcast(&mergedHaloes[0],numMerged,0);
+	vtkstd::vector<vtkIdType> localCounts(numMerged,0);
+	for(vtkIdType id = 0; id < numPoints; ++id)
+		{
+		if(groups.Find(id)!=id)
+			{
+			continue;
+			}
+		vtkstd::vector<vtkIdType>::iterator merged=vtkstd::lower_bound(
+			mergedLabels.begin(),mergedLabels.end(),label[id]);
+		if(merged!=mergedLabels.end() && *merged==label[id])
+			{
+			// counted under the halo, whose label is also among those merged
+			localCounts[vtkstd::lower_bound(mergedLabels.begin(),
+				mergedLabels.end(),mergedHaloes[merged-mergedLabels.begin()])-
+				mergedLabels.begin()]+=haloCount[id];
+			}
+		}
+	mergedCounts.assign(numMerged,0);
+	this->Controller->Reduce(&localCounts[0],&mergedCounts[0],numMerged,
+		vtkCommunicator::SUM_OP,0);
+	this->Controller->Broadcast(&mergedCounts[0],numMerged,0);
+	// every label merged gets the count of its halo
+	for(vtkIdType i = 0; i < numMerged; ++i)
+		{
+		mergedCounts[i]=mergedCounts[vtkstd::lower_bound(mergedLabels.begin(),
+			mergedLabels.end(),mergedHaloes[i])-mergedLabels.begin()];
+		}
 }
 
 //----------------------------------------------------------------------------
@@ -147,12 +494,14 @@ int vtkFriendsOfFriendsHaloFinder::RequestData(vtkInformation* request,
 {
 	// Outline of this filter:
 	// 1. Build Kd tree
-	// 2. Go through each point in output
+	// 2. Go through each point in output, on many threads
 	// 		o calculate points within linking length
-	// 		o these form a halo
+	// 		o join their groups; friends of friends form a halo
 	// 3. Cutoff by particle count
 	// 		o if proto-halo doesn't have minimum particle count, 
 	// 		it is not considered a halo. if it does, it is given a unique id.
+	// 		o the particles of haloes are summed over as they are labelled,
+	// 		and the sums give the catalogue on the second output
 	
   // Get input and output data.
   vtkPointSet* input = vtkPointSet::GetData(inputVector[0]);
@@ -167,7 +516,8 @@ int vtkFriendsOfFriendsHaloFinder::RequestData(vtkInformation* request,
 		{
 		vtkSmartPointer<vtkDataArray> globalIdArrayGeneric = \
 		 	this->GetInputArrayToProcess(0, inputVector);
-		if(!globalIdArray || !globalIdArray->IsA("vtkIdTypeArray"))
+		if(!globalIdArrayGeneric || 
+			!globalIdArrayGeneric->IsA("vtkIdTypeArray"))
 	    {
 	    vtkErrorMacro("Failed to locate global ID array, this is required if running in parallel. Generate by using Tipsy Reader to read in data, by running D3 with ghost cell generation, or by loading in with the original data in your preferred reader.");
 	    return 0;
@@ -177,13 +527,9 @@ int vtkFriendsOfFriendsHaloFinder::RequestData(vtkInformation* request,
 			globalIdArray = vtkIdTypeArray::SafeDownCast(globalIdArrayGeneric);
 			}
 		}
-	// Building a local KdTree for locator purposes
-	vtkSmartPointer<vtkKdTree> pointTree = vtkSmartPointer<vtkKdTree>::New();
-	// building a locator
-	// changing back as input didn't find my ghost cells
-	pointTree->BuildLocatorFromPoints(output);	
-	vtkIdTypeArray* haloIdArray = \
-		this->FindHaloes(pointTree,globalIdArray,output);
+	vtkTable* catalogue = vtkTable::GetData(outputVector,1);
+	vtkIdTypeArray* haloIdArray = this->FindHaloes(globalIdArray,output,
+		catalogue);
 	output->GetPointData()->AddArray(haloIdArray);
 	// Managing memory
 	haloIdArray->Delete();
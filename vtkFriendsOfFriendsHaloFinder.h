@@ -15,19 +15,39 @@
 // .NAME vtkFriendsOfFriendsHaloFinder 
 // .SECTION Description
 // vtkFriendsOfFriendsHaloFinder 
-// Finds groups of particles, defined to be haloes each within a specified
-//  linking length of each other. Parallel by process, and halo ids are 
-//  guaranteed to be globally unique, but does not merge haloes
-//  accross processes. If run in parallel requires a unique ID list as input
-// otherwise, this is unused.
+// Finds groups of particles, defined to be haloes, in which every particle
+//  is linked to the others through a chain of particles each within a 
+//  specified linking length of the next. Pairs are found with a bucket
+//  kd-tree and joined in lock-free disjoint sets, on NumberOfThreads
+//  threads. Parallel by process: particles within a linking length of
+//  another process's piece are sent to it, groups linked across pieces
+//  are merged into one halo on process 0, and the minimum number of
+//  particles is applied to the merged haloes, so halo ids are globally
+//  unique and consistent. A halo's id is the unique id of its first
+//  particle, the lowest among its pieces' groups. If run in parallel
+//  requires a unique ID list as input otherwise, this is unused.
+//
+// The second output is a catalogue of the haloes, a table with a row per
+// halo: its id, number of particles, mass, center of mass, mean velocity,
+// velocity dispersion about it, spin parameter (Bullock et al. 2001, in
+// units where G=1), the distance of its farthest particle from the center
+// and the index (unique id, less one) of its particle of lowest
+// "potential", or -1 without that array. The masses and velocities are
+// those of the "mass" and "velocity" arrays. The rows come from sums
+// kept while particles are labelled, added up over processes on process
+// 0, which alone holds the rows.
 // .SECTION See Also
-// vtkKdTree, vtkKdTree, vtkPointSetAlgorithm.h
+// KdTree, UnionFind, HaloCatalogue, vtkPointSetAlgorithm.h
 
 #ifndef __vtkFriendsOfFriendsHaloFinder_h
 #define __vtkFriendsOfFriendsHaloFinder_h
 #include "vtkPointSetAlgorithm.h"
+#include "vtkMultiThreader.h" // for VTK_THREAD_RETURN_TYPE
+#include <vtkstd/vector>
 class vtkPointSet;
-class vtkKdTree;
+class vtkTable;
+class KdTree;
+class UnionFind;
 class vtkMultiProcessController;
 class vtkIdTypeArray;
 
@@ -35,6 +55,8 @@ enum FriendsOfFriendsMPIData
 {
 	GHOST_POINTS_AND_LOCAL_HALO_IDS,
 	GHOST_POINTS_AND_LOCAL_HALO_IDS_TO_GLOBAL,
+	GHOST_POINTS_COUNT,
+	HALO_LINKS
 };
 class VTK_EXPORT vtkFriendsOfFriendsHaloFinder : public vtkPointSetAlgorithm
 {
@@ -55,6 +77,12 @@ public:
   vtkSetMacro(MinimumNumberOfParticles, int);
   vtkGetMacro(MinimumNumberOfParticles, int);
 
+  // Description:
+  // Get/Set the number of threads to link particles on, 0 (the default)
+  // for one per core
+  vtkSetClampMacro(NumberOfThreads, int, 0, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfThreads, int);
+
  	// Description:
 	// By defualt this filter uses the global controller,
 	// but this method can be used to set another instead.
@@ -66,9 +94,10 @@ public:
 	// a single halo. Considers particles to comprise a halo only if its group
 	// has more than the requisite number of particles, as input by user. 
 	// Output should contain the data set in which halos should be searched
-	// before calling.
-	vtkIdTypeArray* FindHaloes(vtkKdTree* pointTree, 
-		vtkIdTypeArray* globalIdArray, vtkPointSet* input);
+	// before calling. If catalogue is not NULL, the catalogue of the haloes
+	// is added to it.
+	vtkIdTypeArray* FindHaloes(vtkIdTypeArray* globalIdArray, 
+		vtkPointSet* input, vtkTable* catalogue=NULL);
 
 //BTX
 protected:
@@ -76,20 +105,41 @@ protected:
   ~vtkFriendsOfFriendsHaloFinder();
   // Override to specify support for any vtkDataSet input type.
   virtual int FillInputPortInformation(int port, vtkInformation* info);
+  // The catalogue, on port 1, is a table.
+  virtual int FillOutputPortInformation(int port, vtkInformation* info);
+  virtual int RequestDataObject(vtkInformation*,
+   	vtkInformationVector**,
+    vtkInformationVector*);
   // Main implementation.
   virtual int RequestData(vtkInformation*,
    	vtkInformationVector**,
     vtkInformationVector*);
   double LinkingLength;
 	int MinimumNumberOfParticles;
+	int NumberOfThreads;
 	vtkMultiProcessController* Controller;
 
+	// Description:
+	// links the particles of blocks of points until none are left, on one
+	// thread
+	static VTK_THREAD_RETURN_TYPE LinkThread(void* arg);
+	// Description:
+	// merges the groups of this piece, labelled and counted by their roots,
+	// with those they are linked to in other pieces. Returns, sorted, the
+	// labels of groups merged, with the label of the halo of each, and the
+	// count of that halo over all processes.
+	void MergeHaloes(const KdTree& tree,
+		const vtkstd::vector<vtkIdType>& label,
+		const vtkstd::vector<vtkIdType>& haloCount, UnionFind& groups,
+		vtkstd::vector<vtkIdType>& mergedLabels,
+		vtkstd::vector<vtkIdType>& mergedHaloes,
+		vtkstd::vector<vtkIdType>& mergedCounts);
+
 	// Description:
 	// Returns unique id, simply equal to index+1 if running in serial,
 	// or equal to the id at index+1 in the globalIdArray if running in parallel
-	// The plus one is so that we can tell whether a unique id has been assigned
-	// yet in a map (has not been assigned if = 0, which would break down if 
-	// assigned ids were not strictly greater than zero)
+	// The plus one is so that ids of haloes are strictly greater than zero,
+	// which is left for particles in no halo
 	vtkIdType GetUniqueId(unsigned long index, vtkIdTypeArray* globalIdArray);
 
 private:
@@ -13,6 +13,7 @@
 #include "vtkDoubleArray.h" 
 #include "vtkFloatArray.h"
 #include "vtkIntArray.h"
+#include "vtkIdTypeArray.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 #include "vtkDistributedDataFilter.h"
 #include "vtkMultiProcessController.h"
@@ -20,7 +21,9 @@
 #include "vtkInformationVector.h"
 #include "vtkSmartPointer.h"
 #include "vtkDataArraySelection.h"
+#include "AstroVizSubsample.h"
 #include <cmath>
+#include <sstream>
 #include <assert.h>
 #include <string>
 #include <vector>
@@ -97,6 +100,8 @@ vtkGraficReader::vtkGraficReader()
 {
 	srand((unsigned)time(0));
   this->FileName          = 0;
+  this->SubsampleFraction = 1.0;
+  this->SubsampleMode     = SUBSAMPLE_STRIDE;
   this->UpdatePiece       = 0;
   this->UpdateNumPieces   = 0;
   this->SetNumberOfInputPorts(0); 
@@ -121,7 +126,9 @@ void vtkGraficReader::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os,indent);
   os << indent << "FileName: "
-     << (this->FileName ? this->FileName : "(none)") << "\n";
+     << (this->FileName ? this->FileName : "(none)") << "\n"
+     << indent << "SubsampleFraction: " << this->SubsampleFraction << "\n"
+     << indent << "SubsampleMode: " << this->SubsampleMode << "\n";
 }
 
 		
@@ -194,6 +201,21 @@ int vtkGraficReader::RequestData(vtkInformation*,
     vtkErrorMacro("A FileName must be specified.");
     return 0;
     }
+	vtkInformation* outInfo = outputVector->GetInformationObject(0);
+
+  // get the output polydata
+  vtkPolyData *output = \
+      vtkPolyData::SafeDownCast(outInfo->Get(vtkDataObject::DATA_OBJECT()));
+
+	// A lowered subsample fraction is served from the previous read
+	std::ostringstream cacheKey;
+	cacheKey << this->FileName << '\n' << this->ReadEntireDirectory << ' '
+		<< this->SubsampleMode;
+	if(this->SubsampleFraction<1.0 && this->Cache.Extract(cacheKey.str(),
+		this->SubsampleFraction,this->SubsampleMode,output))
+		{
+		return 1;
+		}
 	FIO grafic;
 	if(this->ReadEntireDirectory){
 		char * fileDir = (char *)malloc(strlen(this->FileName) + 1);
@@ -206,12 +228,7 @@ int vtkGraficReader::RequestData(vtkInformation*,
 			fioOpen(this->FileName, 0.01, 0.01);
 	}
 
-	
-	vtkInformation* outInfo = outputVector->GetInformationObject(0);
 
-  // get the output polydata
-  vtkPolyData *output = \
-      vtkPolyData::SafeDownCast(outInfo->Get(vtkDataObject::DATA_OBJECT()));
   vtkSmartPointer<vtkPolyData> GraficReadInitialOutput = \
       vtkSmartPointer<vtkPolyData>::New();
 
@@ -242,79 +259,98 @@ int vtkGraficReader::RequestData(vtkInformation*,
   nDark = fioGetN(grafic,FIO_SPECIES_DARK);
   nStar = fioGetN(grafic,FIO_SPECIES_STAR);
 	
+	// A particle is in the subsample according to its position in the order
+	// read here: stars, dark then gas. Only the subsample is allocated and 
+	// read, and its mass is scaled up to preserve the total.
+	const double fraction=this->SubsampleFraction;
+	const int mode=this->SubsampleMode;
+	uint64_t numRead=0;
+	for(uint64_t j=0; j < nStar+nDark+nGas; j++) {
+		if(InSubsample(j,fraction,mode)) numRead++;
+	}
+	vtkSmartPointer<vtkIdTypeArray> subsampleIds = \
+		vtkSmartPointer<vtkIdTypeArray>::New();
+	subsampleIds->SetNumberOfTuples(numRead);
 	// Allocate the arrays
-	this->AllocateAllGraficVariableArrays(nTot, output);
+	this->AllocateAllGraficVariableArrays(numRead, output);
   // particle variables
   uint64_t piOrder;
   double pdPos[3],pdVel[3];
   float pfMass,pfSoft,pfPot,pfRho,pfTemp,pfMetals,pfTform;
 	// loop variable
 	uint64_t i;
-	// loop variable
-	uint64_t idx;
+	// next row to fill
+	uint64_t idx=0;
 	
 	// read/write star, 
   for(i=0; i<nStar; i++) {
+		if(!InSubsample(i,fraction,mode)) continue;
     fioSeek(grafic,i,FIO_SPECIES_STAR);    
     fioReadStar(grafic,
 								&piOrder,pdPos,pdVel,&pfMass,&pfSoft,&pfPot,&pfMetals,&pfTform);
 		// TODO: read the rest of the variables!
 		//fprintf(stdout,"%d,%llu,%f,%f,%f,%f,%f,%f,%f,%f,%f\n",
 		//				FIO_SPECIES_STAR,piOrder,pdPos[0],pdPos[1],pdPos[2],pdVel[0],pdVel[1],pdVel[2],pfMass,pfSoft,pfPot);
-		idx=i;
+		subsampleIds->SetValue(idx,i);
 		this->GlobalIds->SetTuple1(idx,piOrder);
 		this->Type->SetTuple1(idx,FIO_SPECIES_STAR);
 		this->Positions->SetPoint(idx, pdPos);
     this->Velocity->SetTuple(idx, pdVel);
-		this->Mass->SetTuple1(idx,pfMass);
+		this->Mass->SetTuple1(idx,pfMass/fraction);
 		this->EPS->SetTuple1(idx,pfSoft);
 		this->Potential->SetTuple1(idx,pfPot);
 		// only star has this		
 		this->Metals->SetTuple1(idx,pfMetals);
 		this->Tform->SetTuple1(idx,pfTform);
+		idx++;
   }
 	// read/write dark
   for(i=0; i<nDark; i++) {
+		if(!InSubsample(i+nStar,fraction,mode)) continue;
     fioSeek(grafic,i,FIO_SPECIES_DARK);
     fioReadDark(grafic,
 								&piOrder,pdPos,pdVel,&pfMass,&pfSoft,&pfPot);
     //fprintf(stdout,"%d,%llu,%f,%f,%f,%f,%f,%f,%f,%f,%f\n",
 		//				FIO_SPECIES_DARK,piOrder,pdPos[0],pdPos[1],pdPos[2],pdVel[0],pdVel[1],pdVel[2],pfMass,pfSoft,pfPot);
 
-		idx=i+nStar;
+		subsampleIds->SetValue(idx,i+nStar);
 		// all particle types have this
 		this->GlobalIds->SetTuple1(idx,piOrder);
 		this->Type->SetTuple1(idx,FIO_SPECIES_DARK);
 		this->Positions->SetPoint(idx, pdPos);		
     this->Velocity->SetTuple(idx, pdVel);
-		this->Mass->SetTuple1(idx,pfMass);
+		this->Mass->SetTuple1(idx,pfMass/fraction);
 		this->EPS->SetTuple1(idx,pfSoft);
 		this->Potential->SetTuple1(idx,pfPot);
+		idx++;
   }
 	// read/write gas
   for(i=0; i<nGas; i++) {
+		if(!InSubsample(i+nStar+nDark,fraction,mode)) continue;
     fioSeek(grafic,i,FIO_SPECIES_SPH);
     fioReadSph(grafic,
 							 &piOrder,pdPos,pdVel,&pfMass,&pfSoft,&pfPot,&pfRho,&pfTemp,&pfMetals);
     //fprintf(stdout,"%d,%llu,%f,%f,%f,%f,%f,%f,%f,%f,%f\n",
 		//				FIO_SPECIES_SPH,piOrder,pdPos[0],pdPos[1],pdPos[2],pdVel[0],pdVel[1],pdVel[2],pfMass,pfSoft,pfPot);
-		idx=i+nStar+nDark;
+		subsampleIds->SetValue(idx,i+nStar+nDark);
 		// all particle types have this
 		this->GlobalIds->SetTuple1(idx,piOrder);
 		this->Type->SetTuple1(idx,FIO_SPECIES_SPH);
 		this->Positions->SetPoint(idx, pdPos);		
     this->Velocity->SetTuple(idx, pdVel);
-		this->Mass->SetTuple1(idx,pfMass);
+		this->Mass->SetTuple1(idx,pfMass/fraction);
 		this->EPS->SetTuple1(idx,pfSoft);
 		this->Potential->SetTuple1(idx,pfPot);
 		// only gas has
 		this->RHO->SetTuple1(idx,pfRho);
 		this->Temperature->SetTuple1(idx,pfTemp);
 		this->Metals->SetTuple1(idx,pfMetals);
+		idx++;
   }
 	
 	
 	
+	this->Cache.Store(cacheKey.str(),fraction,output,subsampleIds);
   vtkDebugMacro("Reading all points from file " << this->FileName);
     // Read Successfully
   vtkDebugMacro("Read " << output->GetPoints()->GetNumberOfPoints() \
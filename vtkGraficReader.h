@@ -22,6 +22,7 @@
 
 #include "vtkSmartPointer.h"
 #include "tipsylib/ftipsy.hpp" // functions take Grafic particle objects
+#include "AstroVizSubsample.h" // level of detail subsampling
 #include <vtkstd/vector>
 
 class vtkPolyData;
@@ -48,6 +49,18 @@ public:
   // Get/Set whether to distribute data
 	vtkSetMacro(ReadEntireDirectory,int);
 	vtkGetMacro(ReadEntireDirectory,int);
+
+  // Description:
+  // Get/Set the fraction of the particles to load, for a quick preview.
+  // Mass is divided by the fraction so totals are preserved, and lowering
+  // the fraction is served from the previous read.
+	vtkSetClampMacro(SubsampleFraction,double,1e-6,1.0);
+	vtkGetMacro(SubsampleFraction,double);
+
+  // Description:
+  // Get/Set how the subsample is chosen (see AstroVizSubsample.h)
+	vtkSetClampMacro(SubsampleMode,int,SUBSAMPLE_STRIDE,SUBSAMPLE_RANDOM);
+	vtkGetMacro(SubsampleMode,int);
 	
 // The BTX, ETX comments bracket the portion of the code which should not be
 // attempted to wrap for use by python, specifically the code which uses
@@ -58,6 +71,9 @@ protected:
   ~vtkGraficReader();
 	char* FileName;
 	int ReadEntireDirectory;
+	double SubsampleFraction;
+	int SubsampleMode;
+	SubsampleCache Cache;
 	int RequestInformation(vtkInformation*,	vtkInformationVector**,
 		vtkInformationVector*);
 
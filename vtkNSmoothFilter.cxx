@@ -6,6 +6,8 @@
 #define _USE_MATH_DEFINES
 #include "vtkNSmoothFilter.h"
 #include "AstroVizHelpersLib/AstroVizHelpers.h"
+#include "AstroVizHelpersLib/AstroVizKdTree.h"
+#include "AstroVizHelpersLib/AstroVizKernel.h"
 #include "vtkMultiProcessController.h"
 #include "vtkIdList.h"
 #include "vtkInformation.h"
@@ -19,12 +21,31 @@
 #include "vtkDataArray.h"
 #include "vtkMath.h"
 #include "vtkCallbackCommand.h"
-#include "vtkPointLocator.h"
+#include "vtkDoubleArray.h"
+#include "vtkMultiThreader.h"
+#include "vtkMutexLock.h"
+#include <vtkstd/vector>
+#include <vtkstd/algorithm>
 
 using vtkstd::string;
 
 vtkCxxRevisionMacro(vtkNSmoothFilter, "$Revision: 1.72 $");
 vtkStandardNewMacro(vtkNSmoothFilter);
+vtkCxxSetObjectMacro(vtkNSmoothFilter,Controller,vtkMultiProcessController);
+
+//----------------------------------------------------------------------------
+// What is kept between executions: the tree of the input points and, if
+// they fit in NeighborCacheMemoryLimit, the ids of the neighbors of every
+// point, as many as the most yet smoothed over; both good as long as the
+// points are the same object, unmodified
+struct vtkNSmoothFilterCache
+{
+	vtkPoints* Points;
+	unsigned long PointsMTime;
+	KdTree Tree;
+	NeighborLists Lists;
+};
+
 //----------------------------------------------------------------------------
 vtkNSmoothFilter::vtkNSmoothFilter():vtkPointSetAlgorithm()
 {
@@ -35,11 +56,22 @@ vtkNSmoothFilter::vtkNSmoothFilter():vtkPointSetAlgorithm()
     vtkDataObject::FIELD_ASSOCIATION_POINTS_THEN_CELLS,
     vtkDataSetAttributes::SCALARS);
   this->NeighborNumber = 50; //default
+  this->NumberOfThreads = 0; // one per core
+  this->KernelType = TOP_HAT;
+  this->DistributedSmoothing = 1;
+  this->Controller = NULL;
+  this->SetController(vtkMultiProcessController::GetGlobalController());
+  this->NeighborCacheMemoryLimit = 1024; // megabytes
+  this->Cache = new vtkNSmoothFilterCache;
+  this->Cache->Points = NULL;
+  this->Cache->PointsMTime = 0;
 }
 
 //----------------------------------------------------------------------------
 vtkNSmoothFilter::~vtkNSmoothFilter()
 {
+  this->SetController(NULL);
+  delete this->Cache;
 }
 
 //----------------------------------------------------------------------------
@@ -47,6 +79,12 @@ void vtkNSmoothFilter::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os,indent);
   os << indent << "Neighbor Number: " << this->NeighborNumber << "\n";
+  os << indent << "Number Of Threads: " << this->NumberOfThreads << "\n";
+  os << indent << "Kernel Type: " << this->KernelType << "\n";
+  os << indent << "Distributed Smoothing: " << this->DistributedSmoothing 
+     << "\n";
+  os << indent << "Neighbor Cache Memory Limit: " 
+     << this->NeighborCacheMemoryLimit << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -59,8 +97,8 @@ int vtkNSmoothFilter::FillInputPortInformation(int, vtkInformation* info)
 }
 
 //----------------------------------------------------------------------------
-double vtkNSmoothFilter::CalculateDensity(double pointOne[],
-	double pointTwo[], double smoothedMass)
+double vtkNSmoothFilter::CalculateDensity(const double pointOne[],
+	const double pointTwo[], double smoothedMass)
 {
 	// now calculating the radial distance from the last point to the
   // center point to which it is a neighbor
@@ -78,17 +116,255 @@ double vtkNSmoothFilter::CalculateDensity(double pointOne[],
 	return smoothedDensity;
 }
 
+//----------------------------------------------------------------------------
+// Adds the tuples of the neighbors, times their weights, to the totals, one
+// per component, in the order of the neighbors
+template <class T>
+void vtkNSmoothFilterAccumulate(const T* data, int numComponents,
+	const NeighborHeap::Neighbor* neighbors, const double* weights,
+	int numNeighbors, double* totals)
+{
+	for(int j = 0; j < numNeighbors; ++j)
+		{
+		const T* tuple=data+numComponents*neighbors[j].second;
+		for(int comp = 0; comp < numComponents; ++comp)
+			{
+			totals[comp]+=weights[j]*tuple[comp];
+			}
+		}
+}
+
+//----------------------------------------------------------------------------
+// What the threads share: the tree, the resolved arrays, and the next
+// block of points to hand out
+struct vtkNSmoothFilterTask
+{
+	const KdTree* Tree;
+	int NeighborCount;
+	// if not NULL, the neighbor lists to take neighbors from, or, if
+	// FillLists, to store them in as they are found
+	NeighborLists* Lists;
+	int FillLists;
+	int KernelType;
+	vtkstd::vector<vtkDataArray*> InputArrays;
+	vtkstd::vector<double*> SmoothedColumns;
+	double* SmoothedDensity;
+	double* SmoothedMass;
+	// with a kernel: the masses and velocities as doubles, velocities empty
+	// if there are none, and the columns only a kernel fills, NULL if not
+	vtkstd::vector<double> Masses;
+	vtkstd::vector<double> Velocities;
+	double* SmoothingLength;
+	double* VelocityDispersion;
+	double* VelocityDivergence;
+	// if not NULL, where the squared distance to the farthest neighbor of
+	// each point is kept
+	double* Farthest2;
+	// the points to smooth, in tree order so each block is spatially compact;
+	// blocks of a few thousand are handed out at a time, so threads rarely
+	// wait on the lock yet finish at about the same time
+	const vtkIdType* Points;
+	vtkIdType NumberOfPoints;
+	vtkIdType PointsPerBlock;
+	vtkIdType NextPoint;
+	vtkMutexLock* Lock;
+};
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkNSmoothFilter::SmoothThread(void* arg)
+{
+	vtkNSmoothFilterTask* task=static_cast<vtkNSmoothFilterTask*>(
+		static_cast<vtkMultiThreader::ThreadInfo*>(arg)->UserData);
+	const KdTree* tree=task->Tree;
+	// the neighbors and totals of the current point, each thread's own,
+	// reused for every point
+	NeighborHeap closestNPoints;
+	vtkstd::vector<NeighborHeap::Neighbor> keptNeighbors(task->NeighborCount);
+	vtkstd::vector<double> weights(task->NeighborCount);
+	vtkstd::vector<double> totals(task->SmoothedColumns.size());
+	for(;;)
+		{
+		task->Lock->Lock();
+		const vtkIdType first=task->NextPoint;
+		task->NextPoint=vtkstd::min(task->NumberOfPoints,
+			first+task->PointsPerBlock);
+		const vtkIdType last=task->NextPoint;
+		task->Lock->Unlock();
+		if(first >= last)
+			{
+			break;
+			}
+		for(vtkIdType n = first; n < last; ++n)
+			{
+			const vtkIdType nextPointId=task->Points[n];
+			const double* nextPoint=tree->GetPoint(nextPointId);
+			// finding the closest N points, or taking the first N of those
+			// kept, with their distances computed as the search computes them
+			const NeighborHeap::Neighbor* neighbors;
+			int numNeighbors;
+			if(task->Lists && !task->FillLists)
+				{
+				const vtkIdType* ids=task->Lists->GetNeighbors(nextPointId);
+				numNeighbors=vtkstd::min(task->Lists->GetK(),task->NeighborCount);
+				for(int j = 0; j < numNeighbors; ++j)
+					{
+					const double* y=tree->GetPoint(ids[j]);
+					const double dx=y[0]-nextPoint[0], dy=y[1]-nextPoint[1],
+						dz=y[2]-nextPoint[2];
+					keptNeighbors[j]=NeighborHeap::Neighbor(dx*dx+dy*dy+dz*dz,ids[j]);
+					}
+				neighbors=numNeighbors ? &keptNeighbors[0] : NULL;
+				}
+			else
+				{
+				tree->FindClosestNPoints(nextPoint,task->NeighborCount,
+					closestNPoints);
+				if(task->Lists)
+					{
+					task->Lists->Set(nextPointId,closestNPoints);
+					}
+				neighbors=closestNPoints.GetNeighbors();
+				numNeighbors=closestNPoints.GetNumberOfNeighbors();
+				}
+			numNeighbors=vtkstd::min(numNeighbors,task->NeighborCount);
+			// looping over the closestNPoints, 
+			// only if we have more neighbors than ourselves
+			if(numNeighbors>0)
+				{
+				// the weight of each neighbor: one for the plain mean, m_j W(r_ij,h)
+				// with a kernel, where h is half the distance of the farthest
+				const double farthest2=neighbors[numNeighbors-1].first;
+				if(task->Farthest2)
+					{
+					// short of N neighbors in the piece, any particle elsewhere is one
+					task->Farthest2[nextPointId]=(numNeighbors < task->NeighborCount) ?
+						VTK_DOUBLE_MAX : farthest2;
+					}
+				const SmoothingKernel kernel(
+					vtkstd::max(task->KernelType-CUBIC_SPLINE,0),0.5*sqrt(farthest2));
+				double weightSum=0.0;
+				for(int j = 0; j < numNeighbors; ++j)
+					{
+					weights[j]=(task->KernelType==TOP_HAT) ? 1.0 :
+						task->Masses[neighbors[j].second]*
+						kernel.Evaluate(neighbors[j].first);
+					weightSum+=weights[j];
+					}
+				// keeps track of the totals for each quantity, only dividing by the
+				// total weight at the end
+				vtkstd::fill(totals.begin(),totals.end(),0.0);
+				double* arrayTotals=totals.empty() ? NULL : &totals[0];
+				for(vtkstd::vector<vtkDataArray*>::size_type i = 0; 
+					i < task->InputArrays.size(); ++i)
+					{
+					vtkDataArray* nextArray=task->InputArrays[i];
+					const int numComponents=nextArray->GetNumberOfComponents();
+					switch(nextArray->GetDataType())
+						{
+						vtkTemplateMacro(vtkNSmoothFilterAccumulate(
+							static_cast<VTK_TT*>(nextArray->GetVoidPointer(0)),
+							numComponents,neighbors,&weights[0],numNeighbors,arrayTotals));
+						default:
+							// bit arrays and the like have no typed pointer
+							for(int j = 0; j < numNeighbors; ++j)
+								{
+								for(int comp = 0; comp < numComponents; ++comp)
+									{
+									arrayTotals[comp]+=weights[j]*nextArray->GetComponent(
+										neighbors[j].second,comp);
+									}
+								}
+						}
+					arrayTotals+=numComponents;
+					}
+				// dividing by the total weight at the end, which is zero only if
+				// the neighbors are all massless
+				for(vtkstd::vector<double*>::size_type c = 0; 
+					c < task->SmoothedColumns.size(); ++c)
+					{
+					task->SmoothedColumns[c][nextPointId]=
+						(weightSum > 0) ? totals[c]/weightSum : 0.0;
+					}
+				if(task->KernelType==TOP_HAT)
+					{
+					// for the smoothed Density we need the last neighbor point, as 
+					// this is farthest from the original point
+					// we use this to calculate the volume over which to smooth
+					task->SmoothedDensity[nextPointId]=CalculateDensity(nextPoint,
+						tree->GetPoint(neighbors[numNeighbors-1].second),
+						task->SmoothedMass[nextPointId]);
+					continue;
+					}
+				// the SPH density is the sum of the weights
+				task->SmoothedDensity[nextPointId]=weightSum;
+				task->SmoothingLength[nextPointId]=kernel.GetSmoothingLength();
+				if(task->Velocities.empty() || weightSum <= 0)
+					{
+					continue;
+					}
+				// the dispersion about the kernel weighted mean velocity, and the
+				// divergence, (1/rho_i) sum_j m_j (v_j-v_i).grad_i W(r_ij,h)
+				const double* v=&task->Velocities[0];
+				const double* vi=v+3*nextPointId;
+				double meanVelocity[3]={0.0,0.0,0.0};
+				for(int j = 0; j < numNeighbors; ++j)
+					{
+					const double* vj=v+3*neighbors[j].second;
+					for(int d = 0; d < 3; ++d)
+						{
+						meanVelocity[d]+=weights[j]*vj[d];
+						}
+					}
+				double dispersion=0.0;
+				double divergence=0.0;
+				for(int j = 0; j < numNeighbors; ++j)
+					{
+					const vtkIdType neighborId=neighbors[j].second;
+					const double* vj=v+3*neighborId;
+					const double* xj=tree->GetPoint(neighborId);
+					const double gradient=task->Masses[neighborId]*
+						kernel.EvaluateGradient(neighbors[j].first);
+					for(int d = 0; d < 3; ++d)
+						{
+						const double dv=vj[d]-meanVelocity[d]/weightSum;
+						dispersion+=weights[j]*dv*dv;
+						divergence+=gradient*(vj[d]-vi[d])*(nextPoint[d]-xj[d]);
+						}
+					}
+				task->VelocityDispersion[nextPointId]=sqrt(dispersion/weightSum);
+				task->VelocityDivergence[nextPointId]=divergence/weightSum;
+				}
+			else
+				{
+				// This point has no neighbors, so smoothed mass is identicle to 
+				// this point's mass, and smoothed density is meaningless, set to -1
+				// to indicate it is useless
+				task->SmoothedDensity[nextPointId]=-1;
+				if(task->Farthest2)
+					{
+					task->Farthest2[nextPointId]=0.0;
+					}
+				}
+			}
+		}
+	return VTK_THREAD_RETURN_VALUE;
+}
+
 //----------------------------------------------------------------------------
 int vtkNSmoothFilter::RequestData(vtkInformation *request,
 	vtkInformationVector** inputVector, vtkInformationVector* outputVector)
 {
 	 // Outline of this filter:
 	// 1. Build Kd tree
-	// 2. Go through each point in output
+	// 2. Look up every array to smooth and its smoothed columns once
+	// 3. Hand out blocks of buckets of the tree to the threads, which for 
+	//    each point of a block
 	// 		o calculate N nearest neighbors
-	//		o calculate smoothed quantities
-	// 		o add to their respective arrays.
-	// 3. Add the arrays of smoothed variables to the output
+	//		o weight them, all alike or by mass times the kernel
+	//		o sum each quantity over them into their own scratch buffer
+	// 		o store the weighted averages straight into the smoothed columns,
+	//		  which no other thread writes for that point
+	//		o with a kernel, also the SPH density and velocity statistics
   // Get input and output data.
   vtkPointSet* input = vtkPointSet::GetData(inputVector[0]);
 	vtkDataArray* massArray = this->GetInputArrayToProcess(0, inputVector);
@@ -99,135 +375,332 @@ int vtkNSmoothFilter::RequestData(vtkInformation *request,
     }
   vtkPointSet* output = vtkPointSet::GetData(outputVector);
   output->ShallowCopy(input);
+	const vtkIdType numPoints=output->GetPoints()->GetNumberOfPoints();
 	// smoothing each quantity in the output
 	int numberOriginalArrays = input->GetPointData()->GetNumberOfArrays();
-	// 1. Building the point locator, locale to this process
-	vtkPointLocator* locator = vtkPointLocator::New();
-		locator->SetDataSet(output);
-		locator->BuildLocator();
-	// Allocating arrays to store our smoothed values
+	// 1. Building the tree, locale to this process, unless the one built
+	// last time is of the same points
+	vtkNSmoothFilterCache* cache=this->Cache;
+	vtkPoints* points=output->GetPoints();
+	if(cache->Points!=points || cache->PointsMTime!=points->GetMTime())
+		{
+		cache->Tree.Build(points);
+		cache->Lists.Initialize();
+		cache->Points=points;
+		cache->PointsMTime=points->GetMTime();
+		}
+	const KdTree& tree=cache->Tree;
+	vtkNSmoothFilterTask task;
+	task.Tree=&tree;
+	// plus one as the first point found is always one's self, 
+	// and the user expects specifying 1 neighbor will actually find
+	// one neighbor 
+	task.NeighborCount=this->NeighborNumber+1;
+	task.KernelType=this->KernelType;
+	// the neighbor lists, searched for only if not kept from last time or
+	// kept for fewer neighbors, and then kept for just as many as are asked
+	// for, if they fit in the memory limit
+	task.Lists=NULL;
+	task.FillLists=0;
+	const double memoryLimit=this->NeighborCacheMemoryLimit*1048576.0;
+	const int keptCount=vtkstd::min<vtkIdType>(task.NeighborCount,numPoints);
+	if(cache->Lists.GetNumberOfPoints()==numPoints && 
+		cache->Lists.GetK() >= keptCount && NeighborLists::GetMemorySize(
+		numPoints,cache->Lists.GetK()) <= memoryLimit)
+		{
+		task.Lists=&cache->Lists;
+		}
+	else if(NeighborLists::GetMemorySize(numPoints,keptCount) <= memoryLimit)
+		{
+		cache->Lists.Allocate(numPoints,keptCount);
+		task.Lists=&cache->Lists;
+		task.FillLists=1;
+		}
+	else
+		{
+		cache->Lists.Initialize();
+		}
+	// 2. Allocating arrays to store our smoothed values, and resolving the
+	// arrays and their smoothed columns so the threads work on raw pointers
 	// smoothed density
- 	AllocateDoubleDataArray(output,"smoothed density", 
-		1,output->GetPoints()->GetNumberOfPoints());
+ 	AllocateDoubleDataArray(output,"smoothed density",1,numPoints);
 	for(int i = 0; i < numberOriginalArrays; ++i)
 		{
-		vtkSmartPointer<vtkDataArray> nextArray = \
-		 	output->GetPointData()->GetArray(i);
+		vtkDataArray* nextArray = output->GetPointData()->GetArray(i);
+		if(!nextArray)
+			{
+			// not numeric, nothing to average
+			continue;
+			}
+		task.InputArrays.push_back(nextArray);
 		string baseName = nextArray->GetName();
 		for(int comp = 0; comp < nextArray->GetNumberOfComponents(); ++comp)
 			{
 			string totalName = GetSmoothedArrayName(baseName,comp);
 			// Allocating an column for the total sum of the existing quantities
-			AllocateDoubleDataArray(output,totalName.c_str(),
-				1,output->GetPoints()->GetNumberOfPoints());
-			}
-		}
-	for(unsigned long nextPointId = 0;
-		nextPointId < output->GetPoints()->GetNumberOfPoints();
-	 	++nextPointId)
-		{
-		double* nextPoint=GetPoint(output,nextPointId);
-		// finding the closest N points
-		vtkSmartPointer<vtkIdList> closestNPoints = \
-			vtkSmartPointer<vtkIdList>::New();
-		// plus one as the first point returned by locator is always one's self, 
-		// and the user expects specifying 1 neighbor will actually find
-		// one neighbor 
-		locator->FindClosestNPoints(this->NeighborNumber+1,
-																	nextPoint,closestNPoints);
-		// looping over the closestNPoints, 
-		// only if we have more neighbors than ourselves
-		if(closestNPoints->GetNumberOfIds()>0)
-			{
-			for(int neighborPointLocalId = 0;
-		 		neighborPointLocalId < closestNPoints->GetNumberOfIds();
-				++neighborPointLocalId)
+			AllocateDoubleDataArray(output,totalName.c_str(),1,numPoints);
+			task.SmoothedColumns.push_back(vtkDoubleArray::SafeDownCast(
+				output->GetPointData()->GetArray(totalName.c_str()))->GetPointer(0));
+			}
+		}
+	task.SmoothedDensity=vtkDoubleArray::SafeDownCast(
+		output->GetPointData()->GetArray("smoothed density"))->GetPointer(0);
+	task.SmoothedMass=vtkDoubleArray::SafeDownCast(
+		output->GetPointData()->GetArray(
+		GetSmoothedArrayName(massArray->GetName(),0).c_str()))->GetPointer(0);
+	task.SmoothingLength=task.VelocityDispersion=task.VelocityDivergence=NULL;
+	if(this->KernelType!=TOP_HAT)
+		{
+		// the kernel weights need the mass of every neighbor
+		task.Masses.resize(numPoints);
+		for(vtkIdType i = 0; i < numPoints; ++i)
+			{
+			task.Masses[i]=massArray->GetComponent(i,0);
+			}
+		AllocateDoubleDataArray(output,"smoothing length",1,numPoints);
+		task.SmoothingLength=vtkDoubleArray::SafeDownCast(
+			output->GetPointData()->GetArray("smoothing length"))->GetPointer(0);
+		vtkDataArray* velocityArray=output->GetPointData()->GetArray("velocity");
+		if(velocityArray && velocityArray->GetNumberOfComponents()==3)
+			{
+			task.Velocities.resize(3*numPoints);
+			for(vtkIdType i = 0; i < numPoints; ++i)
 				{
-				vtkIdType neighborPointGlobalId = \
-										closestNPoints->GetId(neighborPointLocalId);
-				double* neighborPoint=GetPoint(output,neighborPointGlobalId);
-			// keeps track of the totals for each quantity inside
-			// the output, only dividing by N at the end
-				for(int i = 0; i < numberOriginalArrays; ++i)
-					{
-					vtkSmartPointer<vtkDataArray> nextArray = \
-						output->GetPointData()->GetArray(i);
-					string baseName = nextArray->GetName();
-					double* data=GetDataValue(output,baseName.c_str(),
-						neighborPointGlobalId);
-					for(int comp = 0; comp < nextArray->GetNumberOfComponents(); ++comp)
-						{
-						string totalName = GetSmoothedArrayName(baseName,comp);
-						// adds data[comp] to value in column totalName
-						double* total = \
-							GetDataValue(output,totalName.c_str(),nextPointId);
-						total[0]+=data[comp];
-						SetDataValue(output,totalName.c_str(),
-							nextPointId,total);
-						// memory management
-						delete [] total;
-						}
-					delete [] data;
-					}
-				// Finally, some memory management
-				delete [] neighborPoint;
+				velocityArray->GetTuple(i,&task.Velocities[3*i]);
+				}
+			AllocateDoubleDataArray(output,"velocity dispersion",1,numPoints);
+			AllocateDoubleDataArray(output,"velocity divergence",1,numPoints);
+			task.VelocityDispersion=vtkDoubleArray::SafeDownCast(
+				output->GetPointData()->GetArray("velocity dispersion"))->GetPointer(0);
+			task.VelocityDivergence=vtkDoubleArray::SafeDownCast(
+				output->GetPointData()->GetArray("velocity divergence"))->GetPointer(0);
+			}
+		else
+			{
+			vtkWarningMacro("No 3 component velocity array, so no velocity "
+				"dispersion or divergence");
+			}
+		}
+	// 3. smoothing each point, in tree order
+	task.Points=tree.GetOrder();
+	task.NumberOfPoints=numPoints;
+	const bool distributed=this->DistributedSmoothing &&
+		RunInParallel(this->Controller);
+	vtkstd::vector<double> farthest2(distributed ? numPoints : 0);
+	task.Farthest2=farthest2.empty() ? NULL : &farthest2[0];
+	this->Smooth(task);
+	// 4. the points whose neighbors might be in other pieces are smoothed
+	// again, with the particles of those pieces they could reach
+	if(distributed && !this->SmoothBoundary(task))
+		{
+		return 0;
+		}
+	// Finally, some memory management
+  output->Squeeze();
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkNSmoothFilter::Smooth(vtkNSmoothFilterTask& task)
+{
+	int numThreads=this->NumberOfThreads > 0 ? this->NumberOfThreads :
+		vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+	task.PointsPerBlock=4096;
+	task.NextPoint=0;
+	task.Lock=vtkMutexLock::New();
+	vtkMultiThreader* threader=vtkMultiThreader::New();
+	threader->SetNumberOfThreads(vtkstd::max(1,int(vtkstd::min<vtkIdType>(
+		numThreads,task.NumberOfPoints/task.PointsPerBlock+1))));
+	threader->SetSingleMethod(vtkNSmoothFilter::SmoothThread,&task);
+	threader->SingleMethodExecute();
+	threader->Delete();
+	task.Lock->Delete();
+}
+
+//----------------------------------------------------------------------------
+int vtkNSmoothFilter::SmoothBoundary(vtkNSmoothFilterTask& task)
+{
+	// Outline:
+	// 1. Share the bounds of every piece
+	// 2. Find the boundary points, whose farthest neighbor is farther than
+	//    another piece; nearer neighbors than those found can only be there.
+	//    For each other piece, the box around their search spheres is what
+	//    we need of it.
+	// 3. Swap those boxes with each other process, and send back the
+	//    particles each asks for: position, mass and velocity when the kernel
+	//    needs them, then every smoothed array, all as doubles
+	// 4. Smooth the boundary points again over a tree of the piece and the
+	//    particles received, which can only make their neighbors nearer
+	const KdTree* tree=task.Tree;
+	const vtkIdType numPoints=tree->GetNumberOfPoints();
+	const int procId=this->Controller->GetLocalProcessId();
+	const int numProc=this->Controller->GetNumberOfProcesses();
+	// 1. the bounds of every piece
+	double localBounds[6];
+	tree->GetBounds(localBounds);
+	vtkstd::vector<double> bounds(6*numProc);
+	this->Controller->AllGather(localBounds,&bounds[0],6);
+	// 2. the boundary points, in tree order, and the boxes to ask for
+	vtkstd::vector<double> requests(6*numProc);
+	for(int proc = 0; proc < numProc; ++proc)
+		{
+		for(int d = 0; d < 3; ++d)
+			{
+			requests[6*proc+2*d]=VTK_DOUBLE_MAX;
+			requests[6*proc+2*d+1]=-VTK_DOUBLE_MAX;
+			}
+		}
+	vtkstd::vector<vtkIdType> boundary;
+	for(vtkIdType n = 0; n < numPoints; ++n)
+		{
+		const vtkIdType id=task.Points[n];
+		const double* x=tree->GetPoint(id);
+		const double radius2=task.Farthest2[id];
+		const double radius=(radius2 < VTK_DOUBLE_MAX) ? sqrt(radius2) : 
+			VTK_DOUBLE_MAX;
+		bool onBoundary=false;
+		for(int proc = 0; proc < numProc; ++proc)
+			{
+			const double* peerBounds=&bounds[6*proc];
+			if(proc==procId || peerBounds[0] > peerBounds[1] ||
+				Distance2ToBounds(x,peerBounds) > radius2)
+				{
+				continue;
+				}
+			onBoundary=true;
+			double* request=&requests[6*proc];
+			for(int d = 0; d < 3; ++d)
+				{
+				request[2*d]=vtkstd::min(request[2*d],
+					vtkstd::max(x[d]-radius,peerBounds[2*d]));
+				request[2*d+1]=vtkstd::max(request[2*d+1],
+					vtkstd::min(x[d]+radius,peerBounds[2*d+1]));
 				}
-			// dividing by N at the end
-			double numberPoints = closestNPoints->GetNumberOfIds();
-			for(int i = 0; i < numberOriginalArrays; ++i)
+			}
+		if(onBoundary)
+			{
+			boundary.push_back(id);
+			}
+		}
+	// 3. swapping boxes and particles with each other process
+	int width=3+(task.Masses.empty() ? 0 : 1)+
+		(task.Velocities.empty() ? 0 : 3);
+	for(vtkstd::vector<vtkDataArray*>::size_type i = 0; 
+		i < task.InputArrays.size(); ++i)
+		{
+		width+=task.InputArrays[i]->GetNumberOfComponents();
+		}
+	vtkstd::vector<double> ghosts;
+	vtkstd::vector<double> send;
+	vtkstd::vector<double> recv;
+	for(int proc = 0; proc < numProc; ++proc)
+		{
+		if(proc==procId)
+			{
+			continue;
+			}
+		send.assign(requests.begin()+6*proc,requests.begin()+6*proc+6);
+		ExchangeWithPeer(this->Controller,proc,send,recv,GHOST_COUNT,
+			GHOST_DATA);
+		send.clear();
+		for(vtkIdType id = 0; id < numPoints && recv.size()==6; ++id)
+			{
+			const double* x=tree->GetPoint(id);
+			if(x[0] < recv[0] || x[0] > recv[1] || x[1] < recv[2] || 
+				x[1] > recv[3] || x[2] < recv[4] || x[2] > recv[5])
+				{
+				continue;
+				}
+			send.insert(send.end(),x,x+3);
+			if(!task.Masses.empty())
+				{
+				send.push_back(task.Masses[id]);
+				}
+			if(!task.Velocities.empty())
 				{
-				vtkSmartPointer<vtkDataArray> nextArray = \
-					output->GetPointData()->GetArray(i);
-				string baseName = nextArray->GetName();
+				send.insert(send.end(),&task.Velocities[3*id],
+					&task.Velocities[3*id]+3);
+				}
+			for(vtkstd::vector<vtkDataArray*>::size_type i = 0; 
+				i < task.InputArrays.size(); ++i)
+				{
+				vtkDataArray* nextArray=task.InputArrays[i];
 				for(int comp = 0; comp < nextArray->GetNumberOfComponents(); ++comp)
 					{
-					string totalName = GetSmoothedArrayName(baseName,comp);
-					// adds data[comp] to value in column totalName
-					double* smoothedData = \
-						GetDataValue(output,totalName.c_str(),nextPointId);
-					smoothedData[0]/=numberPoints;
-					SetDataValue(output,totalName.c_str(),nextPointId,smoothedData);
-					// memory management
-					delete [] smoothedData;
+					send.push_back(nextArray->GetComponent(id,comp));
 					}
 				}
-			// for the smoothed Density we need the identity of the 
-			// last neighbor point, as this is farthest from the original point
-			// we use this to calculate the volume over which to smooth
-			vtkIdType lastNeighborPointGlobalId = \
-				closestNPoints->GetId(closestNPoints->GetNumberOfIds()-1);
-			double* lastNeighborPoint=GetPoint(output,lastNeighborPointGlobalId);		
-			double* smoothedMass = \
-				GetDataValue(output,GetSmoothedArrayName(massArray->GetName(),
-				0).c_str(),
-				nextPointId);
-			double* smoothedDensity=new double[1];
-			smoothedDensity[0]=\
-			 	CalculateDensity(nextPoint,lastNeighborPoint,smoothedMass[0]);
-			//storing the smooth density
-			SetDataValue(output,"smoothed density",nextPointId,smoothedDensity);
-			// Finally, some memory management
-			delete [] lastNeighborPoint;
-			delete [] smoothedMass;
-			delete [] smoothedDensity;
 			}
-		else
+		ExchangeWithPeer(this->Controller,proc,send,recv,GHOST_COUNT,
+			GHOST_DATA);
+		if(recv.size()%width)
 			{
-			// This point has no neighbors, so smoothed mass is identicle to 
-			// this point's mass, and smoothed density is meaningless, set to -1
-			// to indicate it is useless
-			double* density=new double[1];
-			density[0]=-1;
-			SetDataValue(output,"smoothed density",nextPointId,density);
-			// Finally, some memory management
-			delete [] density;
+			vtkErrorMacro("Process " << proc << " sent particles with other "
+				"arrays than this one's; all pieces must have the same arrays");
+			return 0;
 			}
-		// Finally, some memory management
-		delete [] nextPoint;
+		ghosts.insert(ghosts.end(),recv.begin(),recv.end());
 		}
-	// Finally, some memory management
-  output->Squeeze();
-  return 1;
+	// 4. the tree of the piece and its ghosts, whose arrays come after those
+	// of the piece, and smoothing the boundary points again
+	const vtkIdType numGhosts=ghosts.size()/width;
+	vtkSmartPointer<vtkPoints> points=vtkSmartPointer<vtkPoints>::New();
+	points->SetDataTypeToDouble();
+	points->SetNumberOfPoints(numPoints+numGhosts);
+	for(vtkIdType id = 0; id < numPoints; ++id)
+		{
+		points->SetPoint(id,tree->GetPoint(id));
+		}
+	vtkstd::vector<vtkSmartPointer<vtkDoubleArray> > arrays;
+	for(vtkstd::vector<vtkDataArray*>::size_type i = 0; 
+		i < task.InputArrays.size(); ++i)
+		{
+		vtkDataArray* nextArray=task.InputArrays[i];
+		vtkSmartPointer<vtkDoubleArray> extended=
+			vtkSmartPointer<vtkDoubleArray>::New();
+		extended->SetNumberOfComponents(nextArray->GetNumberOfComponents());
+		extended->SetNumberOfTuples(numPoints+numGhosts);
+		for(vtkIdType id = 0; id < numPoints; ++id)
+			{
+			extended->SetTuple(id,nextArray->GetTuple(id));
+			}
+		arrays.push_back(extended);
+		}
+	for(vtkIdType g = 0; g < numGhosts; ++g)
+		{
+		const double* record=&ghosts[g*width];
+		points->SetPoint(numPoints+g,record);
+		record+=3;
+		if(!task.Masses.empty())
+			{
+			task.Masses.push_back(*record++);
+			}
+		if(!task.Velocities.empty())
+			{
+			task.Velocities.insert(task.Velocities.end(),record,record+3);
+			record+=3;
+			}
+		for(vtkstd::vector<vtkSmartPointer<vtkDoubleArray> >::size_type i = 0; 
+			i < arrays.size(); ++i)
+			{
+			arrays[i]->SetTuple(numPoints+g,record);
+			record+=arrays[i]->GetNumberOfComponents();
+			}
+		}
+	KdTree extendedTree;
+	extendedTree.Build(points);
+	task.Tree=&extendedTree;
+	for(vtkstd::vector<vtkSmartPointer<vtkDoubleArray> >::size_type i = 0; 
+		i < arrays.size(); ++i)
+		{
+		task.InputArrays[i]=arrays[i];
+		}
+	task.Farthest2=NULL;
+	task.Lists=NULL;
+	task.Points=boundary.empty() ? NULL : &boundary[0];
+	task.NumberOfPoints=boundary.size();
+	this->Smooth(task);
+	return 1;
 }
 
 string vtkNSmoothFilter::GetSmoothedArrayName(string baseName, int comp){
@@ -21,15 +21,41 @@
 // variables which need a volume to be computed
 // consider the volume as sphere around point with radius of the
 // outermost neighbor point. Runs in parallel but can be slow for large
-// number of neighbors or large particle/process ratio and does not smooth
-// over particles in neighbor processes.
+// number of neighbors or large particle/process ratio. With
+// DistributedSmoothing on, the default, a particle whose neighbors, found
+// in its own piece, reach as far as another piece is smoothed again with
+// the particles of the other pieces within that distance, so results do
+// not depend on how the data is split; with it off each piece is smoothed
+// on its own. Within a process the points are
+// smoothed on NumberOfThreads threads, each taking small spatially compact
+// blocks of points from the tree in turn.
+//
+// With a KernelType other than TOP_HAT the filter is an SPH smoother like
+// the Tipsy smooth tool: h is half the distance to the farthest neighbor,
+// the density is sum_j m_j W(r_ij,h), each quantity is the kernel and mass
+// weighted mean sum_j m_j A_j W(r_ij,h)/rho, and a "smoothing length"
+// array holds h. If there is a 3 component "velocity" array, "velocity
+// dispersion" about the weighted mean velocity and "velocity divergence",
+// (1/rho_i) sum_j m_j (v_j-v_i).grad_i W(r_ij,h), are added as well.
 // .SECTION See Also
 // vtkKdTree, vtkPKdTree
 
 #ifndef __vtkNSmoothFilter_h
 #define __vtkNSmoothFilter_h
 #include "vtkPointSetAlgorithm.h"
+#include "vtkMultiThreader.h" // for VTK_THREAD_RETURN_TYPE
 #include <string>
+class vtkMultiProcessController;
+//BTX
+struct vtkNSmoothFilterTask;
+struct vtkNSmoothFilterCache;
+//ETX
+
+enum NSmoothMPIData
+{
+	GHOST_COUNT,
+	GHOST_DATA
+};
 
 class VTK_EXPORT vtkNSmoothFilter : public vtkPointSetAlgorithm
 {
@@ -43,6 +69,50 @@ public:
   vtkSetMacro(NeighborNumber, int);
   vtkGetMacro(NeighborNumber, int);
 
+  // Description:
+  // Get/Set the number of threads to smooth on, 0 (the default) for one
+  // per core
+  vtkSetClampMacro(NumberOfThreads, int, 0, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfThreads, int);
+
+//BTX
+  enum KernelTypes
+    {
+    TOP_HAT=0,
+    CUBIC_SPLINE=1,
+    WENDLAND_C2=2
+    };
+//ETX
+  // Description:
+  // Get/Set how neighbors are weighted: TOP_HAT (the default) averages
+  // them alike and divides the mean mass by the volume of the sphere out to
+  // the farthest, CUBIC_SPLINE and WENDLAND_C2 weight them by SPH kernels
+  vtkSetClampMacro(KernelType, int, TOP_HAT, WENDLAND_C2);
+  vtkGetMacro(KernelType, int);
+
+  // Description:
+  // Get/Set whether, running in parallel, particles near the edge of a
+  // piece are smoothed over the particles of neighboring pieces too
+  vtkSetMacro(DistributedSmoothing, int);
+  vtkGetMacro(DistributedSmoothing, int);
+  vtkBooleanMacro(DistributedSmoothing, int);
+
+  // Description:
+  // Get/Set the most memory, in megabytes, the neighbor lists kept between
+  // executions may take, 1024 by default. As long as the input points are
+  // unchanged, smoothing again over as many or fewer neighbors, with other
+  // arrays or another kernel, reuses the lists instead of searching the
+  // tree. They take 8 bytes per neighbor per point, so 408 bytes a point
+  // for 50 neighbors; if that is over the limit none are kept, and 0 keeps
+  // none at all.
+  vtkSetClampMacro(NeighborCacheMemoryLimit, int, 0, VTK_INT_MAX);
+  vtkGetMacro(NeighborCacheMemoryLimit, int);
+
+  // Description:
+  // By defualt this filter uses the global controller,
+  // but this method can be used to set another instead.
+  virtual void SetController(vtkMultiProcessController*);
+  vtkGetObjectMacro(Controller, vtkMultiProcessController);
 
 //BTX
 protected:
@@ -57,6 +127,12 @@ protected:
    	vtkInformationVector**,
     vtkInformationVector*);
   int NeighborNumber;
+  int NumberOfThreads;
+  int KernelType;
+  int DistributedSmoothing;
+  vtkMultiProcessController* Controller;
+  int NeighborCacheMemoryLimit;
+  vtkNSmoothFilterCache* Cache;
 
 private:
   vtkNSmoothFilter(const vtkNSmoothFilter&);  // Not implemented.
@@ -66,8 +142,18 @@ private:
 	// where r=dist(pointOne,pointTwo), and diving the smoothed mass
 	// which is the average mass in that volume by the volume
 
-	double CalculateDensity(double pointOne[],
-		double pointTwo[], double smoothedMass);
+	static double CalculateDensity(const double pointOne[],
+		const double pointTwo[], double smoothedMass);
+	// Description:
+	// smooths blocks of points until none are left, on one thread
+	static VTK_THREAD_RETURN_TYPE SmoothThread(void* arg);
+	// Description:
+	// smooths the points of the task on NumberOfThreads threads
+	void Smooth(vtkNSmoothFilterTask& task);
+	// Description:
+	// smooths again the points of the task whose neighbors may be in other
+	// pieces, after getting the particles of those pieces they could reach
+	int SmoothBoundary(vtkNSmoothFilterTask& task);
 	// Description:
 	// returns a string representing the name of the smoothed array
 	vtkstd::string GetSmoothedArrayName(vtkstd::string baseName, int dataIndex);
@@ -18,11 +18,17 @@
 #include "vtkInformationDataObjectKey.h"
 #include "vtkPointSet.h" 
 #include "vtkMultiProcessController.h"
+#include "vtkCommunicator.h"
 #include "vtkSmartPointer.h"
 #include "vtkPointData.h"
 #include "vtkLine.h"
 #include "vtkPlane.h"
+#include "vtkIdTypeArray.h"
+#include "vtkMutexLock.h"
+#include "AstroVizHelpersLib/AstroVizKdTree.h"
 #include <cmath>
+#include <vtkstd/algorithm>
+#include <sstream>
 using vtkstd::string;
 
 vtkCxxRevisionMacro(vtkProfileFilter, "$Revision: 1.72 $");
@@ -31,7 +37,9 @@ vtkCxxSetObjectMacro(vtkProfileFilter, Controller, vtkMultiProcessController);
 //----------------------------------------------------------------------------
 vtkProfileFilter::vtkProfileFilter()
 {
-  this->SetNumberOfInputPorts(2);
+  // the particles, the probe giving the center, and optionally a table of
+  // centers and radii to profile about each of at once
+  this->SetNumberOfInputPorts(3);
 	this->SetInputArrayToProcess(
     0,
     0,
@@ -43,6 +51,13 @@ vtkProfileFilter::vtkProfileFilter()
 	this->MaxR=1.0;
 	this->Delta=1; 
 	this->BinNumber=30;
+	this->AccumulatorWidth=1;
+	this->NumberOfProfiles=1;
+	this->NumberOfThreads=0; // one per core
+	this->CentersArrayName=NULL;
+	this->RadiiArrayName=NULL;
+	this->SetCentersArrayName("center of mass");
+	this->SetRadiiArrayName("max radius");
 	this->Controller = NULL;
   this->SetController(vtkMultiProcessController::GetGlobalController());
 }
@@ -51,12 +66,19 @@ vtkProfileFilter::vtkProfileFilter()
 vtkProfileFilter::~vtkProfileFilter()
 {
  	this->SetController(0);
+	this->SetCentersArrayName(NULL);
+	this->SetRadiiArrayName(NULL);
 }
 
 //----------------------------------------------------------------------------
 void vtkProfileFilter::PrintSelf(ostream& os, vtkIndent indent)
 {
   os << indent << "bin number: " << this->BinNumber << "\n";
+  os << indent << "number of threads: " << this->NumberOfThreads << "\n";
+  os << indent << "centers array name: "
+		<< (this->CentersArrayName ? this->CentersArrayName : "(none)") << "\n";
+  os << indent << "radii array name: "
+		<< (this->RadiiArrayName ? this->RadiiArrayName : "(none)") << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -65,11 +87,30 @@ void vtkProfileFilter::SetSourceConnection(vtkAlgorithmOutput* algOutput)
   this->SetInputConnection(1, algOutput);
 }
 
+//----------------------------------------------------------------------------
+void vtkProfileFilter::SetCentersConnection(vtkAlgorithmOutput* algOutput)
+{
+  this->SetInputConnection(2, algOutput);
+}
+
+//----------------------------------------------------------------------------
 int vtkProfileFilter::FillInputPortInformation (int port, 
 	vtkInformation *info)
 {
   this->Superclass::FillInputPortInformation(port, info);
+  if(port==2)
+		{
+		// the centers, such as the catalogue of the halo finder
+		info->Set(vtkAlgorithm::INPUT_REQUIRED_DATA_TYPE(), "vtkTable");
+		info->Set(vtkAlgorithm::INPUT_IS_OPTIONAL(), 1);
+		return 1;
+		}
   info->Set(vtkAlgorithm::INPUT_REQUIRED_DATA_TYPE(), "vtkPointSet");
+	if(port==1)
+		{
+		// the probe, which a table of centers takes the place of
+		info->Set(vtkAlgorithm::INPUT_IS_OPTIONAL(), 1);
+		}
   return 1;
 }
 
@@ -81,7 +122,8 @@ int vtkProfileFilter::RequestData(vtkInformation *request,
 	// Now we can get the input with which we want to work
  	vtkPointSet* input = vtkPointSet::GetData(inputVector[0]);
 	// Will set the center based upon the selection in the GUI
-	vtkDataSet* centerInfo = vtkDataSet::GetData(inputVector[1]);
+	vtkDataSet* centerInfo = (this->GetNumberOfInputConnections(1) > 0) ?
+		vtkDataSet::GetData(inputVector[1]) : NULL;
 	// Get name of data array containing mass
 	vtkDataArray* massArray = this->GetInputArrayToProcess(0, inputVector);
   if (!massArray)
@@ -91,142 +133,106 @@ int vtkProfileFilter::RequestData(vtkInformation *request,
   	}
 	vtkTable* const output = vtkTable::GetData(outputVector,0);
 	output->Initialize();
+	if(this->BinNumber < 1)
+		{
+		vtkErrorMacro("The number of bins must be at least one");
+		return 0;
+		}
 
 	// Choosing which quantities to profile. Right now choosing all,
 	// could later by modified to use user's input to select
-	this->AdditionalProfileQuantities.push_back(
-		ProfileElement("angular momentum",3,&ComputeAngularMomentum,AVERAGE));
-	this->AdditionalProfileQuantities.push_back(
-		ProfileElement("radial velocity",3,&ComputeRadialVelocity,AVERAGE));
-	this->AdditionalProfileQuantities.push_back(
-		ProfileElement("tangential velocity",3,&ComputeTangentialVelocity,
-		AVERAGE));
-	this->AdditionalProfileQuantities.push_back(
-		ProfileElement("velocity squared",1,&ComputeVelocitySquared,AVERAGE));
-	this->AdditionalProfileQuantities.push_back(
-		ProfileElement("radial velocity squared",1,&ComputeRadialVelocitySquared,
-		AVERAGE));
-	this->AdditionalProfileQuantities.push_back(
-		ProfileElement("tangential velocity squared",1,
-		&ComputeTangentialVelocitySquared,AVERAGE));
-	// These use a different constructor as they are elements to be
-	// postprocessed. 
-	this->AdditionalProfileQuantities.push_back(
-		ProfileElement("velocity dispersion",3,
-		&ComputeVelocityDispersion,
+	this->AdditionalProfileQuantities.clear();
+	this->AddProfileQuantity<AngularMomentumQuantity>(AVERAGE);
+	this->AddProfileQuantity<RadialVelocityQuantity>(AVERAGE);
+	this->AddProfileQuantity<TangentialVelocityQuantity>(AVERAGE);
+	this->AddProfileQuantity<VelocitySquaredQuantity>(AVERAGE);
+	this->AddProfileQuantity<RadialVelocitySquaredQuantity>(AVERAGE);
+	this->AddProfileQuantity<TangentialVelocitySquaredQuantity>(AVERAGE);
+	// These are elements to be postprocessed, from the columns of others
+	this->AddPostprocessedProfileQuantity<VelocityDispersionQuantity>(
+		"velocity dispersion",
 		"velocity squared",AVERAGE,
-		"velocity",AVERAGE));
-	this->AdditionalProfileQuantities.push_back(
-		ProfileElement("tangential velocity dispersion",3,
-		&ComputeVelocityDispersion,
+		"velocity",AVERAGE);
+	this->AddPostprocessedProfileQuantity<VelocityDispersionQuantity>(
+		"tangential velocity dispersion",
 		"tangential velocity squared",AVERAGE,
-		"tangential velocity",AVERAGE));
-	this->AdditionalProfileQuantities.push_back(
-		ProfileElement("radial velocity dispersion",3,
-		&ComputeVelocityDispersion,
+		"tangential velocity",AVERAGE);
+	this->AddPostprocessedProfileQuantity<VelocityDispersionQuantity>(
+		"radial velocity dispersion",
 		"radial velocity squared",AVERAGE,
-		"radial velocity",AVERAGE));
-	this->AdditionalProfileQuantities.push_back(
-		ProfileElement("circular velocity",1,
-		&ComputeCircularVelocity,
+		"radial velocity",AVERAGE);
+	this->AddPostprocessedProfileQuantity<CircularVelocityQuantity>(
+		"circular velocity",
 		massArray->GetName(),CUMULATIVE,
-		"bin radius",TOTAL));
-	this->AdditionalProfileQuantities.push_back(
-		ProfileElement("density",1,
-		&ComputeDensity,
+		"bin radius",TOTAL);
+	this->AddPostprocessedProfileQuantity<DensityQuantity>(
+		"density",
 		massArray->GetName(),CUMULATIVE,
-		"bin radius",TOTAL));
+		"bin radius",TOTAL);
 	// runs in parallel, syncing class member data, if necessary, if not
 	// functions in serial
-	this->SetBoundsAndBinExtents(input,centerInfo); 
+	vtkTable* centers = (this->GetNumberOfInputConnections(2) > 0) ?
+		vtkTable::GetData(inputVector[2]) : NULL;
+	const int multiCenter = this->SetProfileCenters(centers);
+	if(multiCenter < 0)
+		{
+		return 0;
+		}
+	else if(multiCenter)
+		{
+		// a profile about each center, out to its radius
+		if(this->ProfileAxis[0]!=0 || this->ProfileAxis[1]!=0 ||
+			this->ProfileAxis[2]!=0 || this->ProfileHeight!=0)
+			{
+			vtkWarningMacro("Ignoring the profile axis and height, the profiles about a table of centers are spherical and reach out to the radius of each");
+			}
+		this->InitializeBins(input);
+		this->UpdateMultiCenterStatistics(input);
+		}
+	else if(!centerInfo)
+		{
+		vtkErrorMacro("A probe or a table of centers is required");
+		return 0;
+		}
+	else
+		{
+		this->SetBoundsAndBinExtents(input,centerInfo); 
+		this->NumberOfProfiles=1;
+		this->BinSpacings.assign(1,this->BinSpacing);
+		this->InitializeBins(input);
+		this->UpdateStatistics(input);
+		}
 	if(RunInParallel(this->Controller))
 		{
-		int procId=this->Controller->GetLocalProcessId();
-		int numProc=this->Controller->GetNumberOfProcesses();
-		vtkSmartPointer<vtkTable> localTable = \
-			vtkSmartPointer<vtkTable>::New();
-		localTable->Initialize();
-		if(procId==0)
+		// Summing the accumulators of every process, in one collective call
+		// on a single buffer, so no process merges the others' in turn; the
+		// buffers must be alike or the call would not match up
+		if(!this->CheckAccumulatorLayout(input))
 			{
-			// only take the time to initialize on process 0
-			this->InitializeBins(input,localTable);
-			// Syncronizing the intialized table with the other processes
-			this->Controller->Broadcast(localTable,0);
-			this->UpdateStatistics(input,localTable);
-			// Receive computations from each process and merge the table into
-			// the localTable of process 0
-			for(int proc = 1; proc < numProc; ++proc)
-				{
-				vtkSmartPointer<vtkTable> recLocalTable = \
-					vtkSmartPointer<vtkTable>::New();
-				recLocalTable->Initialize();
-				this->Controller->Receive(recLocalTable,proc,DATA_TABLE);
-				this->MergeTables(input,localTable,recLocalTable);
-				}
-			// Perform final computations
-			// Updating averages and doing relevant postprocessing
-			this->BinAveragesAndPostprocessing(input,localTable);
-			// Copy process 0's local table to output, which should have collected
-			// answer
-			output->DeepCopy(localTable);
+			return 0;
 			}
-		else
+		vtkstd::vector<double> localAccumulators(this->Accumulators);
+		if(!localAccumulators.empty())
 			{
-			// Syncing initialized, empty table
-			this->Controller->Broadcast(localTable,0);
-			// Updating table with the data on this processor
-			this->UpdateStatistics(input,localTable);
-			// sending result to root
-			this->Controller->Send(localTable,0,DATA_TABLE);
+			this->Controller->AllReduce(&localAccumulators[0],
+				&this->Accumulators[0],this->Accumulators.size(),
+				vtkCommunicator::SUM_OP);
+			}
+		// Every process now has the profile; process 0 outputs it
+		if(this->Controller->GetLocalProcessId()==0)
+			{
+			// Updating averages and doing relevant postprocessing
+			this->BinAveragesAndPostprocessing(input,output);
 			}
 		}	
 	else
 		{
-		this->InitializeBins(input,output);
-		this->UpdateStatistics(input,output);
 		// Updating averages and doing relevant postprocessing
 		this->BinAveragesAndPostprocessing(input,output);
 		}
 	return 1;
 }
 
-//----------------------------------------------------------------------------
-void vtkProfileFilter::MergeTables(vtkPointSet* input,
-	vtkTable* originalTable, vtkTable* tableToMerge)
-{
-	assert(originalTable->GetNumberOfRows()==tableToMerge->GetNumberOfRows());
-	for(int binNum = 0; binNum < originalTable->GetNumberOfRows(); ++binNum)
-		{
-		this->MergeBins(binNum,ADD,"number in bin",TOTAL,
-			originalTable,tableToMerge);	
-		this->MergeBins(binNum,ADD,"number in bin",CUMULATIVE,
-			originalTable,tableToMerge);
-		assert(0<=binNum<=this->BinNumber);
-		// Updating quanties for the input data arrays
-		for(int i = 0; i < input->GetPointData()->GetNumberOfArrays(); ++i)
-			{
-			vtkSmartPointer<vtkDataArray> nextArray = \
-			 	input->GetPointData()->GetArray(i);
-			// Merging the bins
-			string baseName = nextArray->GetName();
-			this->MergeBins(binNum,ADD,baseName,TOTAL,originalTable,tableToMerge);
-			this->MergeBins(binNum,ADD,baseName,AVERAGE,originalTable,tableToMerge);	
-			this->MergeBins(binNum,ADD,baseName,CUMULATIVE,
-				originalTable,tableToMerge);
-			}
-		for(int i = 0; i < this->AdditionalProfileQuantities.size(); ++i)
-			{
-			ProfileElement nextElement=this->AdditionalProfileQuantities[i];
-			if(!nextElement.Postprocess)
-				{
-				this->MergeBins(binNum,ADD,nextElement.BaseName,
-					nextElement.ProfileColumnType, 
-					originalTable,tableToMerge);
-				}
-			}
-		}
-}
-
 //----------------------------------------------------------------------------
 void vtkProfileFilter::SetBoundsAndBinExtents(vtkPointSet* input, 
 	vtkDataSet* source)
@@ -303,391 +309,534 @@ int vtkProfileFilter::GetBinNumber(double x[])
 
 
 //----------------------------------------------------------------------------
-void vtkProfileFilter::InitializeBins(vtkPointSet* input,
-	vtkTable* output)
+int vtkProfileFilter::SetProfileCenters(vtkTable* centers)
 {
-	// the first column will be the bin radius (max)
-	string binRadiusColumnName=this->GetColumnName("bin radius",
-		TOTAL);
-  // the second column will  be the bin radius (min)
-  string binRadiusMinColumnName=this->GetColumnName("bin radius min",
-                                                 TOTAL);
-	AllocateDataArray(output,binRadiusColumnName.c_str(),1,this->BinNumber);
-  AllocateDataArray(output,binRadiusMinColumnName.c_str(),1,this->BinNumber);
-
-	// setting the bin radii in the output
-	for(int binNum = 0; binNum < this->BinNumber; ++binNum)
-		{
-		this->UpdateBin(binNum,SET,
-			"bin radius",TOTAL,(binNum+1)*this->BinSpacing,output);
-    this->UpdateBin(binNum,SET,
-       "bin radius min",TOTAL,binNum*this->BinSpacing,output);
-      
+	this->ProfileCenters.clear();
+	this->BinSpacings.clear();
+	this->ProfileIds.clear();
+	const bool parallel = RunInParallel(this->Controller);
+	const int procId = parallel ? this->Controller->GetLocalProcessId() : 0;
+	// the number of centers as process 0 has them, -1 if there is no table
+	// of centers and -2 if it lacks the columns needed
+	vtkIdType numCenters = centers ? 0 : -1;
+	vtkstd::vector<double> radii;
+	if(procId==0 && centers)
+		{
+		vtkDataArray* centerArray = vtkDataArray::SafeDownCast(
+			centers->GetColumnByName(this->CentersArrayName ? 
+			this->CentersArrayName : ""));
+		vtkDataArray* radiusArray = vtkDataArray::SafeDownCast(
+			centers->GetColumnByName(this->RadiiArrayName ?
+			this->RadiiArrayName : ""));
+		// the ids of the catalogues of the halo and subhalo finders
+		vtkDataArray* idArray = vtkDataArray::SafeDownCast(
+			centers->GetColumnByName("halo ID"));
+		if(!idArray)
+			{
+			idArray = vtkDataArray::SafeDownCast(
+				centers->GetColumnByName("subhalo ID"));
+			}
+		if(!centerArray || centerArray->GetNumberOfComponents()!=3 || 
+			!radiusArray)
+			{
+			vtkErrorMacro("Failed to locate the center and radius columns of the table of centers");
+			numCenters = -2;
+			}
+		else
+			{
+			numCenters = centers->GetNumberOfRows();
+			this->ProfileCenters.resize(3*numCenters);
+			radii.resize(numCenters);
+			this->ProfileIds.resize(numCenters);
+			for(vtkIdType h = 0; h < numCenters; ++h)
+				{
+				centerArray->GetTuple(h,&this->ProfileCenters[3*h]);
+				radii[h] = radiusArray->GetComponent(h,0);
+				this->ProfileIds[h] = idArray ? 
+					vtkIdType(idArray->GetComponent(h,0)) : h;
+				}
+			}
 		}
-  
-  
-	// always need this for averages
-	AllocateDataArray(output,GetColumnName("number in bin",TOTAL).c_str(),
-		1,this->BinNumber);
-	AllocateDataArray(output,GetColumnName("number in bin",
-		CUMULATIVE).c_str(),1,this->BinNumber);
-	for(int i = 0; i < input->GetPointData()->GetNumberOfArrays(); ++i)
+	if(parallel)
 		{
-		// Next array data
-		vtkSmartPointer<vtkDataArray> nextArray = \
-		 	input->GetPointData()->GetArray(i);
-		int numComponents = nextArray->GetNumberOfComponents();
-		string baseName = nextArray->GetName();
-		AllocateDataArray(output,GetColumnName(baseName,TOTAL).c_str(),
-				numComponents,this->BinNumber);
-		AllocateDataArray(output,GetColumnName(baseName,AVERAGE).c_str(),
-			numComponents,this->BinNumber);
-		AllocateDataArray(output,GetColumnName(baseName,CUMULATIVE).c_str(),
-			numComponents,this->BinNumber);
-		}
-	// For our additional quantities, allocating a column for the average 
-	// and the sum. These are currently restricted to be 3-vectors
-	for(int i = 0; 
-		i < this->AdditionalProfileQuantities.size();
-	 	++i)
-		{
-		ProfileElement nextElement = this->AdditionalProfileQuantities[i];
-		AllocateDataArray(output,
-			GetColumnName(nextElement.BaseName,
-			nextElement.ProfileColumnType).c_str(),nextElement.NumberComponents,
-			this->BinNumber);
+		this->Controller->Broadcast(&numCenters,1,0);
+		if(numCenters > 0)
+			{
+			this->ProfileCenters.resize(3*numCenters);
+			radii.resize(numCenters);
+			this->ProfileIds.resize(numCenters);
+			this->Controller->Broadcast(&this->ProfileCenters[0],3*numCenters,0);
+			this->Controller->Broadcast(&radii[0],numCenters,0);
+			this->Controller->Broadcast(&this->ProfileIds[0],numCenters,0);
+			}
 		}
+	if(numCenters < 0)
+		{
+		this->ProfileIds.clear();
+		return (numCenters==-1) ? 0 : -1;
+		}
+	this->NumberOfProfiles = numCenters;
+	for(vtkIdType h = 0; h < numCenters; ++h)
+		{
+		this->BinSpacings.push_back(
+			this->CalculateBinSpacing(radii[h],this->BinNumber));
+		}
+	return 1;
 }
 
 //----------------------------------------------------------------------------
-double vtkProfileFilter::CalculateBinSpacing(double maxR,int binNumber)
-{
-	return maxR/binNumber;
-}
-
-//----------------------------------------------------------------------------
-void vtkProfileFilter::UpdateStatistics(vtkPointSet* input,vtkTable* output)
+void vtkProfileFilter::InitializeBins(vtkPointSet* input)
 {
-	for(unsigned long nextPointId = 0;
-	 		nextPointId < input->GetPoints()->GetNumberOfPoints();
-	 		++nextPointId)
+	// a row per bin: the number of points, then the components of each
+	// input array, then those of each additional quantity accumulated
+	this->AccumulatorWidth=1;
+	for(int i = 0; i < input->GetPointData()->GetNumberOfArrays(); ++i)
 		{
-			this->UpdateBinStatistics(input,nextPointId,output);
+		vtkDataArray* nextArray = input->GetPointData()->GetArray(i);
+		if(nextArray)
+			{
+			this->AccumulatorWidth+=nextArray->GetNumberOfComponents();
+			}
 		}
+	for(size_t i = 0; i < this->AdditionalProfileQuantities.size(); ++i)
+		{
+		ProfileElement& nextElement = this->AdditionalProfileQuantities[i];
+		if(!nextElement.Postprocess)
+			{
+			this->AccumulatorWidth+=nextElement.NumberComponents;
+			}
+		}
+	this->Accumulators.assign(
+		this->NumberOfProfiles*this->BinNumber*this->AccumulatorWidth,0.0);
 }
 
 //----------------------------------------------------------------------------
-void vtkProfileFilter::UpdateBinStatistics(vtkPointSet* input,
- 	vtkIdType pointGlobalId,vtkTable* output)
+int vtkProfileFilter::CheckAccumulatorLayout(vtkPointSet* input)
 {
-	double* x = GetPoint(input,pointGlobalId);
-	// As we bin by radius always need
-	double* r=PointVectorDifference(x,this->Center);
-	// Many of the quantities explicitely require the velocity
-	double* v=GetDataValue(input,"velocity",pointGlobalId);
-	int binNum=this->GetBinNumber(x);
-  if(binNum < 0){
-    // This indicates the point is not to be included.
-    return;
-  }
-	this->UpdateBin(binNum,ADD,"number in bin",TOTAL,1.0,output);	
-	this->UpdateCumulativeBins(binNum,ADD,
-		"number in bin",CUMULATIVE,1.0,output);	
-	assert(0<=binNum<=this->BinNumber);
-	// Updating quanties for the input data arrays
+	// the layout of a row, the name and number of components of each array,
+	// and the number of rows
+	std::ostringstream layout;
 	for(int i = 0; i < input->GetPointData()->GetNumberOfArrays(); ++i)
 		{
-		vtkSmartPointer<vtkDataArray> nextArray = \
-		 	input->GetPointData()->GetArray(i);
-		// getting the data for this point
-		double* nextData = GetDataValue(input,
-			nextArray->GetName(),pointGlobalId);
-		// Updating the total bin
-		string baseName = nextArray->GetName();
-		this->UpdateBin(binNum,ADD,baseName,TOTAL,nextData, output);	
-		this->UpdateBin(binNum,ADD,baseName,AVERAGE,nextData, output);	
-		this->UpdateCumulativeBins(binNum,ADD,baseName,CUMULATIVE,nextData,
-			output);
-		//Finally some memory management
-		delete [] nextData;
-		}
-	for(int i = 0; i < 
-		this->AdditionalProfileQuantities.size(); 
-		++i)
-		{
-		ProfileElement nextElement=this->AdditionalProfileQuantities[i];
-		if(!nextElement.Postprocess)
+		vtkDataArray* nextArray = input->GetPointData()->GetArray(i);
+		if(nextArray)
 			{
-			double* additionalData = \
-				nextElement.Function(v,r);
-			this->UpdateBin(binNum,ADD,nextElement.BaseName,
-				nextElement.ProfileColumnType,additionalData,output);
+			layout << (nextArray->GetName() ? nextArray->GetName() : "") << ':'
+				<< nextArray->GetNumberOfComponents() << ';';
 			}
 		}
-	// Finally some memory management
-	delete [] x;
-	delete [] r;
-	delete [] v;
+	layout << this->AccumulatorWidth << ';' << this->Accumulators.size();
+	const vtkstd::string localLayout = layout.str();
+	// process 0's layout, which every process compares its own with
+	vtkIdType length = localLayout.size();
+	this->Controller->Broadcast(&length,1,0);
+	vtkstd::vector<char> rootLayout(localLayout.begin(),localLayout.end());
+	rootLayout.resize(length+1);
+	this->Controller->Broadcast(&rootLayout[0],length,0);
+	int localSame = vtkstd::string(&rootLayout[0],length)==localLayout;
+	if(!localSame)
+		{
+		vtkErrorMacro("The point arrays of process "
+			<< this->Controller->GetLocalProcessId()
+			<< " differ from those of process 0, unable to sum the profiles");
+		}
+	int same = 0;
+	this->Controller->AllReduce(&localSame,&same,1,vtkCommunicator::MIN_OP);
+	return same;
 }
 
 //----------------------------------------------------------------------------
-void 	vtkProfileFilter::BinAveragesAndPostprocessing(
-	vtkPointSet* input,vtkTable* output)
+double vtkProfileFilter::CalculateBinSpacing(double maxR,int binNumber)
 {
-	for(int binNum = 0; binNum < this->BinNumber; ++binNum)
-		{
-		int binSize=output->GetValueByName(binNum,
-			GetColumnName("number in bin",TOTAL).c_str()).ToInt();
-		// For each input array, update its average column by getting
-		// the total from the total column then dividing by 
-		// the number in the bin. Only do this if the number in the bin
-		// is greater than zero
-			if(binSize>0)
-				{
-				vtkSmartPointer<vtkDataArray> nextArray;
-				for(int i = 0; i < input->GetPointData()->GetNumberOfArrays(); ++i)
-					{
-					nextArray = input->GetPointData()->GetArray(i);
-					string baseName = nextArray->GetName();
-					this->UpdateBin(binNum,MULTIPLY,baseName,AVERAGE,1./binSize,output);
-					}
-				// For each additional quantity we also divide by N in the average
-				// if requested
-				for(int i = 0; 
-					i < this->AdditionalProfileQuantities.size();
-				 	++i)
-					{
-					ProfileElement nextElement = \
-						this->AdditionalProfileQuantities[i];
-					if(nextElement.ProfileColumnType==AVERAGE)
-						{
-						this->UpdateBin(binNum,MULTIPLY,nextElement.BaseName,
-							AVERAGE,1./binSize,output);
-						}
-					}
-				}
-
-		// Finally post processing those items which are marked as such, don't
-		// do this within the average loop as these quantities are allowed
-		// to depend on averages themselves
-		for(int i = 0; 
-			i < this->AdditionalProfileQuantities.size();
-		 	++i)
-			{
-			ProfileElement nextElement = \
-				this->AdditionalProfileQuantities[i];
-			if(nextElement.Postprocess)
-				{
-				vtkVariant argumentOne = \
-		 			this->GetData(binNum, nextElement.ArgOneBaseName,
-					nextElement.ArgOneColumnType, output);
-				vtkVariant argumentTwo = \
-					this->GetData(binNum, nextElement.ArgTwoBaseName,
-					nextElement.ArgTwoColumnType,	output);
-				double* updateData = \
-					nextElement.PostProcessFunction(argumentOne,argumentTwo);
-				this->UpdateBin(binNum,SET,nextElement.BaseName,TOTAL,
-					updateData,output);
-				// memory management
-				delete [] updateData;
-				}
-			}
-	}
+	return maxR/binNumber;
 }
 
 //----------------------------------------------------------------------------
-string vtkProfileFilter::GetColumnName(string baseName, 
-	ColumnType columnType)
+int vtkProfileFilter::GetMaximumNumberOfComponents(vtkPointSet* input)
 {
-	switch(columnType)
+	int maxComponents = 3;
+	for(int i = 0; i < input->GetPointData()->GetNumberOfArrays(); ++i)
 		{
-		case AVERAGE:
-			return baseName+"_average";
-		case TOTAL:
-			return baseName+"_total";
-		case CUMULATIVE:
-			return baseName+"_cumulative";
-		default:
-			vtkDebugMacro("columnType not found for function GetColumnName, returning error string");
-			return "error";
+		if(input->GetPointData()->GetArray(i))
+			{
+			maxComponents = vtkstd::max(maxComponents,
+				input->GetPointData()->GetArray(i)->GetNumberOfComponents());
+			}
 		}
+	return maxComponents;
 }
 
 //----------------------------------------------------------------------------
-void vtkProfileFilter::UpdateBin(int binNum, BinUpdateType updateType,
- 	string baseName, ColumnType columnType, double* updateData,
- 	vtkTable* output)
+void vtkProfileFilter::AccumulatePoints(vtkPointSet* input,
+	const vtkstd::vector<vtkIdType>& pointIds,
+	const vtkstd::vector<vtkIdType>& rowOffsets, const double center[3],
+	double* accumulators)
 {
-	vtkVariant oldData = this->GetData(binNum,baseName,columnType,output);
-	if(oldData.IsArray())
+	const vtkIdType numPoints = pointIds.size();
+	if(numPoints==0)
 		{
-		this->UpdateArrayBin(binNum,updateType,baseName,columnType,
-			updateData,oldData.ToArray(),output);
+		return;
 		}
-	else
+	vtkPointData* pointData = input->GetPointData();
+	for(vtkIdType i = 0; i < numPoints; ++i)
 		{
-		this->UpdateDoubleBin(binNum,updateType,baseName,columnType,
-			updateData[0],oldData.ToDouble(),output);
+		accumulators[rowOffsets[i]]+=1;
 		}
-}
-
-//----------------------------------------------------------------------------
-void vtkProfileFilter::MergeBins(int binNum, BinUpdateType updateType,
- 	string baseName, ColumnType columnType, vtkTable* originalTable,
-	vtkTable* tableToMerge)
-{
-	vtkVariant originalData = this->GetData(binNum,baseName,columnType,
-		originalTable);
-	vtkVariant mergeData = this->GetData(binNum,baseName,columnType,
-		tableToMerge);
-	if(originalData.IsArray() && mergeData.IsArray())
+	int offset = 1;
+	vtkstd::vector<double> tuple(this->GetMaximumNumberOfComponents(input));
+	for(int j = 0; j < pointData->GetNumberOfArrays(); ++j)
+		{
+		vtkDataArray* nextArray = pointData->GetArray(j);
+		if(!nextArray)
+			{
+			continue;
+			}
+		const int numComponents = nextArray->GetNumberOfComponents();
+		for(vtkIdType i = 0; i < numPoints; ++i)
+			{
+			nextArray->GetTuple(pointIds[i],&tuple[0]);
+			double* row = accumulators+rowOffsets[i]+offset;
+			for(int comp = 0; comp < numComponents; ++comp)
+				{
+				row[comp]+=tuple[comp];
+				}
+			}
+		offset+=numComponents;
+		}
+	// As we bin by radius always need r, and many of the quantities
+	// explicitely require the velocity
+	vtkstd::vector<double> r(3*numPoints);
+	vtkstd::vector<double> v(3*numPoints,0.0);
+	vtkDataArray* velocityArray = pointData->GetArray("velocity");
+	for(vtkIdType i = 0; i < numPoints; ++i)
 		{
-		this->UpdateArrayBin(binNum,updateType,baseName,columnType,
-			mergeData.ToArray(),originalData.ToArray(),originalTable);
+		input->GetPoints()->GetPoint(pointIds[i],&r[3*i]);
+		for(int comp = 0; comp < 3; ++comp)
+			{
+			r[3*i+comp]-=center[comp];
+			}
+		if(velocityArray)
+			{
+			velocityArray->GetTuple(pointIds[i],&v[3*i]);
+			}
 		}
-	else
+	for(size_t j = 0; j < this->AdditionalProfileQuantities.size(); ++j)
 		{
-		assert(originalData.IsNumeric() && mergeData.IsNumeric());
-		this->UpdateDoubleBin(binNum,updateType,baseName,columnType,
-			mergeData.ToDouble(),originalData.ToDouble(),originalTable);
+		ProfileElement& nextElement=this->AdditionalProfileQuantities[j];
+		if(!nextElement.Postprocess)
+			{
+			nextElement.Function(&v[0],&r[0],&rowOffsets[0],numPoints,
+				accumulators+offset);
+			offset+=nextElement.NumberComponents;
+			}
 		}
 }
 
 //----------------------------------------------------------------------------
-void vtkProfileFilter::UpdateBin(int binNum, BinUpdateType updateType,
- 	string baseName, ColumnType columnType, double updateData,
- 	vtkTable* output)
+void vtkProfileFilter::UpdateStatistics(vtkPointSet* input)
 {
-	vtkVariant oldData = this->GetData(binNum,baseName,columnType,output);
-	if(oldData.IsArray())
+	// the points are added in batches, each quantity over a whole batch
+	const vtkIdType batchSize = 4096;
+	vtkstd::vector<vtkIdType> pointIds;
+	vtkstd::vector<vtkIdType> rowOffsets;
+	pointIds.reserve(batchSize);
+	rowOffsets.reserve(batchSize);
+	const vtkIdType numPoints = input->GetPoints()->GetNumberOfPoints();
+	for(vtkIdType pointId = 0; pointId < numPoints; ++pointId)
 		{
-		int sizeOfUpdateData = oldData.ToArray()->GetNumberOfComponents();
-		double* arrayUpdateData = new double[sizeOfUpdateData];
-		for(int comp = 0; comp < sizeOfUpdateData; ++comp)
+		double x[3];
+		input->GetPoint(pointId,x);
+		int binNum=this->GetBinNumber(x);
+		if(binNum < 0)
 			{
-			arrayUpdateData[comp] = updateData;
+			// This indicates the point is not to be included.
+			continue;
+			}
+		// points at MaxR itself belong to the last bin
+		binNum=vtkstd::min(binNum,this->BinNumber-1);
+		pointIds.push_back(pointId);
+		rowOffsets.push_back(binNum*this->AccumulatorWidth);
+		if(vtkIdType(pointIds.size())==batchSize)
+			{
+			this->AccumulatePoints(input,pointIds,rowOffsets,this->Center,
+				&this->Accumulators[0]);
+			pointIds.clear();
+			rowOffsets.clear();
 			}
-		this->UpdateArrayBin(binNum,updateType,baseName,columnType,
-			arrayUpdateData,oldData.ToArray(),output);
-		// finally some memory management
-		delete [] arrayUpdateData;
-		}
-	else
-		{
-		this->UpdateDoubleBin(binNum,updateType,baseName,columnType,
-			updateData,oldData.ToDouble(),output);
 		}
+	this->AccumulatePoints(input,pointIds,rowOffsets,this->Center,
+		&this->Accumulators[0]);
 }
 
 //----------------------------------------------------------------------------
-void vtkProfileFilter::UpdateDoubleBin(int binNum, BinUpdateType updateType,
- 	string baseName, ColumnType columnType, double updateData, double oldData,
- 	vtkTable* output)
+// What the threads accumulating the profiles of many centers share: the
+// tree of the particles, and the next profile to hand out
+struct vtkProfileFilterTask
+{
+	vtkProfileFilter* Filter;
+	vtkPointSet* Input;
+	const KdTree* Tree;
+	vtkIdType NextProfile;
+	vtkMutexLock* Lock;
+};
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkProfileFilter::ProfileThread(void* arg)
 {
-	switch(updateType)
+	vtkProfileFilterTask* task=static_cast<vtkProfileFilterTask*>(
+		static_cast<vtkMultiThreader::ThreadInfo*>(arg)->UserData);
+	vtkProfileFilter* self=task->Filter;
+	// the particles within the radius of the current center, and the
+	// offsets of their bins
+	vtkstd::vector<vtkIdType> ids;
+	vtkstd::vector<vtkIdType> rowOffsets;
+	for(;;)
 		{
-		case ADD:
-			updateData+=oldData;
-			break;
-		case MULTIPLY:
-			updateData*=oldData;
-			break;
-		case SET:
+		task->Lock->Lock();
+		const vtkIdType profile=task->NextProfile++;
+		task->Lock->Unlock();
+		if(profile >= self->NumberOfProfiles)
+			{
 			break;
+			}
+		// each profile has its own rows of the accumulators, so threads never
+		// add to the same ones
+		const double spacing=self->BinSpacings[profile];
+		if(spacing <= 0)
+			{
+			continue;
+			}
+		const double* center=&self->ProfileCenters[3*profile];
+		task->Tree->FindPointsWithinRadius(center,spacing*self->BinNumber,ids);
+		double* rows=&self->Accumulators[
+			profile*self->BinNumber*self->AccumulatorWidth];
+		rowOffsets.resize(ids.size());
+		for(vtkstd::vector<vtkIdType>::size_type i = 0; i < ids.size(); ++i)
+			{
+			const double* x=task->Tree->GetPoint(ids[i]);
+			const int binNum=vtkstd::min(self->BinNumber-1,
+				int(sqrt(vtkMath::Distance2BetweenPoints(x,center))/spacing));
+			rowOffsets[i]=binNum*self->AccumulatorWidth;
+			}
+		self->AccumulatePoints(task->Input,ids,rowOffsets,center,rows);
 		}
-		output->SetValueByName(binNum,
-			GetColumnName(baseName,columnType).c_str(),updateData);
+	return VTK_THREAD_RETURN_VALUE;
 }
 
 //----------------------------------------------------------------------------
-void vtkProfileFilter::UpdateArrayBin(int binNum, BinUpdateType updateType,
- 	string baseName, ColumnType columnType, vtkAbstractArray* updateData,
- 	vtkAbstractArray* oldData, vtkTable* output)
+void vtkProfileFilter::UpdateMultiCenterStatistics(vtkPointSet* input)
 {
-	for(int comp = 0; comp < oldData->GetNumberOfComponents(); ++comp)
-		{
-		switch(updateType)
-			{
-			case ADD:
-				oldData->InsertVariantValue(comp,
-					updateData->GetVariantValue(comp).ToDouble()+\
-					oldData->GetVariantValue(comp).ToDouble());
-				break;
-			case MULTIPLY:
-				oldData->InsertVariantValue(comp,
-					updateData->GetVariantValue(comp).ToDouble()*\
-					oldData->GetVariantValue(comp).ToDouble());
-				break;
-			case SET:
-				oldData->InsertVariantValue(comp,
-					updateData->GetVariantValue(comp).ToDouble());
-				break;
-			}
-		}
-	output->SetValueByName(binNum,GetColumnName(baseName,columnType).c_str(),
-		oldData);
+	KdTree tree;
+	tree.Build(input->GetPoints());
+	vtkProfileFilterTask task;
+	task.Filter=this;
+	task.Input=input;
+	task.Tree=&tree;
+	task.NextProfile=0;
+	task.Lock=vtkMutexLock::New();
+	int numThreads=this->NumberOfThreads > 0 ? this->NumberOfThreads :
+		vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+	vtkMultiThreader* threader=vtkMultiThreader::New();
+	threader->SetNumberOfThreads(vtkstd::max(1,int(vtkstd::min<vtkIdType>(
+		numThreads,this->NumberOfProfiles))));
+	threader->SetSingleMethod(vtkProfileFilter::ProfileThread,&task);
+	threader->SingleMethodExecute();
+	threader->Delete();
+	task.Lock->Delete();
 }
 
-
 //----------------------------------------------------------------------------
-void vtkProfileFilter::UpdateArrayBin(int binNum, BinUpdateType updateType,
- 	string baseName, ColumnType columnType, double* updateData,
- 	vtkAbstractArray* oldData, vtkTable* output)
+void vtkProfileFilter::SetColumn(vtkTable* output, string baseName,
+	ColumnType columnType, int numComponents, 
+	const vtkstd::vector<double>& values, int offset, int stride)
 {
-
-	for(int comp = 0; comp < oldData->GetNumberOfComponents(); ++comp)
+	const vtkIdType numRows = vtkIdType(this->NumberOfProfiles)*this->BinNumber;
+	AllocateDataArray(output,GetColumnName(baseName,columnType).c_str(),
+		numComponents,numRows);
+	vtkDataArray* column = vtkDataArray::SafeDownCast(
+		output->GetColumnByName(GetColumnName(baseName,columnType).c_str()));
+	for(vtkIdType row = 0; row < numRows; ++row)
 		{
-		switch(updateType)
+		for(int comp = 0; comp < numComponents; ++comp)
 			{
-			case ADD:
-				oldData->InsertVariantValue(comp,
-					updateData[comp]+oldData->GetVariantValue(comp).ToDouble());
-				break;
-			case MULTIPLY:
-				oldData->InsertVariantValue(comp,
-					updateData[comp]*oldData->GetVariantValue(comp).ToDouble());
-				break;
-			case SET:
-				oldData->InsertVariantValue(comp,updateData[comp]);
-				break;
+			column->SetComponent(row,comp,values[row*stride+offset+comp]);
 			}
 		}
-	output->SetValueByName(binNum,GetColumnName(baseName,columnType).c_str(),
-		oldData);
 }
 
 //----------------------------------------------------------------------------
-void vtkProfileFilter::UpdateCumulativeBins(int binNum, BinUpdateType 		
-	updateType, string baseName, ColumnType columnType, double* dataToAdd,
-	vtkTable* output)
+void vtkProfileFilter::BinAveragesAndPostprocessing(
+	vtkPointSet* input,vtkTable* output)
 {
-	for(int bin = binNum; bin < this->BinNumber; ++bin)
+	// a row per bin of each profile, the bins of a profile in turn
+	const vtkIdType numRows = vtkIdType(this->NumberOfProfiles)*this->BinNumber;
+	const int width = this->AccumulatorWidth;
+	const vtkstd::vector<double>& totals = this->Accumulators;
+	// the cumulative totals, by a single prefix sum over the bins of each
+	// profile
+	vtkstd::vector<double> cumulative(totals);
+	for(vtkIdType row = 0; row < numRows; ++row)
 		{
-		this->UpdateBin(bin,updateType,baseName,columnType,dataToAdd,output);
+		if(row%this->BinNumber==0)
+			{
+			continue;
+			}
+		for(int k = 0; k < width; ++k)
+			{
+			cumulative[row*width+k]+=cumulative[(row-1)*width+k];
+			}
+		}
+	// the averages, dividing the totals by the number in the bin where it
+	// is greater than zero
+	vtkstd::vector<double> average(totals);
+	for(vtkIdType row = 0; row < numRows; ++row)
+		{
+		const double binSize = totals[row*width];
+		if(binSize > 0)
+			{
+			for(int k = 0; k < width; ++k)
+				{
+				average[row*width+k]/=binSize;
+				}
+			}
+		}
+	// with many centers, the first column is the id of the center of each
+	// profile
+	if(!this->ProfileIds.empty())
+		{
+		vtkIdTypeArray* idColumn = vtkIdTypeArray::New();
+		idColumn->SetName("halo ID");
+		idColumn->SetNumberOfComponents(1);
+		idColumn->SetNumberOfTuples(numRows);
+		for(vtkIdType row = 0; row < numRows; ++row)
+			{
+			idColumn->SetValue(row,this->ProfileIds[row/this->BinNumber]);
+			}
+		output->AddColumn(idColumn);
+		idColumn->Delete();
+		}
+	// the next columns will be the bin radius (max) and (min)
+	vtkstd::vector<double> binRadius(numRows);
+	vtkstd::vector<double> binRadiusMin(numRows);
+	for(vtkIdType row = 0; row < numRows; ++row)
+		{
+		const double spacing = this->BinSpacings[row/this->BinNumber];
+		binRadius[row]=(row%this->BinNumber+1)*spacing;
+		binRadiusMin[row]=(row%this->BinNumber)*spacing;
+		}
+	this->SetColumn(output,"bin radius",TOTAL,1,binRadius,0,1);
+	this->SetColumn(output,"bin radius min",TOTAL,1,binRadiusMin,0,1);
+	// always need this for averages
+	this->SetColumn(output,"number in bin",TOTAL,1,totals,0,width);
+	this->SetColumn(output,"number in bin",CUMULATIVE,1,cumulative,0,width);
+	int offset = 1;
+	for(int i = 0; i < input->GetPointData()->GetNumberOfArrays(); ++i)
+		{
+		vtkDataArray* nextArray = input->GetPointData()->GetArray(i);
+		if(!nextArray)
+			{
+			continue;
+			}
+		const int numComponents = nextArray->GetNumberOfComponents();
+		string baseName = nextArray->GetName();
+		this->SetColumn(output,baseName,TOTAL,numComponents,
+			totals,offset,width);
+		this->SetColumn(output,baseName,AVERAGE,numComponents,
+			average,offset,width);
+		this->SetColumn(output,baseName,CUMULATIVE,numComponents,
+			cumulative,offset,width);
+		offset+=numComponents;
+		}
+	for(size_t i = 0; i < this->AdditionalProfileQuantities.size(); ++i)
+		{
+		ProfileElement& nextElement = this->AdditionalProfileQuantities[i];
+		if(nextElement.Postprocess)
+			{
+			AllocateDataArray(output,GetColumnName(nextElement.BaseName,
+				nextElement.ProfileColumnType).c_str(),nextElement.NumberComponents,
+				numRows);
+			continue;
+			}
+		const vtkstd::vector<double>* values = &totals;
+		if(nextElement.ProfileColumnType==AVERAGE)
+			{
+			values = &average;
+			}
+		else if(nextElement.ProfileColumnType==CUMULATIVE)
+			{
+			values = &cumulative;
+			}
+		this->SetColumn(output,nextElement.BaseName,
+			nextElement.ProfileColumnType,nextElement.NumberComponents,
+			*values,offset,width);
+		offset+=nextElement.NumberComponents;
+		}
+	// Finally post processing those items which are marked as such, once
+	// the averages they are allowed to depend on are in the table
+	for(size_t i = 0; i < this->AdditionalProfileQuantities.size(); ++i)
+		{
+		ProfileElement& nextElement = this->AdditionalProfileQuantities[i];
+		if(!nextElement.Postprocess)
+			{
+			continue;
+			}
+		vtkDataArray* column = vtkDataArray::SafeDownCast(
+			output->GetColumnByName(GetColumnName(nextElement.BaseName,
+			nextElement.ProfileColumnType).c_str()));
+		vtkDataArray* argOneColumn = vtkDataArray::SafeDownCast(
+			output->GetColumnByName(GetColumnName(nextElement.ArgOneBaseName,
+			nextElement.ArgOneColumnType).c_str()));
+		vtkDataArray* argTwoColumn = vtkDataArray::SafeDownCast(
+			output->GetColumnByName(GetColumnName(nextElement.ArgTwoBaseName,
+			nextElement.ArgTwoColumnType).c_str()));
+		if(!argOneColumn || !argTwoColumn)
+			{
+			vtkWarningMacro("Failed to locate the columns to compute " 
+				<< nextElement.BaseName << " from, leaving it zero");
+			for(int comp = 0; comp < nextElement.NumberComponents; ++comp)
+				{
+				column->FillComponent(comp,0);
+				}
+			continue;
+			}
+		vtkstd::vector<double> argumentOne(
+			argOneColumn->GetNumberOfComponents());
+		vtkstd::vector<double> argumentTwo(
+			argTwoColumn->GetNumberOfComponents());
+		vtkstd::vector<double> updateData(nextElement.NumberComponents);
+		for(vtkIdType row = 0; row < numRows; ++row)
+			{
+			argOneColumn->GetTuple(row,&argumentOne[0]);
+			argTwoColumn->GetTuple(row,&argumentTwo[0]);
+			nextElement.PostProcessFunction(&argumentOne[0],&argumentTwo[0],
+				&updateData[0]);
+			column->SetTuple(row,&updateData[0]);
+			}
 		}
 }
 
 //----------------------------------------------------------------------------
-void vtkProfileFilter::UpdateCumulativeBins(int binNum, BinUpdateType 		
-	updateType, string baseName, ColumnType columnType, double dataToAdd,
-	vtkTable* output)
+string vtkProfileFilter::GetColumnName(string baseName, 
+	ColumnType columnType)
 {
-	for(int bin = binNum; bin < this->BinNumber; ++bin)
+	switch(columnType)
 		{
-		this->UpdateBin(bin,updateType,baseName,columnType,dataToAdd,output);
+		case AVERAGE:
+			return baseName+"_average";
+		case TOTAL:
+			return baseName+"_total";
+		case CUMULATIVE:
+			return baseName+"_cumulative";
+		default:
+			vtkDebugMacro("columnType not found for function GetColumnName, returning error string");
+			return "error";
 		}
 }
-//----------------------------------------------------------------------------
-vtkVariant vtkProfileFilter::GetData(int binNum, string baseName,
-	ColumnType columnType, vtkTable* output)
-{
-	return output->GetValueByName(binNum,
-		GetColumnName(baseName,columnType).c_str());
-}
 
 //----------------------------------------------------------------------------
 vtkProfileFilter::ProfileElement::ProfileElement(string baseName, 
-	int numberComponents, double* (*funcPtr)(double [], double []),
+	int numberComponents, void (*funcPtr)(const double*, const double*,
+	const vtkIdType*, vtkIdType, double*),
 	ColumnType columnType)
 {
 	this->BaseName = baseName;
@@ -698,7 +847,8 @@ vtkProfileFilter::ProfileElement::ProfileElement(string baseName,
 }
 
 vtkProfileFilter::ProfileElement::ProfileElement(string baseName, 
-	int numberComponents, double* (*funcPtr)(vtkVariant, vtkVariant),
+	int numberComponents,
+	void (*funcPtr)(const double*, const double*, double*),
 	string argOneBaseName, ColumnType argOneColumnType, 
 	string argTwoBaseName, ColumnType argTwoColumnType)
 {
@@ -13,11 +13,25 @@
 // .NAME vtkProfileFilter 
 // .SECTION Description
 // Calculates various physical profiles as a function of radius.
-// Fully parallel.
+// Fully parallel. The totals of each bin are accumulated in one pass over
+// the points into flat arrays, from which the averages and, by a prefix
+// sum over the bins, the cumulative values are computed at the end, when
+// the output table is filled once.
+//
+// Given a table of centers on the third input, such as the catalogue of
+// the halo finder, a profile is computed about each of them at once
+// instead, out to the radius of each in the RadiiArrayName column, in one
+// pass over the points. Each center's sphere is found in a kd-tree of the
+// points, on NumberOfThreads threads, each accumulating the bins of its
+// own centers. The output then has BinNumber rows per center, the first
+// column the "halo ID" of their center. The profile axis and height apply
+// to the single center only.
 #ifndef __vtkProfileFilter_h
 #define __vtkProfileFilter_h
 #include "vtkTableAlgorithm.h" // super class
 #include "vtkStringArray.h" // some class variables are vtkStringArrays
+#include "vtkMultiThreader.h" // for VTK_THREAD_RETURN_TYPE
+#include "AstroVizHelpersLib/AstroVizProfileQuantities.h" // for templates
 #include <vtkstd/vector>
 class vtkPointSet;
 class vtkMultiProcessController;
@@ -29,13 +43,6 @@ enum ProfileMPIData
 	DATA_TABLE
 };
 
-enum BinUpdateType
-{
-	ADD, 
-	MULTIPLY,
-	SET
-};
-
 enum ColumnType
 {
 	AVERAGE,
@@ -62,20 +69,41 @@ public:
   
   
   // Description:
-  // Get/Set the Profile Axis
+  // Get/Set the Profile Axis. Only the profile about the probe uses it,
+  // the profiles about a table of centers are spherical.
   vtkSetVector3Macro(ProfileAxis,double);
   vtkGetVectorMacro(ProfileAxis,double,3);
 
   // Description:
-  // Get/Set the number of bins
+  // Get/Set the height beyond which points are ignored. Only the profile
+  // about the probe uses it, the profiles about a table of centers reach
+  // out to the radius of each.
   vtkSetMacro(ProfileHeight,double);
   vtkGetMacro(ProfileHeight,double);
 
   // Description:
   // Specify the point locations used to probe input. Any geometry
   // can be used. New style. Equivalent to SetInputConnection(1, algOutput).
+  // Optional if a table of centers is given.
   void SetSourceConnection(vtkAlgorithmOutput* algOutput);
   // Description:
+  // Specify a table of centers, such as the catalogue of the halo finder,
+  // to compute a profile about each of. Optional.
+  // Equivalent to SetInputConnection(2, algOutput).
+  void SetCentersConnection(vtkAlgorithmOutput* algOutput);
+  // Description:
+  // Get/Set the names of the columns of the table of centers holding the
+  // center and the radius out to which to profile about it
+  vtkSetStringMacro(CentersArrayName);
+  vtkGetStringMacro(CentersArrayName);
+  vtkSetStringMacro(RadiiArrayName);
+  vtkGetStringMacro(RadiiArrayName);
+  // Description:
+  // Get/Set the number of threads to profile many centers on, 0 (the
+  // default) for one per core
+  vtkSetClampMacro(NumberOfThreads, int, 0, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfThreads, int);
+  // Description:
   // By defualt this filter uses the global controller,
   // but this method can be used to set another instead.
   virtual void SetController(vtkMultiProcessController*);
@@ -102,7 +130,8 @@ protected:
 	// only the base name, an affix will be added for any
 	// quantities desired to be computed
 	// number elements : the number of elements in each entry
-	// funcPtr : the function to use to evaluate an update
+	// funcPtr : the function to use to evaluate an update, for a batch of
+	// points, or a row of the output if postprocessed
 	// average : if 1 compute the average of this quantity
 	// total : if 1 compute the total of this quantity
 	// cumulative: if 1 compute the cumulative value of this quantity
@@ -112,8 +141,9 @@ protected:
   public:
 		vtkstd::string BaseName;
 		int NumberComponents;
-		double* (*Function)(double [], double []);
-		double* (*PostProcessFunction)(vtkVariant, vtkVariant);
+		void (*Function)(const double*, const double*, const vtkIdType*,
+			vtkIdType, double*);
+		void (*PostProcessFunction)(const double*, const double*, double*);
 		ColumnType ProfileColumnType;
 		int Postprocess;
 		vtkstd::string ArgOneBaseName;
@@ -122,10 +152,11 @@ protected:
 		ColumnType ArgTwoColumnType;
 		// Description:
 		// quantities to be processed for each element in each bin with the
-		// function *functPtr which takes in a radius and a velocity given
-		// by double arrays
+		// function *functPtr which takes in the velocities and radii of a
+		// batch of points, as AccumulateProfileQuantity
 		ProfileElement(vtkstd::string baseName, int numberComponents,
-			double* (*funcPtr)(double [], double []),
+			void (*funcPtr)(const double*, const double*, const vtkIdType*,
+			vtkIdType, double*),
 			ColumnType columnType);
 		// Description:
 		// if post processing is desired, then must specify two arguments, which
@@ -135,16 +166,40 @@ protected:
 		//
 		// The last four arguments specify which two columns
 		// data should be handed to the postprocessing function, which
-		// takes two vtkVariants as arguments and returns a double*,
-		// thus requires that they are part of the input (for which
+		// takes the values of a row of each and writes the result to its
+		// third argument, thus requires that they are part of the input (for which
 		//  CUMULATIVE,AVERAGE and TOTAL are computed for each array name)
 		// or that they are specified as an additional profile element above
 		ProfileElement(vtkstd::string baseName, int numberComponents,
-			double* (*funcPtr)(vtkVariant, vtkVariant),
+			void (*funcPtr)(const double*, const double*, double*),
 			vtkstd::string argOneBaseName, ColumnType argOneColumnType, 
 			vtkstd::string argTwoBaseName, ColumnType argTwoColumnType);
 		~ProfileElement();
  	};
+
+	// Description:
+	// adds Quantity, a class of AstroVizProfileQuantities.h, to the
+	// quantities profiled, as a column of columnType
+	template<class Quantity>
+	void AddProfileQuantity(ColumnType columnType)
+		{
+		this->AdditionalProfileQuantities.push_back(
+			ProfileElement(Quantity::GetName(),Quantity::NumberOfComponents,
+			&AccumulateProfileQuantity<Quantity>,columnType));
+		}
+	// Description:
+	// adds Quantity, a class of AstroVizProfileQuantities.h, computed from
+	// the two columns given once the others are known, as column baseName
+	template<class Quantity>
+	void AddPostprocessedProfileQuantity(vtkstd::string baseName,
+		vtkstd::string argOneBaseName, ColumnType argOneColumnType,
+		vtkstd::string argTwoBaseName, ColumnType argTwoColumnType)
+		{
+		this->AdditionalProfileQuantities.push_back(
+			ProfileElement(baseName,Quantity::NumberOfComponents,
+			&Quantity::Compute,argOneBaseName,argOneColumnType,
+			argTwoBaseName,argTwoColumnType));
+		}
 	double Delta;
   // Description:
 	// Center around which to compute radial bins
@@ -172,6 +227,18 @@ protected:
 	// the virial radius if applicable
 	double MaxR;
 	// Description:
+	// The number of centers profiled about, 1 unless given a table of them
+	vtkIdType NumberOfProfiles;
+	// Description:
+	// For each profile its center, 3 components each, and bin spacing; and,
+	// given a table of centers, the id of each
+	vtkstd::vector<double> ProfileCenters;
+	vtkstd::vector<double> BinSpacings;
+	vtkstd::vector<vtkIdType> ProfileIds;
+	char* CentersArrayName;
+	char* RadiiArrayName;
+	int NumberOfThreads;
+	// Description:
 	// Quantities to add to the input
 	vtkstd::vector<ProfileElement> AdditionalProfileQuantities;
   
@@ -182,142 +249,92 @@ protected:
 	// desired number of bins
 	void SetBoundsAndBinExtents(vtkPointSet* input, vtkDataSet* source);
 
+	// Description:
+	// The totals over the points of each bin, a row of AccumulatorWidth
+	// per bin of each profile in turn: the number in the bin, then the components of each input
+	// array, then those of each additional quantity not postprocessed, in
+	// the order of AdditionalProfileQuantities
+	vtkstd::vector<double> Accumulators;
+	int AccumulatorWidth;
+
 	// Description:
 	// SetBoundsAndBinExtents must have been called first.
 	// 
-	// Initializes a row for each bin, with the max radius of that bin
-	// 
-	// For each dataarray in the input, define a total and an
-	// average column in the binned output table.
-	//
-	// For each additional quantity as specified by the 
-	// AdditionalProfileQuantities array, define a average column in the
-	// binned output table
-	//
-	// For each cumulative array as specified by the CumulativeQuantitiesArray
+	// Lays out and zeroes the accumulators, for the arrays of the input and
+	// the AdditionalProfileQuantities
+	void InitializeBins(vtkPointSet* input);
+
+	// Description:
+	// InitializeBins must have been called first.
 	//
-	void InitializeBins(vtkPointSet* input, vtkTable* output);
+	// Checks that every process laid out its accumulators as process 0 did,
+	// with the same arrays in the same order, before they are summed.
+	// Returns 1 on every process if so, 0 on every process otherwise.
+	int CheckAccumulatorLayout(vtkPointSet* input);
 
 	// Description:
 	// Calculates the bin spacing 
 	double CalculateBinSpacing(double maxR,int binNumber);
 
 	// Description:
-	// For each point in the input, update the relevant bins and bin columns
-	// to reflect this point's data. Finally compute the averages, relevant
-	// dispersions, and global statistics.
-	void UpdateStatistics(vtkPointSet* input,vtkTable* output);
+	// For each point in the input, adds its data values, and the additional
+	// quantities computed from them, to the accumulators of its bin. Note:
+	// quantities that are averages, or require post processing, are
+	// accumulated as totals; BinAveragesAndPostprocessing must be called
+	// after all points have been added to do the proper averaging and/or
+	// postprocessing.
+	void UpdateStatistics(vtkPointSet* input);
 
 	// Description:
-	// For each quantity initialized in InitializeBins updates the statistics
-	// of the correct bin to reflect the data values of the point identified
-	// with pointGlobalId. Note: for quantities that are averages, or require
-	// post processing this are updated additively as with totals. This is
-	// why after all points have updated the bin statistics,
-	// BinAveragesAndPostprocessing must be called to do the proper averaging
-	// and/or postprocessing on  the accumlated columns.
-	void UpdateBinStatistics(vtkPointSet* input, 
-		vtkIdType pointGlobalId,vtkTable* output);
-	
-	// Description:
-	// returns the bin number in which this point lies.
-	int GetBinNumber(double x[]);
-	  
-	// Description:
-	// Updates the data values of attribute specified in attributeName
-	// in the bin specified by binNum, either additively or 	
-	// multiplicatively as specified by updatetype by dataToAdd. Calls
-	// either UpdateArrayBin or UpdateDoubleBin depending on the
-	// type of data in the bin.
-	void UpdateBin(int binNum, BinUpdateType updateType,
-	 	vtkstd::string baseName, ColumnType columnType, double* updateData,
-	 	vtkTable* output);
-	
-	// Description:
-	// Overloaded updated bin, taking in a single double. If column to update
-	// contains an array, also makes an array out of update data by replicating
-	// it in each entry, then finally calls UpdateArrayBin
-	void UpdateBin(int binNum, BinUpdateType updateType,
-	 	vtkstd::string baseName, ColumnType columnType, double updateData,
-		vtkTable* output);
-	
-	// Description:
-	// If this bin contains an array, update with this method. size(updateData)
-	// should be equal to size(oldData)
-	void UpdateArrayBin(int binNum, BinUpdateType updateType,
-	 	vtkstd::string baseName, ColumnType columnType, double* updateData,
-		vtkAbstractArray* oldData, vtkTable* output);
+	// Reads the centers, radii and ids of the table of centers on process
+	// 0, and broadcasts them. Returns 1 if there are centers to profile
+	// about, 0 if there is no table of them and -1 if it lacks the columns.
+	int SetProfileCenters(vtkTable* centers);
 
 	// Description:
-	// If this bin contains an array, update with this method. size(updateData)
-	// should be equal to size(oldData). Identical to other UpdateArrayBin
-	// method except takes in two vtkAbstractArrays		
-	void UpdateArrayBin(int binNum, BinUpdateType updateType,
-	 	vtkstd::string baseName, ColumnType columnType,
-	 	vtkAbstractArray* updateData, vtkAbstractArray* oldData, 
-		vtkTable* output);
-		
-	// Description:
-	// If this bin contains a double, update with this method. 	
-	void UpdateDoubleBin(int binNum, BinUpdateType updateType,
-		vtkstd::string baseName, ColumnType columnType, double updateData,
-	 	double oldData, vtkTable* output);
-		
+	// The most components of any input array, and at least 3
+	int GetMaximumNumberOfComponents(vtkPointSet* input);
+
 	// Description:
-	// This function is useful for those data items who want to keep track of 
-	// a cumulative number. E.g. N(<=r), calls updateBin on all bins >= binNum
-	// updating the attribute specified
-	void UpdateCumulativeBins(int binNum, BinUpdateType 		
-		updateType, vtkstd::string baseName, ColumnType columnType,
-		double* dataToAdd, vtkTable* output);
+	// adds each of the points pointIds, as seen from center, to the
+	// accumulators at the offset of the same index in rowOffsets. Each
+	// additional quantity is added over all of them at once.
+	void AccumulatePoints(vtkPointSet* input,
+		const vtkstd::vector<vtkIdType>& pointIds,
+		const vtkstd::vector<vtkIdType>& rowOffsets, const double center[3],
+		double* accumulators);
 
 	// Description:
-	// This function is useful for those data items who want to keep track of 
-	// a cumulative number. E.g. N(<=r), calls updateBin on all bins >= binNum
-	// updating the attribute specified. Identical to the one above, but calls
-	// the double dataToAdd version of UpdatBin instead of the double*
-	void UpdateCumulativeBins(int binNum, BinUpdateType 		
-		updateType, vtkstd::string baseName, ColumnType columnType, 
-		double dataToAdd, vtkTable* output);
+	// As UpdateStatistics, for every center of the table of centers
+	void UpdateMultiCenterStatistics(vtkPointSet* input);
 
 	// Description:
-	// Based upon the additionalQuantityName, returns a double
-	// array representing the computation of this quantity. 
-	// Always outputs a 3-vector, for quantities such as number in bin
-	// which are scalars, result will be in the first position of the vector
-	// and equal to the norm of the vector.
-	// Currently all of these are calculated
-	// from v and from r, which are 3-vectors taken as inputs. Would have to be 
-	// rediefined to be more general if other quantities were desired.
-	double* CalculateAdditionalProfileQuantity(vtkstd::string
-		additionalQuantityName,double v[], double r[]);
+	// accumulates profiles, handed out one at a time, until none are left,
+	// on one thread
+	static VTK_THREAD_RETURN_TYPE ProfileThread(void* arg);
 	
 	// Description:
-   // After all points have updated the bin statistics, UpdateBinAverages
-	// must be called to do the proper averaging and/or postprocessing on 
-	// the accumlated columns.
+	// returns the bin number in which this point lies.
+	int GetBinNumber(double x[]);
+	
+	// Description:
+	// After all points have updated the accumulators, fills the output
+	// table: for each bin its radii, and for each input array the total,
+	// average and cumulative columns, and the column of each additional
+	// quantity, the postprocessed ones computed last from the others.
 	void BinAveragesAndPostprocessing(vtkPointSet* input, vtkTable* output);
 
 	// Description:
-	// merges tableToMerge into originalTable by adding each row,column in
-	// tableToMerge to the corresponding row,column in originalTable
-	void MergeTables(vtkPointSet* input, vtkTable* originalTable,
-		vtkTable* tableToMerge);
-	// Description:
-	// helper function for MergeTables, to merge two bins by addition, making
-	// the original table contain the updated result
-	void MergeBins(int binNum, BinUpdateType updateType,
-	 	vtkstd::string baseName, ColumnType columnType, vtkTable* originalTable,
-		vtkTable* tableToMerge);
+	// adds to the output a column of numComponents per row, whose values
+	// for row b are values[b*stride+offset,b*stride+offset+numComponents)
+	void SetColumn(vtkTable* output, vtkstd::string baseName,
+		ColumnType columnType, int numComponents,
+		const vtkstd::vector<double>& values, int offset, int stride);
 	// Description:
 	// given a base name, a variable index and a column type
 	// (TOTAL,AVERAGE,or CUMULATIVE) returns a string representing
 	// this data column's name
 	vtkstd::string GetColumnName(vtkstd::string baseName,ColumnType columnType);
-	// Description:
-	// Gets a column's data
-	vtkVariant GetData(int binNum, vtkstd::string baseName,
-		ColumnType columnType, vtkTable* output);
 
   virtual int FillInputPortInformation (int port, vtkInformation *info);
 private:
@@ -20,7 +20,10 @@
 #include "vtkSmartPointer.h"
 #include "vtkDataArraySelection.h"
 #include "vtkMultiProcessController.h"
+#include "vtkIdTypeArray.h"
+#include "AstroVizSubsample.h"
 #include <cmath>
+#include <sstream>
 #include <assert.h>
 #include <string>
 #include <vector>
@@ -90,6 +93,10 @@ vtkRamsesReader::vtkRamsesReader()
 {
 	srand((unsigned)time(0));
   this->FileName          = 0;
+  this->SubsampleFraction = 1.0;
+  this->SubsampleMode     = SUBSAMPLE_STRIDE;
+  this->PrefetchOn        = 1;
+  this->PreviousTimeStep  = 0;
   this->UpdatePiece       = 0;
   this->UpdateNumPieces   = 0;
   this->SetNumberOfInputPorts(0); 
@@ -118,15 +125,155 @@ vtkRamsesReader::vtkRamsesReader()
 vtkRamsesReader::~vtkRamsesReader()
 {
   this->SetFileName(0);
+  this->Prefetcher.Wait();
   this->PointDataArraySelection->Delete();
 }
 
+//----------------------------------------------------------------------------
+void vtkRamsesReader::AddFileName(const char* fileName)
+{
+	this->FileNames.push_back(fileName);
+	this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkRamsesReader::RemoveAllFileNames()
+{
+	this->FileNames.clear();
+	this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkRamsesReader::GetNumberOfFileNames()
+{
+	return this->FileNames.size();
+}
+
+//----------------------------------------------------------------------------
+int vtkRamsesReader::ReadTimeSteps()
+{
+	this->SeriesFileNames.clear();
+	this->TimeSteps.clear();
+	if(this->FileNames.empty())
+		{
+		return 1;
+		}
+	// only the info files are read
+	std::vector<double> aexp, time;
+	for(unsigned i=0; i < this->FileNames.size(); ++i)
+		{
+		try
+			{
+			RAMSES::snapshot rsnap(this->FileNames[i], RAMSES::version3);
+			aexp.push_back(rsnap.m_header.aexp);
+			time.push_back(rsnap.m_header.time);
+			}
+		catch(std::exception& e)
+			{
+			vtkErrorMacro("Error reading info file " << this->FileNames[i] 
+				<< ": " << e.what());
+			return 0;
+			}
+		}
+	// the expansion factor is the time of a cosmological run, in any other
+	// it stays 1 and the time is used instead
+	std::vector<double> distinct(aexp);
+	std::sort(distinct.begin(),distinct.end());
+	const bool cosmological = 		std::unique(distinct.begin(),distinct.end())==distinct.end();
+	std::vector<std::pair<double,std::string> > series;
+	for(unsigned i=0; i < this->FileNames.size(); ++i)
+		{
+		series.push_back(std::make_pair(cosmological ? aexp[i] : time[i],
+			this->FileNames[i]));
+		}
+	std::stable_sort(series.begin(),series.end());
+	for(unsigned i=0; i < series.size(); ++i)
+		{
+		this->TimeSteps.push_back(series[i].first);
+		this->SeriesFileNames.push_back(series[i].second);
+		}
+	return 1;
+}
+
+//----------------------------------------------------------------------------
+void vtkRamsesReader::WarmSnapshot(void* reader)
+{
+	WarmFiles(static_cast<vtkRamsesReader*>(reader)->WarmFileNames);
+}
+
+//----------------------------------------------------------------------------
+void vtkRamsesReader::FinishTimeStep(vtkPolyData* output, int step)
+{
+	if(this->SeriesFileNames.empty())
+		{
+		return;
+		}
+	output->GetInformation()->Set(vtkDataObject::DATA_TIME_STEPS(),
+		&this->TimeSteps[step],1);
+	const int next=NextTimeStep(this->TimeSteps.size(),step,
+		this->PreviousTimeStep);
+	this->PreviousTimeStep=step;
+	// the list of files is only changed while the thread is not running
+	if(!this->PrefetchOn || next < 0 || this->Prefetcher.IsRunning())
+		{
+		return;
+		}
+	const std::string& info=this->SeriesFileNames[next];
+	unsigned ncpu;
+	try
+		{
+		RAMSES::snapshot rsnap(info, RAMSES::version3);
+		ncpu=rsnap.m_header.ncpu;
+		}
+	catch(std::exception&)
+		{
+		return;
+		}
+	// the domains this process will read, split as mpi_distribute_domains
+	// does, whose files are named as the info file with the number of the
+	// domain appended
+	int rank=0, size=1;
+	if(this->Controller!=NULL)
+		{
+		rank=this->Controller->GetLocalProcessId();
+		size=this->Controller->GetNumberOfProcesses();
+		}
+	int npp=(int)((float)ncpu/size);
+	const int first=1+npp*rank;
+	if(rank==size-1)
+		{
+		npp=ncpu-(rank*npp);
+		}
+	const std::string::size_type ii=info.rfind("info");
+	const char* kinds[3] = { "amr", "hydro", "part" };
+	this->WarmFileNames.clear();
+	for(int k=0; k < 3; ++k)
+		{
+		if(std::string(kinds[k])=="part" && !this->HasParticleData)
+			{
+			continue;
+			}
+		for(int icpu=first; icpu < first+npp; ++icpu)
+			{
+			char ext[32];
+			sprintf(ext,".out%05d",icpu);
+			this->WarmFileNames.push_back(info.substr(0,ii)+kinds[k]+
+				info.substr(ii+4,6)+ext);
+			}
+		}
+	this->Prefetcher.Start(vtkRamsesReader::WarmSnapshot,this);
+}
+
 //----------------------------------------------------------------------------
 void vtkRamsesReader::PrintSelf(ostream& os, vtkIndent indent)
 {
   this->Superclass::PrintSelf(os,indent);
   os << indent << "FileName: "
-     << (this->FileName ? this->FileName : "(none)") << "\n";
+     << (this->FileName ? this->FileName : "(none)") << "\n"
+     << indent << "SubsampleFraction: " << this->SubsampleFraction << "\n"
+     << indent << "SubsampleMode: " << this->SubsampleMode << "\n"
+     << indent << "NumberOfFileNames: " << this->FileNames.size() << "\n"
+     << indent << "PrefetchOn: " << this->PrefetchOn << "\n";
 }
 
 		
@@ -230,6 +377,22 @@ int vtkRamsesReader::RequestInformation(
 	this->PointDataArraySelection->AddArray("Type");
   this->PointDataArraySelection->AddArray("Velocity");
 
+	if(!this->ReadTimeSteps())
+		{
+		return 0;
+		}
+	if(this->TimeSteps.empty())
+		{
+		outInfo->Remove(vtkStreamingDemandDrivenPipeline::TIME_STEPS());
+		outInfo->Remove(vtkStreamingDemandDrivenPipeline::TIME_RANGE());
+		}
+	else
+		{
+		outInfo->Set(vtkStreamingDemandDrivenPipeline::TIME_STEPS(),
+			&this->TimeSteps[0],this->TimeSteps.size());
+		double timeRange[2] = { this->TimeSteps.front(), this->TimeSteps.back() };
+		outInfo->Set(vtkStreamingDemandDrivenPipeline::TIME_RANGE(),timeRange,2);
+		}
 	return 1;
 }
 /*
@@ -252,7 +415,7 @@ int vtkRamsesReader::RequestData(vtkInformation*,
   //
 	// Make sure we have a file to read.
   //
-  if(!this->FileName)
+  if(!this->FileName && this->SeriesFileNames.empty())
 	  {
     vtkErrorMacro("A FileName must be specified.");
     return 0;
@@ -267,8 +430,45 @@ int vtkRamsesReader::RequestData(vtkInformation*,
   this->UpdatePiece = outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_PIECE_NUMBER());
 	this->UpdateNumPieces =outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_NUMBER_OF_PIECES());
 
+  // get the output polydata
+  vtkPolyData *output = \
+      vtkPolyData::SafeDownCast(outInfo->Get(vtkDataObject::DATA_OBJECT()));
+
+	// A series is read at the time step requested
+	int step = 0;
+	std::string filename;
+	if(this->SeriesFileNames.empty())
+		{
+		filename = this->FileName;
+		}
+	else
+		{
+		if(outInfo->Has(vtkStreamingDemandDrivenPipeline::UPDATE_TIME_STEPS()))
+			{
+			const double* requested = outInfo->Get(
+				vtkStreamingDemandDrivenPipeline::UPDATE_TIME_STEPS());
+			step = FindTimeStep(this->TimeSteps,requested[0]);
+			}
+		filename = this->SeriesFileNames[step];
+		}
+
+	// A lowered subsample fraction is served from the previous read. Every
+	// process has the same cache state, so all skip the collectives below.
+	std::ostringstream cacheKey;
+	cacheKey << filename << '\n' << this->HasParticleData << ' '
+		<< this->ParticleMassGuess << ' ' << this->SubsampleMode << ' '
+		<< this->UpdatePiece << ' ' << this->UpdateNumPieces << ' '
+		<< this->PointDataArraySelection->GetMTime();
+	if(this->SubsampleFraction<1.0 && this->Cache.Extract(cacheKey.str(),
+		this->SubsampleFraction,this->SubsampleMode,output))
+		{
+		this->FinishTimeStep(output,step);
+		return 1;
+		}
+	const double fraction=this->SubsampleFraction;
+	const int mode=this->SubsampleMode;
+
 	//  Open the snapshot info file
-	std::string filename(this->FileName);
 	RAMSES::snapshot rsnap(filename , RAMSES::version3);    
 	vtkDebugMacro("simulation has " << rsnap.m_header.ncpu << " domains");
 
@@ -276,9 +476,6 @@ int vtkRamsesReader::RequestData(vtkInformation*,
   
   
 
-  // get the output polydata
-  vtkPolyData *output = \
-      vtkPolyData::SafeDownCast(outInfo->Get(vtkDataObject::DATA_OBJECT()));
   vtkSmartPointer<vtkPolyData> RamsesReadInitialOutput = \
       vtkSmartPointer<vtkPolyData>::New();  
 	int mympirank=vtkMultiProcessController::GetGlobalController()->GetLocalProcessId();
@@ -455,17 +652,23 @@ int vtkRamsesReader::RequestData(vtkInformation*,
     for(unsigned i=0; i<mydomains.size(); ++i) 
       {
         double data;
-        // particle id
+        // particle id, which decides if the particle is in the subsample.
+        // The file is still read whole, but only the subsample is kept.
         pdataint.get_var("particle_ID");
+        std::vector<char> keep(pdataint.size(i));
         for(unsigned ip=0; ip < pdataint.size(i); ++ip)
         {
           int dataint = pdataint(i,ip);
+          keep[ip] = InSubsample(dataint < 0 ? -dataint : dataint,
+            fraction,mode);
+          if(!keep[ip]) continue;
           ids.push_back(dataint);        
         }
         // pos x
         pdata.get_var("position_x");
         for(unsigned ip=0; ip < pdata.size(i); ++ip)
         {
+          if(!keep[ip]) continue;
           data = pdata(i,ip);          
           x.push_back(data);
         }
@@ -474,6 +677,7 @@ int vtkRamsesReader::RequestData(vtkInformation*,
         pdata.get_var("position_y");
         for(unsigned ip=0; ip < pdata.size(i); ++ip)
         {
+          if(!keep[ip]) continue;
           data = pdata(i,ip);
           y.push_back(data);
         }
@@ -482,6 +686,7 @@ int vtkRamsesReader::RequestData(vtkInformation*,
         pdata.get_var("position_z");
         for(unsigned ip=0; ip < pdata.size(i); ++ip)
         {
+          if(!keep[ip]) continue;
           data = pdata(i,ip); 
           z.push_back(data);
         }
@@ -491,6 +696,7 @@ int vtkRamsesReader::RequestData(vtkInformation*,
         pdata.get_var("velocity_x");
         for(unsigned ip=0; ip < pdata.size(i); ++ip)
         {
+          if(!keep[ip]) continue;
           data = pdata(i,ip); 
           vx.push_back(data);
         }
@@ -500,6 +706,7 @@ int vtkRamsesReader::RequestData(vtkInformation*,
         pdata.get_var("velocity_y");
         for(unsigned ip=0; ip < pdata.size(i); ++ip)
         {
+          if(!keep[ip]) continue;
           data = pdata(i,ip); 
           vy.push_back(data);
         }
@@ -508,6 +715,7 @@ int vtkRamsesReader::RequestData(vtkInformation*,
         pdata.get_var("velocity_z");
         for(unsigned ip=0; ip < pdata.size(i); ++ip)
         {
+          if(!keep[ip]) continue;
           data = pdata(i,ip); 
           vz.push_back(data);
         }
@@ -516,6 +724,7 @@ int vtkRamsesReader::RequestData(vtkInformation*,
         pdata.get_var("mass");
         for(unsigned ip=0; ip < pdata.size(i); ++ip)
         {
+          if(!keep[ip]) continue;
           data = pdata(i,ip); 
           mass.push_back(data);
         }
@@ -524,12 +733,14 @@ int vtkRamsesReader::RequestData(vtkInformation*,
           pdata.get_var("age");
           for(unsigned ip=0; ip < pdata.size(i); ++ip)
           {
+            if(!keep[ip]) continue;
             data = pdata(i,ip); 
             age.push_back(data);
           }
           pdata.get_var("metallicity");
           for(unsigned ip=0; ip < pdata.size(i); ++ip)
           {
+            if(!keep[ip]) continue;
             data = pdata(i,ip); 
             metals.push_back(data);
           }
@@ -703,6 +914,7 @@ int vtkRamsesReader::RequestData(vtkInformation*,
 			double g_x,g_y,g_z=0;
 			for(unsigned i=0; i < number_local_particles; i++) {
 				gas_id+=1;				
+				if(!InSubsample(gas_id,fraction,mode)) continue;
 				g_x=dRandInRange(pos.x-dx,pos.x+dx);
 				g_y=dRandInRange(pos.y-dx,pos.y+dx);
 				g_z=dRandInRange(pos.z-dx,pos.z+dx);
@@ -755,6 +967,7 @@ int vtkRamsesReader::RequestData(vtkInformation*,
     
     for(unsigned i=0; i < leftover_particles_thisproc; i++) {
 			gas_id+=1;
+			if(!InSubsample(gas_id,fraction,mode)) continue;
 			g_x=dRandInRange(0,1);
 			g_y=dRandInRange(0,1);
 			g_z=dRandInRange(0,1);
@@ -815,7 +1028,8 @@ int vtkRamsesReader::RequestData(vtkInformation*,
 		// all particle types have this
 		this->Positions->SetPoint(i, pos);
 		if (this->Velocity)  this->Velocity->SetTuple(i, vel);
-		if (this->Mass)      this->Mass->SetTuple1(i, mass[i]);
+		// a subsample carries the mass of all the particles it stands for
+		if (this->Mass)      this->Mass->SetTuple1(i, mass[i]/fraction);
 		if (this->Type)      this->Type->SetTuple1(i, type[i]);
 
 		//
@@ -834,6 +1048,15 @@ int vtkRamsesReader::RequestData(vtkInformation*,
 	}
 	
 	
+	// Remember the subsample in case the fraction is lowered
+	vtkSmartPointer<vtkIdTypeArray> subsampleIds = \
+		vtkSmartPointer<vtkIdTypeArray>::New();
+	subsampleIds->SetNumberOfTuples(ids.size());
+	for(unsigned i=0;i< ids.size();i++) {
+		subsampleIds->SetValue(i, ids[i] < 0 ? -ids[i] : ids[i]);
+	}
+	this->Cache.Store(cacheKey.str(),fraction,output,subsampleIds);
+
 	// Done, vis o'clock
 	// can free memory allocated in vectors above
 	
@@ -849,7 +1072,7 @@ int vtkRamsesReader::RequestData(vtkInformation*,
 	metals.clear();
 	type.clear();
 	
-  vtkDebugMacro("Reading all points from file " << this->FileName);
+  vtkDebugMacro("Reading all points from file " << filename);
     // Read Successfully
   vtkDebugMacro("Read " << output->GetPoints()->GetNumberOfPoints() \
 		<< " points.");
@@ -869,6 +1092,7 @@ int vtkRamsesReader::RequestData(vtkInformation*,
 	this->Type        = NULL;
   this->Velocity    = NULL;
   //
+	this->FinishTimeStep(output,step);
  	return 1;
 }
 //----------------------------------------------------------------------------
@@ -15,6 +15,11 @@
 // Read points from a Ramses standard binary file. Fully parallel. Has ability
 // to read in additional attributes from an ascii file, and to only load in
 // marked particles but both these functions are serial only.
+// Given a series of info files (AddFileName) the reader reports their
+// expansion factors as time steps. While a snapshot is shown, the files
+// of the next one are read through on a background thread so that they
+// are in the page cache when it is read; the read itself needs every
+// process and so cannot be done in the background.
 #ifndef __vtkRamsesReader_h
 #define __vtkRamsesReader_h
 
@@ -22,7 +27,10 @@
 
 #include "vtkSmartPointer.h"
 #include "tipsylib/ftipsy.hpp" // functions take Ramses particle objects
+#include "AstroVizSubsample.h" // level of detail subsampling
+#include "AstroVizPrefetch.h" // background warming of the next snapshot
 #include <vtkstd/vector>
+#include <vtkstd/string>
 
 class vtkPolyData;
 class vtkCharArray;
@@ -44,6 +52,20 @@ public:
  	vtkGetStringMacro(FileName);
 
 	
+  // Description:
+  // Add/remove the info files of a series of snapshots. If any are given
+  // they are read instead of FileName, the one shown chosen by time.
+	void AddFileName(const char* fileName);
+	void RemoveAllFileNames();
+	int GetNumberOfFileNames();
+
+  // Description:
+  // Get/Set whether to read the files of the next snapshot of a series
+  // through in the background, to have them in the page cache.
+	vtkSetMacro(PrefetchOn,int);
+	vtkGetMacro(PrefetchOn,int);
+	vtkBooleanMacro(PrefetchOn,int);
+
 	// Description:
   // Set/Get the optional particle mass guess 
 	vtkSetMacro(ParticleMassGuess,double);
@@ -54,6 +76,18 @@ public:
   // Set/Get the optional particle mass guess 
 	vtkSetMacro(HasParticleData,bool);
  	vtkGetMacro(HasParticleData,bool);
+
+  // Description:
+  // Get/Set the fraction of the particles to keep, for a quick preview.
+  // Mass is divided by the fraction so totals are preserved, and lowering
+  // the fraction is served from the previous read.
+	vtkSetClampMacro(SubsampleFraction,double,1e-6,1.0);
+	vtkGetMacro(SubsampleFraction,double);
+
+  // Description:
+  // Get/Set how the subsample is chosen (see AstroVizSubsample.h)
+	vtkSetClampMacro(SubsampleMode,int,SUBSAMPLE_STRIDE,SUBSAMPLE_RANDOM);
+	vtkGetMacro(SubsampleMode,int);
 	
 	// Description:
   // An H5Part file may contain multiple arrays
@@ -88,6 +122,21 @@ protected:
 	char* FileName;
 	double ParticleMassGuess;
 	bool HasParticleData;
+	double SubsampleFraction;
+	int SubsampleMode;
+	SubsampleCache Cache;
+	int PrefetchOn;
+	// Description:
+	// the info files of the series as given, then sorted by time with the
+	// times in TimeSteps
+	vtkstd::vector<vtkstd::string> FileNames;
+	vtkstd::vector<vtkstd::string> SeriesFileNames;
+	vtkstd::vector<double> TimeSteps;
+	int PreviousTimeStep;
+	// Description:
+	// the thread warming the page cache and the files it reads
+	BackgroundTask Prefetcher;
+	vtkstd::vector<vtkstd::string> WarmFileNames;
 	int RequestInformation(vtkInformation*,	vtkInformationVector**,
 		vtkInformationVector*);
 
@@ -124,6 +173,16 @@ protected:
 private:
   vtkRamsesReader(const vtkRamsesReader&);  // Not implemented.
   void operator=(const vtkRamsesReader&);  // Not implemented.
+	// Description:
+	// Reads the times of the info files of the series and sorts them.
+	int ReadTimeSteps();
+	// Description:
+	// Marks output with the time of the step shown, and starts reading the
+	// files of the next step into the page cache.
+	void FinishTimeStep(vtkPolyData* output, int step);
+	// Description:
+	// Body of the background thread, reads through WarmFileNames.
+	static void WarmSnapshot(void* reader);
 	/* Helper functions for storing data in output vector*/
 	// Description:
 	// allocates all vtk arrays for Tipsy variables and places them 
@@ -0,0 +1,561 @@
+/*=========================================================================
+
+  Program:   AstroViz plugin for ParaView
+  Module:    $RCSfile: vtkSubhaloFinder.cxx,v $
+=========================================================================*/
+#include "vtkSubhaloFinder.h"
+#include "AstroVizHelpersLib/AstroVizHelpers.h"
+#include "AstroVizHelpersLib/AstroVizHaloCatalogue.h"
+#include "AstroVizHelpersLib/AstroVizKdTree.h"
+#include "AstroVizHelpersLib/AstroVizUnionFind.h"
+#include "vtkIdTypeArray.h"
+#include "vtkInformation.h"
+#include "vtkInformationVector.h"
+#include "vtkObjectFactory.h"
+#include "vtkPointData.h"
+#include "vtkPointSet.h"
+#include "vtkPoints.h"
+#include "vtkDataArray.h"
+#include "vtkMultiProcessController.h"
+#include "vtkMultiThreader.h"
+#include "vtkMutexLock.h"
+#include "vtkTable.h"
+#include <vtkstd/vector>
+#include <vtkstd/deque>
+#include <vtkstd/algorithm>
+#include <vtkstd/utility>
+
+vtkCxxRevisionMacro(vtkSubhaloFinder, "$Revision: 1.0 $");
+vtkStandardNewMacro(vtkSubhaloFinder);
+vtkCxxSetObjectMacro(vtkSubhaloFinder,Controller,
+	vtkMultiProcessController);
+
+//----------------------------------------------------------------------------
+vtkSubhaloFinder::vtkSubhaloFinder()
+{
+	// the halo ids of vtkFriendsOfFriendsHaloFinder
+	this->SetInputArrayToProcess(
+    0,
+    0,
+    0,
+    vtkDataObject::FIELD_ASSOCIATION_POINTS,
+    "halo ID");
+	// the unique ids, required in parallel
+	this->SetInputArrayToProcess(
+    1,
+    0,
+    0,
+    vtkDataObject::FIELD_ASSOCIATION_POINTS_THEN_CELLS,
+    vtkDataSetAttributes::SCALARS);
+  this->LinkingLength = 0.2; //default
+	this->MinimumNumberOfParticles = 20; // default
+	this->NumberOfThreads = 0; // one per core
+	// the particles, and the catalogue of subhaloes
+	this->SetNumberOfOutputPorts(2);
+	this->Controller = NULL;
+	this->SetController(vtkMultiProcessController::GetGlobalController());
+}
+
+//----------------------------------------------------------------------------
+vtkSubhaloFinder::~vtkSubhaloFinder()
+{
+	this->SetController(NULL);
+}
+
+//----------------------------------------------------------------------------
+void vtkSubhaloFinder::PrintSelf(ostream& os, vtkIndent indent)
+{
+  this->Superclass::PrintSelf(os,indent);
+  os << indent << "Linking Length: " << this->LinkingLength << "\n";
+  os << indent << "Minimum Number Of Particles: "
+		<< this->MinimumNumberOfParticles << "\n";
+  os << indent << "Number Of Threads: " << this->NumberOfThreads << "\n";
+}
+
+//----------------------------------------------------------------------------
+int vtkSubhaloFinder::FillInputPortInformation(int,
+  vtkInformation* info)
+{
+  info->Set(vtkAlgorithm::INPUT_REQUIRED_DATA_TYPE(), "vtkPointSet");
+  return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkSubhaloFinder::FillOutputPortInformation(int port,
+	vtkInformation* info)
+{
+	if(port==1)
+		{
+		info->Set(vtkDataObject::DATA_TYPE_NAME(), "vtkTable");
+		return 1;
+		}
+	return this->Superclass::FillOutputPortInformation(port,info);
+}
+
+//----------------------------------------------------------------------------
+int vtkSubhaloFinder::RequestDataObject(vtkInformation*,
+	vtkInformationVector** inputVector, vtkInformationVector* outputVector)
+{
+	// as vtkFriendsOfFriendsHaloFinder: the particles are of the type of the
+	// input, the catalogue a table
+	vtkPointSet* input = vtkPointSet::GetData(inputVector[0]);
+	if(!input)
+		{
+		return 0;
+		}
+	vtkInformation* info = outputVector->GetInformationObject(0);
+	vtkPointSet* output = vtkPointSet::SafeDownCast(
+		info->Get(vtkDataObject::DATA_OBJECT()));
+	if(!output || !output->IsA(input->GetClassName()))
+		{
+		vtkDataObject* newOutput = input->NewInstance();
+		newOutput->SetPipelineInformation(info);
+		newOutput->Delete();
+		this->GetOutputPortInformation(0)->Set(
+			vtkDataObject::DATA_EXTENT_TYPE(), newOutput->GetExtentType());
+		}
+	info = outputVector->GetInformationObject(1);
+	if(!vtkTable::SafeDownCast(info->Get(vtkDataObject::DATA_OBJECT())))
+		{
+		vtkTable* catalogue = vtkTable::New();
+		catalogue->SetPipelineInformation(info);
+		catalogue->Delete();
+		this->GetOutputPortInformation(1)->Set(
+			vtkDataObject::DATA_EXTENT_TYPE(), catalogue->GetExtentType());
+		}
+	return 1;
+}
+
+//----------------------------------------------------------------------------
+// The haloes dealt to one thread, largest first; the thread takes from the
+// front, others that have run out from the back
+struct vtkSubhaloFinderQueue
+{
+	vtkstd::deque<vtkIdType> Haloes;
+	vtkMutexLock* Lock;
+};
+
+//----------------------------------------------------------------------------
+// A halo being searched: its particles, their scaled positions and
+// velocities, the tree over those positions and the groups linked so far
+struct vtkSubhaloFinderHalo
+{
+	const vtkIdType* Members;
+	vtkIdType NumberOfMembers;
+	vtkstd::vector<double> X;
+	vtkstd::vector<double> V;
+	KdTree Tree;
+	UnionFind Groups;
+};
+
+//----------------------------------------------------------------------------
+// What the threads searching haloes share. The particles of halo h are
+// Members[Offsets[h],Offsets[h+1]), in increasing order of id.
+struct vtkSubhaloFinderTask
+{
+	const double* Positions;
+	const double* Velocities;
+	const vtkIdType* Members;
+	const vtkIdType* Offsets;
+	double LinkingLength;
+	int MinimumNumberOfParticles;
+	vtkSubhaloFinderQueue* Queues;
+	int NumberOfQueues;
+	// for each particle, the id of the first particle of its subhalo, or -1
+	vtkIdType* First;
+	// a halo too large for one thread, whose particles, in tree order, are
+	// handed out in blocks to all of them
+	vtkSubhaloFinderHalo* LargeHalo;
+	vtkIdType PointsPerBlock;
+	vtkIdType NextPoint;
+	vtkMutexLock* Lock;
+};
+
+//----------------------------------------------------------------------------
+// Scales the positions and velocities of the particles of a halo by the
+// halo's dispersion in each, and builds the tree over the positions.
+// Returns false if the halo is too small to hold a subhalo.
+static bool PrepareHalo(vtkSubhaloFinderTask* task,vtkIdType halo,
+	vtkSubhaloFinderHalo& search)
+{
+	const vtkIdType* members=task->Members+task->Offsets[halo];
+	const vtkIdType numMembers=task->Offsets[halo+1]-task->Offsets[halo];
+	search.Members=members;
+	search.NumberOfMembers=numMembers;
+	if(numMembers < task->MinimumNumberOfParticles)
+		{
+		return false;
+		}
+	double meanX[3]={0.0,0.0,0.0};
+	double meanV[3]={0.0,0.0,0.0};
+	for(vtkIdType i = 0; i < numMembers; ++i)
+		{
+		for(int d = 0; d < 3; ++d)
+			{
+			meanX[d]+=task->Positions[3*members[i]+d]/numMembers;
+			meanV[d]+=task->Velocities[3*members[i]+d]/numMembers;
+			}
+		}
+	double dispersionX2=0.0;
+	double dispersionV2=0.0;
+	for(vtkIdType i = 0; i < numMembers; ++i)
+		{
+		for(int d = 0; d < 3; ++d)
+			{
+			const double dx=task->Positions[3*members[i]+d]-meanX[d];
+			const double dv=task->Velocities[3*members[i]+d]-meanV[d];
+			dispersionX2+=dx*dx/numMembers;
+			dispersionV2+=dv*dv/numMembers;
+			}
+		}
+	const double scaleX=(dispersionX2 > 0) ? 1.0/sqrt(dispersionX2) : 1.0;
+	const double scaleV=(dispersionV2 > 0) ? 1.0/sqrt(dispersionV2) : 1.0;
+	vtkstd::vector<double>& x=search.X;
+	vtkstd::vector<double>& v=search.V;
+	x.resize(3*numMembers);
+	v.resize(3*numMembers);
+	for(vtkIdType i = 0; i < numMembers; ++i)
+		{
+		for(int d = 0; d < 3; ++d)
+			{
+			x[3*i+d]=(task->Positions[3*members[i]+d]-meanX[d])*scaleX;
+			v[3*i+d]=(task->Velocities[3*members[i]+d]-meanV[d])*scaleV;
+			}
+		}
+	// particles within the linking length in phase space are within it in
+	// position, so the tree over the positions gives the candidates
+	search.Tree.Build(&x[0],numMembers);
+	search.Groups.Initialize(numMembers);
+	return true;
+}
+
+//----------------------------------------------------------------------------
+// Links the particles [first,last) of a halo, in tree order, to those
+// within the linking length of them in phase space. Blocks of one halo may
+// be linked by many threads at once.
+static void LinkHalo(vtkSubhaloFinderTask* task,vtkSubhaloFinderHalo& search,
+	vtkIdType first,vtkIdType last,vtkstd::vector<vtkIdType>& friends)
+{
+	const double* x=&search.X[0];
+	const double* v=&search.V[0];
+	const double linkingLength2=task->LinkingLength*task->LinkingLength;
+	const vtkIdType* order=search.Tree.GetOrder();
+	for(vtkIdType n = first; n < last; ++n)
+		{
+		const vtkIdType i=order[n];
+		search.Tree.FindPointsWithinRadius(&x[3*i],task->LinkingLength,friends);
+		for(vtkstd::vector<vtkIdType>::size_type k = 0; k < friends.size(); ++k)
+			{
+			const vtkIdType j=friends[k];
+			if(j <= i)
+				{
+				continue;
+				}
+			double distance2=0.0;
+			for(int d = 0; d < 3; ++d)
+				{
+				distance2+=(x[3*i+d]-x[3*j+d])*(x[3*i+d]-x[3*j+d])+
+					(v[3*i+d]-v[3*j+d])*(v[3*i+d]-v[3*j+d]);
+				}
+			if(distance2 <= linkingLength2)
+				{
+				search.Groups.Union(i,j);
+				}
+			}
+		}
+}
+
+//----------------------------------------------------------------------------
+// Marks the groups of a linked halo large enough to be subhaloes
+static void LabelHalo(vtkSubhaloFinderTask* task,vtkSubhaloFinderHalo& search)
+{
+	const vtkIdType* members=search.Members;
+	const vtkIdType numMembers=search.NumberOfMembers;
+	// a group's root is its lowest index, so its member of lowest id
+	vtkstd::vector<vtkIdType> count(numMembers,0);
+	for(vtkIdType i = 0; i < numMembers; ++i)
+		{
+		count[search.Groups.Find(i)]+=1;
+		}
+	for(vtkIdType i = 0; i < numMembers; ++i)
+		{
+		const vtkIdType root=search.Groups.Find(i);
+		task->First[members[i]]=(count[root] >= task->MinimumNumberOfParticles) ?
+			members[root] : -1;
+		}
+}
+
+//----------------------------------------------------------------------------
+// Searches a halo on the calling thread alone
+static void SearchHalo(vtkSubhaloFinderTask* task,vtkIdType halo)
+{
+	vtkSubhaloFinderHalo search;
+	if(!PrepareHalo(task,halo,search))
+		{
+		return;
+		}
+	vtkstd::vector<vtkIdType> friends;
+	LinkHalo(task,search,0,search.NumberOfMembers,friends);
+	LabelHalo(task,search);
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkSubhaloFinder::LinkThread(void* arg)
+{
+	vtkSubhaloFinderTask* task=static_cast<vtkSubhaloFinderTask*>(
+		static_cast<vtkMultiThreader::ThreadInfo*>(arg)->UserData);
+	vtkSubhaloFinderHalo& search=*task->LargeHalo;
+	// the friends of the current particle, reused for every particle
+	vtkstd::vector<vtkIdType> friends;
+	for(;;)
+		{
+		task->Lock->Lock();
+		const vtkIdType first=task->NextPoint;
+		task->NextPoint=vtkstd::min(search.NumberOfMembers,
+			first+task->PointsPerBlock);
+		const vtkIdType last=task->NextPoint;
+		task->Lock->Unlock();
+		if(first >= last)
+			{
+			break;
+			}
+		LinkHalo(task,search,first,last,friends);
+		}
+	return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+VTK_THREAD_RETURN_TYPE vtkSubhaloFinder::SearchThread(void* arg)
+{
+	vtkMultiThreader::ThreadInfo* info=
+		static_cast<vtkMultiThreader::ThreadInfo*>(arg);
+	vtkSubhaloFinderTask* task=static_cast<vtkSubhaloFinderTask*>(
+		info->UserData);
+	for(;;)
+		{
+		// the largest halo left of this thread's own, or else the smallest
+		// left of the next thread's that has any
+		vtkIdType halo=-1;
+		for(int n = 0; n < task->NumberOfQueues && halo < 0; ++n)
+			{
+			vtkSubhaloFinderQueue& queue=
+				task->Queues[(info->ThreadID+n)%task->NumberOfQueues];
+			queue.Lock->Lock();
+			if(!queue.Haloes.empty())
+				{
+				if(n==0)
+					{
+					halo=queue.Haloes.front();
+					queue.Haloes.pop_front();
+					}
+				else
+					{
+					halo=queue.Haloes.back();
+					queue.Haloes.pop_back();
+					}
+				}
+			queue.Lock->Unlock();
+			}
+		if(halo < 0)
+			{
+			break;
+			}
+		SearchHalo(task,halo);
+		}
+	return VTK_THREAD_RETURN_VALUE;
+}
+
+//----------------------------------------------------------------------------
+// Orders haloes by decreasing number of particles
+struct vtkSubhaloFinderLarger
+{
+	vtkSubhaloFinderLarger(const vtkIdType* offsets) : Offsets(offsets) {}
+	bool operator()(vtkIdType a,vtkIdType b) const
+		{
+		return this->Offsets[a+1]-this->Offsets[a] >
+			this->Offsets[b+1]-this->Offsets[b];
+		}
+	const vtkIdType* Offsets;
+};
+
+//----------------------------------------------------------------------------
+int vtkSubhaloFinder::RequestData(vtkInformation*,
+	vtkInformationVector** inputVector,
+  vtkInformationVector* outputVector)
+{
+	// Outline of this filter:
+	// 1. Gather the particles of each halo
+	// 2. Search the haloes in phase space
+	// 		o scale positions and velocities by the halo's dispersions
+	// 		o link particles within the linking length in phase space
+	// 		haloes too large for one thread one at a time, linked in blocks
+	// 		by all the threads; the rest dealt, largest first, to a queue per
+	// 		thread, each thread searching its own, then taking from the others
+	// 3. Label the particles of groups of the minimum particle count by the
+	// 		unique id of their first particle, summing over them for the
+	// 		catalogue on the second output
+	vtkPointSet* input = vtkPointSet::GetData(inputVector[0]);
+	vtkPointSet* output = vtkPointSet::GetData(outputVector);
+	output->ShallowCopy(input);
+	vtkDataArray* haloIdArray = this->GetInputArrayToProcess(0, inputVector);
+	if(!haloIdArray)
+		{
+		vtkErrorMacro("Failed to locate the halo ID array; generate it with the Friends-Of-Friends Halo Finder.");
+		return 0;
+		}
+	vtkDataArray* velocityArray =
+		output->GetPointData()->GetArray("velocity");
+	if(!velocityArray || velocityArray->GetNumberOfComponents()!=3)
+		{
+		vtkErrorMacro("Failed to locate a velocity array, which is required to search haloes in phase space.");
+		return 0;
+		}
+	vtkIdTypeArray* globalIdArray = NULL;
+	const bool parallel = RunInParallel(this->Controller);
+	if(parallel)
+		{
+		globalIdArray = vtkIdTypeArray::SafeDownCast(
+			this->GetInputArrayToProcess(1, inputVector));
+		if(!globalIdArray)
+			{
+			vtkErrorMacro("Failed to locate global ID array, this is required if running in parallel. Generate by using Tipsy Reader to read in data, by running D3 with ghost cell generation, or by loading in with the original data in your preferred reader.");
+			return 0;
+			}
+		}
+	const vtkIdType numPoints=output->GetNumberOfPoints();
+	// 1. the particles of each halo, sorted by halo and then by id
+	vtkstd::vector<double> positions(3*numPoints);
+	vtkstd::vector<double> velocities(3*numPoints);
+	vtkstd::vector<vtkstd::pair<vtkIdType,vtkIdType> > byHalo;
+	for(vtkIdType id = 0; id < numPoints; ++id)
+		{
+		output->GetPoint(id,&positions[3*id]);
+		velocityArray->GetTuple(id,&velocities[3*id]);
+		const vtkIdType haloId=vtkIdType(haloIdArray->GetComponent(id,0));
+		if(haloId!=0)
+			{
+			byHalo.push_back(vtkstd::make_pair(haloId,id));
+			}
+		}
+	vtkstd::sort(byHalo.begin(),byHalo.end());
+	vtkstd::vector<vtkIdType> members(byHalo.size());
+	vtkstd::vector<vtkIdType> offsets(1,0);
+	for(vtkstd::vector<vtkIdType>::size_type i = 0; i < byHalo.size(); ++i)
+		{
+		if(i > 0 && byHalo[i].first!=byHalo[i-1].first)
+			{
+			offsets.push_back(i);
+			}
+		members[i]=byHalo[i].second;
+		}
+	if(!byHalo.empty())
+		{
+		offsets.push_back(byHalo.size());
+		}
+	const vtkIdType numHaloes=offsets.size()-1;
+	// 2. searching the haloes, on many threads
+	int numThreads=this->NumberOfThreads > 0 ? this->NumberOfThreads :
+		vtkMultiThreader::GetGlobalDefaultNumberOfThreads();
+	numThreads=vtkstd::max(1,numThreads);
+	vtkstd::vector<vtkIdType> haloes(numHaloes);
+	for(vtkIdType h = 0; h < numHaloes; ++h)
+		{
+		haloes[h]=h;
+		}
+	vtkstd::sort(haloes.begin(),haloes.end(),
+		vtkSubhaloFinderLarger(&offsets[0]));
+	// haloes of more than a fair share of a thread's particles would leave
+	// the others waiting, so are split among them; the sizes of haloes
+	// follow a power law, so these are few
+	const vtkIdType pointsPerBlock=4096;
+	const vtkIdType largeHaloSize=vtkstd::max(2*pointsPerBlock,
+		vtkIdType(members.size())/(4*numThreads));
+	vtkIdType numLargeHaloes=0;
+	while(numThreads > 1 && numLargeHaloes < numHaloes && 
+		offsets[haloes[numLargeHaloes]+1]-offsets[haloes[numLargeHaloes]] > 
+		largeHaloSize)
+		{
+		++numLargeHaloes;
+		}
+	vtkstd::vector<vtkSubhaloFinderQueue> queues(numThreads);
+	for(int t = 0; t < numThreads; ++t)
+		{
+		queues[t].Lock=vtkMutexLock::New();
+		}
+	for(vtkIdType h = numLargeHaloes; h < numHaloes; ++h)
+		{
+		queues[(h-numLargeHaloes)%numThreads].Haloes.push_back(haloes[h]);
+		}
+	vtkstd::vector<vtkIdType> first(numPoints,-1);
+	vtkSubhaloFinderTask task;
+	task.Positions=positions.empty() ? NULL : &positions[0];
+	task.Velocities=velocities.empty() ? NULL : &velocities[0];
+	task.Members=members.empty() ? NULL : &members[0];
+	task.Offsets=&offsets[0];
+	task.LinkingLength=this->LinkingLength;
+	task.MinimumNumberOfParticles=vtkstd::max(this->MinimumNumberOfParticles,1);
+	task.Queues=&queues[0];
+	task.NumberOfQueues=numThreads;
+	task.First=first.empty() ? NULL : &first[0];
+	task.PointsPerBlock=pointsPerBlock;
+	task.Lock=vtkMutexLock::New();
+	vtkMultiThreader* threader=vtkMultiThreader::New();
+	threader->SetNumberOfThreads(numThreads);
+	for(vtkIdType h = 0; h < numLargeHaloes; ++h)
+		{
+		vtkSubhaloFinderHalo search;
+		if(!PrepareHalo(&task,haloes[h],search))
+			{
+			continue;
+			}
+		task.LargeHalo=&search;
+		task.NextPoint=0;
+		threader->SetSingleMethod(vtkSubhaloFinder::LinkThread,&task);
+		threader->SingleMethodExecute();
+		LabelHalo(&task,search);
+		}
+	task.LargeHalo=NULL;
+	threader->SetSingleMethod(vtkSubhaloFinder::SearchThread,&task);
+	threader->SingleMethodExecute();
+	threader->Delete();
+	task.Lock->Delete();
+	for(int t = 0; t < numThreads; ++t)
+		{
+		queues[t].Lock->Delete();
+		}
+	// 3. labelling the particles of subhaloes, and summing over them; the
+	// first particle of a subhalo comes before its others
+	vtkIdTypeArray* subhaloIdArray = vtkIdTypeArray::New();
+	subhaloIdArray->SetNumberOfComponents(1);
+	subhaloIdArray->SetNumberOfTuples(numPoints);
+	subhaloIdArray->SetName("subhalo ID");
+	vtkDataArray* massArray=output->GetPointData()->GetArray("mass");
+	vtkDataArray* potentialArray=output->GetPointData()->GetArray("potential");
+	HaloCatalogue sums;
+	sums.HasHosts=true;
+	vtkstd::vector<vtkIdType> particleRow(numPoints,-1);
+	for(vtkIdType id = 0; id < numPoints; ++id)
+		{
+		if(first[id] < 0)
+			{
+			subhaloIdArray->SetValue(id,0);
+			continue;
+			}
+		const vtkIdType subhaloId=parallel ?
+			globalIdArray->GetValue(first[id])+1 : first[id]+1;
+		subhaloIdArray->SetValue(id,subhaloId);
+		particleRow[id]=(first[id]==id) ?
+			sums.AddHalo(subhaloId,vtkIdType(haloIdArray->GetComponent(id,0))) :
+			particleRow[first[id]];
+		sums.AddParticle(particleRow[id],&positions[3*id],
+			massArray ? massArray->GetComponent(id,0) : 1.0,&velocities[3*id],
+			potentialArray ? potentialArray->GetComponent(id,0) : VTK_DOUBLE_MAX,
+			parallel ? globalIdArray->GetValue(id) : id);
+		}
+	sums.Fill(this->Controller,output->GetPoints(),
+		particleRow,vtkTable::GetData(outputVector,1));
+	output->GetPointData()->AddArray(subhaloIdArray);
+	// Managing memory
+	subhaloIdArray->Delete();
+  return 1;
+}
@@ -0,0 +1,112 @@
+/*=========================================================================
+
+		Program:   AstroViz plugin for ParaView
+		Module:    $RCSfile: vtkSubhaloFinder.h,v $
+
+		Copyright (c) Christine Corbett Moran
+		All rights reserved.
+
+	This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.  See the above copyright notice for more information.
+
+
+=========================================================================*/
+// .NAME vtkSubhaloFinder
+// .SECTION Description
+// vtkSubhaloFinder
+// Finds the substructure of the haloes of vtkFriendsOfFriendsHaloFinder by
+//  a friends-of-friends search in phase space within each halo. A halo's
+//  positions and velocities are each scaled by the halo's dispersion in
+//  them, the root mean square distance from their mean, and two of its
+//  particles are linked if their scaled positions and velocities together
+//  are within LinkingLength of each other in six dimensions. Groups of at
+//  least MinimumNumberOfParticles are subhaloes, whose id is the unique id
+//  of their first particle; the particles of no subhalo get 0.
+//
+// Haloes are searched on NumberOfThreads threads. As their sizes span
+//  orders of magnitude, the few larger than a fair share of a thread's
+//  particles are searched one at a time, their particles linked in blocks
+//  by all the threads. The rest are dealt to the threads largest first,
+//  and one that runs out takes the smallest left of another's, so no
+//  thread waits while others have haloes left. Parallel by process, each process
+//  searches the particles of its own piece; a halo spanning pieces has its
+//  subhaloes found in each piece apart. Requires unique ids as input when
+//  run in parallel, as the halo finder does.
+//
+// The second output is a catalogue of the subhaloes, as that of the halo
+// finder with a column for the id of each one's host halo.
+// .SECTION See Also
+// vtkFriendsOfFriendsHaloFinder, KdTree, UnionFind, HaloCatalogue
+
+#ifndef __vtkSubhaloFinder_h
+#define __vtkSubhaloFinder_h
+#include "vtkPointSetAlgorithm.h"
+#include "vtkMultiThreader.h" // for VTK_THREAD_RETURN_TYPE
+class vtkMultiProcessController;
+class vtkIdTypeArray;
+
+class VTK_EXPORT vtkSubhaloFinder : public vtkPointSetAlgorithm
+{
+public:
+  static vtkSubhaloFinder *New();
+  vtkTypeRevisionMacro(vtkSubhaloFinder,vtkPointSetAlgorithm);
+  void PrintSelf(ostream& os, vtkIndent indent);
+
+  // Description:
+  // Get/Set the linking length in phase space, in units of the dispersions
+  // of the halo searched
+  vtkSetMacro(LinkingLength, double);
+  vtkGetMacro(LinkingLength, double);
+
+  // Description:
+  // Get/Set the minimum number of particles to consider a subhalo
+  vtkSetMacro(MinimumNumberOfParticles, int);
+  vtkGetMacro(MinimumNumberOfParticles, int);
+
+  // Description:
+  // Get/Set the number of threads to search haloes on, 0 (the default)
+  // for one per core
+  vtkSetClampMacro(NumberOfThreads, int, 0, VTK_MAX_THREADS);
+  vtkGetMacro(NumberOfThreads, int);
+
+ 	// Description:
+	// By defualt this filter uses the global controller,
+	// but this method can be used to set another instead.
+	virtual void SetController(vtkMultiProcessController*);
+	vtkGetObjectMacro(Controller, vtkMultiProcessController);
+
+//BTX
+protected:
+  vtkSubhaloFinder();
+  ~vtkSubhaloFinder();
+  virtual int FillInputPortInformation(int port, vtkInformation* info);
+  // The catalogue, on port 1, is a table.
+  virtual int FillOutputPortInformation(int port, vtkInformation* info);
+  virtual int RequestDataObject(vtkInformation*,
+   	vtkInformationVector**,
+    vtkInformationVector*);
+  // Main implementation.
+  virtual int RequestData(vtkInformation*,
+   	vtkInformationVector**,
+    vtkInformationVector*);
+  double LinkingLength;
+	int MinimumNumberOfParticles;
+	int NumberOfThreads;
+	vtkMultiProcessController* Controller;
+
+	// Description:
+	// searches haloes, from its own queue and then from those of the other
+	// threads, until none are left, on one thread
+	static VTK_THREAD_RETURN_TYPE SearchThread(void* arg);
+	// Description:
+	// links blocks of the particles of one large halo until none are left,
+	// on one of the threads sharing it
+	static VTK_THREAD_RETURN_TYPE LinkThread(void* arg);
+
+private:
+  vtkSubhaloFinder(const vtkSubhaloFinder&);  // Not implemented.
+  void operator=(const vtkSubhaloFinder&);  // Not implemented.
+//ETX
+};
+#endif
@@ -11,6 +11,7 @@
 #include "vtkCellArray.h"
 #include "vtkFloatArray.h" 
 #include "vtkIntArray.h"
+#include "vtkUnsignedCharArray.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 #include "vtkDistributedDataFilter.h"
 #include "vtkMultiProcessController.h"
@@ -19,11 +20,40 @@
 #include "vtkSmartPointer.h"
 #include "vtkDataArraySelection.h"
 #include <cmath>
+#include <vtkstd/algorithm>
+#include <vtkstd/iterator>
+#include <sstream>
 #include <assert.h>
+#include <sys/stat.h>
 
 vtkCxxRevisionMacro(vtkTipsyReader, "$Revision: 1.0 $");
 vtkStandardNewMacro(vtkTipsyReader);
 //----------------------------------------------------------------------------
+// vtkErrorMacro, vtkWarningMacro and vtkDebugMacro for whatever ReadSnapshot
+// reaches: on the background thread the message is only kept, to be shown
+// by CollectPrefetched.
+enum { TIPSY_MESSAGE_ERROR, TIPSY_MESSAGE_WARNING, TIPSY_MESSAGE_DEBUG };
+#define vtkTipsyReaderMessageMacro(level,macro,x) \
+	{ \
+	if(this->InBackground) \
+		{ \
+		std::ostringstream tipsyMessage; \
+		tipsyMessage << "" x; \
+		this->BackgroundMessages.push_back( \
+			vtkstd::make_pair(int(level),tipsyMessage.str())); \
+		} \
+	else \
+		{ \
+		macro(x); \
+		} \
+	}
+#define vtkTipsyReaderErrorMacro(x) \
+	vtkTipsyReaderMessageMacro(TIPSY_MESSAGE_ERROR,vtkErrorMacro,x)
+#define vtkTipsyReaderWarningMacro(x) \
+	vtkTipsyReaderMessageMacro(TIPSY_MESSAGE_WARNING,vtkWarningMacro,x)
+#define vtkTipsyReaderDebugMacro(x) \
+	vtkTipsyReaderMessageMacro(TIPSY_MESSAGE_DEBUG,vtkDebugMacro,x)
+//----------------------------------------------------------------------------
 vtkSmartPointer<vtkFloatArray> AllocateDataArray(
   vtkDataSet *output, const char* arrayName, int numComponents, unsigned long numTuples)
 {
@@ -39,12 +69,70 @@ vtkSmartPointer<vtkFloatArray> AllocateDataArray(
   return dataArray;
 }
 
+//----------------------------------------------------------------------------
+// Allocates the array only if it is selected and not already in output
+vtkSmartPointer<vtkFloatArray> AllocateMissingDataArray(int selected,
+  vtkDataSet *output, const char* arrayName, int numComponents, unsigned long numTuples)
+{
+	if(!selected || output->GetPointData()->GetArray(arrayName))
+		{
+		return vtkSmartPointer<vtkFloatArray>();
+		}
+	return AllocateDataArray(output,arrayName,numComponents,numTuples);
+}
+
+//----------------------------------------------------------------------------
+// The point array each entry of PointDataArraySelection enables
+static const char* const TipsyArraySelection[][2] = 
+{
+	{ "velocity",    "Velocity" },
+	{ "potential",   "Potential" },
+	{ "mass",        "Mass" },
+	{ "eps",         "Eps" },
+	{ "rho",         "Rho" },
+	{ "hsmooth",     "Hsmooth" },
+	{ "temperature", "Temperature" },
+	{ "metals",      "Metals" },
+	{ "tform",       "Tform" },
+	{ "type",        "Type" }
+};
+
+//----------------------------------------------------------------------------
+// Seconds since the epoch the file was last modified, 0 if it does not exist
+static long FileModifiedTime(const char* name)
+{
+	struct stat info;
+	if(!name || stat(name,&info)!=0)
+		{
+		return 0;
+		}
+	return info.st_mtime;
+}
+
 //----------------------------------------------------------------------------
 vtkTipsyReader::vtkTipsyReader()
 {
   this->MarkFileName      = 0; // this file is optional
   this->FileName          = 0;
 	this->DistributeDataOn  = 1;
+	this->UseMemoryMap      = 1;
+	this->SubsampleFraction = 1.0;
+	this->SubsampleMode     = SUBSAMPLE_STRIDE;
+	this->PrefetchCacheSize = 2;
+	this->RegionType        = REGION_ALL;
+	for(int i=0; i < 3; ++i)
+		{
+		this->RegionBounds[2*i]   = -0.5;
+		this->RegionBounds[2*i+1] = 0.5;
+		this->RegionCenter[i]     = 0.0;
+		}
+	this->RegionRadius      = 0.01;
+	this->PreviousTimeStep  = 0;
+	this->PrefetchReader    = NULL;
+	this->PrefetchGhostLevels = 0;
+	this->PrefetchIndexed   = 0;
+	this->PrefetchSucceeded = 0;
+	this->InBackground      = 0;
   this->UpdatePiece       = 0;
   this->UpdateNumPieces   = 0;
   this->SetNumberOfInputPorts(0); 
@@ -72,9 +160,35 @@ vtkTipsyReader::~vtkTipsyReader()
   this->SetFileName(0);
   this->SetMarkFileName(0);
 	this->SetDistributeDataOn(0);
+	// the background thread may still be using the prefetch reader
+	this->Prefetcher.Wait();
+	if(this->PrefetchReader)
+		{
+		this->PrefetchReader->Delete();
+		}
   this->PointDataArraySelection->Delete();
 }
 
+//----------------------------------------------------------------------------
+void vtkTipsyReader::AddFileName(const char* fileName)
+{
+	this->FileNames.push_back(fileName);
+	this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkTipsyReader::RemoveAllFileNames()
+{
+	this->FileNames.clear();
+	this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkTipsyReader::GetNumberOfFileNames()
+{
+	return this->FileNames.size();
+}
+
 //----------------------------------------------------------------------------
 void vtkTipsyReader::PrintSelf(ostream& os, vtkIndent indent)
 {
@@ -82,7 +196,20 @@ void vtkTipsyReader::PrintSelf(ostream& os, vtkIndent indent)
   os << indent << "FileName: "
      << (this->FileName ? this->FileName : "(none)") << "\n"
 		 << indent << "MarkFileName: "
-		 << (this->MarkFileName ? this->MarkFileName : "(none)") << "\n";
+		 << (this->MarkFileName ? this->MarkFileName : "(none)") << "\n"
+		 << indent << "UseMemoryMap: " << this->UseMemoryMap << "\n"
+		 << indent << "SubsampleFraction: " << this->SubsampleFraction << "\n"
+		 << indent << "SubsampleMode: " << this->SubsampleMode << "\n"
+		 << indent << "NumberOfFileNames: " << this->FileNames.size() << "\n"
+		 << indent << "PrefetchCacheSize: " << this->PrefetchCacheSize << "\n"
+		 << indent << "RegionType: " << this->RegionType << "\n"
+		 << indent << "RegionBounds: " << this->RegionBounds[0] << " "
+		 << this->RegionBounds[1] << " " << this->RegionBounds[2] << " "
+		 << this->RegionBounds[3] << " " << this->RegionBounds[4] << " "
+		 << this->RegionBounds[5] << "\n"
+		 << indent << "RegionCenter: " << this->RegionCenter[0] << " "
+		 << this->RegionCenter[1] << " " << this->RegionCenter[2] << "\n"
+		 << indent << "RegionRadius: " << this->RegionRadius << "\n";
 }
 
 //----------------------------------------------------------------------------
@@ -96,14 +223,30 @@ TipsyHeader vtkTipsyReader::ReadTipsyHeader(ifTipsy& tipsyInfile)
 }
 
 //----------------------------------------------------------------------------
-vtkstd::vector<unsigned long> vtkTipsyReader::ReadMarkedParticleIndices(
-	TipsyHeader& tipsyHeader,ifTipsy& tipsyInfile)
+vtkstd::vector<uint64_t> vtkTipsyReader::ReadMarkedParticleIndices(
+	TipsyHeader& tipsyHeader)
 {
+	vtkstd::vector<uint64_t> markedParticleIndices;
+	if(tipsyIsMarkBitmap(this->MarkFileName))
+		{
+		// the bitmap gives the indices already sorted
+		if(!tipsyReadMarkBitmap(this->MarkFileName,tipsyHeader,
+			markedParticleIndices))
+			{
+			vtkTipsyReaderErrorMacro("Error reading bitmap mark file, number of particles\
+										do not match Tipsy file: " 
+										<< this->MarkFileName 
+										<< " please specify a valid mark file or none at all.\
+										For now reading all particles.");
+			}
+		vtkTipsyReaderDebugMacro("Read " << markedParticleIndices.size() 
+			<< " marked point indices.");
+		return markedParticleIndices;
+		}
 	ifstream markInFile(this->MarkFileName);
-	vtkstd::vector<unsigned long> markedParticleIndices;
 	if(!markInFile)
  		{
- 		vtkErrorMacro("Error opening marked particle file: " 
+ 		vtkTipsyReaderErrorMacro("Error opening marked particle file: " 
 									<< this->MarkFileName 
 									<< " please specify a valid mark file or none at all.\
 									 For now reading all particles.");
@@ -111,7 +254,7 @@ vtkstd::vector<unsigned long> vtkTipsyReader::ReadMarkedParticleIndices(
  		}
 	else
 		{
-		unsigned long mfIndex,mfBodies,mfGas,mfStar,mfDark,numBodies;
+		uint64_t mfIndex,mfBodies,mfGas,mfStar,mfDark;
 		// first line of the mark file is of a different format:
 		// intNumBodies intNumGas intNumStars
 		if(markInFile >> mfBodies >> mfGas >> mfStar)
@@ -120,7 +263,7 @@ vtkstd::vector<unsigned long> vtkTipsyReader::ReadMarkedParticleIndices(
 			if(mfBodies!=tipsyHeader.h_nBodies || mfDark!=tipsyHeader.h_nDark \
 				|| mfGas!=tipsyHeader.h_nSph || mfStar!=tipsyHeader.h_nStar)
 	 			{
-	 			vtkErrorMacro("Error opening marked particle file, wrong format,\
+	 			vtkTipsyReaderErrorMacro("Error opening marked particle file, wrong format,\
 	 										number of particles do not match Tipsy file: " 
 											<< this->MarkFileName 
 											<< " please specify a valid mark file or none at all.\
@@ -139,8 +282,15 @@ vtkstd::vector<unsigned long> vtkTipsyReader::ReadMarkedParticleIndices(
 					}
 				// closing file
 				markInFile.close();
+				// the indices may be in any order, but reading needs them sorted
+				vtkstd::sort(markedParticleIndices.begin(),
+					markedParticleIndices.end());
+				markedParticleIndices.erase(vtkstd::unique(
+					markedParticleIndices.begin(),markedParticleIndices.end()),
+					markedParticleIndices.end());
 				// read file successfully
-				vtkDebugMacro("Read " << numBodies<< " marked point indices.");
+				vtkTipsyReaderDebugMacro("Read " << markedParticleIndices.size() 
+					<< " marked point indices.");
 				}	
 	 		}
 		}
@@ -149,157 +299,483 @@ vtkstd::vector<unsigned long> vtkTipsyReader::ReadMarkedParticleIndices(
 }
 
 //----------------------------------------------------------------------------
-void vtkTipsyReader::ReadAllParticles(TipsyHeader& tipsyHeader,
-	ifTipsy& tipsyInfile,int piece,int numpieces,vtkPolyData* output)
+int vtkTipsyReader::ReadAllParticles(TipsyHeader& tipsyHeader,
+	TipsyBlockSource& tipsySource,int piece,int numpieces,vtkPolyData* output)
 {
-	unsigned long pieceSize = floor(tipsyHeader.h_nBodies*1./numpieces);
-	unsigned long beginIndex = piece*pieceSize;
-	unsigned long endIndex = (piece == numpieces - 1) ? \
+	// integer division, a double loses the low bits of large counts
+	const uint64_t pieceSize = tipsyHeader.h_nBodies/numpieces;
+	const uint64_t beginIndex = piece*pieceSize;
+	const uint64_t endIndex = (piece == numpieces - 1) ? \
 	 	tipsyHeader.h_nBodies : (piece+1)*pieceSize;
+	if(this->SubsampleFraction<1.0)
+		{
+		// only the subsample is allocated and read
+		vtkstd::vector<uint64_t> subsample;
+		subsample.reserve((endIndex-beginIndex)*this->SubsampleFraction+1);
+		for(uint64_t i=beginIndex; i < endIndex; ++i)
+			{
+			if(InSubsample(i,this->SubsampleFraction,this->SubsampleMode))
+				{
+				subsample.push_back(i);
+				}
+			}
+		this->AllocateAllTipsyVariableArrays(subsample.size(),output);
+		return this->ReadParticleIndices(subsample,tipsyHeader,tipsySource);
+		}
 	// Allocates vtk scalars and vector arrays to hold particle data, 
 	this->AllocateAllTipsyVariableArrays(endIndex-beginIndex,output);
-	for(unsigned long i=beginIndex; i < endIndex; i++)  
-  	{ 
-		this->ReadParticle(i,tipsyHeader,tipsyInfile,output);
-  	}
+	return this->ReadParticleRange(beginIndex,endIndex,tipsyHeader,
+		tipsySource);
 }
 
 //----------------------------------------------------------------------------
-void vtkTipsyReader::ReadMarkedParticles(
-	vtkstd::vector<unsigned long>& markedParticleIndices,
-	TipsyHeader& tipsyHeader,
-	ifTipsy& tipsyInfile,
-	vtkPolyData* output)
+void vtkTipsyReader::SubsampleIndices(vtkstd::vector<uint64_t>& indices)
 {
-	// Allocates vtk scalars and vector arrays to hold particle data, 
-	// As marked file was read, only allocates numBodies which 
-	// now equals the number of marked particles
-	this->AllocateAllTipsyVariableArrays(markedParticleIndices.size(),output);
-	unsigned long nextMarkedParticleIndex=0;
-	for(vtkstd::vector<unsigned long>::iterator it = \
-	 	markedParticleIndices.begin(); it != markedParticleIndices.end(); ++it)		
+	if(this->SubsampleFraction>=1.0)
 		{
- 		nextMarkedParticleIndex=*it;
-		// reading in the particle
-		this->ReadParticle(nextMarkedParticleIndex,tipsyHeader,
-			tipsyInfile,output);
+		return;
+		}
+	vtkstd::vector<uint64_t>::size_type kept=0;
+	for(vtkstd::vector<uint64_t>::size_type i=0; i < indices.size(); ++i)
+		{
+		if(InSubsample(indices[i],this->SubsampleFraction,this->SubsampleMode))
+			{
+			indices[kept++]=indices[i];
+			}
+		}
+	indices.resize(kept);
+}
+
+//----------------------------------------------------------------------------
+void vtkTipsyReader::ScaleSubsampleMass()
+{
+	// A subsample stands in for all particles, so carries all their mass
+	if(this->Mass && this->SubsampleFraction<1.0)
+		{
+		float* mass=this->Mass->GetPointer(0);
+		const vtkIdType numRead=this->Mass->GetNumberOfTuples();
+		for(vtkIdType i=0; i < numRead; ++i)
+			{
+			mass[i]/=this->SubsampleFraction;
+			}
 		}
 }
 
 //----------------------------------------------------------------------------
-tipsypos::section_type vtkTipsyReader::SeekToIndex(unsigned long index,
-	TipsyHeader& tipsyHeader, ifTipsy& tipsyInfile)
+vtkstd::string vtkTipsyReader::GetCacheKey(const char* fileName,
+	int ghostLevels)
 {
-	if(index < tipsyHeader.h_nSph)
+	// rewriting any of the files invalidates what was read from them
+	const vtkstd::string sidecar=TipsyKeyIndex::sidecarName(fileName);
+	std::ostringstream key;
+	key << fileName << ' ' << FileModifiedTime(fileName) << '\n'
+		<< (this->MarkFileName ? this->MarkFileName : "") << ' ' 
+		<< FileModifiedTime(this->MarkFileName) << '\n'
+		<< FileModifiedTime(sidecar.c_str()) << ' '
+		<< this->UpdatePiece << ' ' << this->UpdateNumPieces << ' '
+		<< ghostLevels << ' ' << this->DistributeDataOn << ' '
+		<< this->SubsampleMode << '\n' << this->RegionType;
+	if(this->RegionType==REGION_BOX)
+		{
+		for(int i=0; i < 6; ++i)
+			{
+			key << ' ' << this->RegionBounds[i];
+			}
+		}
+	else if(this->RegionType==REGION_SPHERE)
 		{
-		// we are seeking a gas particle
-		tipsyInfile.seekg(tipsypos(tipsypos::gas,index));	
-		return tipsypos::gas;
+		key << ' ' << this->RegionCenter[0] << ' ' << this->RegionCenter[1]
+			<< ' ' << this->RegionCenter[2] << ' ' << this->RegionRadius;
 		}
-	else if(index < tipsyHeader.h_nDark+tipsyHeader.h_nSph)
+	return key.str();
+}
+
+//----------------------------------------------------------------------------
+TipsyBlockSource* vtkTipsyReader::OpenTipsyFile(zbTipsy& tipsyBlocked,
+	mTipsy& tipsyMapped, ifTipsy& tipsyInfile, TipsyStreamSource& tipsyStream,
+	TipsyHeader& tipsyHeader)
+{
+	TipsyBlockSource* tipsySource=NULL;
+	if(tipsyBlocked.open(this->CurrentFileName.c_str()))
 		{
-		// we are seeking a dark particle, which begin at index 0 after
-		// gas particles
-		index-=tipsyHeader.h_nSph;
-		tipsyInfile.seekg(tipsypos(tipsypos::dark,index));
-		return tipsypos::dark;
+		// block compressed, written by tzblock
+		vtkTipsyReaderDebugMacro("Reading block compressed file " 
+			<< this->CurrentFileName.c_str());
+		tipsyHeader=tipsyBlocked.header();
+		tipsySource=&tipsyBlocked;
 		}
-	else if(index < tipsyHeader.h_nBodies)
+	else if(this->UseMemoryMap && tipsyMapped.open(this->CurrentFileName.c_str(),"standard"))
 		{
-		// we are seeking a star particle, which begin at index zero after gas
-		// and dark particles
-		index-=(tipsyHeader.h_nSph+tipsyHeader.h_nDark);
-		tipsyInfile.seekg(tipsypos(tipsypos::star,index));	
-		return tipsypos::star;
+		vtkTipsyReaderDebugMacro("Memory mapped file " << this->CurrentFileName.c_str());
+		tipsyHeader=tipsyMapped.header();
+		tipsySource=&tipsyMapped;
 		}
 	else
 		{
-		vtkErrorMacro("An index is greater than the number of particles in the 	file, unable to read");
-		return tipsypos::invalid;
-		}
-}
-
-//----------------------------------------------------------------------------
-//i,tipsyHeader,tipsyInfile,output)
-vtkIdType vtkTipsyReader::ReadParticle(unsigned long index, 
-	TipsyHeader& tipsyHeader, ifTipsy& tipsyInfile, vtkPolyData* output) 
-{
-  // allocating variables for reading
-  vtkIdType id;
-  TipsyGasParticle  g;
-  TipsyDarkParticle d;
-  TipsyStarParticle s;
-	tipsypos::section_type particleSection=this->SeekToIndex(index,
-		tipsyHeader,tipsyInfile);
-	switch(particleSection)
-		{
-   case tipsypos::gas:
-     tipsyInfile >> g;
-		 id=this->ReadGasParticle(output,g);
-     break;
-   case tipsypos::dark:
-     tipsyInfile >> d;
-		 id=this->ReadDarkParticle(output,d);
-     break;
-   case tipsypos::star:
-     tipsyInfile >> s;
-		 id=this->ReadStarParticle(output,s);
-     break;
-   default:
-     assert(0);
-     break;
-    }
-  this->GlobalIds->SetValue(id,index);
-  return id;
+		tipsyInfile.open(this->CurrentFileName.c_str(),"standard");
+		if (!tipsyInfile.is_open()) 
+			{
+			vtkTipsyReaderErrorMacro("Error opening file " << this->CurrentFileName.c_str());
+			return NULL;
+			}
+		// Read the header from the input
+		tipsyHeader=this->ReadTipsyHeader(tipsyInfile);
+		tipsySource=&tipsyStream;
+		}
+	// particles are numbered with vtkIdType global ids
+	if(uint64_t(VTK_ID_MAX) < tipsyHeader.h_nBodies)
+		{
+		vtkTipsyReaderErrorMacro("File " << this->CurrentFileName.c_str() << " has "
+			<< tipsyHeader.h_nBodies << " particles, more than this build of "
+			"VTK can number. Rebuild VTK with VTK_USE_64BIT_IDS.");
+		return NULL;
+		}
+	return tipsySource;
 }
 
 //----------------------------------------------------------------------------
-vtkIdType vtkTipsyReader::ReadBaseParticle(vtkPolyData* output,
-	TipsyBaseParticle& b) 
+int vtkTipsyReader::ReadMissingColumns()
 {
-  this->Positions->SetPoint(ParticleIndex, b.pos);
-  //
-  if (this->Velocity)  this->Velocity->SetTuple(ParticleIndex, b.vel);
-  if (this->Mass)      this->Mass->SetTuple1(ParticleIndex, b.mass);
-  if (this->Potential) this->Potential->SetTuple1(ParticleIndex, b.phi);
-	return ParticleIndex++;
+	const vtkIdType numBodies=this->ColumnCache->GetNumberOfPoints();
+	this->AllocateSelectedArrays(numBodies,this->ColumnCache);
+	if(!this->Columns.any() && !this->Type)
+		{
+		// every selected array has been read already
+		return 1;
+		}
+	zbTipsy tipsyBlocked;
+	mTipsy tipsyMapped;
+	ifTipsy tipsyInfile;
+	TipsyStreamSource tipsyStream(tipsyInfile);
+	TipsyHeader tipsyHeader;
+	TipsyBlockSource* tipsySource=this->OpenTipsyFile(tipsyBlocked,
+		tipsyMapped,tipsyInfile,tipsyStream,tipsyHeader);
+	if(!tipsySource)
+		{
+		this->ColumnCache=NULL;
+		return 0;
+		}
+	// the same runs in the same order give the same rows as the first read
+	vtkstd::vector<vtkstd::pair<uint64_t,uint64_t> > runs;
+	runs.swap(this->ReadRuns);
+	this->GlobalIds=NULL;
+	this->ParticleIndex=0;
+	for(vtkstd::vector<vtkstd::pair<uint64_t,uint64_t> >::size_type r=0;
+		r < runs.size(); ++r)
+		{
+		if(!this->ReadParticleRange(runs[r].first,runs[r].second,tipsyHeader,
+			*tipsySource))
+			{
+			// the new arrays are only partly filled
+			this->ColumnCache=NULL;
+			return 0;
+			}
+		}
+	tipsyBlocked.close();
+	tipsyMapped.close();
+	tipsyInfile.close();
+	this->ScaleSubsampleMass();
+	vtkTipsyReaderDebugMacro("Read the newly selected arrays of " << numBodies 
+		<< " points.");
+	return 1;
 }
 
 //----------------------------------------------------------------------------
-vtkIdType vtkTipsyReader::ReadGasParticle(vtkPolyData* output,
- 	TipsyGasParticle& g)
+void vtkTipsyReader::CopySelectedColumns(vtkPolyData* output)
 {
- 	vtkIdType id=ReadBaseParticle(output,g);
-  if (this->RHO)         this->RHO->SetTuple(id, &g.rho);
-  if (this->Temperature) this->Temperature->SetTuple1(id, g.temp);
-  if (this->Hsmooth)     this->Hsmooth->SetTuple1(id, g.hsmooth);
-  if (this->Metals)      this->Metals->SetTuple1(id, g.metals);
-	if (this->Type)      this->Type->SetTuple1(id, 0.0);
-	return id;
+	output->SetPoints(this->ColumnCache->GetPoints());
+	output->SetVerts(this->ColumnCache->GetVerts());
+	vtkPointData* cached=this->ColumnCache->GetPointData();
+	for(int i=0; i < cached->GetNumberOfArrays(); ++i)
+		{
+		vtkDataArray* array=cached->GetArray(i);
+		const char* name=array->GetName();
+		int selected=1;
+		for(size_t j=0; 
+			j < sizeof(TipsyArraySelection)/sizeof(TipsyArraySelection[0]); ++j)
+			{
+			if(strcmp(name,TipsyArraySelection[j][0])==0)
+				{
+				selected=this->GetPointArrayStatus(TipsyArraySelection[j][1]);
+				break;
+				}
+			}
+		// arrays not chosen by the user, such as vtkGhostLevels, are kept
+		if(selected)
+			{
+			output->GetPointData()->AddArray(array);
+			}
+		}
 }
 
 //----------------------------------------------------------------------------
-vtkIdType vtkTipsyReader::ReadStarParticle(vtkPolyData* output,
- 	TipsyStarParticle& s)
+int vtkTipsyReader::ReadMarkedParticles(
+	vtkstd::vector<uint64_t>& markedParticleIndices,
+	TipsyHeader& tipsyHeader,
+	TipsyBlockSource& tipsySource,
+	int piece,int numPieces,
+	vtkPolyData* output)
 {
- 	vtkIdType id=ReadBaseParticle(output,s);
-  if (this->EPS)    this->EPS->SetTuple1(id, s.eps);
-  if (this->Metals) this->Metals->SetTuple1(id, s.metals);
-  if (this->Tform)  this->Tform->SetTuple1(id, s.tform);
-	if (this->Type)      this->Type->SetTuple1(id, 2.0);
-	return id;
+	// Each piece takes an equal share of the marked particles, so a run of
+	// adjacent indices may be split between two pieces.
+	const uint64_t numMarked=markedParticleIndices.size();
+	const uint64_t begin=numMarked*piece/numPieces;
+	const uint64_t end=numMarked*(piece+1)/numPieces;
+	// Allocates vtk scalars and vector arrays to hold particle data, 
+	// As marked file was read, only allocates numBodies which 
+	// now equals the number of marked particles in this piece
+	this->AllocateAllTipsyVariableArrays(end-begin,output);
+	const vtkstd::vector<uint64_t> pieceIndices(
+		markedParticleIndices.begin()+begin,markedParticleIndices.begin()+end);
+	return this->ReadParticleIndices(pieceIndices,tipsyHeader,tipsySource);
 }
 
-//----------------------------------------------------------------------------	
-vtkIdType vtkTipsyReader::ReadDarkParticle(vtkPolyData* output,
-	TipsyDarkParticle& d)
+//----------------------------------------------------------------------------
+int vtkTipsyReader::ReadParticleRange(uint64_t beginIndex,
+	uint64_t endIndex, TipsyHeader& tipsyHeader,
+	TipsyBlockSource& tipsySource)
 {
- 	vtkIdType id=this->ReadBaseParticle(output,d);
-  if (this->EPS) this->EPS->SetTuple1(id, d.eps);
-	if (this->Type)      this->Type->SetTuple1(id, 1.0);
-	return id;
+	if(endIndex > tipsyHeader.h_nBodies)
+		{
+		vtkTipsyReaderErrorMacro("An index is greater than the number of particles in the file, unable to read");
+		return 0;
+		}
+	// the file holds all gas, then all dark, then all star particles, so any
+	// range of indices is at most three contiguous runs, one per section.
+	// The type value stored for each section is its position in this list.
+	const tipsypos::section_type sections[3] = 
+		{ tipsypos::gas, tipsypos::dark, tipsypos::star };
+	const uint64_t sectionBegin[4] = { 0, tipsyHeader.h_nSph,
+		tipsyHeader.h_nSph+tipsyHeader.h_nDark, tipsyHeader.h_nBodies };
+	this->ReadRuns.push_back(vtkstd::make_pair(beginIndex,endIndex));
+	// global ids are not needed when only adding columns to a previous read
+	vtkIdType* globalIds = (this->GlobalIds) ? this->GlobalIds->GetPointer(0) : NULL;
+	float* type = (this->Type) ? this->Type->GetPointer(0) : NULL;
+	for(int s=0; s < 3; ++s)
+		{
+		uint64_t first = vtkstd::max(beginIndex,sectionBegin[s]);
+		uint64_t last = vtkstd::min(endIndex,sectionBegin[s+1]);
+		if(first >= last)
+			{
+			continue;
+			}
+		// if only the type is wanted there is nothing to read from the file
+		uint64_t count = (this->Columns.any()) ? tipsySource.readBlock(
+			tipsypos(sections[s],first-sectionBegin[s]),last-first,this->Columns,
+			this->ParticleIndex) : last-first;
+		if(count != last-first)
+			{
+			vtkTipsyReaderErrorMacro("Unexpected end of file " << this->CurrentFileName.c_str() 
+				<< " after reading " << count << " of " << last-first 
+				<< " particles.");
+			return 0;
+			}
+		// neither the type nor the index of a particle is stored in the file
+		for(uint64_t i=0; globalIds && i < count; ++i)
+			{
+			globalIds[this->ParticleIndex+i] = first+i;
+			}
+		if(type)
+			{
+			vtkstd::fill(type+this->ParticleIndex,
+				type+this->ParticleIndex+count,float(s));
+			}
+		this->ParticleIndex+=count;
+		}
+	return 1;
 }
 		
+//----------------------------------------------------------------------------
+int vtkTipsyReader::SelectRegion(const char* fileName,
+	TipsyHeader& tipsyHeader, int marked, vtkstd::vector<uint64_t>& indices)
+{
+	TipsyKeyIndex keyIndex;
+	if(!keyIndex.open(TipsyKeyIndex::sidecarName(fileName).c_str()) ||
+		keyIndex.header().nBodies!=tipsyHeader.h_nBodies)
+		{
+		vtkTipsyReaderWarningMacro("Reading all of " << fileName << " as it has no "
+			"Peano-Hilbert index to find the region in; write one with tindex.");
+		return 0;
+		}
+	const TipsyRegion region=(this->RegionType==REGION_BOX) ? 
+		TipsyRegion(this->RegionBounds) :
+		TipsyRegion(this->RegionCenter,this->RegionRadius);
+	vtkstd::vector<TipsyKeyIndex::range_type> ranges;
+	if(!keyIndex.selectRegion(region,ranges))
+		{
+		vtkTipsyReaderWarningMacro("Reading all of " << fileName 
+			<< " as its index could not be read.");
+		return 0;
+		}
+	// the order of a run is the file indices of its particles
+	vtkstd::vector<uint64_t> selected;
+	for(vtkstd::vector<TipsyKeyIndex::range_type>::size_type r=0; 
+		r < ranges.size(); ++r)
+		{
+		const uint64_t at=selected.size();
+		selected.resize(at+ranges[r].second-ranges[r].first);
+		if(!keyIndex.readOrder(ranges[r].first,
+			ranges[r].second-ranges[r].first,&selected[at]))
+			{
+			vtkTipsyReaderWarningMacro("Reading all of " << fileName 
+				<< " as its index could not be read.");
+			return 0;
+			}
+		}
+	vtkstd::sort(selected.begin(),selected.end());
+	if(marked)
+		{
+		vtkstd::vector<uint64_t> both;
+		vtkstd::set_intersection(selected.begin(),selected.end(),
+			indices.begin(),indices.end(),vtkstd::back_inserter(both));
+		selected.swap(both);
+		}
+	vtkTipsyReaderDebugMacro("Selected " << selected.size() << " particles in " 
+		<< ranges.size() << " runs of the index near the region.");
+	indices.swap(selected);
+	return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkTipsyReader::ReadParticleIndices(
+	const vtkstd::vector<uint64_t>& indices, TipsyHeader& tipsyHeader,
+	TipsyBlockSource& tipsySource)
+{
+	vtkstd::vector<uint64_t>::size_type i=0;
+	while(i < indices.size())
+		{
+		// extend the run while the indices are consecutive
+		vtkstd::vector<uint64_t>::size_type j=i+1;
+		while(j < indices.size() && indices[j]==indices[j-1]+1)
+			{
+			++j;
+			}
+		if(!this->ReadParticleRange(indices[i],indices[j-1]+1,tipsyHeader,
+			tipsySource))
+			{
+			return 0;
+			}
+		i=j;
+		}
+	return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkTipsyReader::ReadSpatialPiece(TipsyKeyIndex& keyIndex,
+	TipsyHeader& tipsyHeader, TipsyBlockSource& tipsySource, int piece,
+	int numPieces, int ghostLevels, vtkPolyData* output)
+{
+	// each piece owns an equal slice of the particles sorted by key
+	const uint64_t n=keyIndex.header().nBodies;
+	const uint64_t begin=n*piece/numPieces;
+	const uint64_t end=n*(piece+1)/numPieces;
+	vtkstd::vector<uint64_t> owned(end-begin);
+	if(!owned.empty() && !keyIndex.readOrder(begin,end-begin,&owned[0]))
+		{
+		vtkTipsyReaderErrorMacro("Error reading the particle order from the index of "
+			<< this->CurrentFileName.c_str());
+		return 0;
+		}
+	// reading in file order turns the slice into as few runs as possible
+	vtkstd::sort(owned.begin(),owned.end());
+	this->SubsampleIndices(owned);
+	vtkstd::vector<uint64_t> ghosts;
+	if(ghostLevels > 0 && !owned.empty() &&
+		!this->ReadGhostIndices(keyIndex,begin,end,ghosts))
+		{
+		vtkTipsyReaderErrorMacro("Error reading the ghost particles from the index of "
+			<< this->CurrentFileName.c_str());
+		return 0;
+		}
+	this->SubsampleIndices(ghosts);
+	vtkTipsyReaderDebugMacro("Piece " << piece << " owns " << owned.size() 
+		<< " particles and has " << ghosts.size() << " ghosts.");
+	this->AllocateAllTipsyVariableArrays(owned.size()+ghosts.size(),output);
+	if(!this->ReadParticleIndices(owned,tipsyHeader,tipsySource) ||
+		!this->ReadParticleIndices(ghosts,tipsyHeader,tipsySource))
+		{
+		return 0;
+		}
+	if(ghostLevels > 0)
+		{
+		// owned particles were read first, then the ghosts
+		vtkSmartPointer<vtkUnsignedCharArray> ghostArray = \
+			vtkSmartPointer<vtkUnsignedCharArray>::New();
+		ghostArray->SetName("vtkGhostLevels");
+		ghostArray->SetNumberOfTuples(owned.size()+ghosts.size());
+		unsigned char* ghost=ghostArray->GetPointer(0);
+		vtkstd::fill(ghost,ghost+owned.size(),0);
+		vtkstd::fill(ghost+owned.size(),ghost+owned.size()+ghosts.size(),1);
+		output->GetPointData()->AddArray(ghostArray);
+		}
+	return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkTipsyReader::ReadGhostIndices(TipsyKeyIndex& keyIndex,
+	uint64_t begin, uint64_t end, vtkstd::vector<uint64_t>& ghosts)
+{
+	uint64_t firstKey,lastKey;
+	if(!keyIndex.readKeys(begin,1,&firstKey) ||
+		!keyIndex.readKeys(end-1,1,&lastKey))
+		{
+		return 0;
+		}
+	// the slice covers the index cells c0 to c1, possibly only partly at
+	// either end. Every cell touching one of them is a neighbour.
+	const uint64_t c0=keyIndex.cellOf(firstKey);
+	const uint64_t c1=keyIndex.cellOf(lastKey);
+	const int64_t side=int64_t(1) << keyIndex.header().level;
+	vtkstd::vector<unsigned char> neighbour(keyIndex.cellCount(),0);
+	for(uint64_t c=c0; c <= c1; ++c)
+		{
+		uint32_t x[3],y[3];
+		keyIndex.cellCoordinates(c,x);
+		for(int dx=-1; dx <= 1; ++dx)
+			for(int dy=-1; dy <= 1; ++dy)
+				for(int dz=-1; dz <= 1; ++dz)
+					{
+					const int64_t p[3] = { x[0]+dx, x[1]+dy, x[2]+dz };
+					if(p[0] < 0 || p[1] < 0 || p[2] < 0 ||
+						p[0] >= side || p[1] >= side || p[2] >= side)
+						{
+						continue;
+						}
+					y[0]=p[0]; y[1]=p[1]; y[2]=p[2];
+					neighbour[keyIndex.cellAt(y)]=1;
+					}
+		}
+	// key order ranges of ghosts: the parts of c0 and c1 outside the slice,
+	// then every neighbouring cell not already in the slice
+	vtkstd::vector<vtkstd::pair<uint64_t,uint64_t> > ranges;
+	ranges.push_back(vtkstd::make_pair(keyIndex.cellBegin(c0),begin));
+	ranges.push_back(vtkstd::make_pair(end,keyIndex.cellBegin(c1+1)));
+	for(uint64_t c=0; c < keyIndex.cellCount(); ++c)
+		{
+		if(neighbour[c] && (c < c0 || c > c1))
+			{
+			ranges.push_back(vtkstd::make_pair(keyIndex.cellBegin(c),
+				keyIndex.cellBegin(c+1)));
+			}
+		}
+	for(vtkstd::vector<vtkstd::pair<uint64_t,uint64_t> >::size_type r=0;
+		r < ranges.size(); ++r)
+		{
+		const uint64_t count=ranges[r].second-ranges[r].first;
+		if(count == 0)
+			{
+			continue;
+			}
+		ghosts.resize(ghosts.size()+count);
+		if(!keyIndex.readOrder(ranges[r].first,count,&ghosts[ghosts.size()-count]))
+			{
+			return 0;
+			}
+		}
+	vtkstd::sort(ghosts.begin(),ghosts.end());
+	return 1;
+}
+
 //----------------------------------------------------------------------------
 void vtkTipsyReader::AllocateAllTipsyVariableArrays(vtkIdType numBodies,
 	vtkPolyData* output)
@@ -325,50 +801,52 @@ void vtkTipsyReader::AllocateAllTipsyVariableArrays(vtkIdType numBodies,
   output->SetPoints(this->Positions);
   output->SetVerts(this->Vertices); 
 
+  this->AllocateSelectedArrays(numBodies,output);
+	this->Columns.pos = static_cast<float*>(this->Positions->GetVoidPointer(0));
+}
+
+//----------------------------------------------------------------------------
+void vtkTipsyReader::AllocateSelectedArrays(vtkIdType numBodies,
+	vtkPolyData* output)
+{
   // allocate velocity first as it uses the most memory and on my win32 machine 
   // this helps load really big data without alloc failures.
-  if (this->GetPointArrayStatus("Velocity")) 
-    this->Velocity = AllocateDataArray(output,"velocity",3,numBodies);
-  else 
-    this->Velocity = NULL;
-  if (this->GetPointArrayStatus("Potential")) 
-    this->Potential = AllocateDataArray(output,"potential",1,numBodies);
-  else 
-    this->Potential = NULL;
-  if (this->GetPointArrayStatus("Mass"))
-    this->Mass = AllocateDataArray(output,"mass",1,numBodies);
-  else 
-    this->Mass = NULL;
-  if (this->GetPointArrayStatus("Eps")) 
-    this->EPS = AllocateDataArray(output,"eps",1,numBodies);
-  else 
-    this->EPS = NULL;
-  if (this->GetPointArrayStatus("Rho")) 
-    this->RHO = AllocateDataArray(output,"rho",1,numBodies);
-  else 
-    this->RHO = NULL;
-  if (this->GetPointArrayStatus("Hsmooth")) 
-    this->Hsmooth = AllocateDataArray(output,"hsmooth",1,numBodies);
-  else 
-    this->Hsmooth = NULL;
-  if (this->GetPointArrayStatus("Temperature"))
-    this->Temperature = AllocateDataArray(output,"temperature",1,numBodies);
-  else 
-    this->Temperature = NULL;
-
-  if (this->GetPointArrayStatus("Metals"))
-    this->Metals = AllocateDataArray(output,"metals",1,numBodies);
-  else 
-    this->Metals = NULL;
-  if (this->GetPointArrayStatus("Tform"))
-    this->Tform = AllocateDataArray(output,"tform",1,numBodies);
-  else 
-    this->Tform = NULL;
-	if (this->GetPointArrayStatus("Type"))
-    this->Type = AllocateDataArray(output,"type",1,numBodies);
-  else 
-    this->Type = NULL;
+  this->Velocity = AllocateMissingDataArray(
+		this->GetPointArrayStatus("Velocity"),output,"velocity",3,numBodies);
+  this->Potential = AllocateMissingDataArray(
+		this->GetPointArrayStatus("Potential"),output,"potential",1,numBodies);
+  this->Mass = AllocateMissingDataArray(
+		this->GetPointArrayStatus("Mass"),output,"mass",1,numBodies);
+  this->EPS = AllocateMissingDataArray(
+		this->GetPointArrayStatus("Eps"),output,"eps",1,numBodies);
+  this->RHO = AllocateMissingDataArray(
+		this->GetPointArrayStatus("Rho"),output,"rho",1,numBodies);
+  this->Hsmooth = AllocateMissingDataArray(
+		this->GetPointArrayStatus("Hsmooth"),output,"hsmooth",1,numBodies);
+  this->Temperature = AllocateMissingDataArray(
+		this->GetPointArrayStatus("Temperature"),output,"temperature",1,numBodies);
+  this->Metals = AllocateMissingDataArray(
+		this->GetPointArrayStatus("Metals"),output,"metals",1,numBodies);
+  this->Tform = AllocateMissingDataArray(
+		this->GetPointArrayStatus("Tform"),output,"tform",1,numBodies);
+  this->Type = AllocateMissingDataArray(
+		this->GetPointArrayStatus("Type"),output,"type",1,numBodies);
+
+	// Block reads decode straight into the buffers of these arrays. Arrays
+	// which are not selected or already read stay null and their fields are
+	// skipped.
+	this->Columns = TipsyColumns();
+	if (this->Velocity)    this->Columns.vel     = this->Velocity->GetPointer(0);
+	if (this->Mass)        this->Columns.mass    = this->Mass->GetPointer(0);
+	if (this->Potential)   this->Columns.phi     = this->Potential->GetPointer(0);
+	if (this->EPS)         this->Columns.eps     = this->EPS->GetPointer(0);
+	if (this->RHO)         this->Columns.rho     = this->RHO->GetPointer(0);
+	if (this->Temperature) this->Columns.temp    = this->Temperature->GetPointer(0);
+	if (this->Hsmooth)     this->Columns.hsmooth = this->Hsmooth->GetPointer(0);
+	if (this->Metals)      this->Columns.metals  = this->Metals->GetPointer(0);
+	if (this->Tform)       this->Columns.tform   = this->Tform->GetPointer(0);
 }
+
 //----------------------------------------------------------------------------
 int vtkTipsyReader::RequestInformation(
 	vtkInformation* vtkNotUsed(request),
@@ -391,98 +869,411 @@ int vtkTipsyReader::RequestInformation(
 	this->PointDataArraySelection->AddArray("Type");
   this->PointDataArraySelection->AddArray("Velocity");
 
+	// the times of a series are the times in the headers of its files
+	if(!this->ReadTimeSteps())
+		{
+		return 0;
+		}
+	if(this->TimeSteps.empty())
+		{
+		outInfo->Remove(vtkStreamingDemandDrivenPipeline::TIME_STEPS());
+		outInfo->Remove(vtkStreamingDemandDrivenPipeline::TIME_RANGE());
+		}
+	else
+		{
+		outInfo->Set(vtkStreamingDemandDrivenPipeline::TIME_STEPS(),
+			&this->TimeSteps[0],this->TimeSteps.size());
+		double timeRange[2] = { this->TimeSteps.front(), this->TimeSteps.back() };
+		outInfo->Set(vtkStreamingDemandDrivenPipeline::TIME_RANGE(),timeRange,2);
+		}
 	return 1;
 }
+//----------------------------------------------------------------------------
+int vtkTipsyReader::ReadTimeSteps()
+{
+	this->SeriesFileNames.clear();
+	this->TimeSteps.clear();
+	if(this->FileNames.empty())
+		{
+		return 1;
+		}
+	// only the header of each file is read
+	vtkstd::vector<vtkstd::pair<double,vtkstd::string> > series;
+	for(vtkstd::vector<vtkstd::string>::size_type i=0; 
+		i < this->FileNames.size(); ++i)
+		{
+		TipsyHeader tipsyHeader;
+		zbTipsy tipsyBlocked;
+		if(tipsyBlocked.open(this->FileNames[i].c_str()))
+			{
+			tipsyHeader=tipsyBlocked.header();
+			}
+		else
+			{
+			ifTipsy tipsyInfile(this->FileNames[i].c_str(),"standard");
+			if(!tipsyInfile.is_open())
+				{
+				vtkErrorMacro("Error opening file " << this->FileNames[i]);
+				return 0;
+				}
+			tipsyHeader=this->ReadTipsyHeader(tipsyInfile);
+			tipsyInfile.close();
+			}
+		series.push_back(vtkstd::make_pair(tipsyHeader.h_time,
+			this->FileNames[i]));
+		}
+	vtkstd::stable_sort(series.begin(),series.end());
+	for(vtkstd::vector<vtkstd::pair<double,vtkstd::string> >::size_type i=0;
+		i < series.size(); ++i)
+		{
+		this->TimeSteps.push_back(series[i].first);
+		this->SeriesFileNames.push_back(series[i].second);
+		}
+	return 1;
+}
+
+//----------------------------------------------------------------------------
+vtkstd::string vtkTipsyReader::GetSnapshotKey(const char* fileName,
+	int ghostLevels)
+{
+	std::ostringstream key;
+	key << this->GetCacheKey(fileName,ghostLevels) << ' ' 
+		<< this->SubsampleFraction << ' '
+		<< this->PointDataArraySelection->GetMTime();
+	return key.str();
+}
+
+//----------------------------------------------------------------------------
+void vtkTipsyReader::ReleaseArrays()
+{
+  // release memory smartpointers - just to play safe.
+  this->Vertices    = NULL;
+  this->GlobalIds   = NULL;
+  this->Positions   = NULL;
+  this->Potential   = NULL;
+  this->Mass        = NULL;
+  this->EPS         = NULL;
+  this->RHO         = NULL;
+  this->Hsmooth     = NULL;
+  this->Temperature = NULL;
+  this->Metals      = NULL;
+  this->Tform       = NULL;
+	this->Type       = NULL;
+  this->Velocity    = NULL;
+  this->Columns     = TipsyColumns();
+}
+
+//----------------------------------------------------------------------------
+void vtkTipsyReader::PrefetchSnapshot(void* reader)
+{
+	// runs on the background thread, touching nothing but the reader given,
+	// which keeps its messages in BackgroundMessages rather than showing them
+	vtkTipsyReader* self=static_cast<vtkTipsyReader*>(reader);
+	self->ParticleIndex=0;
+	self->ReadRuns.clear();
+	self->PrefetchSucceeded=self->ReadSnapshot(self->PrefetchGhostLevels,
+		self->PrefetchOutput,self->PrefetchIndexed);
+}
+
+//----------------------------------------------------------------------------
+void vtkTipsyReader::CollectPrefetched(int wait)
+{
+	if(!this->Prefetcher.IsStarted() || 
+		(!wait && this->Prefetcher.IsRunning()))
+		{
+		return;
+		}
+	this->Prefetcher.Wait();
+	vtkTipsyReader* reader=this->PrefetchReader;
+	// what the read reported, shown now that it is on the main thread
+	for(size_t i = 0; i < reader->BackgroundMessages.size(); ++i)
+		{
+		const vtkstd::string& message=reader->BackgroundMessages[i].second;
+		switch(reader->BackgroundMessages[i].first)
+			{
+			case TIPSY_MESSAGE_ERROR:
+				vtkErrorMacro("Reading " << reader->CurrentFileName.c_str()
+					<< " in the background: " << message.c_str());
+				break;
+			case TIPSY_MESSAGE_WARNING:
+				vtkWarningMacro("Reading " << reader->CurrentFileName.c_str()
+					<< " in the background: " << message.c_str());
+				break;
+			default:
+				vtkDebugMacro("Reading " << reader->CurrentFileName.c_str()
+					<< " in the background: " << message.c_str());
+				break;
+			}
+		}
+	reader->BackgroundMessages.clear();
+	if(reader->PrefetchSucceeded)
+		{
+		PrefetchedSnapshot snapshot;
+		snapshot.Key=this->PrefetchKey;
+		snapshot.Data=reader->PrefetchOutput;
+		snapshot.GlobalIds=reader->GlobalIds;
+		snapshot.ReadRuns.swap(reader->ReadRuns);
+		snapshot.Indexed=reader->PrefetchIndexed;
+		this->Prefetched.push_back(snapshot);
+		// the cache is bounded, the oldest snapshot goes first
+		while(int(this->Prefetched.size()) > this->PrefetchCacheSize)
+			{
+			this->Prefetched.pop_front();
+			}
+		}
+	// anything released here, not on the background thread
+	reader->PrefetchOutput=NULL;
+	reader->ReleaseArrays();
+	this->PrefetchKey.clear();
+}
+
+//----------------------------------------------------------------------------
+void vtkTipsyReader::PrefetchTimeStep(int step, int ghostLevels)
+{
+	if(step < 0 || this->PrefetchCacheSize <= 0)
+		{
+		return;
+		}
+	this->CollectPrefetched(0);
+	if(this->Prefetcher.IsRunning())
+		{
+		// still reading an earlier snapshot, which may yet be wanted
+		return;
+		}
+	const char* fileName=this->SeriesFileNames[step].c_str();
+	const vtkstd::string key=this->GetSnapshotKey(fileName,ghostLevels);
+	for(vtkstd::list<PrefetchedSnapshot>::iterator it=this->Prefetched.begin();
+		it != this->Prefetched.end(); ++it)
+		{
+		if(it->Key==key)
+			{
+			return;
+			}
+		}
+	// a private reader with the same settings reads the snapshot, so that
+	// nothing the main thread uses is touched in the background
+	if(!this->PrefetchReader)
+		{
+		this->PrefetchReader=vtkTipsyReader::New();
+		this->PrefetchReader->InBackground=1;
+		}
+	vtkTipsyReader* reader=this->PrefetchReader;
+	reader->CurrentFileName=fileName;
+	reader->SetMarkFileName(this->MarkFileName);
+	reader->DistributeDataOn=this->DistributeDataOn;
+	reader->UseMemoryMap=this->UseMemoryMap;
+	reader->SubsampleFraction=this->SubsampleFraction;
+	reader->SubsampleMode=this->SubsampleMode;
+	reader->RegionType=this->RegionType;
+	vtkstd::copy(this->RegionBounds,this->RegionBounds+6,reader->RegionBounds);
+	vtkstd::copy(this->RegionCenter,this->RegionCenter+3,reader->RegionCenter);
+	reader->RegionRadius=this->RegionRadius;
+	reader->UpdatePiece=this->UpdatePiece;
+	reader->UpdateNumPieces=this->UpdateNumPieces;
+	reader->PointDataArraySelection->CopySelections(
+		this->PointDataArraySelection);
+	reader->PrefetchGhostLevels=ghostLevels;
+	reader->PrefetchOutput=vtkSmartPointer<vtkPolyData>::New();
+	reader->PrefetchSucceeded=0;
+	this->PrefetchKey=key;
+	if(this->Prefetcher.Start(vtkTipsyReader::PrefetchSnapshot,reader))
+		{
+		vtkDebugMacro("Reading " << fileName << " in the background.");
+		}
+	else
+		{
+		reader->PrefetchOutput=NULL;
+		this->PrefetchKey.clear();
+		}
+}
+
 /*
 * Reads a file, optionally only the marked particles from the file, 
 * in the following order:
 * 1. Open Tipsy binary
 * 2. Read Tipsy header (tells us the number of particles of each type we are 
 *    dealing with)
-* NOTE: steps 3, 5 are currently not parallel
+* NOTE: step 5 is currently not parallel
 * 3. Read mark file indices from marked particle file, if there is one
-* 4. Read either marked particles only or all particles
+* 4. Read either marked particles only or all particles, the latter as a
+*    spatially compact piece if the file has a Peano-Hilbert index
 * 5. If an attribute file is additionally specified, reads this additional
 * 	 attribute into a data array, reading only those marked if necessary.
 */
 //----------------------------------------------------------------------------
-int vtkTipsyReader::RequestData(vtkInformation*,
-	vtkInformationVector**,vtkInformationVector* outputVector)
+int vtkTipsyReader::ReadSnapshot(int ghostLevels, vtkPolyData* output,
+	int& indexed)
 {
-  //
-	// Make sure we have a file to read.
-  //
-  if(!this->FileName)
-	  {
-    vtkErrorMacro("A FileName must be specified.");
-    return 0;
-    }
-
-	// Open the tipsy standard file and abort if there is an error.
+	// Open the tipsy standard file and abort if there is an error. The file
+	// is mapped if possible, otherwise read through a file stream; either
+	// way particles are read through a TipsyBlockSource.
+	zbTipsy tipsyBlocked;
+	mTipsy tipsyMapped;
 	ifTipsy tipsyInfile;
-  tipsyInfile.open(this->FileName,"standard");
-  if (!tipsyInfile.is_open()) 
+	TipsyStreamSource tipsyStream(tipsyInfile);
+	TipsyHeader tipsyHeader;
+	TipsyBlockSource* tipsySource=this->OpenTipsyFile(tipsyBlocked,
+		tipsyMapped,tipsyInfile,tipsyStream,tipsyHeader);
+	if(!tipsySource)
 		{
-	  vtkErrorMacro("Error opening file " << this->FileName);
-	  return 0;	
-    }
-
-  // Get output information
-	vtkInformation* outInfo = outputVector->GetInformationObject(0);
-
-  // get the output polydata
-  vtkPolyData *output = vtkPolyData::SafeDownCast(outInfo->Get(vtkDataObject::DATA_OBJECT()));
-  vtkSmartPointer<vtkPolyData> tipsyReadInitialOutput = vtkSmartPointer<vtkPolyData>::New();
-
-  // get this->UpdatePiece information
-  this->UpdatePiece = outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_PIECE_NUMBER());
-	this->UpdateNumPieces =outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_NUMBER_OF_PIECES());
+		return 0;
+		}
+	const char* fileName=this->CurrentFileName.c_str();
 
   // reset counter before reading
   this->ParticleIndex = 0;
+	this->ReadRuns.clear();
 
-  // Read the header from the input
-	TipsyHeader tipsyHeader=this->ReadTipsyHeader(tipsyInfile);
 	// Next considering whether to read in a mark file, 
 	// and if so whether that reading was a success 
-	vtkstd::vector<unsigned long> markedParticleIndices;
-	if(strcmp(this->MarkFileName,"")!=0)
+	vtkstd::vector<uint64_t> markedParticleIndices;
+	if(this->MarkFileName && strcmp(this->MarkFileName,"")!=0)
+		{
+		// Reading only marked particles, every piece reads the mark file and
+		// then its share of the marked particles
+		vtkTipsyReaderDebugMacro("Reading marked point indices from file:" 
+			<< this->MarkFileName);
+		markedParticleIndices=this->ReadMarkedParticleIndices(tipsyHeader);
+		}
+	// A region of interest is read as the particles of the index nodes
+	// meeting it, which are then treated like marked particles, even if
+	// there are none
+	int selected=0;
+	if(this->RegionType!=REGION_ALL)
+		{
+		selected=this->SelectRegion(fileName,tipsyHeader,
+			!markedParticleIndices.empty(),markedParticleIndices);
+		}
+	this->SubsampleIndices(markedParticleIndices);
+	// When distributing, a Peano-Hilbert index lets each piece be read as a
+	// compact region directly, making D3 unnecessary
+	TipsyKeyIndex keyIndex;
+	if(markedParticleIndices.empty() && !selected && 
+		this->GetDistributeDataOn() &&
+		this->UpdateNumPieces>1 &&
+		keyIndex.open(TipsyKeyIndex::sidecarName(fileName).c_str()))
 		{
-		// Reading only marked particles
-		// Make sure we are not running in parallel, this filter does not work in 
-		// parallel
-		if(this->UpdateNumPieces>1)
+		if(keyIndex.header().nBodies!=tipsyHeader.h_nBodies)
 			{
-			vtkErrorMacro("Reading from a mark file is not supported in parallel.");
-			return 0;
+			vtkTipsyReaderWarningMacro("Ignoring the index of " << fileName
+				<< " as it has a different number of particles.");
+			keyIndex.close();
 			}
-		vtkDebugMacro("Reading marked point indices from file:" 
-			<< this->MarkFileName);
-		markedParticleIndices=this->ReadMarkedParticleIndices(tipsyHeader,
-			tipsyInfile);
 		}
+	indexed=keyIndex.is_open();
   // Read every particle and add their position to be displayed, 
 	// as well as relevant scalars
-	if(markedParticleIndices.empty())
+	if(indexed)
+		{
+		vtkTipsyReaderDebugMacro("Reading a spatial piece of " << fileName);
+		if(!this->ReadSpatialPiece(keyIndex,tipsyHeader,*tipsySource,
+			this->UpdatePiece,this->UpdateNumPieces,ghostLevels,output))
+			{
+			return 0;
+			}
+		}
+	else if(markedParticleIndices.empty() && !selected)
 		{
 		// no marked particle file or there was an error reading the mark file, 
 		// so reading all particles
-		vtkDebugMacro("Reading all points from file " << this->FileName);
-		this->ReadAllParticles(tipsyHeader,tipsyInfile, this->UpdatePiece, this->UpdateNumPieces, tipsyReadInitialOutput);
+		vtkTipsyReaderDebugMacro("Reading all points from file " << fileName);
+		if(!this->ReadAllParticles(tipsyHeader,*tipsySource, this->UpdatePiece,
+			this->UpdateNumPieces, output))
+			{
+			return 0;
+			}
 		}
 	else 
 		{
-		//reading only marked particles
-		assert(this->UpdateNumPieces==1);
-		vtkDebugMacro("Reading only the marked points in file: " \
-				<< this->MarkFileName << " from file " << this->FileName);
-		this->ReadMarkedParticles(markedParticleIndices, tipsyHeader,tipsyInfile, tipsyReadInitialOutput);	
+		//reading only marked particles, or those near the region
+		vtkTipsyReaderDebugMacro("Reading " << markedParticleIndices.size() 
+			<< " selected points from file " << fileName);
+		if(!this->ReadMarkedParticles(markedParticleIndices, tipsyHeader,
+			*tipsySource, this->UpdatePiece, this->UpdateNumPieces,
+			output))
+			{
+			return 0;
+			}
 		}
   // Close the tipsy in file.
+	tipsyBlocked.close();
+	tipsyMapped.close();
 	tipsyInfile.close();
+	this->ScaleSubsampleMass();
+	return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkTipsyReader::ReadOutput(int ghostLevels, vtkPolyData* output)
+{
+	// If only the point array selection changed since the last read, the
+	// positions and the arrays already read are reused and only the newly
+	// selected arrays are read from the file
+	const vtkstd::string cacheKey=this->GetCacheKey(
+		this->CurrentFileName.c_str(),ghostLevels);
+	std::ostringstream columnCacheKey;
+	columnCacheKey << cacheKey << ' ' << this->SubsampleFraction;
+	if(this->ColumnCache && this->ColumnCacheKey==columnCacheKey.str())
+		{
+		if(!this->ReadMissingColumns())
+			{
+			return 0;
+			}
+		this->CopySelectedColumns(output);
+		return 1;
+		}
+
+	// If only the subsample fraction was lowered since the last read, the
+	// new subsample is contained in the old one and need not be read again
+	std::ostringstream subsampleCacheKey;
+	subsampleCacheKey << cacheKey << ' ' 
+		<< this->PointDataArraySelection->GetMTime();
+	if(this->SubsampleFraction<1.0 && this->Cache.Extract(
+		subsampleCacheKey.str(),this->SubsampleFraction,this->SubsampleMode,
+		output))
+		{
+		vtkDebugMacro("Subsampled " << output->GetNumberOfPoints() 
+			<< " points from the previous read.");
+		// the rows read for the columns are no longer the ones shown
+		this->ColumnCache = NULL;
+		return 1;
+		}
+	this->ColumnCache = NULL;
+
+	// The snapshot may have been read in the background already
+	const vtkstd::string snapshotKey=this->GetSnapshotKey(
+		this->CurrentFileName.c_str(),ghostLevels);
+	this->CollectPrefetched(this->PrefetchKey==snapshotKey);
+	vtkSmartPointer<vtkPolyData> tipsyReadInitialOutput;
+	int indexed=0;
+	for(vtkstd::list<PrefetchedSnapshot>::iterator it=this->Prefetched.begin();
+		it != this->Prefetched.end(); ++it)
+		{
+		if(it->Key==snapshotKey)
+			{
+			vtkDebugMacro("Using " << this->CurrentFileName 
+				<< " as read in the background.");
+			tipsyReadInitialOutput=it->Data;
+			this->GlobalIds=it->GlobalIds;
+			this->ReadRuns.swap(it->ReadRuns);
+			indexed=it->Indexed;
+			this->Prefetched.erase(it);
+			break;
+			}
+		}
+	if(!tipsyReadInitialOutput)
+		{
+		tipsyReadInitialOutput = vtkSmartPointer<vtkPolyData>::New();
+		if(!this->ReadSnapshot(ghostLevels,tipsyReadInitialOutput,indexed))
+			{
+			return 0;
+			}
+		}
+
 	// If we need to, run D3 on the tipsyReadInitialOutput
-	// producing one level of ghost cells
-	if (this->GetDistributeDataOn() && this->UpdateNumPieces>1)
+	// producing one level of ghost cells. Not needed if the pieces were read
+	// from the index, as they are already spatially compact.
+	if (this->GetDistributeDataOn() && this->UpdateNumPieces>1 && !indexed)
 		{
 		vtkSmartPointer<vtkDistributedDataFilter> d3 = \
 		    vtkSmartPointer<vtkDistributedDataFilter>::New();
@@ -501,30 +1292,84 @@ int vtkTipsyReader::RequestData(vtkInformation*,
       cells[i*2+1] = i;
     }
     output->SetVerts(this->Vertices);
+		// D3 reorders the points, so neither their global indices nor the
+		// runs they were read in describe the output
+		this->Cache.Clear();
+		this->ReadRuns.clear();
 		}
 	else
 		{
-		output->ShallowCopy(tipsyReadInitialOutput);
+		this->ColumnCache = tipsyReadInitialOutput;
+		this->ColumnCacheKey = columnCacheKey.str();
+		this->CopySelectedColumns(output);
+		this->Cache.Store(subsampleCacheKey.str(),this->SubsampleFraction,output,
+			this->GlobalIds);
 		}
 	// Read Successfully
 	vtkDebugMacro("Read " << output->GetPoints()->GetNumberOfPoints() \
 		<< " points.");
+	return 1;
+}
+
+//----------------------------------------------------------------------------
+int vtkTipsyReader::RequestData(vtkInformation*,
+	vtkInformationVector**,vtkInformationVector* outputVector)
+{
   //
-  // release memory smartpointers - just to play safe.
-  this->Vertices    = NULL;
-  this->GlobalIds   = NULL;
-  this->Positions   = NULL;
-  this->Potential   = NULL;
-  this->Mass        = NULL;
-  this->EPS         = NULL;
-  this->RHO         = NULL;
-  this->Hsmooth     = NULL;
-  this->Temperature = NULL;
-  this->Metals      = NULL;
-  this->Tform       = NULL;
-	this->Type       = NULL;
-  this->Velocity    = NULL;
+	// Make sure we have a file to read.
   //
+  if(!this->FileName && this->SeriesFileNames.empty())
+	  {
+    vtkErrorMacro("A FileName must be specified.");
+    return 0;
+    }
+
+  // Get output information
+	vtkInformation* outInfo = outputVector->GetInformationObject(0);
+
+  // get the output polydata
+  vtkPolyData *output = vtkPolyData::SafeDownCast(outInfo->Get(vtkDataObject::DATA_OBJECT()));
+
+  // get this->UpdatePiece information
+  this->UpdatePiece = outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_PIECE_NUMBER());
+	this->UpdateNumPieces =outInfo->Get(vtkStreamingDemandDrivenPipeline::UPDATE_NUMBER_OF_PIECES());
+
+	int ghostLevels = outInfo->Get(
+		vtkStreamingDemandDrivenPipeline::UPDATE_NUMBER_OF_GHOST_LEVELS());
+
+	// A series is read at the time step requested
+	int step = 0;
+	if(this->SeriesFileNames.empty())
+		{
+		this->CurrentFileName = this->FileName;
+		}
+	else
+		{
+		if(outInfo->Has(vtkStreamingDemandDrivenPipeline::UPDATE_TIME_STEPS()))
+			{
+			const double* requested = outInfo->Get(
+				vtkStreamingDemandDrivenPipeline::UPDATE_TIME_STEPS());
+			step = FindTimeStep(this->TimeSteps,requested[0]);
+			}
+		this->CurrentFileName = this->SeriesFileNames[step];
+		}
+
+	const int success = this->ReadOutput(ghostLevels,output);
+	this->ReleaseArrays();
+	if(!success)
+		{
+		return 0;
+		}
+
+	if(!this->SeriesFileNames.empty())
+		{
+		output->GetInformation()->Set(vtkDataObject::DATA_TIME_STEPS(),
+			&this->TimeSteps[step],1);
+		// while this snapshot is looked at, read the one likely to be next
+		this->PrefetchTimeStep(NextTimeStep(this->TimeSteps.size(),step,
+			this->PreviousTimeStep),ghostLevels);
+		this->PreviousTimeStep = step;
+		}
  	return 1;
 }
 //----------------------------------------------------------------------------
@@ -12,9 +12,22 @@
 =========================================================================*/
 // .NAME vtkTipsyReader - Read points from a Tipsy standard binary file
 // .SECTION Description
-// Read points from a Tipsy standard binary file. Fully parallel. Has ability
-// to read in additional attributes from an ascii file, and to only load in
-// marked particles but both these functions are serial only.
+// Read points from a Tipsy standard binary file, or one compressed into
+// independent blocks by tzblock (see tipsylib/zblock.hpp), which are
+// inflated on all cores. Fully parallel. Has ability to read in additional
+// attributes from an ascii file, and to only load in marked particles,
+// which are shared evenly between the pieces. The mark file is either ASCII
+// or a bitmap (see tipsylib/tipsymark.h).
+// If a Peano-Hilbert index written by tindex (the file name with ".phidx"
+// appended) is present, each piece is read as a spatially compact region
+// directly, instead of being redistributed with D3 after reading.
+// Given a box or a sphere, only the particles near it are read, through
+// the same index.
+// Unless D3 is used, the columns read are kept between updates, so
+// enabling another point array reads only that field of the particles.
+// Given a series of files (AddFileName) the reader reports their times as
+// time steps, and reads the snapshot after the one shown (or before it,
+// when stepping back) on a background thread.
 #ifndef __vtkTipsyReader_h
 #define __vtkTipsyReader_h
 
@@ -22,7 +35,15 @@
 
 #include "vtkSmartPointer.h"
 #include "tipsylib/ftipsy.hpp" // functions take Tipsy particle objects
+#include "tipsylib/mtipsy.hpp" // memory mapped reading
+#include "tipsylib/zblock.hpp" // block compressed files
+#include "tipsylib/tipsyidx.hpp" // Peano-Hilbert sidecar index
+#include "tipsylib/tipsymark.h" // bitmap mark files
+#include "AstroVizSubsample.h" // level of detail subsampling
+#include "AstroVizPrefetch.h" // background reading of the next snapshot
 #include <vtkstd/vector>
+#include <vtkstd/string>
+#include <vtkstd/list>
 
 class vtkPolyData;
 class vtkCharArray;
@@ -47,11 +68,67 @@ public:
 	vtkSetStringMacro(FileName);
  	vtkGetStringMacro(FileName);
 
+  // Description:
+  // Add/remove the files of a series of snapshots. If any are given they
+  // are read instead of FileName, the one shown chosen by time.
+	void AddFileName(const char* fileName);
+	void RemoveAllFileNames();
+	int GetNumberOfFileNames();
+
+  // Description:
+  // Get/Set how many snapshots read in the background are kept for when
+  // they are shown. 0 turns off reading in the background.
+	vtkSetClampMacro(PrefetchCacheSize,int,0,16);
+	vtkGetMacro(PrefetchCacheSize,int);
+
   // Description:
   // Get/Set whether to distribute data
 	vtkSetMacro(DistributeDataOn,int);
 	vtkGetMacro(DistributeDataOn,int);
 
+  // Description:
+  // Get/Set whether to read the file through a memory mapping instead of
+  // a file stream. Falls back to the stream if the file cannot be mapped.
+	vtkSetMacro(UseMemoryMap,int);
+	vtkGetMacro(UseMemoryMap,int);
+	vtkBooleanMacro(UseMemoryMap,int);
+
+  // Description:
+  // Get/Set the fraction of the particles to load, for a quick preview of
+  // a large file. Which particles are loaded depends only on their index,
+  // and their mass is divided by the fraction so totals are preserved.
+  // Lowering the fraction is served from the previous read.
+	vtkSetClampMacro(SubsampleFraction,double,1e-6,1.0);
+	vtkGetMacro(SubsampleFraction,double);
+
+  // Description:
+  // Get/Set how the subsample is chosen, by stride (evenly spaced in the
+  // file) or at random. See AstroVizSubsample.h.
+	vtkSetClampMacro(SubsampleMode,int,SUBSAMPLE_STRIDE,SUBSAMPLE_RANDOM);
+	vtkGetMacro(SubsampleMode,int);
+	void SetSubsampleModeToStride() 
+		{ this->SetSubsampleMode(SUBSAMPLE_STRIDE); }
+	void SetSubsampleModeToRandom() 
+		{ this->SetSubsampleMode(SUBSAMPLE_RANDOM); }
+
+  // Description:
+  // Get/Set the region of interest: all particles, or only those in the
+  // octree nodes of the Peano-Hilbert index (see tindex) that meet a box
+  // or a sphere, so that only a little more than the region is read.
+  // Without an index the whole file is read.
+	enum { REGION_ALL=0, REGION_BOX=1, REGION_SPHERE=2 };
+	vtkSetClampMacro(RegionType,int,REGION_ALL,REGION_SPHERE);
+	vtkGetMacro(RegionType,int);
+	void SetRegionTypeToAll() { this->SetRegionType(REGION_ALL); }
+	void SetRegionTypeToBox() { this->SetRegionType(REGION_BOX); }
+	void SetRegionTypeToSphere() { this->SetRegionType(REGION_SPHERE); }
+	vtkSetVector6Macro(RegionBounds,double);
+	vtkGetVector6Macro(RegionBounds,double);
+	vtkSetVector3Macro(RegionCenter,double);
+	vtkGetVector3Macro(RegionCenter,double);
+	vtkSetMacro(RegionRadius,double);
+	vtkGetMacro(RegionRadius,double);
+
   // Description:
   // An H5Part file may contain multiple arrays
   // a GUI (eg Paraview) can provide a mechanism for selecting which data arrays
@@ -85,6 +162,67 @@ protected:
 	char* MarkFileName;
 	char* FileName;
 	int DistributeDataOn;
+	int UseMemoryMap;
+	double SubsampleFraction;
+	int SubsampleMode;
+	int PrefetchCacheSize;
+	int RegionType;
+	double RegionBounds[6];
+	double RegionCenter[3];
+	double RegionRadius;
+	// Description:
+	// the files of the series as given, then sorted by time with the times
+	// in TimeSteps
+	vtkstd::vector<vtkstd::string> FileNames;
+	vtkstd::vector<vtkstd::string> SeriesFileNames;
+	vtkstd::vector<double> TimeSteps;
+	int PreviousTimeStep;
+	// Description:
+	// the file being read, FileName or one of the series
+	vtkstd::string CurrentFileName;
+	// Description:
+	// the last subsampled output, for when the fraction is lowered
+	SubsampleCache Cache;
+	// Description:
+	// every column read so far for the current file and piece, including
+	// those of arrays since disabled, and the key it was read for
+	vtkSmartPointer<vtkPolyData> ColumnCache;
+	vtkstd::string ColumnCacheKey;
+	// Description:
+	// the index ranges passed to ReadParticleRange, in order, so that the
+	// same rows can be read again for a newly enabled array
+	vtkstd::vector<vtkstd::pair<uint64_t,uint64_t> > ReadRuns;
+	// Description:
+	// a snapshot read in the background, and what is needed to use it as if
+	// it had just been read
+	struct PrefetchedSnapshot
+	{
+		vtkstd::string Key;
+		vtkSmartPointer<vtkPolyData> Data;
+		vtkSmartPointer<vtkIdTypeArray> GlobalIds;
+		vtkstd::vector<vtkstd::pair<uint64_t,uint64_t> > ReadRuns;
+		int Indexed;
+	};
+	vtkstd::list<PrefetchedSnapshot> Prefetched;
+	// Description:
+	// the thread reading in the background, the reader it runs (a copy of
+	// this one's settings), and the key of the snapshot it is reading
+	BackgroundTask Prefetcher;
+	vtkTipsyReader* PrefetchReader;
+	vtkstd::string PrefetchKey;
+	// Description:
+	// the arguments and result of ReadSnapshot when run by the
+	// background thread, set on PrefetchReader
+	int PrefetchGhostLevels;
+	vtkSmartPointer<vtkPolyData> PrefetchOutput;
+	int PrefetchIndexed;
+	int PrefetchSucceeded;
+	// Description:
+	// set on PrefetchReader, whose errors, warnings and debug messages are
+	// kept here with their level rather than shown, vtkOutputWindow not
+	// being thread safe; CollectPrefetched reports them on the main thread
+	int InBackground;
+	vtkstd::vector<vtkstd::pair<int,vtkstd::string> > BackgroundMessages;
 	int RequestInformation(vtkInformation*,	vtkInformationVector**,
 		vtkInformationVector*);
 
@@ -106,6 +244,9 @@ protected:
   vtkSmartPointer<vtkFloatArray>   Tform;
 	vtkSmartPointer<vtkFloatArray>		 Type;
   vtkSmartPointer<vtkFloatArray>   Velocity;
+  // Description:
+  // raw buffers of the arrays above which block reads decode into
+  TipsyColumns                     Columns;
 
   //
   int           UpdatePiece;
@@ -119,51 +260,128 @@ private:
   void operator=(const vtkTipsyReader&);  // Not implemented.
 	/* Help functions for reading */
 	// Description:
+	// Fills output for CurrentFileName, from a cache if possible.
+	int ReadOutput(int ghostLevels, vtkPolyData* output);
+	// Description:
+	// Reads this piece of CurrentFileName into output, without
+	// redistributing it. indexed is set to 1 if it was read as a spatially
+	// compact piece, through the Peano-Hilbert index.
+	int ReadSnapshot(int ghostLevels, vtkPolyData* output, int& indexed);
+	// Description:
+	// Starts reading the snapshot of the series with the given step in the
+	// background, unless it is there already or the thread is busy.
+	void PrefetchTimeStep(int step, int ghostLevels);
+	// Description:
+	// Keeps the snapshot read by the background thread, if it has finished.
+	// If wait is 1 waits for it to finish first.
+	void CollectPrefetched(int wait);
+	// Description:
+	// Body of the background thread: PrefetchReader reads its snapshot.
+	static void PrefetchSnapshot(void* reader);
+	// Description:
+	// Reads the times of the files of the series and sorts them by time.
+	int ReadTimeSteps();
+	// Description:
+	// Describes the output for the given file, including the subsample
+	// fraction and the selected arrays.
+	vtkstd::string GetSnapshotKey(const char* fileName, int ghostLevels);
+	// Description:
+	// Drops the references to the arrays of the last read.
+	void ReleaseArrays();
+	// Description:
 	// Reads the Tipsy header. 
 	TipsyHeader ReadTipsyHeader(ifTipsy& tipsyInfile);
 	// Description:
+	// Opens the Tipsy file, block compressed or mapped if possible, and reads
+	// its header. Returns the source to read particles from, which refers to
+	// one of the first four arguments, or NULL if the file could not be
+	// opened.
+	TipsyBlockSource* OpenTipsyFile(zbTipsy& tipsyBlocked, mTipsy& tipsyMapped,
+		ifTipsy& tipsyInfile, TipsyStreamSource& tipsyStream,
+		TipsyHeader& tipsyHeader);
+	// Description:
 	// Reads all particles of this piece from the Tipsy file
-	void ReadAllParticles(TipsyHeader& tipsyHeader,
-		ifTipsy& tipsyInfile,int piece,int numPieces,vtkPolyData* output);
+	int ReadAllParticles(TipsyHeader& tipsyHeader,
+		TipsyBlockSource& tipsySource,int piece,int numPieces,
+		vtkPolyData* output);
 	// Description:
-	// reads in a particle (either gas, dark or star as appropriate) 
-	//from the tipsy in file of this class
-	vtkIdType ReadParticle(unsigned long index, TipsyHeader& tipsyHeader,
-		ifTipsy& tipsyInfile, vtkPolyData* output);
+	// Reads this piece's share of the Marked particles from the tipsy file.
+	// The sorted indices are split evenly by count between the pieces and
+	// runs of adjacent indices are read at once.
+	// Must be called after function ReadMarkedParticleIndices.
+	int ReadMarkedParticles(
+		vtkstd::vector<uint64_t>& markedParticleIndices,
+		TipsyHeader& tipsyHeader,TipsyBlockSource& tipsySource,
+		int piece,int numPieces,vtkPolyData* output);
 	// Description:
-	// reads variables common to all particles
-	vtkIdType ReadBaseParticle(vtkPolyData* output, TipsyBaseParticle& b);
+	// Reads the particles with indices in [beginIndex,endIndex) into the 
+	// arrays allocated by AllocateAllTipsyVariableArrays, starting at row
+	// ParticleIndex. The range is split into its gas, dark and star parts
+	// and each part is decoded with one block read straight into the array
+	// buffers, then recorded in ReadRuns. Returns 0 if the file ended early.
+	int ReadParticleRange(uint64_t beginIndex, uint64_t endIndex,
+		TipsyHeader& tipsyHeader, TipsyBlockSource& tipsySource);
 	// Description:
-	// reads variables common to all gas particles
-	vtkIdType ReadGasParticle(vtkPolyData* output, TipsyGasParticle& g);
+	// Replaces the indices with those of the particles near the region of
+	// interest, keeping only the marked ones if marked is set. Returns 0
+	// if the file has no usable index, leaving the indices as they were.
+	int SelectRegion(const char* fileName, TipsyHeader& tipsyHeader,
+		int marked, vtkstd::vector<uint64_t>& indices);
 	// Description:
-	// reads variables common to all star particles
-	vtkIdType ReadStarParticle(vtkPolyData* output, TipsyStarParticle& s);
+	// Reads the particles with the given indices, which must be sorted in
+	// increasing order. Consecutive indices are coalesced into runs so that
+	// each run is a single ReadParticleRange.
+	int ReadParticleIndices(const vtkstd::vector<uint64_t>& indices,
+		TipsyHeader& tipsyHeader, TipsyBlockSource& tipsySource);
 	// Description:
-	// reads variables common to all dark particles
-	vtkIdType ReadDarkParticle(vtkPolyData* output, TipsyDarkParticle& d);
+	// Removes the indices which are not in the subsample, keeping the order.
+	void SubsampleIndices(vtkstd::vector<uint64_t>& indices);
 	// Description:
-	// Reads only Marked particles from the tipsy file.
-	// Must be called after function ReadMarkedParticleIndices.
-	void ReadMarkedParticles(
-		vtkstd::vector<unsigned long>& markedParticleIndices,
-		TipsyHeader& tipsyHeader,ifTipsy& tipsyInfile,vtkPolyData* output);
+	// Divides the mass of the particles just read by the subsample fraction.
+	void ScaleSubsampleMass();
+	// Description:
+	// Describes which particles are read, in which order, from which
+	// version of the files, except for the subsample fraction. Tells if a
+	// cached read can be reused.
+	vtkstd::string GetCacheKey(const char* fileName, int ghostLevels);
 	// Description:
-	// Helper function to read seek to a given index before reading
-	tipsypos::section_type SeekToIndex(unsigned long index,
-		TipsyHeader& tipsyHeader, ifTipsy& tipsyInfile);
+	// Reads the selected arrays which are not yet in ColumnCache by
+	// replaying ReadRuns, without reading the positions again.
+	int ReadMissingColumns();
+	// Description:
+	// Gives output the points of ColumnCache and those of its arrays which
+	// are selected, sharing rather than copying them.
+	void CopySelectedColumns(vtkPolyData* output);
+	// Description:
+	// Reads this piece's share of the particles in Peano-Hilbert key order,
+	// which is a spatially compact region. If ghostLevels is positive the
+	// particles of the neighbouring index cells are added after them and
+	// flagged in a vtkGhostLevels array.
+	int ReadSpatialPiece(TipsyKeyIndex& keyIndex, TipsyHeader& tipsyHeader,
+		TipsyBlockSource& tipsySource, int piece, int numPieces,
+		int ghostLevels, vtkPolyData* output);
+	// Description:
+	// Collects, in increasing order, the indices of the particles which are
+	// in the index cells neighbouring the key order slice [begin,end) but
+	// are not in the slice.
+	int ReadGhostIndices(TipsyKeyIndex& keyIndex, uint64_t begin,
+		uint64_t end, vtkstd::vector<uint64_t>& ghosts);
 	// Description:
 	// reads in an array of the indices of marked particles from a file, 
-	// returns a queue of marked particles
-	// which is empty if reading was unsucessful.
-	vtkstd::vector<unsigned long> ReadMarkedParticleIndices(
-		TipsyHeader& tipsyHeader,	ifTipsy& tipsyInfile);
+	// either ASCII or bitmap, returns the marked particles sorted and
+	// without duplicates, which is empty if reading was unsucessful.
+	vtkstd::vector<uint64_t> ReadMarkedParticleIndices(
+		TipsyHeader& tipsyHeader);
 	/* Helper functions for storing data in output vector*/
 	// Description:
 	// allocates all vtk arrays for Tipsy variables and places them 
-	// in the output vector
+	// in the output vector. Also points Columns at their buffers.
 	void AllocateAllTipsyVariableArrays(vtkIdType numBodies,
 		vtkPolyData* output);
+	// Description:
+	// allocates the selected point arrays which output does not have yet,
+	// and points Columns at them. The others are left NULL.
+	void AllocateSelectedArrays(vtkIdType numBodies, vtkPolyData* output);
 //ETX
 
 };
@@ -17,10 +17,15 @@
 #include "vtkMath.h"
 #include "vtkInformationDataObjectKey.h"
 #include "vtkPointSet.h" 
-#include "vtkPointLocator.h"
 #include "vtkMultiProcessController.h"
 #include "vtkUnstructuredGrid.h"
 #include "vtkPolyData.h"
+#include "vtkSmartPointer.h"
+#include "vtkPoints.h"
+#include "vtkCellArray.h"
+#include "vtkFieldData.h"
+#include "vtkPointData.h"
+#include "vtkIdTypeArray.h"
 #include <cmath>
 using vtkstd::string;
 
@@ -42,7 +47,8 @@ vtkVirialRadiusFilter::vtkVirialRadiusFilter()
 	// Defaults for quantities which will be computed based on user's
 	// later input
 	this->MaxR=1.0;
-	this->Delta=0.0;
+	this->Deltas.assign(1,0.0);
+	this->ExtractPoints=1;
 	this->Controller = NULL;
 	this->SetController(vtkMultiProcessController::GetGlobalController());
 }
@@ -56,8 +62,54 @@ vtkVirialRadiusFilter::~vtkVirialRadiusFilter()
 //----------------------------------------------------------------------------
 void vtkVirialRadiusFilter::PrintSelf(ostream& os, vtkIndent indent)
 {
-  os << indent << "overdensity: " << this->Delta << "\n"
-		<< "softening :" << this->Softening << "\n";
+  os << indent << "overdensities:";
+	for(size_t i = 0; i < this->Deltas.size(); ++i)
+		{
+		os << " " << this->Deltas[i];
+		}
+	os << "\n" << indent << "softening :" << this->Softening << "\n"
+		<< indent << "extract points: " << this->ExtractPoints << "\n";
+}
+
+//----------------------------------------------------------------------------
+void vtkVirialRadiusFilter::AddDelta(double delta)
+{
+	this->Deltas.push_back(delta);
+	this->Modified();
+}
+
+//----------------------------------------------------------------------------
+void vtkVirialRadiusFilter::RemoveAllDeltas()
+{
+	this->Deltas.clear();
+	this->Modified();
+}
+
+//----------------------------------------------------------------------------
+int vtkVirialRadiusFilter::GetNumberOfDeltas()
+{
+	return this->Deltas.size();
+}
+
+//----------------------------------------------------------------------------
+void vtkVirialRadiusFilter::SetDelta(double delta)
+{
+	// 0, the default of the Delta property, sets nothing
+	if(delta <= 0)
+		{
+		return;
+		}
+	if(this->Deltas.size()!=1 || this->Deltas[0]!=delta)
+		{
+		this->Deltas.assign(1,delta);
+		this->Modified();
+		}
+}
+
+//----------------------------------------------------------------------------
+double vtkVirialRadiusFilter::GetDelta()
+{
+	return this->Deltas.empty() ? 0.0 : this->Deltas[0];
 }
 
 //----------------------------------------------------------------------------
@@ -105,35 +157,77 @@ int vtkVirialRadiusFilter::RequestData(vtkInformation *request,
     }
 	this->CalculateAndSetBounds(output,pointInfo);
 	
-	// Building the point locator and the struct to use as an 
-	// input to the rootfinder.
-	// 1. Building the point locator
-	vtkPointLocator* locator = vtkPointLocator::New();
-		locator->SetDataSet(output);
-		locator->BuildLocator();
-	// Will communicate with other processes if necessary
-	VirialRadiusInfo virialRadiusInfo = \
-	 	ComputeVirialRadius(this->GetController(),
-		locator,massArray->GetName(),this->Softening,
-		this->Delta,this->MaxR,this->Center);	
-	// note that if there was an error finding the virialRadius the 
-	// radius returned is < 0
-	if(virialRadiusInfo.virialRadius>0)
+	if(this->Deltas.empty())
+		{
+		vtkErrorMacro("No overdensity given to find the radius of");
+		return 0;
+		}
+	// Will communicate with other processes if necessary. The radii of
+	// every overdensity are found from the same sort of the points.
+	vtkstd::vector<double> radii;
+	vtkstd::vector<double> masses;
+	vtkstd::vector<vtkIdType> numbers;
+	vtkstd::vector<vtkstd::vector<vtkIdType> > pointsInRadii;
+	if(!ComputeOverdensityRadii(this->GetController(),input,
+		massArray->GetName(),this->Softening,this->MaxR,this->Center,
+		this->Deltas,radii,masses,numbers,
+		this->ExtractPoints ? &pointsInRadii : NULL))
 		{
-		// This is causing problems, segfault
-		//setting the dataSet to this newInput
-		vtkPolyData* newDataSet = \
-			GetDatasetWithinVirialRadius(virialRadiusInfo);	
-		// resetting output, then copying into it the new data set
-		output->Initialize();
-		output->DeepCopy(newDataSet);
-		output->SetCells(VTK_VERTEX,newDataSet->GetVerts());
-		newDataSet->Delete();
+		vtkErrorMacro("Failed to locate mass array on every process");
+		return 0;
 		}
-	else	
+	// note that if there was an error finding a radius the radius
+	// returned is < 0
+	for(size_t i = 0; i < radii.size(); ++i)
 		{
-		vtkErrorMacro("Unable to find virial radius: considering changing your delta or selecting a different point around which to search. For now simply copying input");
+		if(radii[i]<=0)
+			{
+			vtkErrorMacro("Unable to find the radius of overdensity " 
+				<< this->Deltas[i] << ": considering changing your delta or selecting a different point around which to search."
+				<< ((i==0 && this->ExtractPoints) ? " For now simply copying input" : ""));
+			}
 		}
+	if(this->ExtractPoints && radii[0]>0)
+		{
+		// copying the points within straight from their ids, with no
+		// intermediate data set
+		this->CopyPointsWithinRadius(input,pointsInRadii[0],output);
+		}
+	// the radius, mass and number of points of each overdensity, a row of
+	// the field data each
+	const vtkIdType numDeltas=this->Deltas.size();
+	vtkSmartPointer<vtkDoubleArray> deltaColumn = \
+		vtkSmartPointer<vtkDoubleArray>::New();
+	deltaColumn->SetName("overdensity");
+	deltaColumn->SetNumberOfTuples(numDeltas);
+	vtkSmartPointer<vtkDoubleArray> radiusColumn = \
+		vtkSmartPointer<vtkDoubleArray>::New();
+	radiusColumn->SetName("overdensity radius");
+	radiusColumn->SetNumberOfTuples(numDeltas);
+	vtkSmartPointer<vtkDoubleArray> massColumn = \
+		vtkSmartPointer<vtkDoubleArray>::New();
+	massColumn->SetName("overdensity mass");
+	massColumn->SetNumberOfTuples(numDeltas);
+	vtkSmartPointer<vtkIdTypeArray> numberColumn = \
+		vtkSmartPointer<vtkIdTypeArray>::New();
+	numberColumn->SetName("overdensity number of points");
+	numberColumn->SetNumberOfTuples(numDeltas);
+	for(vtkIdType i = 0; i < numDeltas; ++i)
+		{
+		deltaColumn->SetValue(i,this->Deltas[i]);
+		radiusColumn->SetValue(i,radii[i]);
+		massColumn->SetValue(i,masses[i]);
+		numberColumn->SetValue(i,numbers[i]);
+		}
+	// a field data of the output's own, as a shallow copy shares the input's
+	vtkSmartPointer<vtkFieldData> fieldData = \
+		vtkSmartPointer<vtkFieldData>::New();
+	fieldData->PassData(input->GetFieldData());
+	fieldData->AddArray(deltaColumn);
+	fieldData->AddArray(radiusColumn);
+	fieldData->AddArray(massColumn);
+	fieldData->AddArray(numberColumn);
+	output->SetFieldData(fieldData);
 	return 1;	
 }
 
@@ -177,3 +271,27 @@ void vtkVirialRadiusFilter::CalculateAndSetBounds(vtkPointSet* input,
 		}
 }
 
+//----------------------------------------------------------------------------
+void vtkVirialRadiusFilter::CopyPointsWithinRadius(vtkPointSet* input,
+	const vtkstd::vector<vtkIdType>& pointsInRadius,
+	vtkUnstructuredGrid* output)
+{
+	const vtkIdType numPoints=pointsInRadius.size();
+	vtkSmartPointer<vtkPoints> points=vtkSmartPointer<vtkPoints>::New();
+	points->SetNumberOfPoints(numPoints);
+	vtkSmartPointer<vtkCellArray> vertices = \
+		vtkSmartPointer<vtkCellArray>::New();
+	vtkIdType *cells=vertices->WritePointer(numPoints,numPoints*2);
+	output->Initialize();
+	output->GetPointData()->CopyAllocate(input->GetPointData(),numPoints);
+	for(vtkIdType i = 0; i < numPoints; ++i)
+		{
+		const vtkIdType from=pointsInRadius[i];
+		points->SetPoint(i,input->GetPoint(from));
+		output->GetPointData()->CopyData(input->GetPointData(),from,i);
+		cells[i*2]   = 1;
+		cells[i*2+1] = i;
+		}
+	output->SetPoints(points);
+	output->SetCells(VTK_VERTEX,vertices);
+}
@@ -13,15 +13,24 @@
 // .NAME vtkVirialRadiusFilter
 // Given an overdensity and a center, calculates and cuts off 
 // the data set at the point where the density equals this overdensity.
+//
+// Given many overdensities (AddDelta), the radius of each is found from
+// the same sort of the points by radius, and the output's field data gets
+// a row per overdensity: "overdensity", "overdensity radius",
+// "overdensity mass" and "overdensity number of points". The data set is
+// cut off at the radius of the first, unless ExtractPoints is off, when
+// it is passed through whole.
 
 #ifndef __vtkVirialRadiusFilter_h
 #define __vtkVirialRadiusFilter_h
 #include "vtkUnstructuredGridAlgorithm.h"
 #include "vtkStringArray.h" // some class variables are vtkStringArrays
+#include <vtkstd/vector>
 
 class vtkPointSet;
 class vtkDataSet;
 class vtkMultiProcessController;
+class vtkUnstructuredGrid;
 //----------------------------------------------------------------------------
 enum BinUpdateType
 {
@@ -50,9 +59,20 @@ public:
   vtkSetMacro(Softening, double);
   vtkGetMacro(Softening, double);
   // Description:
-  // Get/Set the density parameter
-  vtkSetMacro(Delta, double);
-  vtkGetMacro(Delta, double);
+  // Add/remove the overdensities to find the radius of. SetDelta replaces
+  // them with the one given, unless it is not positive, and GetDelta
+  // returns the first.
+  void AddDelta(double delta);
+  void RemoveAllDeltas();
+  int GetNumberOfDeltas();
+  void SetDelta(double delta);
+  double GetDelta();
+  // Description:
+  // Get/Set whether the output is cut off at the radius of the first
+  // overdensity, on by default
+  vtkSetMacro(ExtractPoints, int);
+  vtkGetMacro(ExtractPoints, int);
+  vtkBooleanMacro(ExtractPoints, int);
   // Description:
   // Get/Set the center
   vtkSetVector3Macro(Center,double);
@@ -94,8 +114,9 @@ protected:
 	double Softening;
   // Description:
 	// Set in GUI, with defaults
-	// Overdensity
-	double Delta; 
+	// Overdensities
+	vtkstd::vector<double> Deltas;
+	int ExtractPoints;
   // Description:
 	// Center around which to compute radial bins
 	double Center[3];
@@ -111,6 +132,12 @@ protected:
 	// based upon the user's input and the boundaries of the dataset.
 	// Works in parallel if necessary
 	void CalculateAndSetBounds(vtkPointSet* input, vtkDataSet* source);
+	// Description:
+	// makes output the points of input pointsInRadius, with their data, a
+	// vertex each
+	void CopyPointsWithinRadius(vtkPointSet* input,
+		const vtkstd::vector<vtkIdType>& pointsInRadius,
+		vtkUnstructuredGrid* output);
 private:
   vtkVirialRadiusFilter(const vtkVirialRadiusFilter&); // Not implemented
   void operator=(const vtkVirialRadiusFilter&); // Not implemented